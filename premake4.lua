@@ -9,13 +9,13 @@ solution "04_camera"
 		kind "ConsoleApp"
 		language "C++"
 		files { "source/**.cpp" }
-		buildoptions { "-Wno-unknown-pragmas" }
+		buildoptions { "-Wno-unknown-pragmas", "-std=c++11", "-pthread" }
 
 		configuration "windows"
 			links {"glu32", "opengl32", "gdi32", "winmm", "user32","GLEW"}
 
 		configuration "linux"
-			links {"GL","glfw","GLEW"}
+			links {"GL","glfw","GLEW","pthread"}
 			libdirs { "libs", "../mylibs" }
 		
 		configuration "macosx"
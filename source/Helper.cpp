@@ -2,6 +2,10 @@
 #include <GL/glew.h>
 #include <iostream>
 
+#if !defined( PLATFORM_WIN32 )
+	#include <sys/resource.h>
+#endif
+
 std::string GetProcessPath() {
 #if defined( PLATFORM_OSX )
 	char exe_file[PATH_MAX + 1];
@@ -69,6 +73,21 @@ std::string GetProcessPath() {
 	return "./";
 #endif
 }
+
+long GetPeakMemoryUsage() {
+#if defined( PLATFORM_WIN32 )
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#if defined( PLATFORM_OSX )
+	return usage.ru_maxrss / 1024; //bytes on OS X
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
  
 void glPrintError()
 {
@@ -30,6 +30,9 @@
 
 extern std::string GetProcessPath();
 
+// peak resident memory of the process so far, in kilobytes. 0 if unknown.
+extern long GetPeakMemoryUsage();
+
 extern void glPrintError();
 
 #endif
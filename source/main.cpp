@@ -31,17 +31,33 @@
 #include <dirent.h> //search files in directory 
 #include <sys/stat.h>
 #include <list> //list for models
+#include <map>
 #include <vector>
 #include <cstring>
+#include <algorithm>
 
 // tdogl classes
 #include "Helper.h"
 #include "tdogl/Program.h"
+#include "tdogl/ProgramCache.h"
+#include "tdogl/ShaderReloader.h"
+#include "tdogl/ShaderVariants.h"
 #include "tdogl/Texture.h"
 #include "tdogl/Camera.h"
 
 
 #include "tdogl/LoadObj.h" //obj loader
+#include "tdogl/ModelLoader.h"
+#include "tdogl/DirectoryWatcher.h"
+#include "tdogl/MaterialTable.h"
+#include "tdogl/Frustum.h"
+#include "tdogl/OcclusionBuffer.h"
+#include "tdogl/BoundingVolumeHierarchy.h"
+#include "tdogl/TransformBatch.h"
+#include "tdogl/TextureCache.h"
+#include "tdogl/TextureUploader.h"
+#include "tdogl/TextureAtlas.h"
+#include "tdogl/ImageLoader.h"
 
 #include "face.h" //opencv module
 
@@ -52,16 +68,73 @@
 // constants
 //#define M_PI 3.1415926535897932384626433832795
 const glm::vec2 SCREEN_SIZE(1920, 1080);
+const GLuint MATERIALS_BINDING = 0; //uniform buffer binding point of the material table
+const GLint TRANSFORMS_TEXTURE_UNIT = 1; //where the buffer texture of gTransforms is bound
+const double MODEL_UPLOAD_BUDGET = 0.004; //seconds per frame spent copying models to the GPU
+const float LOD_PIXEL_ERROR = 1.0f; //largest error of a level of detail on the screen, in pixels
+const bool QUANTIZE_VERTICES = true; //upload models with 16-bit positions and normals, and half float uvs
+const unsigned OCCLUSION_WIDTH = 256, OCCLUSION_HEIGHT = 144; //size of the software depth buffer
+const float OCCLUDER_MIN_PIXELS = 100.0f; //models at least this wide on the screen hide what's behind them
+const bool MIPMAPS_ON_CPU = true; //gamma correct mipmaps made on the workers and cached, instead of glGenerateMipmap
+const GLfloat TEXTURE_ANISOTROPY = 8.0f; //anisotropic filtering of the textures, 1 for none
+const bool COMPRESS_TEXTURES = true; //BC1 textures, or BC7/BC3 with alpha, encoded on the workers and cached. Needs MIPMAPS_ON_CPU.
+const size_t TEXTURE_VRAM_BUDGET = 256 << 20; //bytes of textures kept loaded while no model uses them
+const size_t TEXTURE_UPLOAD_SLOT_BYTES = 4 << 20; //size of each pixel buffer that textures stream through
+const unsigned TEXTURE_UPLOAD_SLOTS = 3; //pixel buffers the GPU can be reading from at once
+const size_t TEXTURE_UPLOAD_BUDGET = 8 << 20; //bytes per frame streamed into textures
+const unsigned ATLAS_SIZE = 2048; //width and height of the atlas the small textures share
+const unsigned ATLAS_LEVELS = 4; //mipmap levels of the atlas, each one halves the room left for gutters
+const unsigned ATLAS_MAX_IMAGE = 256; //textures at most this wide and high go into the atlas
+const size_t IMAGE_DECODE_BUDGET = 64 << 20; //bytes of decoded images waiting to become textures
+const double TEXTURE_CREATE_BUDGET = 0.002; //seconds per frame spent making textures of decoded images
+const bool LIGHTING = false; //light the models that have normals with gLight. Unlit models don't upload their normals.
+
+//a range of a model's vertices (or indices, when it has an ibo) that is drawn with one material
+struct ModelPart {
+    GLint drawStart;
+    GLint drawCount;
+    GLint materialIndex; //index into gMaterials
+    tdogl::Texture* texture;
+    unsigned meshletStart, meshletCount; //the meshlets of ModelAsset::meshlets that cover the range
+
+    ModelPart() :
+        drawStart(0),
+        drawCount(0),
+        materialIndex(0),
+        texture(NULL),
+        meshletStart(0),
+        meshletCount(0)
+    {}
+};
+
+//one level of detail of a model
+struct ModelLod {
+    float error; //in model units, see tdogl::MeshLod
+    std::vector<ModelPart> parts; //one per material
+
+    ModelLod() :
+        error(0.0f)
+    {}
+};
 
 //model with all attributes
 struct ModelAsset {
+    std::string filePath; //the .obj file, used to find the model again when the file changes
     tdogl::Program* shaders;
     tdogl::Texture* texture;
     GLuint vbo_v,vbo_n,vbo_uv; //vbo for vertices,normals and uv
+    GLuint ibo; //element buffer of indexed models, 0 for plain vertex arrays
     GLuint vao;
     GLenum drawType;
     GLint drawStart;
     GLint drawCount;
+    std::vector<ModelLod> lods; //from full detail to coarsest, drawn in place of drawStart/drawCount
+    std::vector<tdogl::Meshlet> meshlets; //culled one by one when drawing the parts, in index order
+    std::vector<glm::vec3> occluderVertices; //coarse copy for gOcclusion, empty if there is none
+    std::vector<unsigned> occluderIndices;
+    glm::vec3 boundsCenter;
+    float boundsRadius;
+    glm::vec3 positionOffset, positionScale; //decodes quantized positions in the vertex shader
 
     ModelAsset() :
         shaders(NULL),
@@ -69,31 +142,39 @@ struct ModelAsset {
         vbo_v(0),
         vbo_n(0),
         vbo_uv(0),
+        ibo(0),
         vao(0),
         drawType(GL_TRIANGLES),
         drawStart(0),
-        drawCount(6*3*2)
+        drawCount(6*3*2),
+        boundsCenter(0.0f),
+        boundsRadius(0.0f),
+        positionOffset(0.0f),
+        positionScale(1.0f)
     {}
 };
 
-typedef struct {
-    GLfloat Ka[3];    // Ambient colour
-    GLfloat Kd[3];    // Diffuse colour
-    GLfloat Ks[3];    // Specular colour
-    GLfloat Ns;       // Specular (coeff)
-}Material;
-
+//what glMultiDrawElementsIndirect reads for each draw
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
 
 //contains model and transformation
 struct ModelInstance {
     ModelAsset* asset;
     glm::mat4 transform;
-    Material* mtl;
+    unsigned lod; //index into asset->lods, chosen every frame by SelectLod
+    bool occluder; //drawn into gOcclusion this frame, so it is never hidden by it
 
     ModelInstance() :
         asset(NULL),
         transform(),
-        mtl(NULL)
+        lod(0),
+        occluder(false)
     {}
 };
 
@@ -123,26 +204,77 @@ GLuint vbo_uv = 0;
 int monkeyT = 0;
 tdogl::Texture* gTexture1 = NULL;
 tdogl::LoadObj load;
+tdogl::ModelLoader* gModelLoader = NULL;
+tdogl::DirectoryWatcher* gModelWatcher = NULL;
+tdogl::FileCache* gFileCache = NULL;
+tdogl::ProgramCache* gPrograms = NULL; //links the shaders, or loads them linked by an earlier run
+tdogl::ShaderReloader* gShaderReloader = NULL; //links the shader variants again when their files are edited
+tdogl::ShaderVariants* gShaderVariants = NULL; //a program for each vertex format that the models use, gProgram is the box's
+tdogl::DirectoryWatcher* gShaderWatcher = NULL; //the resources directory, where the shader files are
+std::map<std::string, unsigned> gModelTickets; //latest ModelLoader ticket of each model file
+double gModelLoadStart = -1.0; //time LoadModels was called, until the models are all loaded
+tdogl::MaterialTable* gMaterials = NULL;
+tdogl::TextureCache* gTextures = NULL; //every texture, shared between the materials that use the same image
+tdogl::TextureUploader* gTextureUploader = NULL; //streams the levels of new textures in over a few frames
+tdogl::TextureAtlas* gTextureAtlas = NULL; //the small textures, so models using them draw without rebinding
+tdogl::ImageLoader* gImageLoader = NULL; //decodes the images in the models directory into gTextures ahead of the models
+double gImageLoadStart = -1.0; //time LoadTextures was called, until the images are all loaded
+unsigned gImagesLoaded = 0; //images from gImageLoader since LoadTextures, and their decoded bytes
+size_t gImageBytesLoaded = 0;
+GLuint gIndirectBuffer = 0; //draws of the meshlets that survive culling, 0 without ARB_multi_draw_indirect
+std::vector<DrawElementsIndirectCommand> gMeshletDraws;
+tdogl::OcclusionBuffer* gOcclusion = NULL; //the box walls and the big models, drawn on the CPU each frame
+std::vector<glm::vec3> gBoxOccluder; //the triangles of the LoadCube box
+std::vector<unsigned> gBoxOccluderIndices;
+tdogl::BoundingVolumeHierarchy gScene; //over the bounds of the instances in models, by index
+bool gSceneChanged = true; //instances were added or removed, so gScene must be built again
+std::vector<unsigned> gMovedInstances; //indices into models whose bounds changed since the last frame
+glm::mat4 gFrameCamera; //the camera matrix of the last frame, for picking
+tdogl::TransformBatch gTransforms; //the model matrices drawn in the frame, the box's first
+GLuint gTransformBuffer = 0; //camera * model of each matrix of gTransforms
+GLuint gTransformTexture = 0; //gTransformBuffer as a buffer texture for the vertex shader
+bool gPicking = false; //the mouse button was down in the last Update
 
 // returns the full path to the file `fileName` in the resources directory of the app bundle
 static std::string ResourcePath(std::string fileName) {
     return GetProcessPath() + "/../resources/" + fileName;
 }
 
-// loads the vertex shader and fragment shader, and links them to make the global gProgram
+// the cheapest variant of the shaders for a vertex format, which is linked the first time
+// anything draws with it. Normals are only worth passing to the shaders when LIGHTING is on.
+static tdogl::Program* ShadersFor(bool normals, bool octahedralNormals, bool uvs) {
+    std::vector<std::string> defines;
+    if(normals) {
+        defines.push_back("HAS_NORMALS");
+        if(octahedralNormals) defines.push_back("OCTAHEDRAL_NORMALS");
+        if(LIGHTING) defines.push_back("LIGHTING");
+    }
+    if(uvs) defines.push_back("HAS_UVS");
+
+    tdogl::Program* program = gShaderVariants->program(defines);
+    program->bindUniformBlock("Materials", MATERIALS_BINDING);
+    return program;
+}
+
+// loads the vertex shader and fragment shader, and links the variant the box uses to make
+// the global gProgram. The models' variants follow as they are loaded.
 static void LoadShaders() {
-    std::vector<tdogl::Shader> shaders;
-    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("vertex-shader.txt"), GL_VERTEX_SHADER));
-    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("fragment-shader.txt"), GL_FRAGMENT_SHADER));
-    //shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath("box-shader.txt"), GL_FRAGMENT_SHADER));
-    gProgram = new tdogl::Program(shaders);
+    double start = glfwGetTime();
+    gShaderVariants = new tdogl::ShaderVariants(gPrograms, ResourcePath("vertex-shader.txt"),
+                                                ResourcePath("fragment-shader.txt"), gShaderReloader);
+    gProgram = ShadersFor(false, false, true);
+    std::cout << "Shaders ready in " << (glfwGetTime() - start) * 1000.0 << " ms ("
+              << (gPrograms->binaryCount() ? "program binary" : "compiled") << ")" << std::endl;
 }
 
 static tdogl::Program* LoadShaders(const char* vertFilename, const char* fragFilename) {
-    std::vector<tdogl::Shader> shaders;
-    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath(vertFilename), GL_VERTEX_SHADER));
-    shaders.push_back(tdogl::Shader::shaderFromFile(ResourcePath(fragFilename), GL_FRAGMENT_SHADER));
-    return new tdogl::Program(shaders);
+    return gPrograms->programFromFiles(ResourcePath(vertFilename), ResourcePath(fragFilename));
+}
+
+static bool HasExtension(const std::string& filePath, const char* extension) {
+    size_t length = strlen(extension);
+    return filePath.length() >= length &&
+        0 == filePath.compare(filePath.length() - length, length, extension);
 }
 
 static void SearchModels( std::vector < std::string > &files ) {
@@ -179,130 +311,434 @@ static void SearchModels( std::vector < std::string > &files ) {
 }
 
 
-static void LoadModels(std::vector < std::string > files,int n) {
-    int count = 0;
-    
+// copies `size` bytes into the buffer bound to GL_ARRAY_BUFFER.
+// The storage is orphaned and mapped unsynchronized, so the driver never has to wait for the
+// GPU or keep a second copy of the data around.
+static void UploadArrayBuffer(const GLvoid* data, GLsizeiptr size) {
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
+    if(size == 0)
+        return;
+
+    GLvoid* staging = glMapBufferRange(GL_ARRAY_BUFFER, 0, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if(staging) {
+        memcpy(staging, data, size);
+        if(glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE)
+            return;
+    }
+
+    //mapping failed, or the buffer got corrupted while mapped
+    glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+}
+
+// finds the image files in the models directory, which the materials' map_Kd point to
+static void SearchImages(std::vector<std::string>& files) {
+    std::string dirname = ResourcePath("Models");
+    DIR* dir = opendir(dirname.c_str());
+    if(!dir)
+        return;
+
+    struct dirent* dirp;
+    while((dirp = readdir(dir))) {
+        std::string filepath = dirname + "/" + dirp->d_name;
+        if(HasExtension(filepath, ".jpg") || HasExtension(filepath, ".jpeg") || HasExtension(filepath, ".png") ||
+           HasExtension(filepath, ".tga") || HasExtension(filepath, ".bmp"))
+            files.push_back(filepath);
+    }
+    closedir(dir);
+}
 
-    while (!files.empty()) {
-        std::string file = files.back();
-        files.pop_back();
+// returns the asset that was loaded from `filePath`, or NULL if there is none
+static ModelAsset* FindModelAsset(const std::string& filePath) {
+    for(unsigned i = 0; i < models.size(); ++i){
+        if(models[i].asset->filePath == filePath)
+            return models[i].asset;
+    }
+    return NULL;
+}
 
+// how every texture is sampled
+static tdogl::TextureCache::Sampling TextureSampling() {
+    return tdogl::TextureCache::Sampling(GL_CLAMP_TO_EDGE, TEXTURE_ANISOTROPY);
+}
 
-        ModelAsset* model = new ModelAsset();
-        model->shaders = LoadShaders("vertex-shader.txt", "fragment-shader.txt");
-        model->drawType = GL_TRIANGLES;
-        model->texture = gTexture1;
+// the same, but never in gTextureAtlas: the walls and the default model texture cover big
+// surfaces at grazing angles, which need all the mipmaps and anisotropic filtering
+static tdogl::TextureCache::Sampling WallSampling() {
+    return tdogl::TextureCache::Sampling(GL_CLAMP_TO_EDGE, TEXTURE_ANISOTROPY, false);
+}
 
+// the texture of a material's map_Kd, from gTextures. Models fall back to the default
+// texture, which isn't counted, when there is no map_Kd or the image can't be loaded.
+static tdogl::Texture* AcquireMaterialTexture(const std::string& filePath, tdogl::Texture* fallback) {
+    if(filePath.empty())
+        return fallback;
 
-        std::vector< glm::vec3 > vertices;
-        std::vector< glm::vec2 > uvs;
-        std::vector< glm::vec3 > normals; // Won't be used at the moment.
-        int res = load.loadObj(file, vertices, uvs, normals,n);
+    tdogl::Texture* texture = gTextures->acquire(filePath, TextureSampling());
+    return texture ? texture : fallback;
+}
 
-        if ( res < 1 ) {
-            std::cerr << "Error loading " << file << std::endl;
+// makes one ModelPart per material group of a level of detail, adding the materials to gMaterials
+static void MakeModelParts(const tdogl::MeshData& mesh,
+                           const std::vector<tdogl::ObjGroup>& groups,
+                           ModelAsset* model,
+                           std::vector<ModelPart>& parts)
+{
+    for(unsigned i = 0; i < groups.size(); ++i){
+        const tdogl::ObjGroup& group = groups[i];
+        if(group.count == 0)
             continue;
+
+        ModelPart part;
+        part.drawStart = group.start;
+        part.drawCount = group.count;
+        part.texture = model->texture;
+
+        for(unsigned m = 0; m < mesh.materials.size(); ++m){
+            const tdogl::ObjMaterial& mtl = mesh.materials[m];
+            if(mtl.name != group.material)
+                continue;
+            part.materialIndex = gMaterials->add(mtl.Ka, mtl.Kd, mtl.Ks, mtl.Ns, mtl.d);
+            part.texture = AcquireMaterialTexture(mtl.map_Kd, model->texture);
+            break;
         }
 
-        glGenBuffers(1, &model->vbo_v);
-        glGenVertexArrays(1, &model->vao);
+        //groups were sorted by material, so neighbours with the same material merge
+        if(!parts.empty()){
+            ModelPart& last = parts.back();
+            if(last.materialIndex == part.materialIndex && last.texture == part.texture &&
+               last.drawStart + last.drawCount == part.drawStart) {
+                last.drawCount += part.drawCount;
+                if(part.texture != model->texture)
+                    gTextures->release(part.texture);
+                continue;
+            }
+        }
+        parts.push_back(part);
+    }
+}
 
-         // bind the VAO
-        glBindVertexArray(model->vao);
-         // bind the VBO
-        glBindBuffer(GL_ARRAY_BUFFER, model->vbo_v);
+// finds the meshlets inside the index range of each part
+static void FindPartMeshlets(ModelAsset* model, std::vector<ModelPart>& parts) {
+    for(unsigned i = 0; i < parts.size(); ++i){
+        ModelPart& part = parts[i];
+        unsigned first = 0;
+        while(first < model->meshlets.size() && model->meshlets[first].indexStart < (unsigned)part.drawStart)
+            ++first;
+        unsigned last = first;
+        while(last < model->meshlets.size() &&
+              model->meshlets[last].indexStart < (unsigned)(part.drawStart + part.drawCount))
+            ++last;
+        part.meshletStart = first;
+        part.meshletCount = last - first;
+    }
+}
 
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3),
-                         &vertices[0], GL_STATIC_DRAW);
-        
-        model->drawCount = vertices.size();
-        std::cerr << model->drawCount << "," << vertices.size() << std::endl;
-        
-        glEnableVertexAttribArray(model->shaders->attrib("vert"));
+// frees the GL objects of an asset that no instance uses anymore
+static void DeleteModelAsset(ModelAsset* asset) {
+    for(unsigned i = 0; i < asset->lods.size(); ++i){
+        const std::vector<ModelPart>& parts = asset->lods[i].parts;
+        for(unsigned p = 0; p < parts.size(); ++p){
+            if(parts[p].texture != asset->texture)
+                gTextures->release(parts[p].texture);
+        }
+    }
+    if(asset->vbo_v)  glDeleteBuffers(1, &asset->vbo_v);
+    if(asset->vbo_n)  glDeleteBuffers(1, &asset->vbo_n);
+    if(asset->vbo_uv) glDeleteBuffers(1, &asset->vbo_uv);
+    if(asset->ibo)    glDeleteBuffers(1, &asset->ibo);
+    if(asset->vao)    glDeleteVertexArrays(1, &asset->vao);
+    delete asset;
+}
+
+// removes every instance of the model loaded from `filePath`
+static void UnloadModel(const std::string& filePath) {
+    ModelAsset* asset = FindModelAsset(filePath);
+    if(!asset)
+        return;
+
+    std::vector<ModelInstance>::iterator it = models.begin();
+    while(it != models.end()){
+        if(it->asset == asset)
+            it = models.erase(it);
+        else
+            ++it;
+    }
+    gSceneChanged = true;
+
+    DeleteModelAsset(asset);
+    std::cerr << "Unloaded " << filePath << std::endl;
+}
+
+// makes the VAO and VBOs for a mesh that finished parsing, and adds it to the scene.
+// If the model was already loaded, its instances are switched over to the new buffers.
+static void UploadModel(const tdogl::MeshData& mesh) {
+    //the file was deleted, or changed again, while this mesh was being parsed
+    std::map<std::string, unsigned>::const_iterator ticket = gModelTickets.find(mesh.filePath);
+    if(ticket == gModelTickets.end() || ticket->second != mesh.ticket)
+        return;
+
+    int res = mesh.format;
+    if ( res < 1 ) {
+        //keep showing the previous version, if there is one
+        std::cerr << "Error loading " << mesh.filePath << std::endl;
+        return;
+    }
+
+    const tdogl::QuantizedVertices& packed = mesh.quantized;
+    const bool quantized = !packed.positions.empty();
+    const size_t vertexCount = quantized ? packed.vertexCount() : mesh.vertices.size();
+    GLsizeiptr vertexBytes = 0;
+
+    //only what the shaders read is uploaded
+    const bool normals = LIGHTING && (res == 1 || res == 2);
+    const bool uvs = (res == 1 || res == 3);
+
+    ModelAsset* model = new ModelAsset();
+    model->filePath = mesh.filePath;
+    model->shaders = ShadersFor(normals, quantized, uvs);
+    model->drawType = GL_TRIANGLES;
+    model->texture = gTexture1;
+
+    //the materials' images decode on the workers while the buffers are filled
+    for(unsigned m = 0; m < mesh.materials.size(); ++m){
+        if(!mesh.materials[m].map_Kd.empty())
+            gTextures->prefetch(mesh.materials[m].map_Kd, TextureSampling());
+    }
+
+    glGenBuffers(1, &model->vbo_v);
+    glGenVertexArrays(1, &model->vao);
+
+     // bind the VAO
+    glBindVertexArray(model->vao);
+     // bind the VBO
+    glBindBuffer(GL_ARRAY_BUFFER, model->vbo_v);
+
+    model->drawCount = mesh.indices.empty() ? vertexCount : mesh.indices.size();
+    std::cerr << model->drawCount << "," << vertexCount << std::endl;
+
+    //quantized attributes are passed as plain integers, the shader applies the scale
+    glEnableVertexAttribArray(model->shaders->attrib("vert"));
+    if (quantized) {
+        vertexBytes += packed.positions.size() * sizeof(GLshort);
+        UploadArrayBuffer(&packed.positions[0], packed.positions.size() * sizeof(GLshort));
+        glVertexAttribPointer(model->shaders->attrib("vert"), 3, GL_SHORT,
+                 GL_FALSE, 4*sizeof(GLshort), NULL);
+        model->positionOffset = packed.positionOffset;
+        model->positionScale = packed.positionScale;
+    } else {
+        vertexBytes += mesh.vertices.size() * sizeof(glm::vec3);
+        UploadArrayBuffer(&mesh.vertices[0], mesh.vertices.size() * sizeof(glm::vec3));
         glVertexAttribPointer(model->shaders->attrib("vert"), 3, GL_FLOAT,
                  GL_FALSE, 3*sizeof(GLfloat), NULL);
+    }
 
-        
-        if (res == 1 || res == 2) {
-        //make and bind vbo for normals
-            glGenBuffers(1, &model->vbo_n);
-            glBindBuffer(GL_ARRAY_BUFFER, model->vbo_n);
-            
-            glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3),
-                         &normals[0], GL_STATIC_DRAW); //normals is std::vector<float>
-            
-            glEnableVertexAttribArray(model->shaders->attrib("vertNormal"));
-        glVertexAttribPointer(model->shaders->attrib("vertNormal"), 3, GL_FLOAT,
-                 GL_TRUE, 3*sizeof(GLfloat), NULL);
-            //glNormalPointer( GL_FLOAT, 3*sizeof(GLfloat) , NULL);
 
+    if (normals) {
+    //make and bind vbo for normals
+        glGenBuffers(1, &model->vbo_n);
+        glBindBuffer(GL_ARRAY_BUFFER, model->vbo_n);
+
+        glEnableVertexAttribArray(model->shaders->attrib("vertNormal"));
+        if (quantized) {
+            vertexBytes += packed.normals.size() * sizeof(GLshort);
+            UploadArrayBuffer(&packed.normals[0], packed.normals.size() * sizeof(GLshort));
+            glVertexAttribPointer(model->shaders->attrib("vertNormal"), 2, GL_SHORT,
+                     GL_FALSE, 2*sizeof(GLshort), NULL);
+        } else {
+            vertexBytes += mesh.normals.size() * sizeof(glm::vec3);
+            UploadArrayBuffer(&mesh.normals[0], mesh.normals.size() * sizeof(glm::vec3));
+            glVertexAttribPointer(model->shaders->attrib("vertNormal"), 3, GL_FLOAT,
+                     GL_TRUE, 3*sizeof(GLfloat), NULL);
         }
-        //make and bind vbo for uv coordinates
-
-        if ( res == 1 || res == 3) {
-            glGenBuffers(1, &model->vbo_uv);
-            glBindBuffer(GL_ARRAY_BUFFER, model->vbo_uv);
-            glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec3),
-             &uvs[0], GL_STATIC_DRAW); //normals is std::vector<float>
-            
-            glEnableVertexAttribArray(model->shaders->attrib("vertTexCoord"));
+    }
+    //make and bind vbo for uv coordinates
+
+    if (uvs) {
+        glGenBuffers(1, &model->vbo_uv);
+        glBindBuffer(GL_ARRAY_BUFFER, model->vbo_uv);
+
+        glEnableVertexAttribArray(model->shaders->attrib("vertTexCoord"));
+        if (quantized) {
+            vertexBytes += packed.uvs.size() * sizeof(GLhalf);
+            UploadArrayBuffer(&packed.uvs[0], packed.uvs.size() * sizeof(GLhalf));
+            glVertexAttribPointer(model->shaders->attrib("vertTexCoord"), 2, GL_HALF_FLOAT,
+                         GL_FALSE, 2*sizeof(GLhalf), NULL);
+        } else {
+            vertexBytes += mesh.uvs.size() * sizeof(glm::vec2);
+            UploadArrayBuffer(&mesh.uvs[0], mesh.uvs.size() * sizeof(glm::vec2));
             glVertexAttribPointer(model->shaders->attrib("vertTexCoord"), 2, GL_FLOAT,
                          GL_TRUE,  2*sizeof(GLfloat), NULL);
-
         }
-        // unbind the VAO
-        glBindVertexArray(0);
-
-/*
-        std::cerr << "MODELLO " << count++ << std::endl;
-            
-        ModelInstance m = ModelInstance(model);
-        //m.asset = &model;
-        
-        m.transform = glm::mat4(); //no transform
-        models.push_back(m);*/
+    }
 
+    //what the same vertices take as floats, to see what quantizing saves
+    GLsizeiptr floatBytes = vertexCount * sizeof(glm::vec3);
+    if (res == 1 || res == 2) floatBytes += vertexCount * sizeof(glm::vec3);
+    if (res == 1 || res == 3) floatBytes += vertexCount * sizeof(glm::vec2);
+    std::cerr << mesh.filePath << ": " << vertexBytes / 1024 << " KB of vertices ("
+              << vertexBytes / (GLsizeiptr)std::max<size_t>(vertexCount, 1) << " bytes each), "
+              << floatBytes / 1024 << " KB as floats" << std::endl;
+
+    //the element buffer binding is part of the VAO
+    if (!mesh.indices.empty()) {
+        glGenBuffers(1, &model->ibo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(GLuint), &mesh.indices[0], GL_STATIC_DRAW);
+    }
 
-        ModelInstance m = ModelInstance();
+    // unbind the VAO
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    model->meshlets = mesh.meshlets;
+    for(unsigned i = 0; i < mesh.lods.size(); ++i){
+        ModelLod lod;
+        lod.error = mesh.lods[i].error;
+        MakeModelParts(mesh, mesh.lods[i].groups, model, lod.parts);
+        FindPartMeshlets(model, lod.parts);
+        model->lods.push_back(lod);
+    }
+    model->boundsCenter = mesh.boundsCenter;
+    model->boundsRadius = mesh.boundsRadius;
+    model->occluderVertices = mesh.occluderVertices;
+    model->occluderIndices = mesh.occluderIndices;
+
+    ModelAsset* oldModel = FindModelAsset(mesh.filePath);
+    if(oldModel) {
+        for(unsigned i = 0; i < models.size(); ++i){
+            if(models[i].asset == oldModel) {
+                models[i].asset = model;
+                models[i].lod = 0;
+                gMovedInstances.push_back(i);
+            }
+        }
+        DeleteModelAsset(oldModel);
+        std::cerr << "Reloaded " << mesh.filePath << std::endl;
+        return;
+    }
 
-        m.asset = model;
-        m.transform = glm::mat4();
+    ModelInstance m = ModelInstance();
 
-        /***LOAD MATERIAL ***/
-        /*
-        const std::string mtl = file.replace(file.length() - 4,
-                                                 4, ".mtl");
-        GLfloat Ka[3];
-        GLfloat Kd[3];
-        GLfloat Ks[3];
-        GLfloat Ns;  
+    m.asset = model;
+    m.transform = glm::mat4();
 
-        
-        bool ret = load.loadMtl(file,Ka,Kd,Ks,Ns);
+    models.push_back(m);
+    gSceneChanged = true;
+}
 
-            if (ret) {
+// queues the image files for decoding on the worker threads, so their textures are in
+// gTextures by the time the models that use them are uploaded
+static void LoadTextures(const std::vector<std::string>& files) {
+    gImageLoadStart = glfwGetTime();
+    gImagesLoaded = 0;
+    gImageBytesLoaded = 0;
+    for(unsigned i = 0; i < files.size(); ++i)
+        gImageLoader->load(files[i]);
+}
 
-                std::cerr << "Mtl Loaded " << std::endl;
-                Material* mtl = new Material();
-                memcpy ( &mtl->Ka, &Ka, sizeof(Ka) );
-                memcpy ( &mtl->Kd, &Kd, sizeof(Kd) );
-                memcpy ( &mtl->Ks, &Ks, sizeof(Ks) );
-                mtl->Ns = Ns;
-                m.mtl = mtl;
-            }
-*/
+// makes textures of the images that finished decoding, until `budgetSeconds` of this frame
+// are used. Nothing holds them yet, so they wait in gTextures for the models to acquire them.
+static void UploadFinishedTextures(double budgetSeconds) {
+    double start = glfwGetTime();
+    tdogl::DecodedImage image;
+
+    bool drained = true;
+    while(gImageLoader->popFinished(image)) {
+        gImagesLoaded++;
+        gImageBytesLoaded += image.bytes();
+        tdogl::Texture* texture = gTextures->acquire(image, TextureSampling());
+        if(texture)
+            gTextures->release(texture);
+        image = tdogl::DecodedImage(); //free what wasn't moved into the texture
+        if(glfwGetTime() - start >= budgetSeconds) {
+            drained = false;
+            break;
+        }
+    }
 
-        
-        
-        models.push_back(m);
-       
+    if(drained && gImageLoadStart >= 0.0 && gImageLoader->pending() == 0) {
+        std::cerr << "Loaded " << gImagesLoaded << " images (" << gImageBytesLoaded / (1024 * 1024)
+                  << " MB decoded) in " << (glfwGetTime() - gImageLoadStart) << " s on "
+                  << tdogl::ThreadPool::shared().threadCount() << " workers" << std::endl;
+        gImageLoadStart = -1.0;
     }
+}
+
+// queues the model files for parsing on the worker threads.
+// The models show up in the scene as UploadFinishedModels picks them up.
+static void LoadModels(const std::vector < std::string >& files) {
+    gModelLoadStart = glfwGetTime();
+    for(unsigned i = 0; i < files.size(); ++i)
+        gModelTickets[files[i]] = gModelLoader->load(files[i]);
+}
 
-    std::cerr<< "NUM COUNT: " << count << std::endl;
+// reloads or unloads the models whose .obj or .mtl files changed since the last frame.
+// Only the changed files are parsed again, everything else in the scene stays as it is.
+static void ApplyModelChanges() {
+    std::vector<tdogl::DirectoryWatcher::Change> changes;
+    if(!gModelWatcher || !gModelWatcher->poll(changes))
+        return;
+
+    for(unsigned i = 0; i < changes.size(); ++i){
+        std::string file = changes[i].filePath;
+
+        if(HasExtension(file, ".mtl")) {
+            //the material belongs to the .obj with the same name
+            file.replace(file.length() - 4, 4, ".obj");
+            if(gModelTickets.find(file) == gModelTickets.end())
+                continue;
+            struct stat filestat;
+            if(stat(file.c_str(), &filestat) != 0)
+                continue;
+        } else if(!HasExtension(file, ".obj")) {
+            continue;
+        } else if(changes[i].type == tdogl::DirectoryWatcher::Change_Removed) {
+            gModelTickets.erase(file);
+            UnloadModel(file);
+            continue;
+        }
 
+        std::cerr << "Changed " << file << std::endl;
+        gModelTickets[file] = gModelLoader->load(file);
+    }
+}
 
+// starts linking the programs whose shader files changed since the last frame, and swaps in
+// the ones that finished. A program that doesn't compile leaves the old one running.
+static void ApplyShaderChanges() {
+    std::vector<tdogl::DirectoryWatcher::Change> changes;
+    if(gShaderWatcher && gShaderWatcher->poll(changes)) {
+        for(unsigned i = 0; i < changes.size(); ++i) {
+            if(changes[i].type == tdogl::DirectoryWatcher::Change_Modified)
+                gShaderReloader->fileChanged(changes[i].filePath);
+        }
+    }
+    gShaderReloader->update();
+}
 
+// uploads the models that finished parsing, until `budgetSeconds` of this frame are used.
+// At least one model is uploaded per call, so big models can't stall the loading forever.
+static void UploadFinishedModels(double budgetSeconds) {
+    double start = glfwGetTime();
+    tdogl::MeshData mesh;
+
+    bool drained = true;
+    while(gModelLoader->popFinished(mesh)) {
+        UploadModel(mesh);
+        mesh = tdogl::MeshData(); //free the CPU copy now that it's on the GPU
+        if(glfwGetTime() - start >= budgetSeconds) {
+            drained = false;
+            break;
+        }
+    }
 
+    if(drained && gModelLoadStart >= 0.0 && gModelLoader->pending() == 0) {
+        std::cerr << "Loaded " << models.size() << " models in "
+                  << (glfwGetTime() - gModelLoadStart) << " s, peak memory "
+                  << GetPeakMemoryUsage() / 1024 << " MB" << std::endl;
+        gModelLoadStart = -1.0;
+    }
 }
 
 static void LoadModel() {
@@ -553,6 +989,14 @@ static void LoadCube(float nP, float fB,float ar) {
 
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
 
+    // the walls hide the models behind them, so they go into the occlusion buffer too
+    gBoxOccluder.clear();
+    gBoxOccluderIndices.clear();
+    for(unsigned i = 0; i + 8 <= sizeof(vertexData) / sizeof(GLfloat); i += 8){
+        gBoxOccluderIndices.push_back((unsigned)gBoxOccluder.size());
+        gBoxOccluder.push_back(glm::vec3(vertexData[i], vertexData[i + 1], vertexData[i + 2]));
+    }
+
     // connect the xyz to the "vert" attribute of the vertex shader
     glEnableVertexAttribArray(gProgram->attrib("vert"));
     glVertexAttribPointer(gProgram->attrib("vert"), 3, GL_FLOAT, GL_FALSE, 8*sizeof(GLfloat), NULL);
@@ -590,48 +1034,274 @@ static void LoadCube(float nP, float fB,float ar) {
 }
 
 
-// loads the file "wooden-crate.jpg" into gTexture
+// loads the wall texture into gTexture and the default model texture into gTexture1
 static void LoadTexture() {
-    tdogl::Bitmap bmp = tdogl::Bitmap::bitmapFromFile(ResourcePath("grid2.jpg"));
-    bmp.flipVertically();
-    gTexture = new tdogl::Texture(bmp);
+    gTextures->prefetch(ResourcePath("grid2.jpg"), WallSampling());
+    gTextures->prefetch(ResourcePath("box.jpg"), WallSampling());
+    gTexture = gTextures->acquire(ResourcePath("grid2.jpg"), WallSampling());
+    gTexture1 = gTextures->acquire(ResourcePath("box.jpg"), WallSampling());
+    if(!gTexture || !gTexture1)
+        throw std::runtime_error("Can't load grid2.jpg and box.jpg");
+}
+
+// draws `count` vertices of the bound VAO, through the element buffer if the asset has one
+static void DrawRange(const ModelAsset* asset, GLint start, GLint count) {
+    if(asset->ibo)
+        glDrawElements(asset->drawType, count, GL_UNSIGNED_INT, (const GLvoid*)(start * sizeof(GLuint)));
+    else
+        glDrawArrays(asset->drawType, start, count);
+}
+
+// draws the meshlets of a part that are inside the frustum and face the eye. Neighbouring
+// meshlets that survive merge into one draw, and all the draws go to the GPU in one call.
+static void DrawVisibleMeshlets(const ModelAsset* asset,
+                                const ModelPart& part,
+                                const tdogl::Frustum& frustum,
+                                const glm::vec3& eye)
+{
+    gMeshletDraws.clear();
+    for(unsigned i = part.meshletStart; i < part.meshletStart + part.meshletCount; ++i){
+        const tdogl::Meshlet& meshlet = asset->meshlets[i];
+        if(!tdogl::MeshletBuilder::isVisible(meshlet, frustum, eye))
+            continue;
+
+        if(!gMeshletDraws.empty()) {
+            DrawElementsIndirectCommand& last = gMeshletDraws.back();
+            if(last.firstIndex + last.count == meshlet.indexStart) {
+                last.count += meshlet.indexCount;
+                continue;
+            }
+        }
+        DrawElementsIndirectCommand draw = { meshlet.indexCount, 1, meshlet.indexStart, 0, 0 };
+        gMeshletDraws.push_back(draw);
+    }
+    if(gMeshletDraws.empty())
+        return;
+
+    if(gIndirectBuffer) {
+        //orphan the buffer so the driver doesn't wait for the previous draws to finish with it
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gIndirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, gMeshletDraws.size() * sizeof(DrawElementsIndirectCommand),
+                     &gMeshletDraws[0], GL_STREAM_DRAW);
+        glMultiDrawElementsIndirect(asset->drawType, GL_UNSIGNED_INT, NULL, (GLsizei)gMeshletDraws.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    } else {
+        std::vector<GLsizei> counts(gMeshletDraws.size());
+        std::vector<const GLvoid*> offsets(gMeshletDraws.size());
+        for(unsigned i = 0; i < gMeshletDraws.size(); ++i){
+            counts[i] = gMeshletDraws[i].count;
+            offsets[i] = (const GLvoid*)(gMeshletDraws[i].firstIndex * sizeof(GLuint));
+        }
+        glMultiDrawElements(asset->drawType, &counts[0], GL_UNSIGNED_INT, &offsets[0], (GLsizei)counts.size());
+    }
+}
+
+// picks the coarsest level of detail of the instance whose error is at most LOD_PIXEL_ERROR
+// pixels on the screen. Needs the frustum of this frame, so call it after gCamera.matrix().
+static void SelectLod(ModelInstance& inst) {
+    const ModelAsset* asset = inst.asset;
+    inst.lod = 0;
+    if(asset->lods.size() < 2)
+        return;
+
+    //the bounding sphere in world space, scaled by the largest scale of the transform
+    glm::vec3 center = glm::vec3(inst.transform * glm::vec4(asset->boundsCenter, 1.0f));
+    float scale = std::max(glm::length(glm::vec3(inst.transform[0])),
+                  std::max(glm::length(glm::vec3(inst.transform[1])),
+                           glm::length(glm::vec3(inst.transform[2]))));
+    float pixels = gCamera.pixelsPerUnit(center, asset->boundsRadius * scale) * scale;
+
+    while(inst.lod + 1 < asset->lods.size() && asset->lods[inst.lod + 1].error * pixels <= LOD_PIXEL_ERROR)
+        ++inst.lod;
+}
+
+// the world space box around the instance's bounding sphere
+static tdogl::BoundingBox InstanceBounds(const ModelInstance& inst) {
+    glm::vec3 center = glm::vec3(inst.transform * glm::vec4(inst.asset->boundsCenter, 1.0f));
+    glm::vec3 extent(inst.asset->boundsRadius * std::max(glm::length(glm::vec3(inst.transform[0])),
+                                                std::max(glm::length(glm::vec3(inst.transform[1])),
+                                                         glm::length(glm::vec3(inst.transform[2])))));
+    return tdogl::BoundingBox(center - extent, center + extent);
+}
+
+// brings gScene up to date with models: a new tree when instances came or went, otherwise
+// only the boxes of the instances that moved
+static void UpdateScene() {
+    if(gSceneChanged) {
+        std::vector<tdogl::BoundingBox> boxes(models.size());
+        for(unsigned i = 0; i < models.size(); ++i)
+            boxes[i] = InstanceBounds(models[i]);
+        gScene.build(boxes);
+    } else {
+        for(unsigned i = 0; i < gMovedInstances.size(); ++i)
+            gScene.refit(gMovedInstances[i], InstanceBounds(models[gMovedInstances[i]]));
+    }
+    gSceneChanged = false;
+    gMovedInstances.clear();
+}
+
+// logs the model under the mouse, along the ray from the tracked eye through the screen
+static void PickModel() {
+    int mouseX, mouseY, windowWidth, windowHeight;
+    glfwGetMousePos(&mouseX, &mouseY);
+    glfwGetWindowSize(&windowWidth, &windowHeight);
+    if(windowWidth <= 0 || windowHeight <= 0)
+        return;
+
+    //any point that shows under the mouse is on the ray, so take one in the middle of the depth range
+    glm::vec4 screenPoint(2.0f * mouseX / windowWidth - 1.0f, 1.0f - 2.0f * mouseY / windowHeight, 0.0f, 1.0f);
+    glm::vec4 worldPoint = glm::inverse(gFrameCamera) * screenPoint;
+    glm::vec3 eye = gCamera.eyePosition();
+    glm::vec3 direction = glm::vec3(worldPoint) / worldPoint.w - eye;
+
+    unsigned picked;
+    float distance;
+    if(gScene.queryRay(eye, direction, picked, distance) && picked < models.size())
+        std::cerr << "Picked " << models[picked].asset->filePath << std::endl;
+}
+
+// draws the instance into gOcclusion if it has an occluder and is big on the screen.
+// Needs the frustum of this frame, like SelectLod.
+static void AddOccluder(ModelInstance& inst, const glm::mat4& camera) {
+    const ModelAsset* asset = inst.asset;
+    inst.occluder = false;
+    if(asset->occluderIndices.empty())
+        return;
+
+    glm::vec3 center = glm::vec3(inst.transform * glm::vec4(asset->boundsCenter, 1.0f));
+    float radius = asset->boundsRadius * std::max(glm::length(glm::vec3(inst.transform[0])),
+                                         std::max(glm::length(glm::vec3(inst.transform[1])),
+                                                  glm::length(glm::vec3(inst.transform[2]))));
+    if(gCamera.pixelsPerUnit(center, radius) * 2.0f * radius < OCCLUDER_MIN_PIXELS)
+        return;
+
+    gOcclusion->addOccluder(camera * inst.transform, asset->occluderVertices, asset->occluderIndices);
+    inst.occluder = true;
+}
+
+// false if the box around the instance's bounding sphere is completely behind the occluders
+static bool IsUnoccluded(const ModelInstance& inst, const glm::mat4& camera) {
+    if(inst.occluder)
+        return true;
+    glm::vec3 extent(inst.asset->boundsRadius);
+    return gOcclusion->isVisible(camera * inst.transform,
+                                 inst.asset->boundsCenter - extent,
+                                 inst.asset->boundsCenter + extent);
+}
+
+// multiplies the camera with every matrix of gTransforms, straight into the mapped
+// gTransformBuffer, and binds it for the vertex shader
+static void UploadTransforms(const glm::mat4& camera) {
+    GLsizeiptr size = gTransforms.size() * sizeof(glm::mat4);
+    glBindBuffer(GL_TEXTURE_BUFFER, gTransformBuffer);
+    //orphan the storage of the last frame, which the GPU may still be reading
+    glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW);
+    GLvoid* mapped = glMapBufferRange(GL_TEXTURE_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if(mapped) {
+        gTransforms.multiply(camera, (float*)mapped);
+        glUnmapBuffer(GL_TEXTURE_BUFFER);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
-     tdogl::Bitmap bmp1 = tdogl::Bitmap::bitmapFromFile(ResourcePath("box.jpg"));
-    bmp.flipVertically();
-    gTexture1 = new tdogl::Texture(bmp1);
+    glActiveTexture(GL_TEXTURE0 + TRANSFORMS_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, gTransformTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+//what is bound while the models are drawn, so instances drawn one after the other that
+//share a program or texture don't bind it again
+struct RenderState {
+    tdogl::Program* shaders;
+    bool textured; //shaders is a variant with uvs, the others don't sample any texture
+    GLuint texture;
+
+    RenderState() :
+        shaders(NULL),
+        textured(false),
+        texture(0)
+    {}
+};
+
+// the parts drawn for an instance at its current level of detail, empty for plain assets
+static const std::vector<ModelPart>& InstanceParts(const ModelInstance& inst) {
+    static const std::vector<ModelPart> none;
+    const ModelAsset* asset = inst.asset;
+    return asset->lods.empty() ? none : asset->lods[std::min<size_t>(inst.lod, asset->lods.size() - 1)].parts;
+}
+
+// the texture object an instance binds first, to order the draws by
+static GLuint FirstTextureObject(const ModelInstance& inst) {
+    const std::vector<ModelPart>& parts = InstanceParts(inst);
+    return parts.empty() ? inst.asset->texture->object() : parts[0].texture->object();
 }
 
-static void RenderInstance(const ModelInstance& inst) {
+// binds a texture unless it is bound already, and sets where its image is in the texture
+// object, which is all of it unless the texture is a region of gTextureAtlas, and whether
+// its coordinates are clamped to the region
+static void BindTexture(const tdogl::Texture* texture, RenderState& state) {
+    if(!state.textured)
+        return;
+    if(texture->object() != state.texture) {
+        glBindTexture(GL_TEXTURE_2D, texture->object());
+        state.texture = texture->object();
+    }
+    state.shaders->setUniform("uvRect", texture->uvRect());
+    state.shaders->setUniform("clampToRegion", (GLint)texture->isRegion());
+}
+
+// draws an instance, whose camera * model matrix is number `transformIndex` of gTransforms
+static void RenderInstance(const ModelInstance& inst, const glm::mat4& camera, GLint transformIndex, RenderState& state) {
     
     ModelAsset* asset = inst.asset;
     tdogl::Program* shaders = asset->shaders;
     
-    //bind the shaders
-    shaders->use();
+    //bind the shaders, and set the uniforms that are the same for every instance
+    if(shaders != state.shaders) {
+        shaders->use();
+        shaders->setUniform("transforms", TRANSFORMS_TEXTURE_UNIT);
+        state.shaders = shaders;
+        state.textured = shaders->hasUniform("tex");
+        if(state.textured)
+            shaders->setUniform("tex", 0); //set to 0 because the texture will be bound to GL_TEXTURE0
+        if(shaders->hasUniform("light.position")) {
+            shaders->setUniform("light.position", gLight.position);
+            shaders->setUniform("light.intensities", gLight.intensities);
+        }
+    }
 
     //set the shader uniforms
-    shaders->setUniform("camera", gCamera.matrix());
-
-    shaders->setUniform("model", inst.transform);
-    //bind the texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, asset->texture->object());
-    shaders->setUniform("tex", 0); //set to 0 because the texture will be bound to GL_TEXTURE0
-    //shaders->setUniform("light.position", gLight.position);
-    //shaders->setUniform("light.intensities", gLight.intensities);
+    shaders->setUniform("transformIndex", transformIndex);
+    shaders->setUniform("positionOffset", asset->positionOffset);
+    shaders->setUniform("positionScale", asset->positionScale);
+    if(shaders->hasUniform("model")) //lit variants only
+        shaders->setUniform("model", inst.transform);
 
   
     
     
     //bind VAO and draw
     glBindVertexArray(asset->vao);
-    glDrawArrays(asset->drawType, asset->drawStart, asset->drawCount);
-
-    //unbind everything
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    shaders->stopUsing();
+    if(asset->lods.empty()) {
+        BindTexture(asset->texture, state);
+        shaders->setUniform("materialIndex", 0);
+        DrawRange(asset, asset->drawStart, asset->drawCount);
+    }
 
+    //the meshlets are culled in model space, so the transform needn't touch every bounding sphere
+    tdogl::Frustum frustum(camera * inst.transform);
+    glm::vec3 eye = glm::vec3(glm::inverse(inst.transform) * glm::vec4(gCamera.eyePosition(), 1.0f));
+
+    //one draw per material: switching material is one index, textures only when they differ
+    const std::vector<ModelPart>& parts = InstanceParts(inst);
+    for(unsigned i = 0; i < parts.size(); ++i){
+        const ModelPart& part = parts[i];
+        BindTexture(part.texture, state);
+        shaders->setUniform("materialIndex", part.materialIndex);
+        if(part.meshletCount > 0)
+            DrawVisibleMeshlets(asset, part, frustum, eye);
+        else
+            DrawRange(asset, part.drawStart, part.drawCount);
+    }
 }
 
 // draws a single frame
@@ -642,20 +1312,55 @@ static void Render() {
     
     
 
+    // the head tracked camera of this frame, shared by everything drawn in it
+    glm::mat4 camera = gCamera.matrix();
+    gFrameCamera = camera;
+
+    // only the instances in the frustum, found through the tree, in the order of models
+    UpdateScene();
+    std::vector<unsigned> visible;
+    gScene.queryFrustum(tdogl::Frustum(camera), visible);
+    std::sort(visible.begin(), visible.end());
+
+    // the box walls and the big models go into the occlusion buffer first, on the workers
+    gOcclusion->clear();
+    gOcclusion->addOccluder(camera, gBoxOccluder, gBoxOccluderIndices);
+    for(unsigned i = 0; i < visible.size(); ++i){
+        SelectLod(models[visible[i]]);
+        AddOccluder(models[visible[i]], camera);
+    }
+    gOcclusion->rasterize(tdogl::ThreadPool::shared());
+
+    // the transforms of everything that is drawn go to the GPU in one go
+    std::vector<unsigned> drawn;
+    gTransforms.clear();
+    gTransforms.add(glm::mat4(1.0f)); // the box
+    for(unsigned i = 0; i < visible.size(); ++i){
+        const ModelInstance& inst = models[visible[i]];
+        if(!IsUnoccluded(inst, camera))
+            continue;
+        drawn.push_back(visible[i]);
+        gTransforms.add(inst.transform);
+    }
+    UploadTransforms(camera);
+
     /*** RENDER FIRST OBJECT ***/
     // bind the program (the shaders)
     gProgram->use();
-    // set the "camera" uniform
-    gProgram->setUniform("camera", gCamera.matrix());
-    // set the "model" uniform in the vertex shader, based on the gDegreesRotated global
-    gProgram->setUniform("model", glm::translate(glm::mat4(1.0f),                       
-        glm::vec3(0.0f, 0.0f, 0.0f))); 
+    // the box is the first matrix of gTransforms
+    gProgram->setUniform("transforms", TRANSFORMS_TEXTURE_UNIT);
+    gProgram->setUniform("transformIndex", 0);
+    // the box has plain float vertices
+    gProgram->setUniform("positionOffset", glm::vec3(0.0f));
+    gProgram->setUniform("positionScale", glm::vec3(1.0f));
     // bind the texture and set the "tex" uniform in the fragment shader
      glActiveTexture(GL_TEXTURE0);
      glBindTexture(GL_TEXTURE_2D, gTexture->object());
      gProgram->setUniform("tex", 0); //set to 0 because the texture is bound to GL_TEXTURE0
-     //gProgram->setUniform("light.position", gLight.position);
-     //gProgram->setUniform("light.intensities", gLight.intensities);
+     gProgram->setUniform("uvRect", gTexture->uvRect());
+     gProgram->setUniform("clampToRegion", (GLint)gTexture->isRegion());
+     gProgram->setUniform("materialIndex", 0); //the box has no material of its own
+     gMaterials->bind(MATERIALS_BINDING);
     // bind the VAO (the triangle)
     glBindVertexArray(gVAO);
     // draw the VAO
@@ -672,11 +1377,31 @@ static void Render() {
 
     /*** RENDER MODELS***/
 
-    std::vector<ModelInstance>::iterator it;
-    int count = 0;
-    for(it = models.begin(); it != models.end(); ++it){
-        std::cerr << "Rendering " << count++ << std::endl; 
-        RenderInstance(*it);
+    // instances with the same program and first texture go one after the other, so those
+    // in the atlas mostly draw without binding anything in between
+    std::vector<unsigned> order(drawn.size());
+    for(unsigned i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+        const ModelInstance& instA = models[drawn[a]];
+        const ModelInstance& instB = models[drawn[b]];
+        if(instA.asset->shaders != instB.asset->shaders)
+            return instA.asset->shaders < instB.asset->shaders;
+        return FirstTextureObject(instA) < FirstTextureObject(instB);
+    });
+
+    RenderState state;
+    glActiveTexture(GL_TEXTURE0);
+    for(unsigned i = 0; i < order.size(); ++i){
+        std::cerr << "Rendering " << order[i] << std::endl; 
+        RenderInstance(models[drawn[order[i]]], camera, order[i] + 1, state);
+    }
+
+    // unbind everything
+    if(state.shaders) {
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        state.shaders->stopUsing();
     }
     
     // swap the display buffers (displays what was just drawn)
@@ -701,6 +1426,12 @@ void Update(float secondsElapsed) {
         gCamera.setNearAndFarPlanes(gCamera.nearPlane() - 0.001f, gCamera.farPlane() );
     }
 
+    //pick the model under the mouse on each click
+    bool picking = glfwGetMouseButton(GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    if(picking && !gPicking)
+        PickModel();
+    gPicking = picking;
+
     //increase or decrease field of view based on mouse wheel
     /*const float zoomSensitivity = -0.2;
 
@@ -755,21 +1486,65 @@ void AppMain(int screenX,int screenY,int camX,int camY,float n,float fB) {
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
 
+    // the camera * model matrices of the instances, read by the vertex shader as a buffer texture
+    glGenBuffers(1, &gTransformBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, gTransformBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glGenTextures(1, &gTransformTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, gTransformTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, gTransformBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    // the culled meshlets go through an indirect buffer where the driver supports it
+    if(GLEW_ARB_multi_draw_indirect)
+        glGenBuffers(1, &gIndirectBuffer);
+
     // load vertex and fragment shaders into opengl
+    gFileCache = new tdogl::FileCache(ResourcePath("Cache"));
+    gPrograms = new tdogl::ProgramCache(gFileCache);
+    gShaderReloader = new tdogl::ShaderReloader(gPrograms);
     LoadShaders();
+    try {
+        //without the trailing slash of ResourcePath(""), so the changed files have the same
+        //paths as ResourcePath(fileName)
+        gShaderWatcher = new tdogl::DirectoryWatcher(GetProcessPath() + "/../resources");
+    } catch (const std::exception& e) {
+        std::cerr << "Shader hot reload disabled: " << e.what() << std::endl;
+    }
+    gMaterials = new tdogl::MaterialTable();
 
     // load the texture
+    gTextureUploader = new tdogl::TextureUploader(TEXTURE_UPLOAD_SLOT_BYTES, TEXTURE_UPLOAD_SLOTS);
+    gTextureAtlas = new tdogl::TextureAtlas(ATLAS_SIZE, ATLAS_LEVELS, ATLAS_MAX_IMAGE);
+    gTextures = new tdogl::TextureCache(tdogl::ThreadPool::shared(), gFileCache, TEXTURE_VRAM_BUDGET,
+                                        MIPMAPS_ON_CPU, COMPRESS_TEXTURES, gTextureUploader, gTextureAtlas);
     LoadTexture();
 
     // create buffer and fill it with the points of the triangle
     float ar = (float)screenY/(float)screenX;
 
+    gImageLoader = new tdogl::ImageLoader(tdogl::ThreadPool::shared(), gFileCache,
+                                          gTextures->decodeOptions(TextureSampling()), IMAGE_DECODE_BUDGET);
+    std::vector<std::string> images;
+    SearchImages(images);
+    LoadTextures(images);
+
     std::vector <std::string> files;
     SearchModels(files);
 
     LoadCube(n,fB,ar);
 
-    LoadModels(files,n);
+    gOcclusion = new tdogl::OcclusionBuffer(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+    gModelLoader = new tdogl::ModelLoader(tdogl::ThreadPool::shared(), (int)n, gFileCache,
+                                          QUANTIZE_VERTICES);
+    LoadModels(files);
+
+    try {
+        gModelWatcher = new tdogl::DirectoryWatcher(ResourcePath("Models"));
+    } catch (const std::exception& e) {
+        std::cerr << "Model hot reload disabled: " << e.what() << std::endl;
+    }
     
 
     //LoadModel();
@@ -779,9 +1554,9 @@ void AppMain(int screenX,int screenY,int camX,int camY,float n,float fB) {
     gCamera.setPosition(glm::vec3(0,0,4));
     gCamera.setViewportAspectRatio((float)(screenX) / (float)(screenY));
 
-    //gLight.position = gCamera.position();
+    gLight.position = gCamera.position();
     //gLight.position = glm::vec3( 0.5f, 0.5f, -n+2);
-    //gLight.intensities = glm::vec3(1,1,1); //white
+    gLight.intensities = glm::vec3(1,1,1); //white
 
     // run while the window is open
     double lastTime = glfwGetTime();
@@ -790,6 +1565,13 @@ void AppMain(int screenX,int screenY,int camX,int camY,float n,float fB) {
         double thisTime = glfwGetTime();
         Update(thisTime - lastTime);
         lastTime = thisTime;
+
+        // stream in the models that finished loading since the last frame
+        ApplyModelChanges();
+        ApplyShaderChanges();
+        UploadFinishedTextures(TEXTURE_CREATE_BUDGET);
+        UploadFinishedModels(MODEL_UPLOAD_BUDGET);
+        gTextureUploader->update(TEXTURE_UPLOAD_BUDGET);
         
         // draw one frame
         Render();
@@ -807,6 +1589,22 @@ void AppMain(int screenX,int screenY,int camX,int camY,float n,float fB) {
     }
 
     // clean up and exit
+    delete gModelWatcher;
+    delete gModelLoader;
+    delete gImageLoader;
+    delete gTextures;
+    delete gTextureAtlas;
+    delete gTextureUploader;
+    delete gShaderWatcher;
+    delete gShaderReloader;
+    delete gShaderVariants;
+    delete gPrograms;
+    delete gFileCache;
+    delete gOcclusion;
+    if(gIndirectBuffer)
+        glDeleteBuffers(1, &gIndirectBuffer);
+    glDeleteTextures(1, &gTransformTexture);
+    glDeleteBuffers(1, &gTransformBuffer);
     glfwTerminate();
 }
 
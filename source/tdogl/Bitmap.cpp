@@ -17,86 +17,151 @@
  */
 
 #include "Bitmap.h"
+#include "ThreadPool.h"
+#include <algorithm>
 #include <stdexcept>
 
 //uses stb_image to try load files
 #define STBI_FAILURE_USERMSG
 #include <stb_image.c>
 
-using namespace tdogl;
-
-
-inline unsigned char AverageRGB(unsigned char rgb[3]) {
-    return (unsigned char)(((double)rgb[0] + (double)rgb[1] + (double)rgb[2]) / 3.0);
-}
-
-static void Grayscale2GrayscaleAlpha(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = 255;
-}
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TDOGL_BITMAP_SSE2 1
+#endif
 
-static void Grayscale2RGB(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = src[0];
-    dest[2] = src[0];
-}
-
-static void Grayscale2RGBA(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = src[0];
-    dest[2] = src[0];
-    dest[3] = 255;
-}
+using namespace tdogl;
 
-static void GrayscaleAlpha2Grayscale(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-}
 
-static void GrayscaleAlpha2RGB(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = src[0];
-    dest[2] = src[0];
-}
+/*
+ * Pixel format conversion
+ *
+ * Every pixel is converted through RGBA: the source format is widened to RGBA, and RGBA
+ * is narrowed to the destination format. Colour becomes grey with integer Rec. 601
+ * weights. With SSE2 four pixels are converted at a time, each in a 32 bit lane.
+ */
 
-static void GrayscaleAlpha2RGBA(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = src[0];
-    dest[2] = src[0];
-    dest[3] = src[1];
+// Rec. 601 luma, with weights that add up to 256
+inline unsigned char Luma(const unsigned char* rgb) {
+    return (unsigned char)((rgb[0] * 77 + rgb[1] * 150 + rgb[2] * 29 + 128) >> 8);
 }
 
-static void RGB2Grayscale(unsigned char* src, unsigned char* dest){
-    dest[0] = AverageRGB(src);
-}
+template <Bitmap::Format Src, Bitmap::Format Dest>
+inline void ConvertPixel(const unsigned char* src, unsigned char* dest) {
+    unsigned char rgba[4];
+    if(Src <= Bitmap::Format_GrayscaleAlpha){
+        rgba[0] = rgba[1] = rgba[2] = src[0];
+        rgba[3] = Src == Bitmap::Format_GrayscaleAlpha ? src[1] : 255;
+    } else {
+        rgba[0] = src[0];
+        rgba[1] = src[1];
+        rgba[2] = src[2];
+        rgba[3] = Src == Bitmap::Format_RGBA ? src[3] : 255;
+    }
 
-static void RGB2GrayscaleAlpha(unsigned char* src, unsigned char* dest){
-    dest[0] = AverageRGB(src);
-    dest[1] = 255;
+    if(Dest <= Bitmap::Format_GrayscaleAlpha){
+        dest[0] = Src <= Bitmap::Format_GrayscaleAlpha ? rgba[0] : Luma(rgba);
+        if(Dest == Bitmap::Format_GrayscaleAlpha)
+            dest[1] = rgba[3];
+    } else {
+        dest[0] = rgba[0];
+        dest[1] = rgba[1];
+        dest[2] = rgba[2];
+        if(Dest == Bitmap::Format_RGBA)
+            dest[3] = rgba[3];
+    }
 }
 
-static void RGB2RGBA(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = src[1];
-    dest[2] = src[2];
-    dest[3] = 255;
+#ifdef TDOGL_BITMAP_SSE2
+// loads four pixels of any format as RGBA, one pixel per 32 bit lane. RGB reads 16 bytes,
+// 4 more than the pixels.
+template <Bitmap::Format Src>
+inline __m128i LoadPixels(const unsigned char* src) {
+    const __m128i opaque = _mm_set1_epi32((int)0xff000000);
+    if(Src == Bitmap::Format_Grayscale){
+        int bytes;
+        memcpy(&bytes, src, 4);
+        __m128i g = _mm_cvtsi32_si128(bytes);
+        g = _mm_unpacklo_epi8(g, g);
+        return _mm_or_si128(_mm_unpacklo_epi16(g, g), opaque);
+    } else if(Src == Bitmap::Format_GrayscaleAlpha){
+        __m128i ga = _mm_loadl_epi64((const __m128i*)src);
+        __m128i g = _mm_and_si128(ga, _mm_set1_epi16(0xff));
+        return _mm_unpacklo_epi16(_mm_or_si128(g, _mm_slli_epi16(g, 8)), ga);
+    } else if(Src == Bitmap::Format_RGB){
+        //pixel k moves k bytes up, from byte 3k to byte 4k
+        const __m128i lane = _mm_setr_epi32(0xffffff, 0, 0, 0);
+        __m128i rgb = _mm_loadu_si128((const __m128i*)src);
+        __m128i rgba = _mm_or_si128(_mm_and_si128(rgb, lane),
+                                    _mm_and_si128(_mm_slli_si128(rgb, 1), _mm_slli_si128(lane, 4)));
+        rgba = _mm_or_si128(rgba, _mm_and_si128(_mm_slli_si128(rgb, 2), _mm_slli_si128(lane, 8)));
+        rgba = _mm_or_si128(rgba, _mm_and_si128(_mm_slli_si128(rgb, 3), _mm_slli_si128(lane, 12)));
+        return _mm_or_si128(rgba, opaque);
+    } else {
+        return _mm_loadu_si128((const __m128i*)src);
+    }
 }
 
-static void RGBA2Grayscale(unsigned char* src, unsigned char* dest){
-    dest[0] = AverageRGB(src);
-}
+// stores four RGBA pixels as the destination format. RGB writes 16 bytes, 4 more than the
+// pixels. Grey is the luma of the colour unless the source was grey in the first place.
+template <Bitmap::Format Src, Bitmap::Format Dest>
+inline void StorePixels(__m128i rgba, unsigned char* dest) {
+    if(Dest == Bitmap::Format_RGBA){
+        _mm_storeu_si128((__m128i*)dest, rgba);
+    } else if(Dest == Bitmap::Format_RGB){
+        //pixel k moves k bytes down, from byte 4k to byte 3k
+        const __m128i lane = _mm_setr_epi32(0xffffff, 0, 0, 0);
+        __m128i rgb = _mm_or_si128(_mm_and_si128(rgba, lane),
+                                   _mm_and_si128(_mm_srli_si128(rgba, 1), _mm_slli_si128(lane, 3)));
+        rgb = _mm_or_si128(rgb, _mm_and_si128(_mm_srli_si128(rgba, 2), _mm_slli_si128(lane, 6)));
+        rgb = _mm_or_si128(rgb, _mm_and_si128(_mm_srli_si128(rgba, 3), _mm_slli_si128(lane, 9)));
+        _mm_storeu_si128((__m128i*)dest, rgb);
+    } else {
+        const __m128i byte = _mm_set1_epi32(0xff);
+        __m128i grey;
+        if(Src <= Bitmap::Format_GrayscaleAlpha){
+            grey = _mm_and_si128(rgba, byte);
+        } else {
+            //the products and their sum fit the low 16 bits of each lane
+            __m128i r = _mm_and_si128(rgba, byte);
+            __m128i g = _mm_and_si128(_mm_srli_epi32(rgba, 8), byte);
+            __m128i b = _mm_and_si128(_mm_srli_epi32(rgba, 16), byte);
+            grey = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi32(77)),
+                                               _mm_mullo_epi16(g, _mm_set1_epi32(150))),
+                                 _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi32(29)),
+                                               _mm_set1_epi32(128)));
+            grey = _mm_srli_epi32(grey, 8);
+        }
 
-static void RGBA2GrayscaleAlpha(unsigned char* src, unsigned char* dest){
-    dest[0] = AverageRGB(src);
-    dest[1] = src[3];
+        if(Dest == Bitmap::Format_Grayscale){
+            __m128i packed = _mm_packs_epi32(grey, grey);
+            int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+            memcpy(dest, &bytes, 4);
+        } else {
+            //grey and alpha in the low 16 bits of each lane, then the lanes' low halves packed together
+            __m128i ga = _mm_or_si128(grey, _mm_slli_epi32(_mm_srli_epi32(rgba, 24), 8));
+            ga = _mm_shufflelo_epi16(ga, _MM_SHUFFLE(3, 3, 2, 0));
+            ga = _mm_shufflehi_epi16(ga, _MM_SHUFFLE(3, 3, 2, 0));
+            _mm_storel_epi64((__m128i*)dest, _mm_shuffle_epi32(ga, _MM_SHUFFLE(3, 3, 2, 0)));
+        }
+    }
 }
-
-static void RGBA2RGB(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = src[1];
-    dest[2] = src[2];
+#endif
+
+// converts `count` pixels from one row of a bitmap
+template <Bitmap::Format Src, Bitmap::Format Dest>
+static void ConvertRow(const unsigned char* src, unsigned char* dest, unsigned count) {
+    unsigned i = 0;
+#ifdef TDOGL_BITMAP_SSE2
+    //the 16 byte loads and stores of RGB go past the 4 pixels, so stop while 6 are left
+    for(; i + 6 <= count; i += 4)
+        StorePixels<Src, Dest>(LoadPixels<Src>(src + i * Src), dest + i * Dest);
+#endif
+    for(; i < count; ++i)
+        ConvertPixel<Src, Dest>(src + i * Src, dest + i * Dest);
 }
 
-typedef void(*FormatConverterFunc)(unsigned char*, unsigned char*);
+typedef void(*FormatConverterFunc)(const unsigned char*, unsigned char*, unsigned);
 
 static FormatConverterFunc ConverterFuncForFormats(Bitmap::Format srcFormat, Bitmap::Format destFormat){
     if(srcFormat == destFormat)
@@ -106,9 +171,9 @@ static FormatConverterFunc ConverterFuncForFormats(Bitmap::Format srcFormat, Bit
             
         case Bitmap::Format_Grayscale:
             switch(destFormat){
-                case Bitmap::Format_GrayscaleAlpha: return Grayscale2GrayscaleAlpha;
-                case Bitmap::Format_RGB:            return Grayscale2RGB;
-                case Bitmap::Format_RGBA:           return Grayscale2RGBA;
+                case Bitmap::Format_GrayscaleAlpha: return ConvertRow<Bitmap::Format_Grayscale, Bitmap::Format_GrayscaleAlpha>;
+                case Bitmap::Format_RGB:            return ConvertRow<Bitmap::Format_Grayscale, Bitmap::Format_RGB>;
+                case Bitmap::Format_RGBA:           return ConvertRow<Bitmap::Format_Grayscale, Bitmap::Format_RGBA>;
                 default:
                     throw std::runtime_error("Unhandled bitmap format");
             }
@@ -116,9 +181,9 @@ static FormatConverterFunc ConverterFuncForFormats(Bitmap::Format srcFormat, Bit
             
         case Bitmap::Format_GrayscaleAlpha:
             switch(destFormat){
-                case Bitmap::Format_Grayscale: return GrayscaleAlpha2Grayscale;
-                case Bitmap::Format_RGB:       return GrayscaleAlpha2RGB;
-                case Bitmap::Format_RGBA:      return GrayscaleAlpha2RGBA;
+                case Bitmap::Format_Grayscale: return ConvertRow<Bitmap::Format_GrayscaleAlpha, Bitmap::Format_Grayscale>;
+                case Bitmap::Format_RGB:       return ConvertRow<Bitmap::Format_GrayscaleAlpha, Bitmap::Format_RGB>;
+                case Bitmap::Format_RGBA:      return ConvertRow<Bitmap::Format_GrayscaleAlpha, Bitmap::Format_RGBA>;
                 default:
                     throw std::runtime_error("Unhandled bitmap format");
             }
@@ -126,9 +191,9 @@ static FormatConverterFunc ConverterFuncForFormats(Bitmap::Format srcFormat, Bit
             
         case Bitmap::Format_RGB:
             switch(destFormat){
-                case Bitmap::Format_Grayscale:      return RGB2Grayscale;
-                case Bitmap::Format_GrayscaleAlpha: return RGB2GrayscaleAlpha;
-                case Bitmap::Format_RGBA:           return RGB2RGBA;
+                case Bitmap::Format_Grayscale:      return ConvertRow<Bitmap::Format_RGB, Bitmap::Format_Grayscale>;
+                case Bitmap::Format_GrayscaleAlpha: return ConvertRow<Bitmap::Format_RGB, Bitmap::Format_GrayscaleAlpha>;
+                case Bitmap::Format_RGBA:           return ConvertRow<Bitmap::Format_RGB, Bitmap::Format_RGBA>;
                 default:
                     throw std::runtime_error("Unhandled bitmap format");
             }
@@ -136,9 +201,9 @@ static FormatConverterFunc ConverterFuncForFormats(Bitmap::Format srcFormat, Bit
             
         case Bitmap::Format_RGBA:
             switch(destFormat){
-                case Bitmap::Format_Grayscale:      return RGBA2Grayscale;
-                case Bitmap::Format_GrayscaleAlpha: return RGBA2GrayscaleAlpha;
-                case Bitmap::Format_RGB:            return RGBA2RGB;
+                case Bitmap::Format_Grayscale:      return ConvertRow<Bitmap::Format_RGBA, Bitmap::Format_Grayscale>;
+                case Bitmap::Format_GrayscaleAlpha: return ConvertRow<Bitmap::Format_RGBA, Bitmap::Format_GrayscaleAlpha>;
+                case Bitmap::Format_RGB:            return ConvertRow<Bitmap::Format_RGBA, Bitmap::Format_RGB>;
                 default:
                     throw std::runtime_error("Unhandled bitmap format");
             }
@@ -150,6 +215,106 @@ static FormatConverterFunc ConverterFuncForFormats(Bitmap::Format srcFormat, Bit
 }
 
 
+/*
+ * Flipping and rotation
+ *
+ * Both work on bands of rows. Bitmaps of ParallelBytes or more have their bands spread
+ * over the shared thread pool.
+ */
+
+static const size_t ParallelBytes = 4 << 20;
+static const unsigned FlipGrainRows = 16;
+static const unsigned RotateTileSize = 32; //pixels along each side of a tile
+static const unsigned RotateGrainRows = 2 * RotateTileSize;
+
+// swaps every row in [begin, end) with its opposite, through a buffer small enough for the stack
+static void FlipRows(unsigned char* pixels, size_t rowSize, unsigned height, unsigned begin, unsigned end) {
+    unsigned char buffer[4096];
+    for(unsigned rowIdx = begin; rowIdx < end; ++rowIdx){
+        unsigned char* row = pixels + rowIdx * rowSize;
+        unsigned char* oppositeRow = pixels + (height - rowIdx - 1) * rowSize;
+        for(size_t offset = 0; offset < rowSize; offset += sizeof(buffer)){
+            size_t size = rowSize - offset < sizeof(buffer) ? rowSize - offset : sizeof(buffer);
+            memcpy(buffer, row + offset, size);
+            memcpy(row + offset, oppositeRow + offset, size);
+            memcpy(oppositeRow + offset, buffer, size);
+        }
+    }
+}
+
+// writes the pixels of the source rows [rowBegin, rowEnd) to their places in the rotated
+// bitmap, one square tile at a time so both the rows read and the rows written stay in the
+// cache. `width` and `height` are those of the source.
+template <unsigned Size>
+static void RotateRows(const unsigned char* src, unsigned char* dest, unsigned width, unsigned height, unsigned rowBegin, unsigned rowEnd) {
+    for(unsigned tileRow = rowBegin; tileRow < rowEnd; tileRow += RotateTileSize){
+        unsigned rowLimit = std::min(tileRow + RotateTileSize, rowEnd);
+        for(unsigned tileCol = 0; tileCol < width; tileCol += RotateTileSize){
+            unsigned colLimit = std::min(tileCol + RotateTileSize, width);
+            for(unsigned col = tileCol; col < colLimit; ++col){
+                //source column `col` becomes destination row width - col - 1
+                unsigned char* out = dest + ((size_t)(width - col - 1) * height + tileRow) * Size;
+                const unsigned char* in = src + ((size_t)tileRow * width + col) * Size;
+                for(unsigned row = tileRow; row < rowLimit; ++row, out += Size, in += width * Size)
+                    memcpy(out, in, Size);
+            }
+        }
+    }
+}
+
+#ifdef TDOGL_BITMAP_SSE2
+// 4 byte pixels are moved in 4x4 blocks, transposed in registers
+template <>
+void RotateRows<4>(const unsigned char* src, unsigned char* dest, unsigned width, unsigned height, unsigned rowBegin, unsigned rowEnd) {
+    for(unsigned tileRow = rowBegin; tileRow < rowEnd; tileRow += RotateTileSize){
+        unsigned rowLimit = std::min(tileRow + RotateTileSize, rowEnd);
+        for(unsigned tileCol = 0; tileCol < width; tileCol += RotateTileSize){
+            unsigned colLimit = std::min(tileCol + RotateTileSize, width);
+            unsigned row = tileRow;
+            for(; row + 4 <= rowLimit; row += 4){
+                const float* in = (const float*)(src + ((size_t)row * width + tileCol) * 4);
+                unsigned col = tileCol;
+                for(; col + 4 <= colLimit; col += 4, in += 4){
+                    __m128 r0 = _mm_loadu_ps(in);
+                    __m128 r1 = _mm_loadu_ps(in + width);
+                    __m128 r2 = _mm_loadu_ps(in + 2 * width);
+                    __m128 r3 = _mm_loadu_ps(in + 3 * width);
+                    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                    //r0 is now column `col` of the 4 rows, which ends up furthest down
+                    float* out = (float*)(dest + ((size_t)(width - col - 1) * height + row) * 4);
+                    _mm_storeu_ps(out, r0);
+                    _mm_storeu_ps(out - height, r1);
+                    _mm_storeu_ps(out - 2 * height, r2);
+                    _mm_storeu_ps(out - 3 * height, r3);
+                }
+                for(; col < colLimit; ++col){
+                    for(unsigned r = row; r < row + 4; ++r)
+                        memcpy(dest + ((size_t)(width - col - 1) * height + r) * 4, src + ((size_t)r * width + col) * 4, 4);
+                }
+            }
+            for(; row < rowLimit; ++row){
+                for(unsigned col = tileCol; col < colLimit; ++col)
+                    memcpy(dest + ((size_t)(width - col - 1) * height + row) * 4, src + ((size_t)row * width + col) * 4, 4);
+            }
+        }
+    }
+}
+#endif
+
+typedef void(*RotateRowsFunc)(const unsigned char*, unsigned char*, unsigned, unsigned, unsigned, unsigned);
+
+static RotateRowsFunc RotateFuncForFormat(Bitmap::Format format) {
+    switch(format){
+        case Bitmap::Format_Grayscale:      return RotateRows<1>;
+        case Bitmap::Format_GrayscaleAlpha: return RotateRows<2>;
+        case Bitmap::Format_RGB:            return RotateRows<3>;
+        case Bitmap::Format_RGBA:           return RotateRows<4>;
+        default:
+            throw std::runtime_error("Unhandled bitmap format");
+    }
+}
+
+
 /*
  * Misc funcs
  */
@@ -159,15 +324,10 @@ inline unsigned GetPixelOffset(unsigned col, unsigned row, unsigned width, unsig
 }
 
 inline bool RectsOverlap(unsigned srcCol, unsigned srcRow, unsigned destCol, unsigned destRow, unsigned width, unsigned height){
+    //the rects overlap only if they overlap in both directions
     unsigned colDiff = srcCol > destCol ? srcCol - destCol : destCol - srcCol;
-    if(colDiff < width)
-        return true;
-    
     unsigned rowDiff = srcRow > destRow ? srcRow - destRow : destRow - srcRow;
-    if(rowDiff < height)
-        return true;
-    
-    return false;
+    return colDiff < width && rowDiff < height;
 }
 
 
@@ -188,14 +348,41 @@ Bitmap::~Bitmap() {
     if(_pixels) free(_pixels);
 }
 
-Bitmap Bitmap::bitmapFromFile(std::string filePath) {    
+Bitmap::Bitmap() :
+    _format(Format_RGBA),
+    _width(0),
+    _height(0),
+    _pixels(NULL)
+{
+}
+
+Bitmap Bitmap::bitmapWithPixels(unsigned width,
+                                unsigned height,
+                                Format format,
+                                unsigned char* pixels)
+{
+    if(!pixels) throw std::runtime_error("No pixels to take");
+    if(width == 0) throw std::runtime_error("Zero width bitmap");
+    if(height == 0) throw std::runtime_error("Zero height bitmap");
+    if(format <= 0 || format > 4) throw std::runtime_error("Invalid bitmap format");
+    
+    Bitmap bmp;
+    bmp._width = width;
+    bmp._height = height;
+    bmp._format = format;
+    bmp._pixels = pixels;
+    return bmp;
+}
+
+Bitmap Bitmap::bitmapFromFile(std::string filePath, bool flipVertically) {
     int width, height, channels;
+    stbi_set_flip_vertically_on_load(flipVertically ? 1 : 0);
     unsigned char* pixels = stbi_load(filePath.c_str(), &width, &height, &channels, 0);
+    stbi_set_flip_vertically_on_load(0);
     if(!pixels) throw std::runtime_error(stbi_failure_reason());
     
-    Bitmap bmp(width, height, (Format)channels, pixels);
-    stbi_image_free(pixels);
-    return bmp;
+    //stbi_image_free is free(), so the bitmap can own the decoder's buffer
+    return bitmapWithPixels(width, height, (Format)channels, pixels);
 }
 
 Bitmap::Bitmap(const Bitmap& other) :
@@ -205,7 +392,29 @@ Bitmap::Bitmap(const Bitmap& other) :
 }
 
 Bitmap& Bitmap::operator = (const Bitmap& other) {
-    _set(other._width, other._height, other._format, other._pixels);
+    if(this != &other)
+        _set(other._width, other._height, other._format, other._pixels);
+    return *this;
+}
+
+Bitmap::Bitmap(Bitmap&& other) noexcept :
+    _format(other._format),
+    _width(other._width),
+    _height(other._height),
+    _pixels(other._pixels)
+{
+    other._pixels = NULL;
+}
+
+Bitmap& Bitmap::operator = (Bitmap&& other) noexcept {
+    if(this != &other){
+        if(_pixels) free(_pixels);
+        _format = other._format;
+        _width = other._width;
+        _height = other._height;
+        _pixels = other._pixels;
+        other._pixels = NULL;
+    }
     return *this;
 }
 
@@ -238,31 +447,34 @@ void Bitmap::setPixel(unsigned int column, unsigned int row, const unsigned char
 }
 
 void Bitmap::flipVertically() {
-    unsigned long rowSize = _format*_width;
-    unsigned char* rowBuffer = new unsigned char[rowSize];
-    unsigned halfRows = _height / 2;
+    unsigned char* pixels = _pixels;
+    const size_t rowSize = (size_t)_format * _width;
+    const unsigned height = _height;
+    const unsigned halfRows = _height / 2;
     
-    for(unsigned rowIdx = 0; rowIdx < halfRows; ++rowIdx){
-        unsigned char* row = _pixels + GetPixelOffset(0, rowIdx, _width, _height, _format);
-        unsigned char* oppositeRow = _pixels + GetPixelOffset(0, _height - rowIdx - 1, _width, _height, _format);
-        
-        memcpy(rowBuffer, row, rowSize);
-        memcpy(row, oppositeRow, rowSize);
-        memcpy(oppositeRow, rowBuffer, rowSize);
+    if(rowSize * _height < ParallelBytes){
+        FlipRows(pixels, rowSize, height, 0, halfRows);
+        return;
     }
-    
-    delete rowBuffer;
+    ThreadPool::shared().parallelFor(halfRows, FlipGrainRows, [=](unsigned begin, unsigned end) {
+        FlipRows(pixels, rowSize, height, begin, end);
+    });
 }
 
 void Bitmap::rotate90CounterClockwise() {
-    unsigned char* newPixels = (unsigned char*) malloc(_format*_width*_height);
+    unsigned char* newPixels = (unsigned char*) malloc((size_t)_format*_width*_height);
+    if(!newPixels) throw std::runtime_error("Out of memory rotating bitmap");
     
-    for(unsigned row = 0; row < _height; ++row){
-        for(unsigned col = 0; col < _width; ++col){
-            unsigned srcOffset = GetPixelOffset(col, row, _width, _height, _format);
-            unsigned destOffset = GetPixelOffset(row, _width - col - 1, _height, _width, _format);
-            memcpy(newPixels + destOffset, _pixels + srcOffset, _format); //copy one pixel
-        }
+    RotateRowsFunc rotate = RotateFuncForFormat(_format);
+    const unsigned char* pixels = _pixels;
+    const unsigned width = _width;
+    const unsigned height = _height;
+    if((size_t)_format * _width * _height < ParallelBytes){
+        rotate(pixels, newPixels, width, height, 0, height);
+    } else {
+        ThreadPool::shared().parallelFor(height, RotateGrainRows, [=](unsigned begin, unsigned end) {
+            rotate(pixels, newPixels, width, height, begin, end);
+        });
     }
     
     free(_pixels);
@@ -289,10 +501,10 @@ void Bitmap::copyRectFromBitmap(const Bitmap& src,
     if(width == 0 || height == 0)
         throw std::runtime_error("Can't copy zero height/width rectangle");
     
-    if(srcCol + width >= src.width() || srcRow + height >= src.height())
+    if(srcCol + width > src.width() || srcRow + height > src.height())
         throw std::runtime_error("Rectangle doesn't fit within source bitmap");
 
-    if(destCol + width >= _width || destRow + height >= _height)
+    if(destCol + width > _width || destRow + height > _height)
         throw std::runtime_error("Rectangle doesn't fit within destination bitmap");
     
     if(_pixels == src._pixels && RectsOverlap(srcCol, srcRow, destCol, destRow, width, height))
@@ -300,18 +512,16 @@ void Bitmap::copyRectFromBitmap(const Bitmap& src,
     
     FormatConverterFunc converter = NULL;
     if(_format != src._format)
-        converter = ConverterFuncForFormats(_format, src._format);
+        converter = ConverterFuncForFormats(src._format, _format);
     
     for(unsigned row = 0; row < height; ++row){
-        for(unsigned col = 0; col < width; ++col){
-            unsigned char* srcPixel = src._pixels + GetPixelOffset(srcCol + col, srcRow + row, src._width, src._height, src._format);
-            unsigned char* destPixel = _pixels + GetPixelOffset(destCol + col, destRow + row, _width, _height, _format);
-            
-            if(converter){
-                converter(srcPixel, destPixel);
-            } else {
-                memcpy(destPixel, srcPixel, _format);
-            }
+        const unsigned char* srcPixels = src._pixels + GetPixelOffset(srcCol, srcRow + row, src._width, src._height, src._format);
+        unsigned char* destPixels = _pixels + GetPixelOffset(destCol, destRow + row, _width, _height, _format);
+        
+        if(converter){
+            converter(srcPixels, destPixels, width);
+        } else {
+            memcpy(destPixels, srcPixels, width * _format);
         }
     }
 }
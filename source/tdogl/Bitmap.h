@@ -54,10 +54,24 @@ namespace tdogl {
                const unsigned char* pixels = NULL);
         ~Bitmap();
         
+        /**
+         Makes a bitmap that takes ownership of `pixels` instead of copying them. The pixels
+         must have been allocated with malloc (stb_image allocates that way), and are freed
+         when the bitmap is.
+         */
+        static Bitmap bitmapWithPixels(unsigned width,
+                                       unsigned height,
+                                       Format format,
+                                       unsigned char* pixels);
+        
         /**
          Tries to load the given file into a tdogl::Bitmap.
+         
+         The decoded pixels are used as they are, without being copied. If flipVertically is
+         true the rows are decoded bottom to top, which is the order tdogl::Texture wants,
+         so there is no need to call `flipVertically` afterwards.
          */
-        static Bitmap bitmapFromFile(std::string filePath);
+        static Bitmap bitmapFromFile(std::string filePath, bool flipVertically = false);
                 
         /** width in pixels */
         unsigned width() const;
@@ -94,11 +108,15 @@ namespace tdogl {
         
         /**
          Reverses the row order of the pixels, so the bitmap will be upside down.
+         
+         Big bitmaps are split into bands of rows on tdogl::ThreadPool::shared().
          */
         void flipVertically();
         
         /**
          Rotates the image 90 degrees counter clockwise.
+         
+         Like `flipVertically`, big bitmaps are rotated on the shared thread pool.
          */
         void rotate90CounterClockwise();
         
@@ -129,12 +147,19 @@ namespace tdogl {
         /** Assignment operator */
         Bitmap& operator = (const Bitmap& other);
         
+        /** Move constructor. Takes the pixels of `other`, which can only be destroyed or assigned to afterwards. */
+        Bitmap(Bitmap&& other) noexcept;
+        
+        /** Move assignment operator */
+        Bitmap& operator = (Bitmap&& other) noexcept;
+        
     private:
         Format _format;
         unsigned _width;
         unsigned _height;
         unsigned char* _pixels;
         
+        Bitmap();
         void _set(unsigned width, unsigned height, Format format, const unsigned char* pixels);
         static void _getPixelOffset(unsigned col, unsigned row, unsigned width, unsigned height, Format format);
     };
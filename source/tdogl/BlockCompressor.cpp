@@ -0,0 +1,493 @@
+/*
+ tdogl::BlockCompressor
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "BlockCompressor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+using namespace tdogl;
+
+static const uint32_t BlockCacheVersion = 1;
+static const unsigned GrainBlockRows = 4;
+static const unsigned PowerIterations = 8;
+
+// BC7 weights of the 16 palette entries, out of 64
+static const int Bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+unsigned CompressedImage::blockSize(Format format) {
+    return format == Format_BC1 ? 8 : 16;
+}
+
+// the 16 pixels of the block at (blockCol, blockRow) of an RGBA bitmap, repeating the last
+// column and row past the edges
+static void FetchBlock(const Bitmap& rgba, unsigned blockCol, unsigned blockRow, float pixels[16][4]) {
+    for(unsigned y = 0; y < 4; ++y){
+        unsigned row = std::min(blockRow * 4 + y, rgba.height() - 1);
+        for(unsigned x = 0; x < 4; ++x){
+            const unsigned char* pixel = rgba.getPixel(std::min(blockCol * 4 + x, rgba.width() - 1), row);
+            for(int c = 0; c < 4; ++c)
+                pixels[y * 4 + x][c] = pixel[c];
+        }
+    }
+}
+
+// the endpoints of the pixels' extent along their principal axis, from power iteration on
+// the covariance of the first `channels` channels
+static void AxisEndpoints(const float pixels[16][4], int channels, float endpoints[2][4]) {
+    float mean[4] = {}, low[4], high[4];
+    for(int c = 0; c < channels; ++c){
+        low[c] = high[c] = pixels[0][c];
+        for(int i = 0; i < 16; ++i){
+            mean[c] += pixels[i][c];
+            low[c] = std::min(low[c], pixels[i][c]);
+            high[c] = std::max(high[c], pixels[i][c]);
+        }
+        mean[c] /= 16.0f;
+    }
+
+    float covariance[4][4] = {};
+    for(int i = 0; i < 16; ++i){
+        for(int a = 0; a < channels; ++a){
+            for(int b = 0; b < channels; ++b)
+                covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+        }
+    }
+
+    //start along the diagonal of the bounding box, which is usually close already
+    float axis[4];
+    for(int c = 0; c < channels; ++c)
+        axis[c] = high[c] - low[c];
+    for(unsigned iteration = 0; iteration < PowerIterations; ++iteration){
+        float next[4] = {}, length = 0.0f;
+        for(int a = 0; a < channels; ++a){
+            for(int b = 0; b < channels; ++b)
+                next[a] += covariance[a][b] * axis[b];
+            length = std::max(length, std::fabs(next[a]));
+        }
+        if(length <= 0.0f)
+            break;
+        for(int c = 0; c < channels; ++c)
+            axis[c] = next[c] / length;
+    }
+
+    float lengthSquared = 0.0f;
+    for(int c = 0; c < channels; ++c)
+        lengthSquared += axis[c] * axis[c];
+    if(lengthSquared <= 0.0f){
+        //every pixel is the same
+        for(int c = 0; c < channels; ++c)
+            endpoints[0][c] = endpoints[1][c] = mean[c];
+        return;
+    }
+
+    float lowest = 1e30f, highest = -1e30f;
+    for(int i = 0; i < 16; ++i){
+        float t = 0.0f;
+        for(int c = 0; c < channels; ++c)
+            t += (pixels[i][c] - mean[c]) * axis[c];
+        lowest = std::min(lowest, t);
+        highest = std::max(highest, t);
+    }
+    for(int c = 0; c < channels; ++c){
+        endpoints[0][c] = std::min(255.0f, std::max(0.0f, mean[c] + lowest * axis[c] / lengthSquared));
+        endpoints[1][c] = std::min(255.0f, std::max(0.0f, mean[c] + highest * axis[c] / lengthSquared));
+    }
+}
+
+// picks the nearest palette entry for every pixel, and returns the total squared error
+static float SelectIndices(const float pixels[16][4], int channels, const float (*palette)[4], int paletteSize, unsigned char indices[16]) {
+    float total = 0.0f;
+    for(int i = 0; i < 16; ++i){
+        float best = 1e30f;
+        for(int p = 0; p < paletteSize; ++p){
+            float error = 0.0f;
+            for(int c = 0; c < channels; ++c){
+                float d = pixels[i][c] - palette[p][c];
+                error += d * d;
+            }
+            if(error < best){
+                best = error;
+                indices[i] = (unsigned char)p;
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+// the endpoints that best fit the pixels, by least squares, when pixel i is
+// endpoint 0 * (1 - weights[indices[i]]) + endpoint 1 * weights[indices[i]].
+// Returns false if the indices don't pin the endpoints down.
+static bool FitEndpoints(const float pixels[16][4], int channels, const float* weights, const unsigned char indices[16], float endpoints[2][4]) {
+    float a = 0.0f, b = 0.0f, c = 0.0f, x0[4] = {}, x1[4] = {};
+    for(int i = 0; i < 16; ++i){
+        float w = weights[indices[i]];
+        a += (1.0f - w) * (1.0f - w);
+        b += (1.0f - w) * w;
+        c += w * w;
+        for(int ch = 0; ch < channels; ++ch){
+            x0[ch] += (1.0f - w) * pixels[i][ch];
+            x1[ch] += w * pixels[i][ch];
+        }
+    }
+    float determinant = a * c - b * b;
+    if(std::fabs(determinant) < 1e-6f)
+        return false;
+    for(int ch = 0; ch < channels; ++ch){
+        endpoints[0][ch] = std::min(255.0f, std::max(0.0f, (c * x0[ch] - b * x1[ch]) / determinant));
+        endpoints[1][ch] = std::min(255.0f, std::max(0.0f, (a * x1[ch] - b * x0[ch]) / determinant));
+    }
+    return true;
+}
+
+/*
+ * BC1 colour blocks
+ */
+
+static unsigned short PackRGB565(const float color[4]) {
+    unsigned r = (unsigned)(color[0] * 31.0f / 255.0f + 0.5f);
+    unsigned g = (unsigned)(color[1] * 63.0f / 255.0f + 0.5f);
+    unsigned b = (unsigned)(color[2] * 31.0f / 255.0f + 0.5f);
+    return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(unsigned short packed, float color[4]) {
+    unsigned r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (float)((r << 3) | (r >> 2));
+    color[1] = (float)((g << 2) | (g >> 4));
+    color[2] = (float)((b << 3) | (b >> 2));
+}
+
+// palette index order of BC1's four colour mode: the endpoints, then the thirds between them
+static const float Bc1Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+// quantises the endpoints, and returns the error of the block with them
+static float TryBc1(const float pixels[16][4], const float endpoints[2][4], unsigned short colors[2], unsigned char indices[16]) {
+    colors[0] = PackRGB565(endpoints[0]);
+    colors[1] = PackRGB565(endpoints[1]);
+    //the four colour mode needs color0 > color1
+    if(colors[0] < colors[1])
+        std::swap(colors[0], colors[1]);
+
+    float palette[4][4];
+    UnpackRGB565(colors[0], palette[0]);
+    UnpackRGB565(colors[1], palette[1]);
+    if(colors[0] == colors[1]){
+        memset(indices, 0, 16);
+        return SelectIndices(pixels, 3, palette, 1, indices);
+    }
+    for(int p = 2; p < 4; ++p){
+        for(int c = 0; c < 3; ++c)
+            palette[p][c] = palette[0][c] + (palette[1][c] - palette[0][c]) * Bc1Weights[p];
+    }
+    return SelectIndices(pixels, 3, palette, 4, indices);
+}
+
+static void EncodeBc1(const float pixels[16][4], unsigned char* out) {
+    float endpoints[2][4];
+    AxisEndpoints(pixels, 3, endpoints);
+
+    unsigned short colors[2];
+    unsigned char indices[16];
+    float error = TryBc1(pixels, endpoints, colors, indices);
+
+    //refit to the indices the principal axis gave, and keep it if it's better
+    unsigned short refitColors[2];
+    unsigned char refitIndices[16];
+    if(colors[0] != colors[1] && FitEndpoints(pixels, 3, Bc1Weights, indices, endpoints) &&
+       TryBc1(pixels, endpoints, refitColors, refitIndices) < error)
+    {
+        memcpy(colors, refitColors, sizeof(colors));
+        memcpy(indices, refitIndices, sizeof(indices));
+    }
+
+    uint32_t bits = 0;
+    for(int i = 0; i < 16; ++i)
+        bits |= (uint32_t)indices[i] << (2 * i);
+    out[0] = (unsigned char)colors[0];
+    out[1] = (unsigned char)(colors[0] >> 8);
+    out[2] = (unsigned char)colors[1];
+    out[3] = (unsigned char)(colors[1] >> 8);
+    for(int i = 0; i < 4; ++i)
+        out[4 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+/*
+ * BC3 alpha blocks
+ */
+
+static void EncodeBc3Alpha(const float pixels[16][4], unsigned char* out) {
+    float low = 255.0f, high = 0.0f;
+    for(int i = 0; i < 16; ++i){
+        low = std::min(low, pixels[i][3]);
+        high = std::max(high, pixels[i][3]);
+    }
+    int alpha0 = (int)(high + 0.5f), alpha1 = (int)(low + 0.5f);
+
+    //with alpha0 > alpha1 the palette is both endpoints, then 6 steps from alpha0 to alpha1
+    float palette[8][4];
+    palette[0][0] = (float)alpha0;
+    palette[1][0] = (float)alpha1;
+    for(int p = 2; p < 8; ++p)
+        palette[p][0] = (float)(((8 - p) * alpha0 + (p - 1) * alpha1) / 7);
+
+    float alphas[16][4];
+    for(int i = 0; i < 16; ++i)
+        alphas[i][0] = pixels[i][3];
+    unsigned char indices[16] = {};
+    if(alpha0 != alpha1)
+        SelectIndices(alphas, 1, palette, 8, indices);
+
+    uint64_t bits = 0;
+    for(int i = 0; i < 16; ++i)
+        bits |= (uint64_t)indices[i] << (3 * i);
+    out[0] = (unsigned char)alpha0;
+    out[1] = (unsigned char)alpha1;
+    for(int i = 0; i < 6; ++i)
+        out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+static void EncodeBc3(const float pixels[16][4], unsigned char* out) {
+    EncodeBc3Alpha(pixels, out);
+    EncodeBc1(pixels, out + 8);
+}
+
+/*
+ * BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a p-bit each, 4 bit indices
+ */
+
+// the 7 bit endpoint and p-bit nearest to an RGBA colour
+static void QuantizeBc7(const float color[4], int quantized[4], int& pBit) {
+    float bestError = 1e30f;
+    for(int p = 0; p < 2; ++p){
+        int q[4];
+        float error = 0.0f;
+        for(int c = 0; c < 4; ++c){
+            q[c] = std::min(127, std::max(0, (int)std::floor((color[c] - p) / 2.0f + 0.5f)));
+            float d = (float)(q[c] * 2 + p) - color[c];
+            error += d * d;
+        }
+        if(error < bestError){
+            bestError = error;
+            pBit = p;
+            memcpy(quantized, q, sizeof(q));
+        }
+    }
+}
+
+static float TryBc7(const float pixels[16][4], const float endpoints[2][4], int quantized[2][4], int pBits[2], unsigned char indices[16]) {
+    QuantizeBc7(endpoints[0], quantized[0], pBits[0]);
+    QuantizeBc7(endpoints[1], quantized[1], pBits[1]);
+
+    float palette[16][4];
+    for(int p = 0; p < 16; ++p){
+        for(int c = 0; c < 4; ++c){
+            int e0 = quantized[0][c] * 2 + pBits[0], e1 = quantized[1][c] * 2 + pBits[1];
+            palette[p][c] = (float)(((64 - Bc7Weights[p]) * e0 + Bc7Weights[p] * e1 + 32) >> 6);
+        }
+    }
+    return SelectIndices(pixels, 4, palette, 16, indices);
+}
+
+// appends the low `count` bits of value to a 128 bit block, least significant bit first
+static void PutBits(unsigned char* block, unsigned& position, unsigned value, unsigned count) {
+    for(unsigned i = 0; i < count; ++i, ++position){
+        if(value & (1u << i))
+            block[position / 8] |= (unsigned char)(1u << (position % 8));
+    }
+}
+
+static void EncodeBc7(const float pixels[16][4], unsigned char* out) {
+    float weights[16];
+    for(int p = 0; p < 16; ++p)
+        weights[p] = Bc7Weights[p] / 64.0f;
+
+    float endpoints[2][4];
+    AxisEndpoints(pixels, 4, endpoints);
+
+    int quantized[2][4], pBits[2];
+    unsigned char indices[16];
+    float error = TryBc7(pixels, endpoints, quantized, pBits, indices);
+
+    int refitQuantized[2][4], refitPBits[2];
+    unsigned char refitIndices[16];
+    if(FitEndpoints(pixels, 4, weights, indices, endpoints) &&
+       TryBc7(pixels, endpoints, refitQuantized, refitPBits, refitIndices) < error)
+    {
+        memcpy(quantized, refitQuantized, sizeof(quantized));
+        memcpy(pBits, refitPBits, sizeof(pBits));
+        memcpy(indices, refitIndices, sizeof(indices));
+    }
+
+    //the first index is stored without its top bit, so it must be below 8
+    if(indices[0] >= 8){
+        for(int c = 0; c < 4; ++c)
+            std::swap(quantized[0][c], quantized[1][c]);
+        std::swap(pBits[0], pBits[1]);
+        for(int i = 0; i < 16; ++i)
+            indices[i] = (unsigned char)(15 - indices[i]);
+    }
+
+    memset(out, 0, 16);
+    unsigned position = 0;
+    PutBits(out, position, 1u << 6, 7); //mode 6
+    for(int c = 0; c < 4; ++c){
+        PutBits(out, position, quantized[0][c], 7);
+        PutBits(out, position, quantized[1][c], 7);
+    }
+    PutBits(out, position, pBits[0], 1);
+    PutBits(out, position, pBits[1], 1);
+    PutBits(out, position, indices[0], 3);
+    for(int i = 1; i < 16; ++i)
+        PutBits(out, position, indices[i], 4);
+}
+
+/*
+ * BlockCompressor
+ */
+
+BlockCompressor::BlockCompressor(ThreadPool& pool, FileCache* cache) :
+    _pool(pool),
+    _cache(cache)
+{
+}
+
+CompressedImage::Format BlockCompressor::formatFor(const Bitmap& bitmap, bool allowBC7) {
+    bool opaque = true;
+    if(bitmap.format() == Bitmap::Format_GrayscaleAlpha || bitmap.format() == Bitmap::Format_RGBA){
+        const unsigned char* pixels = bitmap.pixelBuffer();
+        const size_t size = (size_t)bitmap.width() * bitmap.height() * bitmap.format();
+        for(size_t i = bitmap.format() - 1; i < size && opaque; i += bitmap.format())
+            opaque = pixels[i] == 255;
+    }
+    if(opaque)
+        return CompressedImage::Format_BC1;
+    return allowBC7 ? CompressedImage::Format_BC7 : CompressedImage::Format_BC3;
+}
+
+CompressedImage::Level BlockCompressor::compress(const Bitmap& bitmap, CompressedImage::Format format) const {
+    //the encoders read RGBA
+    const Bitmap* rgba = &bitmap;
+    Bitmap converted(bitmap.width(), bitmap.height(), Bitmap::Format_RGBA);
+    if(bitmap.format() != Bitmap::Format_RGBA){
+        converted.copyRectFromBitmap(bitmap, 0, 0, 0, 0, 0, 0);
+        rgba = &converted;
+    }
+
+    const unsigned blockCols = (bitmap.width() + 3) / 4, blockRows = (bitmap.height() + 3) / 4;
+    const unsigned blockSize = CompressedImage::blockSize(format);
+    CompressedImage::Level level;
+    level.width = bitmap.width();
+    level.height = bitmap.height();
+    level.blocks.resize((size_t)blockCols * blockRows * blockSize);
+
+    unsigned char* blocks = &level.blocks[0];
+    _pool.parallelFor(blockRows, GrainBlockRows, [=](unsigned begin, unsigned end) {
+        float pixels[16][4];
+        for(unsigned row = begin; row < end; ++row){
+            for(unsigned col = 0; col < blockCols; ++col){
+                FetchBlock(*rgba, col, row, pixels);
+                unsigned char* out = blocks + ((size_t)row * blockCols + col) * blockSize;
+                switch(format){
+                    case CompressedImage::Format_BC1: EncodeBc1(pixels, out); break;
+                    case CompressedImage::Format_BC3: EncodeBc3(pixels, out); break;
+                    case CompressedImage::Format_BC7: EncodeBc7(pixels, out); break;
+                }
+            }
+        }
+    });
+    return level;
+}
+
+std::string BlockCompressor::_cacheKey(const std::string& filePath, bool allowBC7) const {
+    uint64_t hash = FileCache::hash(&BlockCacheVersion, sizeof(BlockCacheVersion));
+    hash = FileCache::hash(&allowBC7, sizeof(allowBC7), hash);
+    hash = FileCache::hash(filePath.data(), filePath.size(), hash);
+    if(!_cache || !FileCache::hashFile(filePath, hash, hash))
+        return "";
+    return FileCache::key(hash, ".blocks");
+}
+
+CompressedImage BlockCompressor::compressForFile(const std::string& filePath,
+                                                 bool allowBC7,
+                                                 const Bitmap& level0,
+                                                 const std::vector<Bitmap>& mipmaps) const
+{
+    CompressedImage image;
+    image.format = formatFor(level0, allowBC7);
+    image.levels.push_back(compress(level0, image.format));
+    for(size_t i = 0; i < mipmaps.size(); ++i)
+        image.levels.push_back(compress(mipmaps[i], image.format));
+
+    const std::string key = _cacheKey(filePath, allowBC7);
+    if(key.empty())
+        return image;
+
+    //the format and the number of levels, then the size and blocks of each level
+    std::vector<uint32_t> header;
+    header.push_back((uint32_t)image.format);
+    header.push_back((uint32_t)image.levels.size());
+    for(size_t i = 0; i < image.levels.size(); ++i){
+        header.push_back(image.levels[i].width);
+        header.push_back(image.levels[i].height);
+    }
+    std::vector<unsigned char> blob((const unsigned char*)&header[0], (const unsigned char*)&header[0] + header.size() * sizeof(uint32_t));
+    for(size_t i = 0; i < image.levels.size(); ++i)
+        blob.insert(blob.end(), image.levels[i].blocks.begin(), image.levels[i].blocks.end());
+    if(!_cache->write(key, blob))
+        std::cerr << "Can't write " << key << " to the cache" << std::endl;
+    return image;
+}
+
+bool BlockCompressor::readCached(const std::string& filePath, bool allowBC7, CompressedImage& image) const {
+    const std::string key = _cacheKey(filePath, allowBC7);
+    std::vector<unsigned char> blob;
+    if(key.empty() || !_cache->read(key, blob))
+        return false;
+
+    uint32_t format, levelCount;
+    if(blob.size() < 2 * sizeof(uint32_t))
+        return false;
+    memcpy(&format, &blob[0], sizeof(format));
+    memcpy(&levelCount, &blob[sizeof(format)], sizeof(levelCount));
+    size_t offset = (2 + 2 * (size_t)levelCount) * sizeof(uint32_t);
+    if(format > CompressedImage::Format_BC7 || levelCount == 0 || offset > blob.size())
+        return false;
+
+    image.format = (CompressedImage::Format)format;
+    image.levels.resize(levelCount);
+    for(uint32_t i = 0; i < levelCount; ++i){
+        CompressedImage::Level& level = image.levels[i];
+        memcpy(&level.width, &blob[(2 + 2 * i) * sizeof(uint32_t)], sizeof(uint32_t));
+        memcpy(&level.height, &blob[(3 + 2 * i) * sizeof(uint32_t)], sizeof(uint32_t));
+        size_t size = (size_t)((level.width + 3) / 4) * ((level.height + 3) / 4) * CompressedImage::blockSize(image.format);
+        if(offset + size > blob.size())
+            return false;
+        level.blocks.assign(blob.begin() + offset, blob.begin() + offset + size);
+        offset += size;
+    }
+    if(offset != blob.size()){
+        std::cerr << "Ignoring cached blocks of " << filePath << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,105 @@
+/*
+ tdogl::BlockCompressor
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Bitmap.h"
+#include "FileCache.h"
+#include "ThreadPool.h"
+
+namespace tdogl {
+
+    /**
+     An image and its mipmap levels in a block compressed format, ready for
+     glCompressedTexImage2D.
+     */
+    struct CompressedImage {
+        enum Format {
+            Format_BC1, /**< 8 bytes per 4x4 block: RGB without alpha (DXT1) */
+            Format_BC3, /**< 16 bytes per 4x4 block: BC1 colour plus 8 bit interpolated alpha (DXT5) */
+            Format_BC7  /**< 16 bytes per 4x4 block: RGBA with 7 bit endpoints, here always mode 6 */
+        };
+
+        struct Level {
+            unsigned width;
+            unsigned height;
+            std::vector<unsigned char> blocks; //block rows from the top down, blocks left to right
+        };
+
+        Format format;
+        std::vector<Level> levels; //level 0 first
+
+        /** bytes per 4x4 block */
+        static unsigned blockSize(Format format);
+    };
+
+    /**
+     Encodes bitmaps into BC1, BC3 or BC7 blocks on the CPU, so textures take a quarter
+     (BC3, BC7) to a sixth (BC1 from RGB) of the memory and bandwidth of raw pixels.
+
+     Each block's endpoints lie on the principal axis of its colours, and are then refined
+     by least squares for the chosen indices. The block rows of each level are split over
+     the thread pool. Nothing here uses OpenGL.
+     */
+    class BlockCompressor {
+    public:
+        /**
+         @param pool   The pool the blocks are encoded on
+         @param cache  Where to keep the compressed images of files. May be NULL.
+         */
+        explicit BlockCompressor(ThreadPool& pool, FileCache* cache = NULL);
+
+        /**
+         BC1 for bitmaps without alpha or whose alpha is all 255, otherwise BC7 if allowed
+         and BC3 if not.
+         */
+        static CompressedImage::Format formatFor(const Bitmap& bitmap, bool allowBC7);
+
+        /**
+         Encodes one bitmap. Sizes that aren't a multiple of 4 repeat their last column and
+         row to fill the edge blocks.
+         */
+        CompressedImage::Level compress(const Bitmap& bitmap, CompressedImage::Format format) const;
+
+        /**
+         Encodes a file's bitmap and its mipmaps in the format from `formatFor`, and keeps
+         the result in the cache. `level0` must be loaded from the file the same way every
+         time (e.g. always flipped).
+         */
+        CompressedImage compressForFile(const std::string& filePath,
+                                        bool allowBC7,
+                                        const Bitmap& level0,
+                                        const std::vector<Bitmap>& mipmaps) const;
+
+        /**
+         Reads what `compressForFile` cached for a file, without decoding the file.
+
+         @result false if the file has changed or was never compressed with this `allowBC7`
+         */
+        bool readCached(const std::string& filePath, bool allowBC7, CompressedImage& image) const;
+
+    private:
+        ThreadPool& _pool;
+        FileCache* _cache;
+
+        std::string _cacheKey(const std::string& filePath, bool allowBC7) const;
+    };
+
+}
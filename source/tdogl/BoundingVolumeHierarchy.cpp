@@ -0,0 +1,321 @@
+/*
+ tdogl::BoundingVolumeHierarchy
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "BoundingVolumeHierarchy.h"
+#include <algorithm>
+#include <cfloat>
+
+using namespace tdogl;
+
+static const unsigned SahBins = 16;
+static const unsigned NoParent = ~0u;
+
+BoundingBox::BoundingBox() :
+    low(FLT_MAX),
+    high(-FLT_MAX)
+{
+}
+
+BoundingBox::BoundingBox(const glm::vec3& low, const glm::vec3& high) :
+    low(low),
+    high(high)
+{
+}
+
+void BoundingBox::add(const BoundingBox& box) {
+    low = glm::min(low, box.low);
+    high = glm::max(high, box.high);
+}
+
+void BoundingBox::add(const glm::vec3& point) {
+    low = glm::min(low, point);
+    high = glm::max(high, point);
+}
+
+glm::vec3 BoundingBox::center() const {
+    return (low + high) * 0.5f;
+}
+
+float BoundingBox::halfArea() const {
+    glm::vec3 size = high - low;
+    if(size.x < 0.0f || size.y < 0.0f || size.z < 0.0f)
+        return 0.0f;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+// distance along the ray where it enters the box, or false if it misses the box
+static bool IntersectRay(const BoundingBox& box,
+                         const glm::vec3& origin,
+                         const glm::vec3& inverseDirection,
+                         float maxDistance,
+                         float& distance)
+{
+    glm::vec3 t0 = (box.low - origin) * inverseDirection;
+    glm::vec3 t1 = (box.high - origin) * inverseDirection;
+    glm::vec3 entries = glm::min(t0, t1), exits = glm::max(t0, t1);
+    float enter = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+    float leave = std::min(std::min(exits.x, exits.y), std::min(exits.z, maxDistance));
+    distance = enter;
+    return enter <= leave;
+}
+
+// true if the whole box is on the inside of every plane of the frustum
+static bool ContainsBox(const Frustum& frustum, const BoundingBox& box) {
+    for(int i = 0; i < Frustum::PlaneCount; ++i){
+        //the corner least far along the plane's normal
+        const glm::vec4& p = frustum.plane((Frustum::Plane)i);
+        glm::vec3 corner(p.x >= 0.0f ? box.low.x : box.high.x,
+                         p.y >= 0.0f ? box.low.y : box.high.y,
+                         p.z >= 0.0f ? box.low.z : box.high.z);
+        if(p.x * corner.x + p.y * corner.y + p.z * corner.z + p.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+{
+}
+
+void BoundingVolumeHierarchy::build(const std::vector<BoundingBox>& boxes) {
+    const unsigned count = (unsigned)boxes.size();
+    _boxes = boxes;
+    _nodes.clear();
+    _items.resize(count);
+    _leaves.resize(count);
+    for(unsigned i = 0; i < count; ++i)
+        _items[i] = i;
+    if(count == 0)
+        return;
+
+    //a binary tree with at least one item per leaf never has more nodes than this, so the
+    //references into _nodes stay valid while it grows
+    _nodes.reserve(2 * count);
+    Node root;
+    root.parent = NoParent;
+    root.first = 0;
+    root.count = count;
+    _nodes.push_back(root);
+
+    std::vector<unsigned> stack(1, 0);
+    while(!stack.empty()){
+        unsigned index = stack.back();
+        stack.pop_back();
+        Node& node = _nodes[index];
+
+        BoundingBox centers;
+        node.box = BoundingBox();
+        for(unsigned i = node.first; i < node.first + node.count; ++i){
+            node.box.add(_boxes[_items[i]]);
+            centers.add(_boxes[_items[i]].center());
+        }
+
+        if(node.count <= MaxLeafItems){
+            for(unsigned i = node.first; i < node.first + node.count; ++i)
+                _leaves[_items[i]] = index;
+            continue;
+        }
+
+        unsigned leftCount = _split(node.first, node.count, centers);
+        Node left, right;
+        left.parent = right.parent = index;
+        left.first = node.first;
+        left.count = leftCount;
+        right.first = node.first + leftCount;
+        right.count = node.count - leftCount;
+
+        node.first = (unsigned)_nodes.size();
+        node.count = 0;
+        stack.push_back(node.first);
+        stack.push_back(node.first + 1);
+        _nodes.push_back(left);
+        _nodes.push_back(right);
+    }
+}
+
+// reorders _items[first, first + count) into two parts at the cheapest split of the surface
+// area heuristic, tried at SahBins planes along each axis. Returns the size of the first part.
+unsigned BoundingVolumeHierarchy::_split(unsigned first, unsigned count, const BoundingBox& centers) {
+    glm::vec3 extent = centers.high - centers.low;
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    unsigned bestBin = 0;
+
+    for(int axis = 0; axis < 3; ++axis){
+        if(extent[axis] <= 0.0f)
+            continue;
+        const float scale = SahBins / extent[axis];
+
+        BoundingBox bins[SahBins];
+        unsigned binCounts[SahBins] = {};
+        for(unsigned i = first; i < first + count; ++i){
+            const BoundingBox& box = _boxes[_items[i]];
+            unsigned bin = std::min(SahBins - 1, (unsigned)((box.center()[axis] - centers.low[axis]) * scale));
+            bins[bin].add(box);
+            binCounts[bin]++;
+        }
+
+        //the boxes right of each plane, then sweep from the left
+        float rightAreas[SahBins];
+        unsigned rightCounts[SahBins];
+        BoundingBox right;
+        unsigned rightCount = 0;
+        for(unsigned b = SahBins - 1; b > 0; --b){
+            right.add(bins[b]);
+            rightCount += binCounts[b];
+            rightAreas[b] = right.halfArea();
+            rightCounts[b] = rightCount;
+        }
+
+        BoundingBox left;
+        unsigned leftCount = 0;
+        for(unsigned b = 1; b < SahBins; ++b){
+            left.add(bins[b - 1]);
+            leftCount += binCounts[b - 1];
+            if(leftCount == 0 || rightCounts[b] == 0)
+                continue;
+            float cost = left.halfArea() * leftCount + rightAreas[b] * rightCounts[b];
+            if(cost < bestCost){
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    //all the centres are in the same place: any split is as good as another
+    if(bestAxis < 0)
+        return count / 2;
+
+    const float scale = SahBins / extent[bestAxis];
+    const float low = centers.low[bestAxis];
+    const std::vector<BoundingBox>& boxes = _boxes;
+    unsigned* middle = std::partition(&_items[first], &_items[first] + count, [&](unsigned item) {
+        return std::min(SahBins - 1, (unsigned)((boxes[item].center()[bestAxis] - low) * scale)) < bestBin;
+    });
+    return (unsigned)(middle - &_items[first]);
+}
+
+unsigned BoundingVolumeHierarchy::size() const {
+    return (unsigned)_boxes.size();
+}
+
+void BoundingVolumeHierarchy::refit(unsigned item, const BoundingBox& box) {
+    _boxes[item] = box;
+
+    unsigned index = _leaves[item];
+    Node& leaf = _nodes[index];
+    leaf.box = BoundingBox();
+    for(unsigned i = leaf.first; i < leaf.first + leaf.count; ++i)
+        leaf.box.add(_boxes[_items[i]]);
+
+    //stop as soon as a node doesn't change, because then nothing above it does either
+    for(index = leaf.parent; index != NoParent; index = _nodes[index].parent){
+        Node& node = _nodes[index];
+        BoundingBox fitted = _nodes[node.first].box;
+        fitted.add(_nodes[node.first + 1].box);
+        if(fitted.low == node.box.low && fitted.high == node.box.high)
+            break;
+        node.box = fitted;
+    }
+}
+
+void BoundingVolumeHierarchy::queryFrustum(const Frustum& frustum, std::vector<unsigned>& items) const {
+    if(_nodes.empty())
+        return;
+
+    //nodes completely inside the frustum take all their items without any more tests
+    std::vector<std::pair<unsigned, bool> > stack;
+    stack.reserve(64);
+    stack.push_back(std::make_pair(0u, false));
+    while(!stack.empty()){
+        const Node& node = _nodes[stack.back().first];
+        bool inside = stack.back().second;
+        stack.pop_back();
+        if(!inside){
+            if(!frustum.intersectsBox(node.box.low, node.box.high))
+                continue;
+            inside = ContainsBox(frustum, node.box);
+        }
+
+        if(node.count == 0){
+            stack.push_back(std::make_pair(node.first, inside));
+            stack.push_back(std::make_pair(node.first + 1, inside));
+            continue;
+        }
+
+        for(unsigned i = node.first; i < node.first + node.count; ++i){
+            const BoundingBox& box = _boxes[_items[i]];
+            if(inside || node.count == 1 || frustum.intersectsBox(box.low, box.high))
+                items.push_back(_items[i]);
+        }
+    }
+}
+
+bool BoundingVolumeHierarchy::queryRay(const glm::vec3& origin,
+                                       const glm::vec3& direction,
+                                       unsigned& item,
+                                       float& distance) const
+{
+    if(_nodes.empty())
+        return false;
+
+    const glm::vec3 inverseDirection = 1.0f / direction;
+    float nearest = FLT_MAX;
+    float enter;
+    if(!IntersectRay(_nodes[0].box, origin, inverseDirection, nearest, enter))
+        return false;
+
+    //nearer children are visited first, so most far away subtrees are skipped
+    std::vector<std::pair<float, unsigned> > stack;
+    stack.reserve(64);
+    stack.push_back(std::make_pair(enter, 0u));
+    bool hit = false;
+    while(!stack.empty()){
+        std::pair<float, unsigned> top = stack.back();
+        stack.pop_back();
+        if(top.first > nearest)
+            continue;
+
+        const Node& node = _nodes[top.second];
+        if(node.count == 0){
+            float enterA, enterB;
+            bool hitA = IntersectRay(_nodes[node.first].box, origin, inverseDirection, nearest, enterA);
+            bool hitB = IntersectRay(_nodes[node.first + 1].box, origin, inverseDirection, nearest, enterB);
+            if(hitA && hitB && enterA < enterB){
+                stack.push_back(std::make_pair(enterB, node.first + 1));
+                stack.push_back(std::make_pair(enterA, node.first));
+            } else {
+                if(hitA) stack.push_back(std::make_pair(enterA, node.first));
+                if(hitB) stack.push_back(std::make_pair(enterB, node.first + 1));
+            }
+            continue;
+        }
+
+        for(unsigned i = node.first; i < node.first + node.count; ++i){
+            if(IntersectRay(_boxes[_items[i]], origin, inverseDirection, nearest, enter) && enter < nearest){
+                nearest = enter;
+                item = _items[i];
+                hit = true;
+            }
+        }
+    }
+
+    distance = nearest;
+    return hit;
+}
@@ -0,0 +1,108 @@
+/*
+ tdogl::BoundingVolumeHierarchy
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "Frustum.h"
+
+namespace tdogl {
+
+    /**
+     An axis aligned box. A default constructed box is empty, and grows with `add`.
+     */
+    struct BoundingBox {
+        glm::vec3 low;
+        glm::vec3 high;
+
+        BoundingBox();
+        BoundingBox(const glm::vec3& low, const glm::vec3& high);
+
+        void add(const BoundingBox& box);
+        void add(const glm::vec3& point);
+
+        glm::vec3 center() const;
+
+        /** half the surface area, 0 for an empty box */
+        float halfArea() const;
+    };
+
+    /**
+     A tree of bounding boxes over a set of items, e.g. the instances of a scene, that finds
+     the items in a frustum or under a ray without looking at every item.
+
+     `build` splits the items with the surface area heuristic. When items move, `refit`
+     updates the boxes on the way from the item to the root without changing the tree. That
+     is much cheaper than a build, but the tree gets looser as items move far from where
+     they were, so build again now and then, and when items are added or removed.
+     */
+    class BoundingVolumeHierarchy {
+    public:
+        /** the most items in a leaf */
+        static const unsigned MaxLeafItems = 4;
+
+        BoundingVolumeHierarchy();
+
+        /**
+         Builds the tree over `boxes`. Item i of the queries is boxes[i].
+         */
+        void build(const std::vector<BoundingBox>& boxes);
+
+        /** number of items */
+        unsigned size() const;
+
+        /**
+         Changes the box of an item, and enlarges or shrinks its ancestors to fit.
+         */
+        void refit(unsigned item, const BoundingBox& box);
+
+        /**
+         Appends the items whose boxes intersect the frustum to `items`, with the same caveat
+         as Frustum::intersectsBox.
+         */
+        void queryFrustum(const Frustum& frustum, std::vector<unsigned>& items) const;
+
+        /**
+         Finds the item whose box the ray enters first.
+
+         @param origin     Start of the ray
+         @param direction  Direction of the ray, needn't be normalised
+         @param item       Set to the item that was hit
+         @param distance   Set to the distance to the hit, in lengths of `direction`
+         @result false if the ray misses every box
+         */
+        bool queryRay(const glm::vec3& origin, const glm::vec3& direction, unsigned& item, float& distance) const;
+
+    private:
+        struct Node {
+            BoundingBox box;
+            unsigned parent;
+            unsigned first; //first child for inner nodes (the other one is next to it), first item for leaves
+            unsigned count; //number of items of a leaf, 0 for inner nodes
+        };
+
+        std::vector<Node> _nodes;
+        std::vector<BoundingBox> _boxes; //by item
+        std::vector<unsigned> _items; //item ids, in the order of the leaves
+        std::vector<unsigned> _leaves; //the leaf of each item
+
+        unsigned _split(unsigned first, unsigned count, const BoundingBox& centers);
+    };
+
+}
@@ -158,6 +158,20 @@ namespace tdogl {
          */
         glm::mat4 view() const;
 
+        /**
+         How many pixels one world unit covers at the nearest point of a sphere, seen through
+         the off-axis frustum of the last `projection` call.
+
+         Multiply by a distance in world units to get its size on the screen, e.g. to choose
+         a level of detail.
+         */
+        float pixelsPerUnit(const glm::vec3& center, float radius) const;
+
+        /**
+         The world position of the head tracked eye, as of the last `projection` call.
+         */
+        glm::vec3 eyePosition() const;
+
     private:
         glm::vec3 _position;
         float _horizontalAngle;
@@ -0,0 +1,106 @@
+/*
+ tdogl::DirectoryWatcher
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "DirectoryWatcher.h"
+#include <stdexcept>
+
+#if defined( linux ) || defined( __linux__ )
+    #define TDOGL_HAS_INOTIFY
+    #include <sys/inotify.h>
+    #include <unistd.h>
+    #include <errno.h>
+#endif
+
+using namespace tdogl;
+
+// replaces the change for the same file if there is one, so each file is reported once
+static void MergeChange(std::vector<DirectoryWatcher::Change>& changes,
+                        const std::string& filePath,
+                        DirectoryWatcher::ChangeType type)
+{
+    for(unsigned i = 0; i < changes.size(); ++i){
+        if(changes[i].filePath == filePath){
+            changes[i].type = type;
+            return;
+        }
+    }
+
+    DirectoryWatcher::Change change;
+    change.filePath = filePath;
+    change.type = type;
+    changes.push_back(change);
+}
+
+DirectoryWatcher::DirectoryWatcher(const std::string& dirPath) :
+    _dirPath(dirPath),
+    _fd(-1),
+    _watch(-1)
+{
+#ifdef TDOGL_HAS_INOTIFY
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(_fd < 0)
+        throw std::runtime_error("inotify_init1 failed");
+
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM;
+    _watch = inotify_add_watch(_fd, dirPath.c_str(), mask);
+    if(_watch < 0){
+        close(_fd); _fd = -1;
+        throw std::runtime_error(std::string("Can't watch directory: ") + dirPath);
+    }
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+#ifdef TDOGL_HAS_INOTIFY
+    if(_fd >= 0) close(_fd);
+#endif
+}
+
+const std::string& DirectoryWatcher::dirPath() const {
+    return _dirPath;
+}
+
+bool DirectoryWatcher::poll(std::vector<Change>& changes) {
+    changes.clear();
+
+#ifdef TDOGL_HAS_INOTIFY
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    for(;;){
+        ssize_t length = read(_fd, buffer, sizeof(buffer));
+        if(length <= 0)
+            break; //EAGAIN: no more events queued
+
+        for(char* ptr = buffer; ptr < buffer + length; ){
+            const struct inotify_event* event = (const struct inotify_event*)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if(event->len == 0 || (event->mask & IN_ISDIR))
+                continue;
+
+            std::string filePath = _dirPath + "/" + event->name;
+            if(event->mask & (IN_DELETE | IN_MOVED_FROM))
+                MergeChange(changes, filePath, Change_Removed);
+            else
+                MergeChange(changes, filePath, Change_Modified);
+        }
+    }
+#endif
+
+    return !changes.empty();
+}
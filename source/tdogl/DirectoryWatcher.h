@@ -0,0 +1,79 @@
+/*
+ tdogl::DirectoryWatcher
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     Reports the files of a directory that were written, created or deleted.
+
+     Uses inotify on Linux. On other platforms the watcher never reports anything, so the
+     directory only gets scanned once at startup, like before.
+     */
+    class DirectoryWatcher {
+    public:
+        enum ChangeType {
+            Change_Modified, /**< the file was created, written or moved into the directory */
+            Change_Removed   /**< the file was deleted or moved out of the directory */
+        };
+
+        struct Change {
+            std::string filePath;
+            ChangeType type;
+        };
+
+        /**
+         Starts watching `dirPath`. Subdirectories are not watched.
+
+         @throws std::exception if the directory can not be watched.
+         */
+        DirectoryWatcher(const std::string& dirPath);
+
+        /**
+         Stops watching the directory.
+         */
+        ~DirectoryWatcher();
+
+        /** the watched directory */
+        const std::string& dirPath() const;
+
+        /**
+         Collects the changes since the last call, without blocking.
+
+         Several events on the same file are merged into one change, with the type of the
+         last event, so saving a file in an editor shows up once.
+
+         @result false if nothing changed
+         */
+        bool poll(std::vector<Change>& changes);
+
+    private:
+        std::string _dirPath;
+        int _fd;
+        int _watch;
+
+        //copying disabled
+        DirectoryWatcher(const DirectoryWatcher&);
+        const DirectoryWatcher& operator=(const DirectoryWatcher&);
+    };
+
+}
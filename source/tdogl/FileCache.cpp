@@ -0,0 +1,115 @@
+/*
+ tdogl::FileCache
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "FileCache.h"
+#include <atomic>
+#include <cstdio>
+#include <sstream>
+
+#if defined( __WIN32__ ) || defined( _WIN32 ) || defined( _WIN64 )
+    #include <direct.h>
+    #define MakeDirectory(path) _mkdir(path)
+#else
+    #include <sys/stat.h>
+    #define MakeDirectory(path) mkdir(path, 0755)
+#endif
+
+using namespace tdogl;
+
+static std::atomic<unsigned> gTempFileCounter(0);
+
+FileCache::FileCache(const std::string& dirPath) :
+    _dirPath(dirPath)
+{
+    //fails harmlessly if it exists already
+    MakeDirectory(dirPath.c_str());
+}
+
+const std::string& FileCache::dirPath() const {
+    return _dirPath;
+}
+
+uint64_t FileCache::hash(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t result = seed;
+    for(size_t i = 0; i < size; ++i)
+        result = (result ^ bytes[i]) * 1099511628211ULL;
+    return result;
+}
+
+bool FileCache::hashFile(const std::string& filePath, uint64_t& result, uint64_t seed) {
+    FILE* file = fopen(filePath.c_str(), "rb");
+    if(!file)
+        return false;
+
+    result = seed;
+    unsigned char buffer[64 * 1024];
+    size_t read;
+    while((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        result = hash(buffer, read, result);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+std::string FileCache::key(uint64_t hash, const std::string& extension) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+    return std::string(hex) + extension;
+}
+
+bool FileCache::read(const std::string& key, std::vector<unsigned char>& data) const {
+    FILE* file = fopen((_dirPath + "/" + key).c_str(), "rb");
+    if(!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    bool ok = size >= 0;
+    if(ok){
+        data.resize((size_t)size);
+        ok = size == 0 || fread(&data[0], 1, (size_t)size, file) == (size_t)size;
+    }
+    fclose(file);
+    return ok;
+}
+
+bool FileCache::write(const std::string& key, const std::vector<unsigned char>& data) const {
+    std::ostringstream tempPath;
+    tempPath << _dirPath << "/" << key << "." << gTempFileCounter++ << ".tmp";
+
+    FILE* file = fopen(tempPath.str().c_str(), "wb");
+    if(!file)
+        return false;
+
+    bool ok = data.empty() || fwrite(&data[0], 1, data.size(), file) == data.size();
+    ok = (fclose(file) == 0) && ok;
+
+    const std::string path = _dirPath + "/" + key;
+#if defined( __WIN32__ ) || defined( _WIN32 ) || defined( _WIN64 )
+    remove(path.c_str()); //rename doesn't replace files on Windows
+#endif
+    if(!ok || rename(tempPath.str().c_str(), path.c_str()) != 0){
+        remove(tempPath.str().c_str());
+        return false;
+    }
+    return true;
+}
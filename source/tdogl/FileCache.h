@@ -0,0 +1,86 @@
+/*
+ tdogl::FileCache
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     A directory of files made from other files, such as processed meshes, that are
+     expensive to make again.
+
+     Entries are found by a key that is derived from a hash of everything the entry was
+     made from, so a changed source file simply gets a new entry. Old entries are never
+     deleted, the directory can be emptied at any time.
+
+     Reading and writing are safe from several threads at once.
+     */
+    class FileCache {
+    public:
+        /**
+         Creates the directory if it doesn't exist yet.
+
+         @param dirPath  The directory to keep the entries in
+         */
+        explicit FileCache(const std::string& dirPath);
+
+        const std::string& dirPath() const;
+
+        /**
+         64-bit FNV-1a hash of the given bytes. Pass the result of a previous call as `seed`
+         to hash several pieces of data together.
+         */
+        static uint64_t hash(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL);
+
+        /**
+         Hashes the contents of a file, like `hash`.
+
+         @result false if the file can't be read
+         */
+        static bool hashFile(const std::string& filePath, uint64_t& result, uint64_t seed = 14695981039346656037ULL);
+
+        /**
+         Makes the name of an entry from a hash, e.g. "0123456789abcdef.mesh"
+         */
+        static std::string key(uint64_t hash, const std::string& extension);
+
+        /**
+         Reads an entry.
+
+         @result false if there is no entry with that key
+         */
+        bool read(const std::string& key, std::vector<unsigned char>& data) const;
+
+        /**
+         Writes an entry. The entry is written to a temporary file first, so other threads or
+         processes never read half-written entries.
+
+         @result false if the entry couldn't be written. Failing to cache isn't fatal, so
+                 this doesn't throw.
+         */
+        bool write(const std::string& key, const std::vector<unsigned char>& data) const;
+
+    private:
+        std::string _dirPath;
+    };
+
+}
@@ -0,0 +1,69 @@
+/*
+ tdogl::Frustum
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "Frustum.h"
+#include <cmath>
+
+using namespace tdogl;
+
+static glm::vec4 Row(const glm::mat4& m, int row) {
+    return glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+}
+
+Frustum::Frustum(const glm::mat4& clip) {
+    //Gribb and Hartmann: a point is inside when -w <= x, y, z <= w in clip space
+    glm::vec4 x = Row(clip, 0), y = Row(clip, 1), z = Row(clip, 2), w = Row(clip, 3);
+    _planes[Left]   = w + x;
+    _planes[Right]  = w - x;
+    _planes[Bottom] = w + y;
+    _planes[Top]    = w - y;
+    _planes[Near]   = w + z;
+    _planes[Far]    = w - z;
+
+    for(int i = 0; i < PlaneCount; ++i){
+        float length = glm::length(glm::vec3(_planes[i]));
+        if(length > 0.0f)
+            _planes[i] /= length;
+    }
+}
+
+const glm::vec4& Frustum::plane(Plane plane) const {
+    return _planes[plane];
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const {
+    for(int i = 0; i < PlaneCount; ++i){
+        const glm::vec4& p = _planes[i];
+        if(p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::intersectsBox(const glm::vec3& low, const glm::vec3& high) const {
+    for(int i = 0; i < PlaneCount; ++i){
+        //the corner furthest along the plane's normal
+        const glm::vec4& p = _planes[i];
+        glm::vec3 corner(p.x >= 0.0f ? high.x : low.x,
+                         p.y >= 0.0f ? high.y : low.y,
+                         p.z >= 0.0f ? high.z : low.z);
+        if(p.x * corner.x + p.y * corner.y + p.z * corner.z + p.w < 0.0f)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,62 @@
+/*
+ tdogl::Frustum
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace tdogl {
+
+    /**
+     The six planes of a view volume, for visibility tests.
+
+     The planes are taken from a complete clip matrix, so any projection works, including
+     the asymmetric frustum of the head tracked tdogl::Camera.
+     */
+    class Frustum {
+    public:
+        enum Plane { Left = 0, Right, Bottom, Top, Near, Far, PlaneCount };
+
+        /**
+         @param clip  The matrix that takes points to clip space, e.g. camera * model. The
+                      planes are in the space the matrix starts from.
+         */
+        explicit Frustum(const glm::mat4& clip);
+
+        /**
+         The plane as (normal, distance), normalised, with the normal pointing inside.
+         */
+        const glm::vec4& plane(Plane plane) const;
+
+        /**
+         @result false if the sphere is completely outside. Spheres near the corners can
+                 give true even though they are outside.
+         */
+        bool intersectsSphere(const glm::vec3& center, float radius) const;
+
+        /**
+         @result false if the box is completely outside, with the same caveat as
+                 `intersectsSphere`.
+         */
+        bool intersectsBox(const glm::vec3& low, const glm::vec3& high) const;
+
+    private:
+        glm::vec4 _planes[PlaneCount];
+    };
+
+}
@@ -0,0 +1,164 @@
+/*
+ tdogl::ImageLoader
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "ImageLoader.h"
+#include "MipmapBuilder.h"
+#include <iostream>
+
+using namespace tdogl;
+
+size_t DecodedImage::bytes() const {
+    size_t total = 0;
+    for(size_t i = 0; i < image.levels.size(); ++i)
+        total += image.levels[i].blocks.size();
+    for(size_t i = 0; i < level0.size(); ++i)
+        total += (size_t)level0[i].width() * level0[i].height() * level0[i].format();
+    for(size_t i = 0; i < mipmaps.size(); ++i)
+        total += (size_t)mipmaps[i].width() * mipmaps[i].height() * mipmaps[i].format();
+    return total;
+}
+
+void ImageLoader::decode(const std::string& filePath,
+                         const DecodeOptions& options,
+                         ThreadPool& pool,
+                         FileCache* cache,
+                         DecodedImage& image)
+{
+    const bool compress = options.compress && options.mipmaps;
+    image.filePath = filePath;
+    try {
+        BlockCompressor compressor(pool, cache);
+        bool forAtlas = false;
+        if(compress && compressor.readCached(filePath, options.allowBC7, image.image)){
+            forAtlas = options.atlas && options.atlas->accepts(image.image.levels[0].width, image.image.levels[0].height);
+            image.compressed = !forAtlas;
+            if(image.compressed)
+                return;
+        }
+
+        image.image = CompressedImage();
+        image.level0.push_back(Bitmap::bitmapFromFile(filePath, true));
+        forAtlas = options.atlas && options.atlas->accepts(image.level0[0].width(), image.level0[0].height());
+        if(options.mipmaps)
+            image.mipmaps = MipmapBuilder(pool, cache).buildForFile(filePath, image.level0[0]);
+        if(compress && !forAtlas){
+            image.image = compressor.compressForFile(filePath, options.allowBC7, image.level0[0], image.mipmaps);
+            image.compressed = true;
+            image.level0.clear();
+            image.mipmaps.clear();
+        }
+    } catch (const std::exception& e) {
+        image.error = e.what();
+        image.compressed = false;
+        image.level0.clear();
+        image.mipmaps.clear();
+    }
+}
+
+ImageLoader::ImageLoader(ThreadPool& pool, FileCache* cache, const DecodeOptions& options, size_t maxDecodedBytes) :
+    _pool(pool),
+    _cache(cache),
+    _options(options),
+    _maxDecodedBytes(maxDecodedBytes),
+    _maxRunning(pool.threadCount()),
+    _nextTicket(1),
+    _running(0),
+    _finishedBytes(0)
+{
+}
+
+ImageLoader::~ImageLoader() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _queued.clear();
+    while(_running > 0)
+        _allDone.wait(lock);
+}
+
+unsigned ImageLoader::load(const std::string& filePath) {
+    std::vector<Queued> start;
+    unsigned ticket;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ticket = _nextTicket++;
+        Queued file = { filePath, ticket };
+        _queued.push_back(file);
+        _admit(start);
+    }
+    _start(start);
+    return ticket;
+}
+
+bool ImageLoader::popFinished(DecodedImage& image) {
+    std::vector<Queued> start;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(_finished.empty())
+            return false;
+
+        image = std::move(_finished.front());
+        _finished.pop_front();
+        _finishedBytes -= image.bytes();
+        _admit(start);
+    }
+    _start(start);
+    return true;
+}
+
+unsigned ImageLoader::pending() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return (unsigned)_queued.size() + _running;
+}
+
+// takes the queued files that may start now off the queue. Must be called with _mutex held.
+void ImageLoader::_admit(std::vector<Queued>& start) {
+    while(!_queued.empty() && _running < _maxRunning && _finishedBytes < _maxDecodedBytes){
+        start.push_back(_queued.front());
+        _queued.pop_front();
+        ++_running;
+    }
+}
+
+// submits the files from _admit. They count as running, so the loader can't be destroyed
+// before their jobs are done.
+void ImageLoader::_start(const std::vector<Queued>& start) {
+    for(size_t i = 0; i < start.size(); ++i){
+        Queued file = start[i];
+        _pool.submit([this, file]() { _decode(file); });
+    }
+}
+
+void ImageLoader::_decode(const Queued& file) {
+    DecodedImage image;
+    image.ticket = file.ticket;
+    decode(file.filePath, _options, _pool, _cache, image);
+    if(!image.error.empty())
+        std::cerr << "Error decoding " << file.filePath << ": " << image.error << std::endl;
+
+    //the next file takes this job's place before it stops counting as running
+    std::vector<Queued> start;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _finishedBytes += image.bytes();
+        _finished.push_back(std::move(image));
+        --_running;
+        _admit(start);
+        if(_running == 0)
+            _allDone.notify_all();
+    }
+    _start(start);
+}
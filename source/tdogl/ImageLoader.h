@@ -0,0 +1,168 @@
+/*
+ tdogl::ImageLoader
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Bitmap.h"
+#include "BlockCompressor.h"
+#include "FileCache.h"
+#include "TextureAtlas.h"
+#include "ThreadPool.h"
+
+namespace tdogl {
+
+    /**
+     An image file, decoded on a worker thread and ready to be uploaded: either block
+     compressed, or level 0 and the mipmaps as bitmaps.
+     */
+    struct DecodedImage {
+        std::string filePath;
+
+        /** the value returned by the ImageLoader::load call that queued this image */
+        unsigned ticket;
+
+        /** whether the image is in `image`, or else in `level0` and `mipmaps` */
+        bool compressed;
+        CompressedImage image;
+
+        /** level 0 as the only element, flipped for OpenGL. Empty if the image is compressed. */
+        std::vector<Bitmap> level0;
+
+        /** the levels below level 0, empty without DecodeOptions::mipmaps */
+        std::vector<Bitmap> mipmaps;
+
+        /** why the file couldn't be loaded, empty on success */
+        std::string error;
+
+        DecodedImage() : ticket(0), compressed(false) {}
+
+        /** bytes of pixels or blocks held */
+        size_t bytes() const;
+    };
+
+    /**
+     What is done to an image after it is decoded.
+     */
+    struct DecodeOptions {
+        /** make the mipmaps with tdogl::MipmapBuilder */
+        bool mipmaps;
+
+        /** block compress with tdogl::BlockCompressor, needs `mipmaps` */
+        bool compress;
+
+        /** let tdogl::BlockCompressor choose BC7 for images with alpha */
+        bool allowBC7;
+
+        /** images this atlas accepts aren't compressed, so they can go in it. May be NULL. */
+        const TextureAtlas* atlas;
+
+        DecodeOptions() : mipmaps(false), compress(false), allowBC7(false), atlas(NULL) {}
+    };
+
+    /**
+     Decodes image files on a tdogl::ThreadPool, many at once, with a bound on the memory
+     the decoded images take.
+
+     `load` only queues a file. A file starts decoding when fewer jobs than the pool has
+     workers are running, and the decoded images that haven't been collected with
+     `popFinished` take less than the memory budget. So a directory of hundreds of images
+     never has more than the budget, plus one image per worker, decoded at once, and the
+     pool's queue stays short enough for other jobs to get through.
+
+     Like tdogl::ModelLoader, finished images are collected with `popFinished`, usually once
+     per frame on the main thread, which hands them to the upload stage.
+     */
+    class ImageLoader {
+    public:
+        /**
+         Decodes an image on the calling thread, reading and writing mipmaps and compressed
+         images in the cache if there is one. Errors go to `image.error`.
+         */
+        static void decode(const std::string& filePath,
+                           const DecodeOptions& options,
+                           ThreadPool& pool,
+                           FileCache* cache,
+                           DecodedImage& image);
+
+        /**
+         @param pool  The pool to decode on
+         @param cache  Where mipmaps and compressed images are kept. May be NULL.
+         @param options  What to make of each image
+         @param maxDecodedBytes  Memory budget of the images waiting in `popFinished`
+         */
+        ImageLoader(ThreadPool& pool, FileCache* cache, const DecodeOptions& options, size_t maxDecodedBytes);
+
+        /**
+         Drops the files that haven't started, and waits for the jobs that are running.
+         */
+        ~ImageLoader();
+
+        /**
+         Queues an image file for decoding.
+
+         @result A ticket that is copied into the DecodedImage
+         */
+        unsigned load(const std::string& filePath);
+
+        /**
+         Moves the oldest finished image into `image`, which makes room for more files to
+         start decoding.
+
+         @result false if no image has finished since the last call
+         */
+        bool popFinished(DecodedImage& image);
+
+        /**
+         @result The number of files that are queued or being decoded
+         */
+        unsigned pending();
+
+    private:
+        struct Queued {
+            std::string filePath;
+            unsigned ticket;
+        };
+
+        ThreadPool& _pool;
+        FileCache* _cache;
+        DecodeOptions _options;
+        size_t _maxDecodedBytes;
+        unsigned _maxRunning;
+        unsigned _nextTicket;
+        std::deque<Queued> _queued;
+        unsigned _running;
+        std::deque<DecodedImage> _finished;
+        size_t _finishedBytes;
+        std::mutex _mutex;
+        std::condition_variable _allDone;
+
+        void _admit(std::vector<Queued>& start);
+        void _start(const std::vector<Queued>& start);
+        void _decode(const Queued& file);
+
+        //copying disabled
+        ImageLoader(const ImageLoader&);
+        const ImageLoader& operator=(const ImageLoader&);
+    };
+
+}
@@ -19,7 +19,6 @@
 #include "LoadObj.h"
 #include <stdexcept>
 #include <cmath>
-#include <GL/glfw.h>
 #include <vector>
 #include <iostream>
 #include <stdio.h>
@@ -27,73 +26,105 @@
 
 using namespace tdogl;
 
-LoadObj::LoadObj() 
-    
+LoadObj::LoadObj() :
+    _countingPass(true)
 {
 }
 
+void LoadObj::setCountingPass(bool countFirst) {
+	_countingPass = countFirst;
+}
+
 
 
 
 
-bool LoadObj::loadMtl( std::string filename, 
-			GLfloat Ka[],    // Ambient colour
-    		GLfloat Kd[],    // Diffuse colour
-    		GLfloat Ks[],    // Specular colour
-    		GLfloat &Ns) {   // Specular (coeff)) {
+// returns the directory part of `filename`, including the trailing slash
+static std::string DirectoryOf(const std::string& filename) {
+	size_t slash = filename.find_last_of("/\\");
+	if (slash == std::string::npos)
+		return "";
+	return filename.substr(0, slash + 1);
+}
 
-	const char* path = filename.c_str();
-	FILE* file = fopen(path, "r");
+// strips leading whitespace and the trailing newline/whitespace of a line
+static std::string Trim(const char* text) {
+	std::string str(text);
+	size_t first = str.find_first_not_of(" \t\r\n");
+	if (first == std::string::npos)
+		return "";
+	size_t last = str.find_last_not_of(" \t\r\n");
+	return str.substr(first, last - first + 1);
+}
+
+bool LoadObj::loadMtl(const std::string filename,
+			std::vector < ObjMaterial > & out_materials) {
+
+	FILE* file = fopen(filename.c_str(), "r");
 
 	if( file == NULL ) {
-		std::cerr << "Material not founded" << std::endl;
+		std::cerr << "Material not found: " << filename << std::endl;
 		return false;
 	}
 
-	while( 1 ){
- 
+	const std::string dir = DirectoryOf(filename);
+	ObjMaterial* material = NULL;
+	bool ok = true;
+	char line[1024];
+
+	while( ok && fgets(line, sizeof(line), file) ){
+
 	    char lineHeader[128];
-	    // read the first word of the line
-	    int res = fscanf(file, "%s", lineHeader);
-	    if (res == EOF)
-	        break; // EOF = End Of File. Quit the loop.
-	 
-	    // else : parse lineHeader
+	    // read the first word of the line, skipping blank lines
+	    if (sscanf(line, "%127s", lineHeader) != 1 || lineHeader[0] == '#')
+	    	continue;
 
-	    if( strcmp( lineHeader, "Ns" ) == 0 ){
+	    const char* args = strstr(line, lineHeader) + strlen(lineHeader);
 
-	    	int matches = fscanf(file, "%f", &Ns);
-	    	if (matches != 1) {
-	    		return false;
-	    	}
-            
-        }
+	    if( strcmp( lineHeader, "newmtl" ) == 0 ){
+	    	out_materials.push_back(ObjMaterial());
+	    	material = &out_materials.back();
+	    	material->name = Trim(args);
+	    	continue;
+	    }
 
-        else if( strcmp( lineHeader, "Ka" ) == 0 ){
+	    if (material == NULL)
+	    	continue; //values before the first newmtl have nothing to belong to
 
-	    	int matches = fscanf(file, "%f %f %f", &Ka[0], &Ka[1], &Ka[2]);
-            if (matches != 3) {
-	    		return false;
-	    	}
+	    if( strcmp( lineHeader, "Ns" ) == 0 ){
+	    	ok = sscanf(args, "%f", &material->Ns) == 1;
+        }
+        else if( strcmp( lineHeader, "d" ) == 0 ){
+	    	ok = sscanf(args, "%f", &material->d) == 1;
+        }
+        else if( strcmp( lineHeader, "Ka" ) == 0 ){
+	    	glm::vec3& Ka = material->Ka;
+	    	ok = sscanf(args, "%f %f %f", &Ka[0], &Ka[1], &Ka[2]) == 3;
         }
-
         else if( strcmp( lineHeader, "Kd" ) == 0 ){
-
-	    	int matches = fscanf(file, "%f %f %f", &Kd[0], &Kd[1], &Kd[2]);
-            if (matches != 3) {
-	    		return false;
-	    	}
+	    	glm::vec3& Kd = material->Kd;
+	    	ok = sscanf(args, "%f %f %f", &Kd[0], &Kd[1], &Kd[2]) == 3;
         }
-
         else if( strcmp( lineHeader, "Ks" ) == 0 ){
-
-	    	int matches = fscanf(file, "%f %f %f", &Ks[0], &Ks[1], &Ks[2]);
-            if (matches != 3) {
-	    		return false;
-	    	}
+	    	glm::vec3& Ks = material->Ks;
+	    	ok = sscanf(args, "%f %f %f", &Ks[0], &Ks[1], &Ks[2]) == 3;
+        }
+        else if( strcmp( lineHeader, "map_Kd" ) == 0 ){
+	    	//options like "-s 1 1 1" come before the file name, which is always last
+	    	std::string map = Trim(args);
+	    	size_t space = map.find_last_of(" \t");
+	    	if (space != std::string::npos)
+	    		map = map.substr(space + 1);
+	    	ok = !map.empty();
+	    	material->map_Kd = dir + map;
         }
-
 	}
+
+	if (!ok)
+		std::cerr << "Malformed material file: " << filename << std::endl;
+
+	fclose(file);
+	return ok;
 }
 
 
@@ -107,188 +138,456 @@ int LoadObj::loadObj(const std::string filename,
     				std::vector < glm::vec3 > & out_normals,
     				int n) {
 
+	std::vector< ObjGroup > groups;
+	std::string mtllib;
+	return loadObj(filename, out_vertices, out_uvs, out_normals, groups, mtllib, n);
+}
 
-	std::vector< unsigned int > vertexIndices, uvIndices, normalIndices;
-	std::vector< glm::vec3 > temp_vertices;
-	std::vector< glm::vec2 > temp_uvs;
-	std::vector< glm::vec3 > temp_normals;
-	const char *path = filename.c_str();
-	FILE * file = fopen(path, "r");
-
-	bool vt = false;
-	bool vn = false;
-	int retval = -1;
+namespace {
+	// one corner of a face, as 0-based indices into the attribute arrays, -1 if missing
+	struct FaceCorner {
+		int v, vt, vn;
+	};
+}
 
-	if( file == NULL ){
-    	printf("Impossible to open the file !\n");
-    return -1;
-	}
+static const char* SkipSpaces(const char* p) {
+	while (*p == ' ' || *p == '\t' || *p == '\r')
+		++p;
+	return p;
+}
 
-	
+static const char* SkipLine(const char* p) {
+	while (*p && *p != '\n')
+		++p;
+	return *p ? p + 1 : p;
+}
 
-	while( 1 ){
- 
-	    char lineHeader[128];
-	    // read the first word of the line
-	    int res = fscanf(file, "%s", lineHeader);
-	    if (res == EOF)
-	        break; // EOF = End Of File. Quit the loop.
-	 
-	    // else : parse lineHeader
-
-	    if ( strcmp( lineHeader, "v" ) == 0 ){
-		    glm::vec3 vertex;
-		    int r = fscanf(file, "%f %f %f\n", &vertex.x , &vertex.y, &vertex.z );
-		    vertex.z -= n-2;
-		    /*
-		    vertex.x = ((float)((int)(vertex.x*100)))/100;
-		    vertex.y = ((float)((int)(vertex.y*100)))/100;
-		    vertex.z = ((float)((int)(vertex.z*100)))/100;*/
-		    /*
-		    vertex.x = (int)vertex.x;
-		    vertex.y = (int)vertex.y;
-		    vertex.z = (int)vertex.z;
-		    */temp_vertices.push_back(vertex);
+// the rest of the line, without surrounding whitespace
+static std::string RestOfLine(const char* p) {
+	const char* end = p;
+	while (*end && *end != '\n')
+		++end;
+	return Trim(std::string(p, end).c_str());
+}
 
-	    }
-	    else if ( strcmp( lineHeader, "vt" ) == 0 ){
-	    	vt = true;
-		    glm::vec2 uv;
-		    int r = fscanf(file, "%f %f\n", &uv.x, &uv.y );
-		    temp_uvs.push_back(uv);
+// parses [+-]digits[.digits][(e|E)[+-]digits]. Returns `p` if there is no number.
+static const char* ParseFloat(const char* p, float& out) {
+	const char* start = p;
+	bool negative = (*p == '-');
+	if (*p == '-' || *p == '+')
+		++p;
+
+	double value = 0.0;
+	bool digits = false;
+	while (*p >= '0' && *p <= '9') {
+		value = value * 10.0 + (*p++ - '0');
+		digits = true;
+	}
+	if (*p == '.') {
+		++p;
+		double scale = 0.1;
+		while (*p >= '0' && *p <= '9') {
+			value += (*p++ - '0') * scale;
+			scale *= 0.1;
+			digits = true;
 		}
-		else if ( strcmp( lineHeader, "vn" ) == 0 ){
-		    vn = true;
-		    glm::vec3 normal;
-		    int r = fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
-		    temp_normals.push_back(normal);
+	}
+	if (!digits)
+		return start;
+
+	if (*p == 'e' || *p == 'E') {
+		const char* e = p + 1;
+		bool negativeExp = (*e == '-');
+		if (*e == '-' || *e == '+')
+			++e;
+		if (*e >= '0' && *e <= '9') {
+			int exponent = 0;
+			while (*e >= '0' && *e <= '9')
+				exponent = exponent * 10 + (*e++ - '0');
+			value *= pow(10.0, negativeExp ? -exponent : exponent);
+			p = e;
 		}
+	}
 
-		
-		else if ( strcmp( lineHeader, "f" ) == 0 ){
+	out = (float)(negative ? -value : value);
+	return p;
+}
 
-			std::string vertex1, vertex2, vertex3;
-		    unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
+// parses an optionally negative integer. Returns `p` if there is no number.
+static const char* ParseInt(const char* p, int& out) {
+	const char* start = p;
+	bool negative = (*p == '-');
+	if (*p == '-' || *p == '+')
+		++p;
+	if (*p < '0' || *p > '9')
+		return start;
+
+	int value = 0;
+	while (*p >= '0' && *p <= '9')
+		value = value * 10 + (*p++ - '0');
+	out = negative ? -value : value;
+	return p;
+}
 
-			if ( vt && vn  ) { //format %d/%d/%d
+// turns a 1-based or negative (counted back from the last element) .obj index into a
+// 0-based index. Returns -1 if the index is out of range.
+static int ResolveIndex(int index, size_t count) {
+	if (index > 0)
+		return (size_t)index <= count ? index - 1 : -1;
+	if (index < 0)
+		return (size_t)(-index) <= count ? (int)count + index : -1;
+	return -1;
+}
+
+// parses the corners of an "f" line: v, v/vt, v//vn or v/vt/vn, in any mix
+static bool ParseFace(const char* p,
+                      size_t vertexCount, size_t uvCount, size_t normalCount,
+                      std::vector< FaceCorner > & corners) {
+	corners.clear();
+	for (;;) {
+		p = SkipSpaces(p);
+		if (*p == '\0' || *p == '\n' || *p == '#')
+			break;
+
+		FaceCorner corner = { -1, -1, -1 };
+		int index = 0;
+		const char* end = ParseInt(p, index);
+		if (end == p)
+			return false;
+		corner.v = ResolveIndex(index, vertexCount);
+		if (corner.v < 0)
+			return false;
+		p = end;
+
+		if (*p == '/') {
+			++p;
+			if (*p != '/') {
+				end = ParseInt(p, index);
+				if (end == p)
+					return false;
+				corner.vt = ResolveIndex(index, uvCount);
+				if (corner.vt < 0)
+					return false;
+				p = end;
+			}
+			if (*p == '/') {
+				++p;
+				end = ParseInt(p, index);
+				if (end == p)
+					return false;
+				corner.vn = ResolveIndex(index, normalCount);
+				if (corner.vn < 0)
+					return false;
+				p = end;
+			}
+		}
+
+		if (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '\0')
+			return false;
+		corners.push_back(corner);
+	}
+	return corners.size() >= 3;
+}
 
-				retval = 1;				
-				int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
-		    	
-		    	if (matches != 9){
-		        	printf(" %d File can't be read by our simple parser : ( Try exporting with other options\n",matches);
-		        	return -1;
-		    	}
+// twice the signed area of the 2D triangle abc
+static float Cross2D(const glm::vec2& a, const glm::vec2& b, const glm::vec2& c) {
+	return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
 
-		    	vertexIndices.push_back(vertexIndex[0]);
-			    vertexIndices.push_back(vertexIndex[1]);
-			    vertexIndices.push_back(vertexIndex[2]);
-			    
-			    uvIndices    .push_back(uvIndex[0]);
-			    uvIndices    .push_back(uvIndex[1]);
-			    uvIndices    .push_back(uvIndex[2]);
+static bool PointInTriangle(const glm::vec2& p, const glm::vec2& a, const glm::vec2& b, const glm::vec2& c) {
+	return Cross2D(a, b, p) >= 0.0f && Cross2D(b, c, p) >= 0.0f && Cross2D(c, a, p) >= 0.0f;
+}
 
-			    normalIndices.push_back(normalIndex[0]);
-			    normalIndices.push_back(normalIndex[1]);
-			    normalIndices.push_back(normalIndex[2]);
+// splits a polygon into triangles, appending the corners of each triangle to `triangles`.
+// Convex polygons are fanned from the first corner; concave ones are ear clipped in the
+// plane of the polygon.
+static void Triangulate(const std::vector< FaceCorner > & corners,
+                        const std::vector< glm::vec3 > & positions,
+                        std::vector< FaceCorner > & triangles) {
+	const size_t count = corners.size();
+	if (count == 3) {
+		triangles.insert(triangles.end(), corners.begin(), corners.end());
+		return;
+	}
 
-			}
+	//Newell's method gives a stable normal for non-planar polygons too
+	glm::vec3 normal(0.0f);
+	for (size_t i = 0; i < count; i++) {
+		const glm::vec3& a = positions[corners[i].v];
+		const glm::vec3& b = positions[corners[(i + 1) % count].v];
+		normal.x += (a.y - b.y) * (a.z + b.z);
+		normal.y += (a.z - b.z) * (a.x + b.x);
+		normal.z += (a.x - b.x) * (a.y + b.y);
+	}
 
-			else if ( !vt && vn ) { //format %d//%d
+	//project onto the axis plane the polygon faces the most, counter clockwise
+	int axis = 2;
+	if (fabs(normal.x) > fabs(normal.y) && fabs(normal.x) > fabs(normal.z))
+		axis = 0;
+	else if (fabs(normal.y) > fabs(normal.z))
+		axis = 1;
+	const int u = (axis + 1) % 3;
+	const int v = (axis + 2) % 3;
+	const float flip = normal[axis] < 0.0f ? -1.0f : 1.0f;
+
+	std::vector< glm::vec2 > points(count);
+	for (size_t i = 0; i < count; i++) {
+		const glm::vec3& pos = positions[corners[i].v];
+		points[i] = glm::vec2(pos[u], pos[v] * flip);
+	}
 
-				retval = 2;
-				int matches = fscanf(file, "%d//%d %d//%d %d//%d\n", &vertexIndex[0], &normalIndex[0], &vertexIndex[1],  &normalIndex[1], &vertexIndex[2], &normalIndex[2] );
-		    	
-		    	if (matches != 6){
-		        	printf(" %d File can't be read by our simple parser : ( Try exporting with other options\n",matches);
-		        	return -1;
-		    	}
+	bool convex = true;
+	for (size_t i = 0; i < count && convex; i++)
+		convex = Cross2D(points[i], points[(i + 1) % count], points[(i + 2) % count]) >= 0.0f;
 
-		    	vertexIndices.push_back(vertexIndex[0]);
-			    vertexIndices.push_back(vertexIndex[1]);
-			    vertexIndices.push_back(vertexIndex[2]);
-			   
+	if (convex) {
+		for (size_t i = 1; i + 1 < count; i++) {
+			triangles.push_back(corners[0]);
+			triangles.push_back(corners[i]);
+			triangles.push_back(corners[i + 1]);
+		}
+		return;
+	}
 
-			    normalIndices.push_back(normalIndex[0]);
-			    normalIndices.push_back(normalIndex[1]);
-			    normalIndices.push_back(normalIndex[2]);
+	std::vector< size_t > remaining(count);
+	for (size_t i = 0; i < count; i++)
+		remaining[i] = i;
+
+	while (remaining.size() > 3) {
+		const size_t size = remaining.size();
+		size_t ear = size;
+		for (size_t i = 0; i < size && ear == size; i++) {
+			size_t a = remaining[(i + size - 1) % size];
+			size_t b = remaining[i];
+			size_t c = remaining[(i + 1) % size];
+			if (Cross2D(points[a], points[b], points[c]) <= 0.0f)
+				continue; //reflex corner
+
+			bool empty = true;
+			for (size_t j = 0; j < size && empty; j++) {
+				size_t other = remaining[j];
+				if (other != a && other != b && other != c)
+					empty = !PointInTriangle(points[other], points[a], points[b], points[c]);
 			}
+			if (empty)
+				ear = i;
+		}
 
-			else if ( vt && !vn ) { //format %d/%d
-				
-				retval = 3;
-				int matches = fscanf(file, "%d/%d %d/%d %d/%d\n", &vertexIndex[0], &uvIndex[0],  &vertexIndex[1], &uvIndex[1],  &vertexIndex[2], &uvIndex[2] );
-		    	
-		    	if (matches != 6){
-		        	printf(" %d File can't be read by our simple parser : ( Try exporting with other options\n",matches);
-		        	return -1;
-		    	}
-
-		    	vertexIndices.push_back(vertexIndex[0]);
-			    vertexIndices.push_back(vertexIndex[1]);
-			    vertexIndices.push_back(vertexIndex[2]);
-			    /*** comment uvIndices if uv are not included***/
-			    uvIndices    .push_back(uvIndex[0]);
-			    uvIndices    .push_back(uvIndex[1]);
-			    uvIndices    .push_back(uvIndex[2]);
-
-			    
+		//degenerate polygon: clip anything so the loop always ends
+		if (ear == size)
+			ear = 0;
 
-			}
+		triangles.push_back(corners[remaining[(ear + size - 1) % size]]);
+		triangles.push_back(corners[remaining[ear]]);
+		triangles.push_back(corners[remaining[(ear + 1) % size]]);
+		remaining.erase(remaining.begin() + ear);
+	}
 
-			else if ( !vt && !vn) { //format %d
+	triangles.push_back(corners[remaining[0]]);
+	triangles.push_back(corners[remaining[1]]);
+	triangles.push_back(corners[remaining[2]]);
+}
 
-				retval = 4;
-				int matches = fscanf(file, "%d %d %d\n", &vertexIndex[0],  &vertexIndex[1],  &vertexIndex[2] );
-		    	
-		    	if (matches != 3){
-		        	printf(" %d File can't be read by our simple parser : ( Try exporting with other options\n",matches);
-		        	return -1;
-		    	}
+namespace {
+	// how many elements of each kind an .obj file has
+	struct ElementCounts {
+		size_t vertices, uvs, normals;
+		size_t triangleCorners; // 3 per triangle, after triangulating the polygons
+	};
+}
 
-		    	vertexIndices.push_back(vertexIndex[0]);
-			    vertexIndices.push_back(vertexIndex[1]);
-			    vertexIndices.push_back(vertexIndex[2]);
-		
+// a quick pass over the file that only looks at the keywords and counts the face corners,
+// so every array can be allocated once with its final size
+static ElementCounts CountElements(const char* p) {
+	ElementCounts counts = { 0, 0, 0, 0 };
+	for ( ; *p; p = SkipLine(p) ) {
+		p = SkipSpaces(p);
+		if ( p[0] == 'v' ) {
+			if ( p[1] == ' ' || p[1] == '\t' )
+				counts.vertices++;
+			else if ( p[1] == 't' )
+				counts.uvs++;
+			else if ( p[1] == 'n' )
+				counts.normals++;
+		}
+		else if ( p[0] == 'f' && (p[1] == ' ' || p[1] == '\t') ) {
+			size_t corners = 0;
+			for ( p++; *p && *p != '\n' && *p != '#'; ) {
+				p = SkipSpaces(p);
+				if ( (unsigned char)*p <= ' ' || *p == '#' )
+					break;
+				corners++;
+				while ( (unsigned char)*p > ' ' )
+					p++;
 			}
+			if ( corners >= 3 )
+				counts.triangleCorners += 3 * (corners - 2);
+		}
+	}
+	return counts;
+}
 
-		
-			else {
+// starts a new group at `start`, with the name and material of the current one
+static void BeginGroup(std::vector< ObjGroup > & groups, unsigned start) {
+	ObjGroup group;
+	if (!groups.empty()) {
+		group.name = groups.back().name;
+		group.material = groups.back().material;
+	}
+	group.start = start;
+	groups.push_back(group);
+}
 
-				return -1;
-			}
+int LoadObj::loadObj(const std::string filename,
+    				std::vector < glm::vec3 > & out_vertices,
+    				std::vector < glm::vec2 > & out_uvs,
+    				std::vector < glm::vec3 > & out_normals,
+    				std::vector < ObjGroup > & out_groups,
+    				std::string & out_mtllib,
+    				int n) {
 
-		}
+	FILE * file = fopen(filename.c_str(), "rb");
+	if( file == NULL ){
+    	printf("Impossible to open the file !\n");
+    	return -1;
+	}
 
+	//parse from memory: one read instead of a stdio call per token
+	fseek(file, 0, SEEK_END);
+	long fileSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if ( fileSize < 0 ) {
+		fclose(file);
+		return -1;
 	}
-	// For each vertex of each triangle
-	for( unsigned int i=0; i<vertexIndices.size(); i++ ){
-			unsigned int vertexIndex = vertexIndices[i];
-			glm::vec3 vertex = temp_vertices[ vertexIndex-1 ];
-			/*std::cout << i << "   "<< vertex.x << "," << vertex.y << 
-		    "," << vertex.z << std::endl;*/
-			out_vertices.push_back(vertex);
-		}
+	std::vector< char > text(fileSize + 1);
+	size_t read = fread(&text[0], 1, fileSize, file);
+	fclose(file);
+	text[read] = '\0';
+
+	ElementCounts counts = { 0, 0, 0, 0 };
+	if ( _countingPass )
+		counts = CountElements(&text[0]);
 
-	for( unsigned int i=0; i<normalIndices.size(); i++ ){
-		unsigned int normalIndex = normalIndices[i];
-		glm::vec3 vertex = temp_normals[ normalIndex-1 ];
-		/*std::cerr << i << "   " << vertex.x << "," << vertex.y << 
-	    "," << vertex.z << std::endl;*/
-		out_normals.push_back(vertex);
+	std::vector< glm::vec3 > temp_vertices;
+	std::vector< glm::vec2 > temp_uvs;
+	std::vector< glm::vec3 > temp_normals;
+	std::vector< FaceCorner > corners;
+	std::vector< FaceCorner > triangles;
+	temp_vertices.reserve(counts.vertices);
+	temp_uvs.reserve(counts.uvs);
+	temp_normals.reserve(counts.normals);
+	triangles.reserve(counts.triangleCorners);
+	std::vector< ObjGroup > groups;
+	bool hasUVs = false;
+	bool hasNormals = false;
+	unsigned lineNumber = 0;
+
+	BeginGroup(groups, 0);
+
+	for ( const char* p = &text[0]; *p; p = SkipLine(p) ) {
+		lineNumber++;
+		p = SkipSpaces(p);
+		const char* keyword = p;
+		while ( (unsigned char)*p > ' ' )
+			p++;
+		const size_t length = p - keyword;
+		if ( length == 0 || keyword[0] == '#' )
+			continue;
+
+		if ( length == 1 && keyword[0] == 'v' ) {
+			glm::vec3 vertex(0.0f);
+			for (int i = 0; i < 3; i++)
+				p = ParseFloat(SkipSpaces(p), vertex[i]);
+			vertex.z -= n-2;
+			temp_vertices.push_back(vertex);
+		}
+		else if ( length == 2 && keyword[0] == 'v' && keyword[1] == 't' ) {
+			glm::vec2 uv(0.0f);
+			for (int i = 0; i < 2; i++)
+				p = ParseFloat(SkipSpaces(p), uv[i]);
+			temp_uvs.push_back(uv);
+		}
+		else if ( length == 2 && keyword[0] == 'v' && keyword[1] == 'n' ) {
+			glm::vec3 normal(0.0f);
+			for (int i = 0; i < 3; i++)
+				p = ParseFloat(SkipSpaces(p), normal[i]);
+			temp_normals.push_back(normal);
+		}
+		else if ( length == 1 && keyword[0] == 'f' ) {
+			if ( !ParseFace(p, temp_vertices.size(), temp_uvs.size(), temp_normals.size(), corners) ) {
+				printf("%s:%u: malformed face\n", filename.c_str(), lineNumber);
+				return -1;
+			}
+			for (size_t i = 0; i < corners.size(); i++) {
+				hasUVs = hasUVs || corners[i].vt >= 0;
+				hasNormals = hasNormals || corners[i].vn >= 0;
+			}
+			Triangulate(corners, temp_vertices, triangles);
+		}
+		else if ( (length == 1 && (keyword[0] == 'o' || keyword[0] == 'g')) ||
+		          (length == 6 && strncmp(keyword, "usemtl", 6) == 0) ) {
+			BeginGroup(groups, triangles.size());
+			if ( keyword[0] == 'u' )
+				groups.back().material = RestOfLine(p);
+			else
+				groups.back().name = RestOfLine(p);
+		}
+		else if ( length == 6 && strncmp(keyword, "mtllib", 6) == 0 ) {
+			out_mtllib = DirectoryOf(filename) + RestOfLine(p);
+		}
 	}
 
-	for( unsigned int i=0; i<uvIndices.size(); i++ ){
-		unsigned int uvIndex = uvIndices[i];
-		glm::vec2 vertex = temp_uvs[ uvIndex-1 ];
-		/*std::cerr << i << "   " << vertex.x << "," << vertex.y << 
-	    std::endl;*/
-		out_uvs.push_back(vertex);
+	//the text isn't needed anymore, free it before the outputs are allocated
+	std::vector< char >().swap(text);
+
+	if ( triangles.empty() )
+		return -1;
+
+	if ( _countingPass ) {
+		out_vertices.reserve(out_vertices.size() + triangles.size());
+		if ( hasUVs )
+			out_uvs.reserve(out_uvs.size() + triangles.size());
+		if ( hasNormals )
+			out_normals.reserve(out_normals.size() + triangles.size());
 	}
 
-	fclose (file);
+	//faces that lack an attribute the others have get a zero uv or a flat normal
+	const unsigned firstVertex = out_vertices.size();
+	for ( size_t i = 0; i < triangles.size(); i += 3 ) {
+		const FaceCorner* tri = &triangles[i];
+		glm::vec3 flatNormal(0.0f);
+		if ( hasNormals && (tri[0].vn < 0 || tri[1].vn < 0 || tri[2].vn < 0) ) {
+			const glm::vec3& a = temp_vertices[tri[0].v];
+			flatNormal = glm::cross(temp_vertices[tri[1].v] - a, temp_vertices[tri[2].v] - a);
+			float len = glm::length(flatNormal);
+			if (len > 0.0f)
+				flatNormal /= len;
+		}
 
-	return retval;
+		for ( int c = 0; c < 3; c++ ) {
+			out_vertices.push_back(temp_vertices[tri[c].v]);
+			if ( hasUVs )
+				out_uvs.push_back(tri[c].vt >= 0 ? temp_uvs[tri[c].vt] : glm::vec2(0.0f));
+			if ( hasNormals )
+				out_normals.push_back(tri[c].vn >= 0 ? temp_normals[tri[c].vn] : flatNormal);
+		}
+	}
 
+	//close the groups and drop the ones without faces
+	for ( size_t i = 0; i < groups.size(); i++ ) {
+		unsigned end = (i + 1 < groups.size()) ? groups[i + 1].start : triangles.size();
+		groups[i].count = end - groups[i].start;
+		groups[i].start += firstVertex;
+		if ( groups[i].count > 0 )
+			out_groups.push_back(groups[i]);
+	}
 
-}
\ No newline at end of file
+	if ( hasUVs && hasNormals )
+		return 1;
+	if ( hasNormals )
+		return 2;
+	if ( hasUVs )
+		return 3;
+	return 4;
+}
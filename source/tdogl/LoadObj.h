@@ -20,26 +20,94 @@
 
 #include <glm/glm.hpp>
  #include <iostream>
+  #include <string>
   #include <vector>
 
  namespace tdogl {
 
+ 	/**
+ 	 A material from a .mtl file.
+
+ 	 Values missing from the file keep the defaults, so a material with only a
+ 	 texture shows the texture unchanged.
+ 	 */
+ 	struct ObjMaterial {
+ 		std::string name;
+ 		glm::vec3 Ka;       // Ambient colour
+ 		glm::vec3 Kd;       // Diffuse colour
+ 		glm::vec3 Ks;       // Specular colour
+ 		float Ns;           // Specular (coeff)
+ 		float d;            // Opacity
+ 		std::string map_Kd; // Diffuse texture, as a path relative to the working directory
+
+ 		ObjMaterial() : Ka(0.0f), Kd(1.0f), Ks(0.0f), Ns(0.0f), d(1.0f) {}
+ 	};
+
+ 	/**
+ 	 A run of consecutive triangles in the .obj file with the same object/group
+ 	 name and material. Every `o`, `g` and `usemtl` line starts a new run.
+
+ 	 `start` and `count` are in vertices of the output arrays of loadObj.
+ 	 */
+ 	struct ObjGroup {
+ 		std::string name;     // name given to `o` or `g`, empty if there was none
+ 		std::string material; // name given to `usemtl`, empty if there was none
+ 		unsigned start;
+ 		unsigned count;
+
+ 		ObjGroup() : start(0), count(0) {}
+ 	};
+
  	class LoadObj {
  		public:
  			LoadObj();
 
- 			bool loadMtl( std::string filename,
-									float Ka[],    
-    								float Kd[],    
-    								float Ks[],    
-    								float &Ns);
+ 			/**
+ 			 Reads every `newmtl` block of a .mtl file, appending them to `out_materials`.
+
+ 			 @result false if the file can't be opened or is malformed
+ 			 */
+ 			bool loadMtl(const std::string filename,
+ 			        std::vector < ObjMaterial > & out_materials);
 
+ 			/**
+ 			 Loads the faces of an .obj file as a flat list of triangles.
+
+ 			 Faces can have any number of corners, and each corner can be written
+ 			 as v, v/vt, v//vn or v/vt/vn with positive or negative indices. Polygons
+ 			 are triangulated, and corners without a uv or normal get a zero uv or
+ 			 the face normal when the rest of the file has them.
+
+ 			 @result 1 with uvs and normals, 2 normals only, 3 uvs only, 4 positions
+ 			         only, -1 if the file can't be read or has no faces
+ 			 */
  			int loadObj(const std::string filename,
     				std::vector < glm::vec3 > & out_vertices,
     				std::vector < glm::vec2 > & out_uvs,
     				std::vector < glm::vec3 > & out_normals,
     				int n);
 
+ 			/**
+ 			 Same as above, but also returns the group runs of the file and the
+ 			 path of its `mtllib`, resolved against the directory of the .obj file.
+ 			 */
+ 			int loadObj(const std::string filename,
+    				std::vector < glm::vec3 > & out_vertices,
+    				std::vector < glm::vec2 > & out_uvs,
+    				std::vector < glm::vec3 > & out_normals,
+    				std::vector < ObjGroup > & out_groups,
+    				std::string & out_mtllib,
+    				int n);
+
+ 			/**
+ 			 Whether loadObj first counts the elements of the file, so that every
+ 			 array is allocated once with its final size. On by default; when off,
+ 			 the arrays grow as the file is parsed, which needs more memory at the
+ 			 peak on big files.
+ 			 */
+ 			void setCountingPass(bool countFirst);
+
  		private:
+ 			bool _countingPass;
  	};
  }
\ No newline at end of file
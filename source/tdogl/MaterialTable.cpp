@@ -0,0 +1,83 @@
+/*
+ tdogl::MaterialTable
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "MaterialTable.h"
+#include <cstring>
+#include <iostream>
+
+using namespace tdogl;
+
+MaterialTable::MaterialTable() :
+    _buffer(0),
+    _dirty(true)
+{
+    add(glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(0.0f), 0.0f, 1.0f);
+}
+
+MaterialTable::~MaterialTable() {
+    if(_buffer != 0) glDeleteBuffers(1, &_buffer);
+}
+
+unsigned MaterialTable::add(const glm::vec3& Ka,
+                            const glm::vec3& Kd,
+                            const glm::vec3& Ks,
+                            float Ns,
+                            float d)
+{
+    Entry entry;
+    entry.ambient = glm::vec4(Ka, 0.0f);
+    entry.diffuse = glm::vec4(Kd, d);
+    entry.specular = glm::vec4(Ks, Ns);
+
+    for(unsigned i = 0; i < _entries.size(); ++i){
+        if(memcmp(&_entries[i], &entry, sizeof(Entry)) == 0)
+            return i;
+    }
+
+    if(_entries.size() >= MaxEntries){
+        std::cerr << "Material table is full, using the default material" << std::endl;
+        return 0;
+    }
+
+    _entries.push_back(entry);
+    _dirty = true;
+    return (unsigned)_entries.size() - 1;
+}
+
+unsigned MaterialTable::size() const {
+    return (unsigned)_entries.size();
+}
+
+void MaterialTable::bind(GLuint bindingPoint) {
+    if(_buffer == 0){
+        //the whole block is allocated once, so entries can be added without reallocating
+        glGenBuffers(1, &_buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+        glBufferData(GL_UNIFORM_BUFFER, MaxEntries * sizeof(Entry), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    if(_dirty){
+        glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, _entries.size() * sizeof(Entry), &_entries[0]);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        _dirty = false;
+    }
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, _buffer);
+}
@@ -0,0 +1,87 @@
+/*
+ tdogl::MaterialTable
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     All the materials of the scene, in one uniform buffer.
+
+     Materials with the same values share one entry, so a draw only has to set the index
+     of its material instead of uploading every colour.
+
+     Entry 0 is always a white material that leaves the texture unchanged.
+     */
+    class MaterialTable {
+    public:
+        /**
+         One material, in the std140 layout of the `Materials` block in the fragment shader.
+         */
+        struct Entry {
+            glm::vec4 ambient;  /**< Ka, w unused */
+            glm::vec4 diffuse;  /**< Kd, opacity in w */
+            glm::vec4 specular; /**< Ks, specular coefficient (Ns) in w */
+        };
+
+        /** size of the materials array in the shader */
+        static const unsigned MaxEntries = 256;
+
+        MaterialTable();
+
+        /**
+         Deletes the uniform buffer
+         */
+        ~MaterialTable();
+
+        /**
+         Adds a material, or finds the existing entry with the same values.
+
+         @result The index of the material, for the `materialIndex` shader uniform. When the
+                 table is full, 0 is returned.
+         */
+        unsigned add(const glm::vec3& Ka,
+                     const glm::vec3& Kd,
+                     const glm::vec3& Ks,
+                     float Ns,
+                     float d);
+
+        /** number of materials in the table */
+        unsigned size() const;
+
+        /**
+         Uploads the table if materials were added since the last call, and binds the
+         buffer to the given uniform block binding point.
+         */
+        void bind(GLuint bindingPoint);
+
+    private:
+        std::vector<Entry> _entries;
+        GLuint _buffer;
+        bool _dirty;
+
+        //copying disabled
+        MaterialTable(const MaterialTable&);
+        const MaterialTable& operator=(const MaterialTable&);
+    };
+
+}
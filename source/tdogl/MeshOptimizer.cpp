@@ -0,0 +1,435 @@
+/*
+ tdogl::MeshOptimizer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+using namespace tdogl;
+
+/*
+ * Vertex welding
+ */
+
+namespace {
+    // all the attributes of one vertex, compared bit for bit
+    struct VertexKey {
+        float values[8];
+
+        bool operator==(const VertexKey& other) const {
+            return memcmp(values, other.values, sizeof(values)) == 0;
+        }
+    };
+
+    struct VertexKeyHash {
+        size_t operator()(const VertexKey& key) const {
+            //FNV-1a over the bytes
+            const unsigned char* bytes = (const unsigned char*)key.values;
+            size_t hash = 2166136261u;
+            for(size_t i = 0; i < sizeof(key.values); ++i)
+                hash = (hash ^ bytes[i]) * 16777619u;
+            return hash;
+        }
+    };
+}
+
+void MeshOptimizer::buildIndexed(std::vector<glm::vec3>& positions,
+                                 std::vector<glm::vec2>& uvs,
+                                 std::vector<glm::vec3>& normals,
+                                 std::vector<unsigned>& indices)
+{
+    const size_t count = positions.size();
+    const bool hasUVs = uvs.size() == count;
+    const bool hasNormals = normals.size() == count;
+
+    std::unordered_map<VertexKey, unsigned, VertexKeyHash> unique;
+    unique.reserve(count);
+    indices.resize(count);
+
+    //vertices are compacted in place: the write position never passes the read position
+    size_t uniqueCount = 0;
+    for(size_t i = 0; i < count; ++i){
+        VertexKey key;
+        memset(&key, 0, sizeof(key));
+        key.values[0] = positions[i].x;
+        key.values[1] = positions[i].y;
+        key.values[2] = positions[i].z;
+        if(hasUVs){
+            key.values[3] = uvs[i].x;
+            key.values[4] = uvs[i].y;
+        }
+        if(hasNormals){
+            key.values[5] = normals[i].x;
+            key.values[6] = normals[i].y;
+            key.values[7] = normals[i].z;
+        }
+
+        std::pair<std::unordered_map<VertexKey, unsigned, VertexKeyHash>::iterator, bool> inserted =
+            unique.insert(std::make_pair(key, (unsigned)uniqueCount));
+        if(inserted.second){
+            positions[uniqueCount] = positions[i];
+            if(hasUVs) uvs[uniqueCount] = uvs[i];
+            if(hasNormals) normals[uniqueCount] = normals[i];
+            ++uniqueCount;
+        }
+        indices[i] = inserted.first->second;
+    }
+
+    positions.resize(uniqueCount);
+    if(hasUVs) uvs.resize(uniqueCount);
+    if(hasNormals) normals.resize(uniqueCount);
+}
+
+
+/*
+ * Forsyth vertex cache optimisation
+ * https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+ */
+
+static const int MaxCacheSize = 32;
+static const float CacheDecayPower = 1.5f;
+static const float LastTriScore = 0.75f;
+static const float ValenceBoostScale = 2.0f;
+static const float ValenceBoostPower = 0.5f;
+static const int MaxValenceScores = 32;
+
+namespace {
+    struct ForsythTables {
+        float cache[MaxCacheSize];
+        float valence[MaxValenceScores];
+
+        ForsythTables() {
+            for(int i = 0; i < MaxCacheSize; ++i){
+                if(i < 3){
+                    //the last triangle's vertices are in the cache, but using them right
+                    //away makes a strip, which is worse than a fan
+                    cache[i] = LastTriScore;
+                } else {
+                    const float scaler = 1.0f / (MaxCacheSize - 3);
+                    cache[i] = powf(1.0f - (i - 3) * scaler, CacheDecayPower);
+                }
+            }
+            for(int i = 0; i < MaxValenceScores; ++i)
+                valence[i] = i == 0 ? 0.0f : ValenceBoostScale * powf((float)i, -ValenceBoostPower);
+        }
+    };
+}
+
+static float VertexScore(const ForsythTables& tables, int cachePosition, unsigned remainingValence) {
+    if(remainingValence == 0)
+        return -1.0f; //no triangles left, the vertex doesn't matter anymore
+
+    float score = cachePosition >= 0 ? tables.cache[cachePosition] : 0.0f;
+    if(remainingValence < (unsigned)MaxValenceScores)
+        score += tables.valence[remainingValence];
+    else
+        score += ValenceBoostScale * powf((float)remainingValence, -ValenceBoostPower);
+    return score;
+}
+
+void MeshOptimizer::optimizeVertexCache(unsigned* indices, size_t indexCount, size_t vertexCount) {
+    static const ForsythTables tables;
+    const size_t triangleCount = indexCount / 3;
+    if(triangleCount < 2)
+        return;
+
+    //triangles of each vertex, as one array sliced by offsets
+    std::vector<unsigned> valence(vertexCount, 0);
+    for(size_t i = 0; i < indexCount; ++i)
+        valence[indices[i]]++;
+
+    std::vector<unsigned> offsets(vertexCount + 1, 0);
+    for(size_t v = 0; v < vertexCount; ++v)
+        offsets[v + 1] = offsets[v] + valence[v];
+
+    std::vector<unsigned> adjacency(indexCount);
+    std::vector<unsigned> remaining(vertexCount, 0);
+    for(size_t t = 0; t < triangleCount; ++t){
+        for(int c = 0; c < 3; ++c){
+            unsigned v = indices[t * 3 + c];
+            adjacency[offsets[v] + remaining[v]++] = (unsigned)t;
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for(size_t v = 0; v < vertexCount; ++v)
+        vertexScore[v] = VertexScore(tables, -1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for(size_t t = 0; t < triangleCount; ++t){
+        const unsigned* tri = indices + t * 3;
+        triangleScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+    }
+
+    std::vector<unsigned> output;
+    output.reserve(indexCount);
+
+    unsigned cache[MaxCacheSize + 3];
+    int cacheSize = 0;
+    size_t nextUnemitted = 0;
+
+    long best = 0;
+    for(size_t t = 1; t < triangleCount; ++t){
+        if(triangleScore[t] > triangleScore[best])
+            best = (long)t;
+    }
+
+    while(best >= 0){
+        const unsigned* tri = indices + best * 3;
+        output.insert(output.end(), tri, tri + 3);
+        emitted[best] = true;
+
+        //take the triangle off its vertices' lists
+        for(int c = 0; c < 3; ++c){
+            unsigned v = tri[c];
+            unsigned* list = &adjacency[offsets[v]];
+            for(unsigned i = 0; i < remaining[v]; ++i){
+                if(list[i] == (unsigned)best){
+                    list[i] = list[remaining[v] - 1];
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        //the triangle's vertices go to the front of the LRU cache
+        unsigned newCache[MaxCacheSize + 3];
+        int newCacheSize = 0;
+        for(int c = 0; c < 3; ++c)
+            newCache[newCacheSize++] = tri[c];
+        for(int i = 0; i < cacheSize; ++i){
+            unsigned v = cache[i];
+            if(v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCacheSize++] = v;
+        }
+
+        //rescore everything that was in the cache, including what just fell out of it
+        for(int i = 0; i < newCacheSize; ++i){
+            unsigned v = newCache[i];
+            cachePosition[v] = i < MaxCacheSize ? i : -1;
+            vertexScore[v] = VertexScore(tables, cachePosition[v], remaining[v]);
+        }
+
+        best = -1;
+        float bestScore = 0.0f;
+        for(int i = 0; i < newCacheSize; ++i){
+            unsigned v = newCache[i];
+            const unsigned* list = &adjacency[offsets[v]];
+            for(unsigned j = 0; j < remaining[v]; ++j){
+                unsigned t = list[j];
+                const unsigned* other = indices + t * 3;
+                float score = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+                triangleScore[t] = score;
+                if(score > bestScore){
+                    bestScore = score;
+                    best = (long)t;
+                }
+            }
+        }
+
+        cacheSize = std::min(newCacheSize, MaxCacheSize);
+        memcpy(cache, newCache, cacheSize * sizeof(unsigned));
+
+        //dead end: continue with the next triangle in the input order
+        if(best < 0){
+            while(nextUnemitted < triangleCount && emitted[nextUnemitted])
+                ++nextUnemitted;
+            if(nextUnemitted < triangleCount)
+                best = (long)nextUnemitted;
+        }
+    }
+
+    memcpy(indices, &output[0], indexCount * sizeof(unsigned));
+}
+
+
+/*
+ * Overdraw ordering
+ */
+
+namespace {
+    struct Cluster {
+        size_t start;     // first index
+        size_t count;     // number of indices
+        float sortKey;
+    };
+
+    bool ClusterDrawsFirst(const Cluster& a, const Cluster& b) {
+        return a.sortKey > b.sortKey;
+    }
+}
+
+void MeshOptimizer::optimizeOverdraw(unsigned* indices,
+                                     size_t indexCount,
+                                     const std::vector<glm::vec3>& positions)
+{
+    const size_t triangleCount = indexCount / 3;
+    if(triangleCount < 2)
+        return;
+
+    const unsigned cacheSize = 16;
+    const size_t minClusterTriangles = 16;
+
+    //cut wherever the cache order starts over, i.e. a triangle misses all three vertices
+    std::vector<Cluster> clusters;
+    std::vector<unsigned> cacheStamp(positions.size(), 0);
+    unsigned time = cacheSize + 1;
+    for(size_t t = 0; t < triangleCount; ++t){
+        int misses = 0;
+        for(int c = 0; c < 3; ++c){
+            unsigned v = indices[t * 3 + c];
+            if(time - cacheStamp[v] > cacheSize){
+                cacheStamp[v] = time++;
+                misses++;
+            }
+        }
+
+        bool newCluster = clusters.empty() ||
+            (misses == 3 && clusters.back().count >= minClusterTriangles * 3);
+        if(newCluster){
+            Cluster cluster = { t * 3, 0, 0.0f };
+            clusters.push_back(cluster);
+        }
+        clusters.back().count += 3;
+    }
+
+    if(clusters.size() < 2)
+        return;
+
+    //clusters that face away from the middle of the mesh are on its outside, and likely
+    //to cover the others, so they are drawn first
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> clusterCenters(clusters.size());
+    std::vector<glm::vec3> clusterNormals(clusters.size());
+
+    for(size_t i = 0; i < clusters.size(); ++i){
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for(size_t k = clusters[i].start; k < clusters[i].start + clusters[i].count; k += 3){
+            const glm::vec3& a = positions[indices[k]];
+            const glm::vec3& b = positions[indices[k + 1]];
+            const glm::vec3& c = positions[indices[k + 2]];
+            glm::vec3 n = glm::cross(b - a, c - a); //length is twice the area
+            float triangleArea = glm::length(n);
+            center += (a + b + c) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+
+        meshCenter += center;
+        meshArea += area;
+        clusterCenters[i] = area > 0.0f ? center / area : positions[indices[clusters[i].start]];
+        clusterNormals[i] = normal;
+    }
+    if(meshArea > 0.0f)
+        meshCenter /= meshArea;
+
+    for(size_t i = 0; i < clusters.size(); ++i){
+        float normalLength = glm::length(clusterNormals[i]);
+        clusters[i].sortKey = normalLength > 0.0f ?
+            glm::dot(clusterCenters[i] - meshCenter, clusterNormals[i] / normalLength) : 0.0f;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), ClusterDrawsFirst);
+
+    std::vector<unsigned> output;
+    output.reserve(indexCount);
+    for(size_t i = 0; i < clusters.size(); ++i)
+        output.insert(output.end(), indices + clusters[i].start, indices + clusters[i].start + clusters[i].count);
+
+    memcpy(indices, &output[0], triangleCount * 3 * sizeof(unsigned));
+}
+
+
+/*
+ * Vertex fetch ordering
+ */
+
+template <typename T>
+static void RemapVertices(std::vector<T>& attribute, const std::vector<unsigned>& remap, size_t newCount) {
+    if(attribute.size() != remap.size())
+        return;
+
+    std::vector<T> reordered(newCount);
+    for(size_t v = 0; v < remap.size(); ++v){
+        if(remap[v] != ~0u)
+            reordered[remap[v]] = attribute[v];
+    }
+    attribute.swap(reordered);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<glm::vec3>& positions,
+                                        std::vector<glm::vec2>& uvs,
+                                        std::vector<glm::vec3>& normals,
+                                        std::vector<unsigned>& indices)
+{
+    std::vector<unsigned> remap(positions.size(), ~0u);
+    unsigned next = 0;
+    for(size_t i = 0; i < indices.size(); ++i){
+        unsigned& v = remap[indices[i]];
+        if(v == ~0u)
+            v = next++;
+        indices[i] = v;
+    }
+
+    RemapVertices(positions, remap, next);
+    RemapVertices(uvs, remap, next);
+    RemapVertices(normals, remap, next);
+}
+
+
+/*
+ * Analysis
+ */
+
+MeshOptimizer::CacheStats MeshOptimizer::analyzeVertexCache(const unsigned* indices,
+                                                            size_t indexCount,
+                                                            size_t vertexCount,
+                                                            unsigned cacheSize)
+{
+    CacheStats stats = { 0.0f, 0.0f };
+    if(indexCount < 3 || vertexCount == 0)
+        return stats;
+
+    std::vector<unsigned> cacheStamp(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    unsigned time = cacheSize + 1;
+    size_t misses = 0;
+    size_t usedCount = 0;
+
+    for(size_t i = 0; i < indexCount; ++i){
+        unsigned v = indices[i];
+        if(time - cacheStamp[v] > cacheSize){
+            cacheStamp[v] = time++;
+            misses++;
+        }
+        if(!used[v]){
+            used[v] = true;
+            usedCount++;
+        }
+    }
+
+    stats.acmr = (float)misses / (float)(indexCount / 3);
+    stats.atvr = (float)misses / (float)usedCount;
+    return stats;
+}
@@ -0,0 +1,89 @@
+/*
+ tdogl::MeshOptimizer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     Reorders indexed triangle meshes so they draw faster.
+
+     None of the functions change what the mesh looks like, only the order of the triangles
+     and vertices. They don't use OpenGL, so they can run on worker threads.
+     */
+    class MeshOptimizer {
+    public:
+        /**
+         How well a triangle order uses the post-transform vertex cache.
+         */
+        struct CacheStats {
+            float acmr; /**< average cache miss ratio: vertices transformed per triangle (0.5 - 3) */
+            float atvr; /**< average transformed vertex ratio: transforms per unique vertex (1 = ideal) */
+        };
+
+        /**
+         Merges the identical vertices of a flat triangle list.
+
+         On input the attribute arrays hold 3 vertices per triangle. On output they hold
+         each unique vertex once, and `indices` holds 3 indices per triangle, in the same
+         order as the input triangles. `uvs` and `normals` may be empty.
+         */
+        static void buildIndexed(std::vector<glm::vec3>& positions,
+                                 std::vector<glm::vec2>& uvs,
+                                 std::vector<glm::vec3>& normals,
+                                 std::vector<unsigned>& indices);
+
+        /**
+         Reorders the triangles of `indices[0, indexCount)` for the vertex cache, using Tom
+         Forsyth's linear-speed vertex cache optimisation.
+         */
+        static void optimizeVertexCache(unsigned* indices, size_t indexCount, size_t vertexCount);
+
+        /**
+         Reorders clusters of triangles so the ones most likely to be in front are drawn
+         first, which lets early-Z reject more of the hidden pixels.
+
+         Clusters are cut where the cache order already restarts, so the result of
+         optimizeVertexCache is mostly kept. Call it after optimizeVertexCache.
+         */
+        static void optimizeOverdraw(unsigned* indices,
+                                     size_t indexCount,
+                                     const std::vector<glm::vec3>& positions);
+
+        /**
+         Reorders the vertices in the order the indices first use them, so vertex fetch
+         reads memory sequentially. The indices are remapped to match.
+         */
+        static void optimizeVertexFetch(std::vector<glm::vec3>& positions,
+                                        std::vector<glm::vec2>& uvs,
+                                        std::vector<glm::vec3>& normals,
+                                        std::vector<unsigned>& indices);
+
+        /**
+         Simulates a FIFO vertex cache of the given size to measure a triangle order.
+         */
+        static CacheStats analyzeVertexCache(const unsigned* indices,
+                                             size_t indexCount,
+                                             size_t vertexCount,
+                                             unsigned cacheSize = 16);
+    };
+
+}
@@ -0,0 +1,455 @@
+/*
+ tdogl::MeshSimplifier
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+using namespace tdogl;
+
+// how much more the planes through the open borders count than the surface itself
+static const double BorderWeight = 10.0;
+
+namespace {
+    // sum of squared distances to a set of planes: p'Ap + 2b'p + c, weighted by area
+    struct Quadric {
+        double a00, a01, a02, a11, a12, a22;
+        double b0, b1, b2;
+        double c;
+        double weight;
+
+        Quadric() { memset(this, 0, sizeof(Quadric)); }
+
+        Quadric(const glm::vec3& normal, float distance, double w) {
+            double x = normal.x, y = normal.y, z = normal.z, d = distance;
+            a00 = w * x * x; a01 = w * x * y; a02 = w * x * z;
+            a11 = w * y * y; a12 = w * y * z;
+            a22 = w * z * z;
+            b0 = w * x * d; b1 = w * y * d; b2 = w * z * d;
+            c = w * d * d;
+            weight = w;
+        }
+
+        Quadric& operator+=(const Quadric& q) {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02;
+            a11 += q.a11; a12 += q.a12;
+            a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2;
+            c += q.c;
+            weight += q.weight;
+            return *this;
+        }
+
+        // mean squared distance of `p` to the planes
+        double error(const glm::vec3& p) const {
+            double x = p.x, y = p.y, z = p.z;
+            double e = x * (a00 * x + 2.0 * (a01 * y + a02 * z + b0)) +
+                       y * (a11 * y + 2.0 * (a12 * z + b1)) +
+                       z * (a22 * z + 2.0 * b2) + c;
+            return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+        }
+    };
+
+    // moving vertex `from` onto `to`. The versions tell whether the cost is still up to date.
+    struct Collapse {
+        float cost;
+        unsigned from, to;
+        unsigned fromVersion, toVersion;
+
+        bool operator<(const Collapse& other) const {
+            return cost > other.cost; //std::priority_queue pops the largest, we want the cheapest
+        }
+    };
+
+    struct PositionHash {
+        size_t operator()(const glm::vec3& p) const {
+            unsigned bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+
+    struct PositionEqual {
+        bool operator()(const glm::vec3& a, const glm::vec3& b) const {
+            return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+        }
+    };
+
+    class Simplifier {
+    public:
+        Simplifier(const std::vector<glm::vec3>& positions,
+                   const std::vector<glm::vec2>& uvs,
+                   const std::vector<glm::vec3>& normals,
+                   const std::vector<unsigned>& indices,
+                   const std::vector<unsigned>& rangeStarts);
+
+        unsigned liveTriangles() const { return _liveTriangles; }
+        float error() const { return (float)sqrt(_maxError); }
+
+        // collapses edges until at most `target` triangles are left, or nothing can be collapsed
+        void run(unsigned target);
+
+        // copies the live triangles into `level`
+        void snapshot(MeshSimplifier::Level& level) const;
+
+    private:
+        const std::vector<glm::vec3>& _vertices;
+        const std::vector<glm::vec2>& _uvs;
+        const std::vector<glm::vec3>& _normals;
+        std::vector<unsigned> _rangeStarts;
+
+        std::vector<unsigned> _corners;         //current vertex of each triangle corner
+        std::vector<unsigned> _triangleRange;
+        std::vector<bool> _triangleDead;
+        unsigned _liveTriangles;
+
+        //"points" are the unique positions, shared by the vertices of a seam
+        std::vector<unsigned> _pointOf;          //vertex -> point
+        std::vector<glm::vec3> _points;
+        std::vector<std::vector<unsigned> > _pointVertices;
+        std::vector<std::vector<unsigned> > _pointTriangles;
+        std::vector<Quadric> _quadrics;
+        std::vector<bool> _border;
+        std::vector<bool> _dead;
+        std::vector<unsigned> _version;
+
+        std::priority_queue<Collapse> _queue;
+        double _maxError;
+
+        unsigned _point(unsigned triangle, int corner) const { return _pointOf[_corners[triangle * 3 + corner]]; }
+        bool _isBorderEdge(unsigned a, unsigned b) const;
+        bool _flips(unsigned from, unsigned to) const;
+        void _pushEdge(unsigned a, unsigned b);
+        unsigned _closestVertex(unsigned vertex, unsigned point) const;
+        void _collapse(unsigned from, unsigned to);
+    };
+}
+
+Simplifier::Simplifier(const std::vector<glm::vec3>& positions,
+                       const std::vector<glm::vec2>& uvs,
+                       const std::vector<glm::vec3>& normals,
+                       const std::vector<unsigned>& indices,
+                       const std::vector<unsigned>& rangeStarts) :
+    _vertices(positions),
+    _uvs(uvs),
+    _normals(normals),
+    _rangeStarts(rangeStarts),
+    _corners(indices),
+    _liveTriangles((unsigned)(indices.size() / 3)),
+    _maxError(0.0)
+{
+    if(_rangeStarts.empty())
+        _rangeStarts.push_back(0);
+
+    //weld the vertices by position
+    std::unordered_map<glm::vec3, unsigned, PositionHash, PositionEqual> unique;
+    unique.reserve(positions.size());
+    _pointOf.resize(positions.size());
+    for(size_t v = 0; v < positions.size(); ++v){
+        std::pair<std::unordered_map<glm::vec3, unsigned, PositionHash, PositionEqual>::iterator, bool> inserted =
+            unique.insert(std::make_pair(positions[v], (unsigned)_points.size()));
+        if(inserted.second){
+            _points.push_back(positions[v]);
+            _pointVertices.push_back(std::vector<unsigned>());
+        }
+        _pointOf[v] = inserted.first->second;
+        _pointVertices[inserted.first->second].push_back((unsigned)v);
+    }
+
+    const size_t pointCount = _points.size();
+    const unsigned triangleCount = _liveTriangles;
+    _pointTriangles.resize(pointCount);
+    _quadrics.resize(pointCount);
+    _border.resize(pointCount, false);
+    _dead.resize(pointCount, false);
+    _version.resize(pointCount, 0);
+    _triangleDead.resize(triangleCount, false);
+    _triangleRange.resize(triangleCount);
+
+    unsigned range = 0;
+    for(unsigned t = 0; t < triangleCount; ++t){
+        while(range + 1 < _rangeStarts.size() && t * 3 >= _rangeStarts[range + 1])
+            ++range;
+        _triangleRange[t] = range;
+
+        for(int c = 0; c < 3; ++c)
+            _pointTriangles[_point(t, c)].push_back(t);
+
+        const glm::vec3& p0 = _points[_point(t, 0)];
+        glm::vec3 normal = glm::cross(_points[_point(t, 1)] - p0, _points[_point(t, 2)] - p0);
+        float length = glm::length(normal);
+        if(length <= 0.0f)
+            continue;
+        normal /= length;
+
+        Quadric plane(normal, -glm::dot(normal, p0), 0.5 * length);
+        for(int c = 0; c < 3; ++c)
+            _quadrics[_point(t, c)] += plane;
+    }
+
+    //borders get planes perpendicular to their triangle, so they stay in place
+    for(unsigned t = 0; t < triangleCount; ++t){
+        const glm::vec3& p0 = _points[_point(t, 0)];
+        glm::vec3 normal = glm::cross(_points[_point(t, 1)] - p0, _points[_point(t, 2)] - p0);
+        if(glm::length(normal) <= 0.0f)
+            continue;
+        normal = glm::normalize(normal);
+
+        for(int c = 0; c < 3; ++c){
+            unsigned a = _point(t, c), b = _point(t, (c + 1) % 3);
+            if(a == b || !_isBorderEdge(a, b))
+                continue;
+
+            _border[a] = _border[b] = true;
+            glm::vec3 edge = _points[b] - _points[a];
+            float edgeLength = glm::length(edge);
+            if(edgeLength <= 0.0f)
+                continue;
+            glm::vec3 sideNormal = glm::normalize(glm::cross(edge, normal));
+            Quadric side(sideNormal, -glm::dot(sideNormal, _points[a]), BorderWeight * edgeLength * edgeLength);
+            _quadrics[a] += side;
+            _quadrics[b] += side;
+        }
+    }
+
+    for(unsigned t = 0; t < triangleCount; ++t){
+        for(int c = 0; c < 3; ++c){
+            _pushEdge(_point(t, c), _point(t, (c + 1) % 3));
+        }
+    }
+}
+
+// an edge of only one triangle, or between triangles of different ranges
+bool Simplifier::_isBorderEdge(unsigned a, unsigned b) const {
+    unsigned shared = 0, range = 0;
+    bool mixedRanges = false;
+    const std::vector<unsigned>& triangles = _pointTriangles[a];
+    for(size_t i = 0; i < triangles.size(); ++i){
+        unsigned t = triangles[i];
+        if(_triangleDead[t])
+            continue;
+        if(_point(t, 0) != b && _point(t, 1) != b && _point(t, 2) != b)
+            continue;
+        if(shared > 0 && _triangleRange[t] != range)
+            mixedRanges = true;
+        range = _triangleRange[t];
+        ++shared;
+    }
+    return shared != 2 || mixedRanges;
+}
+
+// whether moving `from` onto `to` turns a remaining triangle over, or makes it a sliver
+bool Simplifier::_flips(unsigned from, unsigned to) const {
+    const std::vector<unsigned>& triangles = _pointTriangles[from];
+    for(size_t i = 0; i < triangles.size(); ++i){
+        unsigned t = triangles[i];
+        if(_triangleDead[t])
+            continue;
+
+        unsigned p[3] = { _point(t, 0), _point(t, 1), _point(t, 2) };
+        if(p[0] == to || p[1] == to || p[2] == to)
+            continue; //this one goes away
+
+        glm::vec3 moved[3];
+        for(int c = 0; c < 3; ++c)
+            moved[c] = _points[p[c] == from ? to : p[c]];
+
+        glm::vec3 before = glm::cross(_points[p[1]] - _points[p[0]], _points[p[2]] - _points[p[0]]);
+        glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+        float beforeLength = glm::length(before), afterLength = glm::length(after);
+        if(beforeLength <= 0.0f)
+            continue;
+        if(afterLength <= 0.0f || glm::dot(before, after) < 0.25f * beforeLength * afterLength)
+            return true;
+    }
+    return false;
+}
+
+void Simplifier::_pushEdge(unsigned a, unsigned b) {
+    if(a == b || _dead[a] || _dead[b])
+        return;
+
+    Quadric q = _quadrics[a];
+    q += _quadrics[b];
+
+    //a border vertex can only slide along its border
+    bool borderEdge = (_border[a] || _border[b]) && _isBorderEdge(a, b);
+    bool canMoveA = !_border[a] || borderEdge;
+    bool canMoveB = !_border[b] || borderEdge;
+
+    Collapse collapse;
+    if(canMoveA && (!canMoveB || q.error(_points[b]) <= q.error(_points[a]))){
+        collapse.from = a;
+        collapse.to = b;
+    } else if(canMoveB){
+        collapse.from = b;
+        collapse.to = a;
+    } else {
+        return;
+    }
+
+    collapse.cost = (float)q.error(_points[collapse.to]);
+    collapse.fromVersion = _version[collapse.from];
+    collapse.toVersion = _version[collapse.to];
+    _queue.push(collapse);
+}
+
+// the vertex of `point` whose normal and uv are closest to those of `vertex`
+unsigned Simplifier::_closestVertex(unsigned vertex, unsigned point) const {
+    const std::vector<unsigned>& candidates = _pointVertices[point];
+    unsigned best = candidates[0];
+    float bestDistance = -1.0f;
+    for(size_t i = 0; i < candidates.size(); ++i){
+        unsigned v = candidates[i];
+        float distance = 0.0f;
+        if(_normals.size() == _vertices.size()){
+            glm::vec3 d = _normals[v] - _normals[vertex];
+            distance += glm::dot(d, d);
+        }
+        if(_uvs.size() == _vertices.size()){
+            glm::vec2 d = _uvs[v] - _uvs[vertex];
+            distance += glm::dot(d, d);
+        }
+        if(bestDistance < 0.0f || distance < bestDistance){
+            best = v;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+void Simplifier::_collapse(unsigned from, unsigned to) {
+    std::vector<unsigned>& fromTriangles = _pointTriangles[from];
+    std::vector<unsigned>& toTriangles = _pointTriangles[to];
+
+    for(size_t i = 0; i < fromTriangles.size(); ++i){
+        unsigned t = fromTriangles[i];
+        if(_triangleDead[t])
+            continue;
+
+        unsigned* corners = &_corners[t * 3];
+        if(_pointOf[corners[0]] == to || _pointOf[corners[1]] == to || _pointOf[corners[2]] == to){
+            _triangleDead[t] = true;
+            --_liveTriangles;
+            continue;
+        }
+
+        for(int c = 0; c < 3; ++c){
+            if(_pointOf[corners[c]] == from)
+                corners[c] = _closestVertex(corners[c], to);
+        }
+        toTriangles.push_back(t);
+    }
+
+    _quadrics[to] += _quadrics[from];
+    _dead[from] = true;
+    _version[to]++;
+    std::vector<unsigned>().swap(fromTriangles);
+
+    //drop the dead triangles, and queue the edges around `to` with their new costs
+    size_t kept = 0;
+    for(size_t i = 0; i < toTriangles.size(); ++i){
+        unsigned t = toTriangles[i];
+        if(_triangleDead[t])
+            continue;
+        toTriangles[kept++] = t;
+    }
+    toTriangles.resize(kept);
+
+    for(size_t i = 0; i < toTriangles.size(); ++i){
+        unsigned t = toTriangles[i];
+        for(int c = 0; c < 3; ++c){
+            unsigned p = _point(t, c);
+            if(p != to)
+                _pushEdge(to, p);
+        }
+    }
+}
+
+void Simplifier::run(unsigned target) {
+    while(_liveTriangles > target && !_queue.empty()){
+        Collapse collapse = _queue.top();
+        _queue.pop();
+
+        if(_dead[collapse.from] || _dead[collapse.to] ||
+           _version[collapse.from] != collapse.fromVersion ||
+           _version[collapse.to] != collapse.toVersion)
+            continue; //out of date
+
+        if(_flips(collapse.from, collapse.to))
+            continue;
+
+        _maxError = std::max(_maxError, (double)collapse.cost);
+        _collapse(collapse.from, collapse.to);
+    }
+}
+
+void Simplifier::snapshot(MeshSimplifier::Level& level) const {
+    level.error = error();
+    level.indices.clear();
+    level.indices.reserve(_liveTriangles * 3);
+    level.rangeCounts.assign(_rangeStarts.size(), 0);
+
+    for(unsigned t = 0; t < _triangleDead.size(); ++t){
+        if(_triangleDead[t])
+            continue;
+        level.indices.insert(level.indices.end(), &_corners[t * 3], &_corners[t * 3] + 3);
+        level.rangeCounts[_triangleRange[t]] += 3;
+    }
+}
+
+void MeshSimplifier::buildLevels(const std::vector<glm::vec3>& positions,
+                                 const std::vector<glm::vec2>& uvs,
+                                 const std::vector<glm::vec3>& normals,
+                                 const std::vector<unsigned>& indices,
+                                 const std::vector<unsigned>& rangeStarts,
+                                 float ratio,
+                                 unsigned minTriangles,
+                                 unsigned maxLevels,
+                                 std::vector<Level>& levels)
+{
+    levels.clear();
+    unsigned previous = (unsigned)(indices.size() / 3);
+    if(previous * ratio < minTriangles)
+        return;
+
+    Simplifier simplifier(positions, uvs, normals, indices, rangeStarts);
+
+    while(levels.size() < maxLevels){
+        unsigned target = (unsigned)(previous * ratio);
+        if(target < minTriangles)
+            break;
+
+        simplifier.run(target);
+
+        //a level that is barely smaller than the previous one isn't worth its memory
+        unsigned reached = simplifier.liveTriangles();
+        if(reached > previous - previous / 8)
+            break;
+
+        levels.push_back(Level());
+        simplifier.snapshot(levels.back());
+        previous = reached;
+
+        if(reached > target)
+            break; //ran out of edges to collapse
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ tdogl::MeshSimplifier
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     Makes levels of detail of indexed triangle meshes.
+
+     Edges are collapsed in the order of their quadric error (Garland and Heckbert,
+     "Surface Simplification Using Quadric Error Metrics"). Each collapse moves one vertex
+     onto the other, so the simplified meshes are new index buffers into the original
+     vertex arrays, and all the levels can share one vertex buffer.
+
+     Doesn't use OpenGL, so it can run on worker threads.
+     */
+    class MeshSimplifier {
+    public:
+        /**
+         One simplified version of a mesh.
+         */
+        struct Level {
+            /** roughly the largest distance between this level and the full mesh, in model units */
+            float error;
+
+            /** the remaining triangles, 3 indices each, in the order of the input */
+            std::vector<unsigned> indices;
+
+            /** the number of indices left in each of the input ranges */
+            std::vector<unsigned> rangeCounts;
+        };
+
+        /**
+         Simplifies a mesh step by step, keeping a copy every time the triangle count
+         falls to the next target.
+
+         The mesh can be split into ranges of indices (e.g. one per material). Triangles stay
+         in their range, and the edges between ranges are kept like the open borders of the
+         mesh, so each level can still be drawn range by range.
+
+         @param positions     The vertex positions. Vertices with the same position are treated
+                              as one, so seams in the other attributes don't stop the collapses.
+         @param uvs           Used to choose the vertex a seam vertex collapses into. May be empty.
+         @param normals       Like `uvs`. May be empty.
+         @param indices       3 per triangle
+         @param rangeStarts   The first index of each range, in increasing order. Empty means
+                              one range for the whole mesh.
+         @param ratio         Each level has at most `ratio` times the triangles of the previous one
+         @param minTriangles  No level is made with fewer triangles than this
+         @param maxLevels     The most levels to make
+         @param levels        Receives the levels, from the most detailed to the least. The full
+                              mesh is not included.
+         */
+        static void buildLevels(const std::vector<glm::vec3>& positions,
+                                const std::vector<glm::vec2>& uvs,
+                                const std::vector<glm::vec3>& normals,
+                                const std::vector<unsigned>& indices,
+                                const std::vector<unsigned>& rangeStarts,
+                                float ratio,
+                                unsigned minTriangles,
+                                unsigned maxLevels,
+                                std::vector<Level>& levels);
+    };
+
+}
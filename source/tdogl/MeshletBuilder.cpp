@@ -0,0 +1,264 @@
+/*
+ tdogl::MeshletBuilder
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "MeshletBuilder.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+using namespace tdogl;
+
+// a normal cone wider than this (cosine of the half angle) is not worth testing
+static const float MinConeCosine = 0.1f;
+
+namespace {
+    struct PositionHash {
+        size_t operator()(const glm::vec3& p) const {
+            unsigned bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+
+    struct PositionEqual {
+        bool operator()(const glm::vec3& a, const glm::vec3& b) const {
+            return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+        }
+    };
+
+    typedef std::unordered_map<glm::vec3, unsigned, PositionHash, PositionEqual> PointMap;
+}
+
+// gives the same id to the corners that have the same position
+static unsigned WeldCorners(const unsigned* indices,
+                            size_t indexCount,
+                            const std::vector<glm::vec3>& positions,
+                            std::vector<unsigned>& points)
+{
+    PointMap ids;
+    ids.reserve(indexCount);
+    points.resize(indexCount);
+    for(size_t i = 0; i < indexCount; ++i)
+        points[i] = ids.insert(std::make_pair(positions[indices[i]], (unsigned)ids.size())).first->second;
+    return (unsigned)ids.size();
+}
+
+// bounding sphere and normal cone of a finished meshlet
+static void ComputeBounds(const unsigned* indices,
+                          unsigned indexCount,
+                          const std::vector<glm::vec3>& positions,
+                          bool cullBackfaces,
+                          Meshlet& meshlet)
+{
+    glm::vec3 low = positions[indices[0]], high = low;
+    for(unsigned i = 1; i < indexCount; ++i){
+        low = glm::min(low, positions[indices[i]]);
+        high = glm::max(high, positions[indices[i]]);
+    }
+
+    meshlet.center = (low + high) * 0.5f;
+    meshlet.radius = 0.0f;
+    for(unsigned i = 0; i < indexCount; ++i)
+        meshlet.radius = std::max(meshlet.radius, glm::length(positions[indices[i]] - meshlet.center));
+
+    meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.coneCutoff = 2.0f;
+    if(!cullBackfaces)
+        return;
+
+    std::vector<glm::vec3> normals;
+    glm::vec3 sum(0.0f);
+    for(unsigned i = 0; i < indexCount; i += 3){
+        const glm::vec3& a = positions[indices[i]];
+        glm::vec3 n = glm::cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a);
+        float length = glm::length(n);
+        if(length <= 0.0f)
+            continue;
+        normals.push_back(n / length);
+        sum += normals.back();
+    }
+
+    float sumLength = glm::length(sum);
+    if(normals.empty() || sumLength <= 0.0f)
+        return;
+
+    glm::vec3 axis = sum / sumLength;
+    float minCosine = 1.0f;
+    for(size_t i = 0; i < normals.size(); ++i)
+        minCosine = std::min(minCosine, glm::dot(axis, normals[i]));
+
+    meshlet.coneAxis = axis;
+    if(minCosine > MinConeCosine)
+        meshlet.coneCutoff = sqrtf(1.0f - minCosine * minCosine);
+}
+
+// vertex cache order inside one meshlet, on a compact copy of its indices
+static void OptimizeMeshletOrder(unsigned* indices, unsigned indexCount) {
+    std::vector<unsigned> local(indexCount), global;
+    std::unordered_map<unsigned, unsigned> ids;
+    for(unsigned i = 0; i < indexCount; ++i){
+        std::pair<std::unordered_map<unsigned, unsigned>::iterator, bool> inserted =
+            ids.insert(std::make_pair(indices[i], (unsigned)global.size()));
+        if(inserted.second)
+            global.push_back(indices[i]);
+        local[i] = inserted.first->second;
+    }
+
+    MeshOptimizer::optimizeVertexCache(&local[0], indexCount, global.size());
+    for(unsigned i = 0; i < indexCount; ++i)
+        indices[i] = global[local[i]];
+}
+
+void MeshletBuilder::build(std::vector<unsigned>& indices,
+                           unsigned start,
+                           unsigned count,
+                           const std::vector<glm::vec3>& positions,
+                           bool cullBackfaces,
+                           std::vector<Meshlet>& meshlets)
+{
+    const unsigned triangleCount = count / 3;
+    if(triangleCount == 0)
+        return;
+    const unsigned* input = &indices[start];
+
+    //triangles around each position
+    std::vector<unsigned> points;
+    unsigned pointCount = WeldCorners(input, triangleCount * 3, positions, points);
+
+    std::vector<unsigned> offsets(pointCount + 1, 0);
+    for(unsigned i = 0; i < triangleCount * 3; ++i)
+        offsets[points[i] + 1]++;
+    for(unsigned p = 0; p < pointCount; ++p)
+        offsets[p + 1] += offsets[p];
+
+    std::vector<unsigned> adjacency(triangleCount * 3);
+    std::vector<unsigned> filled(offsets.begin(), offsets.end() - 1);
+    for(unsigned i = 0; i < triangleCount * 3; ++i)
+        adjacency[filled[points[i]]++] = i / 3;
+
+    std::vector<glm::vec3> centroids(triangleCount);
+    for(unsigned t = 0; t < triangleCount; ++t)
+        centroids[t] = (positions[input[t * 3]] + positions[input[t * 3 + 1]] + positions[input[t * 3 + 2]]) / 3.0f;
+
+    enum { Free = 0, Candidate, Taken };
+    std::vector<unsigned char> state(triangleCount, Free);
+    std::vector<unsigned> candidates;
+    std::vector<unsigned> output;
+    output.reserve(triangleCount * 3);
+    unsigned seed = 0;
+
+    //grow each meshlet from the first free triangle, always adding the neighbour closest to
+    //the meshlet's centre, which keeps the bounding spheres small
+    while(true){
+        while(seed < triangleCount && state[seed] == Taken)
+            ++seed;
+        if(seed == triangleCount)
+            break;
+
+        const unsigned first = (unsigned)output.size();
+        glm::vec3 sum(0.0f);
+        unsigned size = 0;
+        unsigned next = seed;
+
+        while(true){
+            state[next] = Taken;
+            output.insert(output.end(), input + next * 3, input + next * 3 + 3);
+            sum += centroids[next];
+            if(++size == MaxTriangles)
+                break;
+
+            for(int c = 0; c < 3; ++c){
+                unsigned p = points[next * 3 + c];
+                for(unsigned i = offsets[p]; i < offsets[p + 1]; ++i){
+                    unsigned t = adjacency[i];
+                    if(state[t] == Free){
+                        state[t] = Candidate;
+                        candidates.push_back(t);
+                    }
+                }
+            }
+            if(candidates.empty())
+                break;
+
+            glm::vec3 center = sum / (float)size;
+            size_t best = 0;
+            float bestDistance = -1.0f;
+            for(size_t i = 0; i < candidates.size(); ++i){
+                glm::vec3 d = centroids[candidates[i]] - center;
+                float distance = glm::dot(d, d);
+                if(bestDistance < 0.0f || distance < bestDistance){
+                    best = i;
+                    bestDistance = distance;
+                }
+            }
+            next = candidates[best];
+            candidates[best] = candidates.back();
+            candidates.pop_back();
+        }
+
+        //the neighbours that didn't fit are free for the next meshlet
+        for(size_t i = 0; i < candidates.size(); ++i)
+            state[candidates[i]] = Free;
+        candidates.clear();
+
+        OptimizeMeshletOrder(&output[first], size * 3);
+
+        Meshlet meshlet;
+        meshlet.indexStart = start + first;
+        meshlet.indexCount = size * 3;
+        ComputeBounds(&output[first], size * 3, positions, cullBackfaces, meshlet);
+        meshlets.push_back(meshlet);
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin() + start);
+}
+
+bool MeshletBuilder::isClosed(const unsigned* indices, size_t indexCount, const std::vector<glm::vec3>& positions) {
+    std::vector<unsigned> points;
+    WeldCorners(indices, indexCount, positions, points);
+
+    //each directed edge once, and its reverse once
+    std::unordered_map<unsigned long long, unsigned> edges;
+    edges.reserve(indexCount);
+    for(size_t t = 0; t + 2 < indexCount; t += 3){
+        for(int c = 0; c < 3; ++c){
+            unsigned a = points[t + c], b = points[t + (c + 1) % 3];
+            if(a != b)
+                edges[((unsigned long long)a << 32) | b]++;
+        }
+    }
+
+    for(std::unordered_map<unsigned long long, unsigned>::const_iterator it = edges.begin(); it != edges.end(); ++it){
+        unsigned long long reverse = (it->first << 32) | (it->first >> 32);
+        std::unordered_map<unsigned long long, unsigned>::const_iterator twin = edges.find(reverse);
+        if(it->second != 1 || twin == edges.end() || twin->second != 1)
+            return false;
+    }
+    return true;
+}
+
+bool MeshletBuilder::isVisible(const Meshlet& meshlet, const Frustum& frustum, const glm::vec3& eye) {
+    if(!frustum.intersectsSphere(meshlet.center, meshlet.radius))
+        return false;
+
+    //every point of the sphere sees all the normals of the cone from behind
+    glm::vec3 toCenter = meshlet.center - eye;
+    return glm::dot(toCenter, meshlet.coneAxis) < meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
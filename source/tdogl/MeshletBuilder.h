@@ -0,0 +1,88 @@
+/*
+ tdogl::MeshletBuilder
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "Frustum.h"
+
+namespace tdogl {
+
+    /**
+     A small cluster of neighbouring triangles that is culled as a whole.
+     */
+    struct Meshlet {
+        /** the range of the mesh's index array */
+        unsigned indexStart;
+        unsigned indexCount;
+
+        /** bounding sphere, in model space */
+        glm::vec3 center;
+        float radius;
+
+        /** all the triangle normals are within the cone around `coneAxis` */
+        glm::vec3 coneAxis;
+
+        /** sine of the cone's half angle. More than 1 if the triangles can't all face away at once. */
+        float coneCutoff;
+    };
+
+    /**
+     Splits indexed meshes into meshlets, and tests them for visibility.
+
+     The builder doesn't use OpenGL, so it can run on worker threads.
+     */
+    class MeshletBuilder {
+    public:
+        /** the most triangles in a meshlet */
+        static const unsigned MaxTriangles = 128;
+
+        /**
+         Reorders the triangles of `indices[start, start + count)` into meshlets of up to
+         MaxTriangles neighbouring triangles, and appends the meshlets to `meshlets`.
+
+         Triangles are neighbours when they share a position, so flat shaded meshes, which
+         share no vertices, still make compact meshlets.
+
+         @param cullBackfaces  Whether the meshlets get normal cones. Without back face
+                               culling in GL, the back faces of open meshes can be seen,
+                               so only closed meshes should have them (see `isClosed`).
+         */
+        static void build(std::vector<unsigned>& indices,
+                          unsigned start,
+                          unsigned count,
+                          const std::vector<glm::vec3>& positions,
+                          bool cullBackfaces,
+                          std::vector<Meshlet>& meshlets);
+
+        /**
+         @result true if every edge of the triangles, by position, has exactly one triangle
+                 on each side, so no back face can ever be seen.
+         */
+        static bool isClosed(const unsigned* indices, size_t indexCount, const std::vector<glm::vec3>& positions);
+
+        /**
+         @param frustum  The view volume, in the mesh's model space
+         @param eye      The eye position, in the mesh's model space
+         @result false if the meshlet is outside the frustum, or all its triangles face away
+         */
+        static bool isVisible(const Meshlet& meshlet, const Frustum& frustum, const glm::vec3& eye);
+    };
+
+}
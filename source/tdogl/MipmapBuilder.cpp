@@ -0,0 +1,195 @@
+/*
+ tdogl::MipmapBuilder
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "MipmapBuilder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TDOGL_MIPMAP_SSE2 1
+#endif
+
+using namespace tdogl;
+
+static const uint32_t MipmapCacheVersion = 1;
+static const unsigned GrainRows = 16;
+
+namespace {
+    // 16 bit linear light for every 8 bit sRGB value, and 8 bit sRGB for every 16 bit linear value
+    struct GammaTables {
+        uint16_t toLinear[256];
+        unsigned char toSrgb[65536];
+
+        GammaTables() {
+            for(int i = 0; i < 256; ++i){
+                double c = i / 255.0;
+                double linear = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+                toLinear[i] = (uint16_t)(linear * 65535.0 + 0.5);
+            }
+            for(int i = 0; i < 65536; ++i){
+                double linear = i / 65535.0;
+                double c = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+                toSrgb[i] = (unsigned char)(c * 255.0 + 0.5);
+            }
+        }
+    };
+}
+
+static const GammaTables& Tables() {
+    static const GammaTables tables;
+    return tables;
+}
+
+// the index of the alpha channel of a pixel, or -1
+static int AlphaChannel(Bitmap::Format format) {
+    switch(format){
+        case Bitmap::Format_GrayscaleAlpha: return 1;
+        case Bitmap::Format_RGBA:           return 3;
+        default:                            return -1;
+    }
+}
+
+// one row of a bitmap in 16 bit linear light. Alpha is scaled to 16 bits as it is.
+static void RowToLinear(const unsigned char* row, unsigned channelCount, int alpha, const GammaTables& tables, uint16_t* linear) {
+    for(unsigned i = 0; i < channelCount; ++i)
+        linear[i] = tables.toLinear[row[i]];
+    if(alpha >= 0){
+        const unsigned pixelSize = alpha + 1;
+        for(unsigned i = alpha; i < channelCount; i += pixelSize)
+            linear[i] = (uint16_t)(row[i] * 257);
+    }
+}
+
+// a = the rounded average of a and b, channel by channel
+static void AverageRows(uint16_t* a, const uint16_t* b, unsigned channelCount) {
+    unsigned i = 0;
+#ifdef TDOGL_MIPMAP_SSE2
+    for(; i + 8 <= channelCount; i += 8){
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        _mm_storeu_si128((__m128i*)(a + i), _mm_avg_epu16(va, vb));
+    }
+#endif
+    for(; i < channelCount; ++i)
+        a[i] = (uint16_t)((a[i] + b[i] + 1) >> 1);
+}
+
+// makes the rows [begin, end) of `dest` from the rows twice as far down `src`
+static void DownsampleRows(const Bitmap& src, Bitmap& dest, unsigned begin, unsigned end) {
+    const GammaTables& tables = Tables();
+    const unsigned pixelSize = src.format();
+    const int alpha = AlphaChannel(src.format());
+    const unsigned srcChannels = src.width() * pixelSize;
+    std::vector<uint16_t> top(srcChannels), bottom(srcChannels);
+
+    for(unsigned row = begin; row < end; ++row){
+        unsigned srcRow = 2 * row;
+        unsigned srcRowBelow = std::min(srcRow + 1, src.height() - 1);
+        RowToLinear(src.getPixel(0, srcRow), srcChannels, alpha, tables, &top[0]);
+        RowToLinear(src.getPixel(0, srcRowBelow), srcChannels, alpha, tables, &bottom[0]);
+        AverageRows(&top[0], &bottom[0], srcChannels);
+
+        //every channel goes through the sRGB table, then alpha is redone
+        unsigned char* out = dest.getPixel(0, row);
+        const unsigned destWidth = dest.width();
+        const unsigned lastCol = src.width() - 1;
+        for(unsigned col = 0; col < destWidth; ++col){
+            const uint16_t* left = &top[2 * col * pixelSize];
+            const uint16_t* right = &top[std::min(2 * col + 1, lastCol) * pixelSize];
+            for(unsigned c = 0; c < pixelSize; ++c)
+                out[col * pixelSize + c] = tables.toSrgb[(left[c] + right[c] + 1) >> 1];
+        }
+        if(alpha >= 0){
+            for(unsigned col = 0; col < destWidth; ++col){
+                unsigned linear = (top[2 * col * pixelSize + alpha] + top[std::min(2 * col + 1, lastCol) * pixelSize + alpha] + 1) >> 1;
+                out[col * pixelSize + alpha] = (unsigned char)((linear * 255 + 32767) / 65535);
+            }
+        }
+    }
+}
+
+MipmapBuilder::MipmapBuilder(ThreadPool& pool, FileCache* cache) :
+    _pool(pool),
+    _cache(cache)
+{
+}
+
+std::vector<Bitmap> MipmapBuilder::build(const Bitmap& level0) const {
+    std::vector<Bitmap> levels;
+    const Bitmap* above = &level0;
+    while(above->width() > 1 || above->height() > 1){
+        Bitmap level(std::max(above->width() / 2, 1u), std::max(above->height() / 2, 1u), above->format());
+        const Bitmap& src = *above;
+        _pool.parallelFor(level.height(), GrainRows, [&](unsigned begin, unsigned end) {
+            DownsampleRows(src, level, begin, end);
+        });
+        levels.push_back(std::move(level));
+        above = &levels.back();
+    }
+    return levels;
+}
+
+std::vector<Bitmap> MipmapBuilder::buildForFile(const std::string& filePath, const Bitmap& level0) const {
+    uint64_t hash = FileCache::hash(&MipmapCacheVersion, sizeof(MipmapCacheVersion));
+    hash = FileCache::hash(filePath.data(), filePath.size(), hash);
+    const std::string key = _cache && FileCache::hashFile(filePath, hash, hash) ? FileCache::key(hash, ".mips") : "";
+
+    //the entry is the size and format of level 0, then the pixels of every level below it
+    const uint32_t header[3] = { level0.width(), level0.height(), (uint32_t)level0.format() };
+    std::vector<unsigned char> blob;
+    if(!key.empty() && _cache->read(key, blob)){
+        std::vector<unsigned> widths, heights;
+        size_t size = sizeof(header);
+        for(unsigned width = level0.width(), height = level0.height(); width > 1 || height > 1;){
+            width = std::max(width / 2, 1u);
+            height = std::max(height / 2, 1u);
+            widths.push_back(width);
+            heights.push_back(height);
+            size += (size_t)width * height * level0.format();
+        }
+
+        if(blob.size() == size && memcmp(&blob[0], header, sizeof(header)) == 0){
+            std::vector<Bitmap> levels;
+            levels.reserve(widths.size());
+            const unsigned char* pixels = &blob[sizeof(header)];
+            for(size_t i = 0; i < widths.size(); ++i){
+                levels.push_back(Bitmap(widths[i], heights[i], level0.format(), pixels));
+                pixels += (size_t)widths[i] * heights[i] * level0.format();
+            }
+            return levels;
+        }
+        std::cerr << "Ignoring cached mipmaps of " << filePath << std::endl;
+    }
+
+    std::vector<Bitmap> levels = build(level0);
+    if(!key.empty()){
+        blob.assign((const unsigned char*)header, (const unsigned char*)header + sizeof(header));
+        for(size_t i = 0; i < levels.size(); ++i){
+            const unsigned char* pixels = levels[i].pixelBuffer();
+            blob.insert(blob.end(), pixels, pixels + (size_t)levels[i].width() * levels[i].height() * levels[i].format());
+        }
+        if(!_cache->write(key, blob))
+            std::cerr << "Can't write " << key << " to the cache" << std::endl;
+    }
+    return levels;
+}
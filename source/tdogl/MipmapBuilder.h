@@ -0,0 +1,66 @@
+/*
+ tdogl::MipmapBuilder
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Bitmap.h"
+#include "FileCache.h"
+#include "ThreadPool.h"
+
+namespace tdogl {
+
+    /**
+     Makes the mipmap levels of bitmaps on the CPU.
+
+     Each level halves the one above with a 2x2 box filter. The colour channels are
+     averaged in linear light, i.e. they are decoded from sRGB first and encoded again
+     after. Averaging the sRGB values directly would make detailed textures darker in the
+     distance. Alpha is averaged as it is.
+
+     Nothing here uses OpenGL, so the levels can be made on worker threads and handed to
+     tdogl::Texture on the main thread.
+     */
+    class MipmapBuilder {
+    public:
+        /**
+         @param pool   The pool the rows of each level are split over
+         @param cache  Where to keep the levels of files. May be NULL.
+         */
+        explicit MipmapBuilder(ThreadPool& pool, FileCache* cache = NULL);
+
+        /**
+         Makes levels 1 and down of `level0`, ending with a 1x1 level. Odd sizes round
+         down, leaving out the last column or row of the level above, and a side of 1 stays 1.
+         */
+        std::vector<Bitmap> build(const Bitmap& level0) const;
+
+        /**
+         Like `build`, for a bitmap loaded from a file. The levels are read from the cache
+         if the file has been seen before, so `level0` must be loaded from the file the same
+         way every time (e.g. always flipped).
+         */
+        std::vector<Bitmap> buildForFile(const std::string& filePath, const Bitmap& level0) const;
+
+    private:
+        ThreadPool& _pool;
+        FileCache* _cache;
+    };
+
+}
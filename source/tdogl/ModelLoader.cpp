@@ -0,0 +1,499 @@
+/*
+ tdogl::ModelLoader
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "ModelLoader.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+using namespace tdogl;
+
+static const float LodRatio = 0.5f;       //each level of detail has half the triangles of the previous one
+static const unsigned MinLodTriangles = 128;
+static const unsigned MaxLods = 4;        //not counting the full detail mesh
+static const float OccluderError = 0.01f;  //largest error of the occluder, relative to the bounding radius
+static const unsigned MaxOccluderTriangles = 1024;
+
+//change this when the processing changes, so the old cache entries aren't used anymore
+static const unsigned MeshCacheVersion = 4;
+
+template <typename T>
+static void AppendRange(std::vector<T>& dest, const std::vector<T>& src, unsigned start, unsigned count) {
+    if(src.size() >= start + count)
+        dest.insert(dest.end(), src.begin() + start, src.begin() + start + count);
+}
+
+// moves the groups that use the same material next to each other, keeping the file order
+// otherwise, so each material can be drawn with a single call
+static void SortGroupsByMaterial(MeshData& mesh) {
+    std::vector<std::string> order;
+    for(unsigned i = 0; i < mesh.groups.size(); ++i){
+        if(std::find(order.begin(), order.end(), mesh.groups[i].material) == order.end())
+            order.push_back(mesh.groups[i].material);
+    }
+
+    std::vector<ObjGroup> sorted;
+    for(unsigned m = 0; m < order.size(); ++m){
+        for(unsigned i = 0; i < mesh.groups.size(); ++i){
+            if(mesh.groups[i].material == order[m])
+                sorted.push_back(mesh.groups[i]);
+        }
+    }
+
+    bool inOrder = true;
+    for(unsigned i = 0; i < sorted.size(); ++i)
+        inOrder = inOrder && sorted[i].start == mesh.groups[i].start;
+    if(inOrder)
+        return;
+
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    vertices.reserve(mesh.vertices.size());
+    normals.reserve(mesh.normals.size());
+    uvs.reserve(mesh.uvs.size());
+
+    for(unsigned i = 0; i < sorted.size(); ++i){
+        ObjGroup& group = sorted[i];
+        AppendRange(vertices, mesh.vertices, group.start, group.count);
+        AppendRange(normals, mesh.normals, group.start, group.count);
+        AppendRange(uvs, mesh.uvs, group.start, group.count);
+        group.start = (unsigned)vertices.size() - group.count;
+    }
+
+    mesh.vertices.swap(vertices);
+    mesh.normals.swap(normals);
+    mesh.uvs.swap(uvs);
+    mesh.groups.swap(sorted);
+}
+
+// cuts the flat triangle list into an indexed mesh with levels of detail, and optimises
+// each level and cuts it into meshlets. Each group is reordered on its own, so the material
+// ranges stay where they are.
+static void OptimizeMesh(MeshData& mesh) {
+    MeshOptimizer::buildIndexed(mesh.vertices, mesh.uvs, mesh.normals, mesh.indices);
+    if(mesh.indices.empty())
+        return;
+
+    const size_t vertexCount = mesh.vertices.size();
+    const size_t fullIndexCount = mesh.indices.size();
+    MeshOptimizer::CacheStats before =
+        MeshOptimizer::analyzeVertexCache(&mesh.indices[0], fullIndexCount, vertexCount);
+
+    //back faces of open meshes can be seen, so only closed ones get normal cones
+    const bool closed = MeshletBuilder::isClosed(&mesh.indices[0], fullIndexCount, mesh.vertices);
+
+    std::vector<unsigned> groupStarts;
+    for(unsigned i = 0; i < mesh.groups.size(); ++i){
+        const ObjGroup& group = mesh.groups[i];
+        MeshOptimizer::optimizeVertexCache(&mesh.indices[group.start], group.count, vertexCount);
+        MeshOptimizer::optimizeOverdraw(&mesh.indices[group.start], group.count, mesh.vertices);
+        MeshletBuilder::build(mesh.indices, group.start, group.count, mesh.vertices, closed, mesh.meshlets);
+        groupStarts.push_back(group.start);
+    }
+
+    mesh.lods.resize(1);
+    mesh.lods[0].groups = mesh.groups;
+
+    //the simplified levels go after the full mesh in the same index array
+    std::vector<MeshSimplifier::Level> levels;
+    MeshSimplifier::buildLevels(mesh.vertices, mesh.uvs, mesh.normals, mesh.indices, groupStarts,
+                                LodRatio, MinLodTriangles, MaxLods, levels);
+
+    for(unsigned l = 0; l < levels.size(); ++l){
+        MeshSimplifier::Level& level = levels[l];
+        MeshLod lod;
+        lod.error = level.error;
+
+        unsigned offset = 0;
+        for(unsigned i = 0; i < mesh.groups.size(); ++i){
+            unsigned count = level.rangeCounts[i];
+            if(count == 0)
+                continue;
+
+            ObjGroup group = mesh.groups[i];
+            group.start = (unsigned)mesh.indices.size() + offset;
+            group.count = count;
+            lod.groups.push_back(group);
+
+            MeshOptimizer::optimizeVertexCache(&level.indices[offset], count, vertexCount);
+            MeshOptimizer::optimizeOverdraw(&level.indices[offset], count, mesh.vertices);
+            offset += count;
+        }
+
+        mesh.indices.insert(mesh.indices.end(), level.indices.begin(), level.indices.end());
+        for(unsigned i = 0; i < lod.groups.size(); ++i)
+            MeshletBuilder::build(mesh.indices, lod.groups[i].start, lod.groups[i].count,
+                                  mesh.vertices, closed, mesh.meshlets);
+        mesh.lods.push_back(lod);
+    }
+
+    //the full mesh uses every vertex, so it decides the vertex order
+    MeshOptimizer::optimizeVertexFetch(mesh.vertices, mesh.uvs, mesh.normals, mesh.indices);
+
+    MeshOptimizer::CacheStats after =
+        MeshOptimizer::analyzeVertexCache(&mesh.indices[0], fullIndexCount, mesh.vertices.size());
+    std::cerr << mesh.filePath << ": " << fullIndexCount / 3 << " triangles, "
+              << mesh.vertices.size() << " vertices, ACMR " << before.acmr << " -> " << after.acmr
+              << ", ATVR " << before.atvr << " -> " << after.atvr << ", "
+              << mesh.lods.size() << " levels of detail, " << mesh.meshlets.size() << " meshlets"
+              << (closed ? "" : " (open, no cone culling)") << std::endl;
+}
+
+static void ComputeBounds(MeshData& mesh) {
+    if(mesh.vertices.empty())
+        return;
+
+    glm::vec3 low = mesh.vertices[0], high = mesh.vertices[0];
+    for(size_t i = 1; i < mesh.vertices.size(); ++i){
+        low = glm::min(low, mesh.vertices[i]);
+        high = glm::max(high, mesh.vertices[i]);
+    }
+
+    mesh.boundsCenter = (low + high) * 0.5f;
+    mesh.boundsRadius = 0.0f;
+    for(size_t i = 0; i < mesh.vertices.size(); ++i)
+        mesh.boundsRadius = std::max(mesh.boundsRadius, glm::length(mesh.vertices[i] - mesh.boundsCenter));
+}
+
+// moves every vertex of the occluder in along its normal, far enough that the faces around
+// it move in by at least `distance`. A simplified mesh is up to its error outside the full
+// one in places, and an occluder sticking out would hide things that are in view.
+static void ShrinkOccluder(MeshData& mesh, float distance) {
+    std::vector<glm::vec3>& vertices = mesh.occluderVertices;
+    const std::vector<unsigned>& indices = mesh.occluderIndices;
+
+    //meshes wound the other way round have their normals pointing in
+    float volume = 0.0f;
+    for(size_t i = 0; i + 2 < indices.size(); i += 3)
+        volume += glm::dot(vertices[indices[i]], glm::cross(vertices[indices[i + 1]], vertices[indices[i + 2]]));
+    const float outwards = volume < 0.0f ? -1.0f : 1.0f;
+
+    std::vector<glm::vec3> normals(vertices.size(), glm::vec3(0.0f));
+    for(size_t i = 0; i + 2 < indices.size(); i += 3){
+        const glm::vec3& a = vertices[indices[i]];
+        glm::vec3 face = glm::cross(vertices[indices[i + 1]] - a, vertices[indices[i + 2]] - a) * outwards;
+        for(int k = 0; k < 3; ++k)
+            normals[indices[i + k]] += face;
+    }
+    for(size_t v = 0; v < normals.size(); ++v){
+        float length = glm::length(normals[v]);
+        normals[v] = length > 0.0f ? normals[v] / length : glm::vec3(0.0f);
+    }
+
+    //the face most askew to the vertex normal moves in by distance * cos of the angle
+    std::vector<float> leastCos(vertices.size(), 1.0f);
+    for(size_t i = 0; i + 2 < indices.size(); i += 3){
+        const glm::vec3& a = vertices[indices[i]];
+        glm::vec3 face = glm::cross(vertices[indices[i + 1]] - a, vertices[indices[i + 2]] - a) * outwards;
+        float length = glm::length(face);
+        if(length == 0.0f)
+            continue;
+        for(int k = 0; k < 3; ++k){
+            float& c = leastCos[indices[i + k]];
+            c = std::min(c, glm::dot(normals[indices[i + k]], face / length));
+        }
+    }
+    for(size_t v = 0; v < vertices.size(); ++v)
+        vertices[v] -= normals[v] * (distance / std::max(leastCos[v], 0.25f));
+}
+
+// copies the coarsest level of detail that is still within OccluderError of the full mesh,
+// with its own compact vertices, as the occluder of the mesh. It is shrunk by the error of the
+// level, so it stays inside the full mesh.
+static void BuildOccluder(MeshData& mesh) {
+    for(size_t l = mesh.lods.size(); l-- > 0;){
+        const MeshLod& lod = mesh.lods[l];
+        if(lod.error > OccluderError * mesh.boundsRadius)
+            continue;
+
+        unsigned indexCount = 0;
+        for(unsigned i = 0; i < lod.groups.size(); ++i)
+            indexCount += lod.groups[i].count;
+        if(indexCount / 3 > MaxOccluderTriangles)
+            return;
+
+        std::vector<unsigned> remap(mesh.vertices.size(), ~0u);
+        for(unsigned i = 0; i < lod.groups.size(); ++i){
+            const ObjGroup& group = lod.groups[i];
+            for(unsigned k = group.start; k < group.start + group.count; ++k){
+                unsigned& vertex = remap[mesh.indices[k]];
+                if(vertex == ~0u){
+                    vertex = (unsigned)mesh.occluderVertices.size();
+                    mesh.occluderVertices.push_back(mesh.vertices[mesh.indices[k]]);
+                }
+                mesh.occluderIndices.push_back(vertex);
+            }
+        }
+        ShrinkOccluder(mesh, lod.error);
+        return;
+    }
+}
+
+/*
+ * Cache entries
+ */
+
+static void WriteBytes(std::vector<unsigned char>& blob, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    blob.insert(blob.end(), bytes, bytes + size);
+}
+
+template <typename T>
+static void WriteValue(std::vector<unsigned char>& blob, const T& value) {
+    WriteBytes(blob, &value, sizeof(T));
+}
+
+template <typename T>
+static void WriteArray(std::vector<unsigned char>& blob, const std::vector<T>& values) {
+    WriteValue(blob, (unsigned)values.size());
+    if(!values.empty())
+        WriteBytes(blob, &values[0], values.size() * sizeof(T));
+}
+
+static void WriteString(std::vector<unsigned char>& blob, const std::string& value) {
+    WriteValue(blob, (unsigned)value.size());
+    WriteBytes(blob, value.data(), value.size());
+}
+
+static void WriteGroups(std::vector<unsigned char>& blob, const std::vector<ObjGroup>& groups) {
+    WriteValue(blob, (unsigned)groups.size());
+    for(unsigned i = 0; i < groups.size(); ++i){
+        WriteString(blob, groups[i].name);
+        WriteString(blob, groups[i].material);
+        WriteValue(blob, groups[i].start);
+        WriteValue(blob, groups[i].count);
+    }
+}
+
+namespace {
+    // reads back what the Write functions wrote, throwing if the entry is cut short
+    struct BlobReader {
+        const std::vector<unsigned char>& blob;
+        size_t position;
+
+        explicit BlobReader(const std::vector<unsigned char>& b) : blob(b), position(0) {}
+
+        void bytes(void* data, size_t size) {
+            if(size > blob.size() - position)
+                throw std::runtime_error("Cache entry is truncated");
+            if(size > 0)
+                memcpy(data, &blob[position], size);
+            position += size;
+        }
+
+        template <typename T>
+        T value() {
+            T result;
+            bytes(&result, sizeof(T));
+            return result;
+        }
+
+        template <typename T>
+        void array(std::vector<T>& values) {
+            values.resize(value<unsigned>());
+            if(!values.empty())
+                bytes(&values[0], values.size() * sizeof(T));
+        }
+
+        std::string string() {
+            std::string result(value<unsigned>(), '\0');
+            if(!result.empty())
+                bytes(&result[0], result.size());
+            return result;
+        }
+
+        void groups(std::vector<ObjGroup>& groups) {
+            groups.resize(value<unsigned>());
+            for(unsigned i = 0; i < groups.size(); ++i){
+                groups[i].name = string();
+                groups[i].material = string();
+                groups[i].start = value<unsigned>();
+                groups[i].count = value<unsigned>();
+            }
+        }
+    };
+}
+
+// the key depends on the file's path and contents, and on everything that changes the processing
+static bool MeshCacheKey(const std::string& filePath, int n, std::string& key) {
+    uint64_t hash = FileCache::hash(&MeshCacheVersion, sizeof(MeshCacheVersion));
+    hash = FileCache::hash(&n, sizeof(n), hash);
+    hash = FileCache::hash(filePath.data(), filePath.size(), hash);
+    if(!FileCache::hashFile(filePath, hash, hash))
+        return false;
+
+    key = FileCache::key(hash, ".mesh");
+    return true;
+}
+
+static void WriteCachedMesh(const FileCache& cache, const std::string& key, const MeshData& mesh, const std::string& mtllib) {
+    std::vector<unsigned char> blob;
+    WriteValue(blob, mesh.format);
+    WriteString(blob, mtllib);
+    WriteArray(blob, mesh.vertices);
+    WriteArray(blob, mesh.uvs);
+    WriteArray(blob, mesh.normals);
+    WriteArray(blob, mesh.indices);
+    WriteGroups(blob, mesh.groups);
+    WriteValue(blob, (unsigned)mesh.lods.size());
+    for(unsigned i = 0; i < mesh.lods.size(); ++i){
+        WriteValue(blob, mesh.lods[i].error);
+        WriteGroups(blob, mesh.lods[i].groups);
+    }
+    WriteArray(blob, mesh.meshlets);
+    WriteArray(blob, mesh.occluderVertices);
+    WriteArray(blob, mesh.occluderIndices);
+    WriteValue(blob, mesh.boundsCenter);
+    WriteValue(blob, mesh.boundsRadius);
+
+    if(!cache.write(key, blob))
+        std::cerr << "Can't write " << key << " to the cache" << std::endl;
+}
+
+static bool ReadCachedMesh(const FileCache& cache, const std::string& key, MeshData& mesh, std::string& mtllib) {
+    std::vector<unsigned char> blob;
+    if(!cache.read(key, blob))
+        return false;
+
+    try {
+        BlobReader reader(blob);
+        mesh.format = reader.value<int>();
+        mtllib = reader.string();
+        reader.array(mesh.vertices);
+        reader.array(mesh.uvs);
+        reader.array(mesh.normals);
+        reader.array(mesh.indices);
+        reader.groups(mesh.groups);
+        mesh.lods.resize(reader.value<unsigned>());
+        for(unsigned i = 0; i < mesh.lods.size(); ++i){
+            mesh.lods[i].error = reader.value<float>();
+            reader.groups(mesh.lods[i].groups);
+        }
+        reader.array(mesh.meshlets);
+        reader.array(mesh.occluderVertices);
+        reader.array(mesh.occluderIndices);
+        mesh.boundsCenter = reader.value<glm::vec3>();
+        mesh.boundsRadius = reader.value<float>();
+    } catch (const std::exception& e) {
+        std::cerr << "Ignoring cached " << mesh.filePath << ": " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+ModelLoader::ModelLoader(ThreadPool& pool, int n, FileCache* cache, bool quantize) :
+    _pool(pool),
+    _n(n),
+    _cache(cache),
+    _quantize(quantize),
+    _pending(0),
+    _nextTicket(1)
+{
+}
+
+ModelLoader::~ModelLoader() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(_pending > 0)
+        _allDone.wait(lock);
+}
+
+unsigned ModelLoader::load(const std::string& filePath) {
+    unsigned ticket;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_pending;
+        ticket = _nextTicket++;
+    }
+    _pool.submit([this, filePath, ticket]() { _parse(filePath, ticket); });
+    return ticket;
+}
+
+bool ModelLoader::popFinished(MeshData& mesh) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_finished.empty())
+        return false;
+
+    mesh = std::move(_finished.front());
+    _finished.pop_front();
+    return true;
+}
+
+unsigned ModelLoader::pending() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _pending;
+}
+
+void ModelLoader::_parse(const std::string& filePath, unsigned ticket) {
+    MeshData mesh;
+    mesh.filePath = filePath;
+    mesh.ticket = ticket;
+
+    try {
+        LoadObj loader;
+        std::string mtllib;
+        std::string cacheKey;
+        bool cached = _cache && MeshCacheKey(filePath, _n, cacheKey) &&
+                      ReadCachedMesh(*_cache, cacheKey, mesh, mtllib);
+
+        if(cached){
+            std::cerr << filePath << ": read from the cache" << std::endl;
+        } else {
+            //start over, in case a broken cache entry was partly read
+            mesh = MeshData();
+            mesh.filePath = filePath;
+            mesh.ticket = ticket;
+            mtllib.clear();
+            mesh.format = loader.loadObj(filePath, mesh.vertices, mesh.uvs, mesh.normals,
+                                         mesh.groups, mtllib, _n);
+            if(mesh.format >= 1){
+                SortGroupsByMaterial(mesh);
+                OptimizeMesh(mesh);
+                ComputeBounds(mesh);
+                BuildOccluder(mesh);
+                if(_cache && !cacheKey.empty())
+                    WriteCachedMesh(*_cache, cacheKey, mesh, mtllib);
+            }
+        }
+
+        if(mesh.format >= 1){
+            //files without mtllib use the .mtl with the same name, if there is one
+            if(mtllib.empty())
+                mtllib = filePath.substr(0, filePath.length() - 4) + ".mtl";
+            loader.loadMtl(mtllib, mesh.materials);
+
+            if(_quantize){
+                VertexQuantizer::quantize(mesh.vertices, mesh.uvs, mesh.normals, mesh.quantized);
+                std::vector<glm::vec3>().swap(mesh.vertices);
+                std::vector<glm::vec2>().swap(mesh.uvs);
+                std::vector<glm::vec3>().swap(mesh.normals);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error parsing " << filePath << ": " << e.what() << std::endl;
+        mesh.format = -1;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _finished.push_back(std::move(mesh));
+    --_pending;
+    if(_pending == 0)
+        _allDone.notify_all();
+}
@@ -0,0 +1,170 @@
+/*
+ tdogl::ModelLoader
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+#include "LoadObj.h"
+#include "FileCache.h"
+#include "VertexQuantizer.h"
+#include "MeshletBuilder.h"
+
+namespace tdogl {
+
+    /**
+     One level of detail of a MeshData: some of its indices, split by material like
+     MeshData::groups.
+     */
+    struct MeshLod {
+        /** roughly the largest distance from the full detail surface, in model units */
+        float error;
+
+        /** ranges of MeshData::indices, one per group of MeshData::groups that has triangles left */
+        std::vector<ObjGroup> groups;
+
+        MeshLod() : error(0.0f) {}
+    };
+
+    /**
+     The CPU side of a model, as parsed from an .obj file on a worker thread.
+
+     Contains everything that is needed to make the GL buffers, so the main thread only has
+     to copy it into the GPU.
+     */
+    struct MeshData {
+        std::string filePath;
+
+        /** the value returned by the ModelLoader::load call that queued this mesh */
+        unsigned ticket;
+
+        /** return value of LoadObj::loadObj: 1-4 on success, < 1 if the file failed to load */
+        int format;
+
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+
+        /** the vertices in 16 bits per component. When the loader quantizes, this replaces
+            the three arrays above, which are left empty. */
+        QuantizedVertices quantized;
+
+        /** 3 per triangle, into the attribute arrays above, which hold each vertex once */
+        std::vector<unsigned> indices;
+
+        /** the usemtl runs, sorted so each material is one contiguous range of indices */
+        std::vector<ObjGroup> groups;
+
+        /** the materials of the model's .mtl file */
+        std::vector<ObjMaterial> materials;
+
+        /**
+         The levels of detail, from the full mesh (which has the same groups as `groups`) to
+         the coarsest. All of them index the same vertices.
+         */
+        std::vector<MeshLod> lods;
+
+        /** the clusters of all the levels of detail, in the order of their indices. Each one is
+            inside one group of one level. */
+        std::vector<Meshlet> meshlets;
+
+        /** a coarse copy of the mesh, for software occlusion culling with
+            tdogl::OcclusionBuffer. Empty when no level of detail is both close to the full
+            mesh and small enough. */
+        std::vector<glm::vec3> occluderVertices;
+        std::vector<unsigned> occluderIndices;
+
+        /** bounding sphere of the vertices */
+        glm::vec3 boundsCenter;
+        float boundsRadius;
+
+        MeshData() : ticket(0), format(-1), boundsRadius(0.0f) {}
+    };
+
+    /**
+     Parses .obj files on a tdogl::ThreadPool.
+
+     The parsed triangles are welded into an indexed mesh, simplified into levels of detail
+     by tdogl::MeshSimplifier, reordered for the vertex cache and for overdraw by
+     tdogl::MeshOptimizer, and cut into meshlets by tdogl::MeshletBuilder, also on the
+     worker thread. With a tdogl::FileCache the result is
+     kept on disk, and files that didn't change are read back instead of processed again.
+
+     `load` returns immediately. Finished meshes are collected with `popFinished`, usually
+     once per frame on the main thread, which then does the GL upload.
+     */
+    class ModelLoader {
+    public:
+        /**
+         @param pool  The pool to run the parsing jobs on
+         @param n     Near plane offset, forwarded to LoadObj::loadObj
+         @param cache Where to keep the processed meshes. May be NULL.
+         @param quantize  Whether to deliver the vertices as MeshData::quantized
+         */
+        ModelLoader(ThreadPool& pool, int n, FileCache* cache = NULL, bool quantize = false);
+
+        /**
+         Waits for the jobs that are still running.
+         */
+        ~ModelLoader();
+
+        /**
+         Queues the given .obj file for parsing.
+
+         @result A ticket that is copied into the finished MeshData. Loading the same file
+                 again before the first load finished gives a newer ticket, which lets the
+                 caller throw away out of date results.
+         */
+        unsigned load(const std::string& filePath);
+
+        /**
+         Moves the oldest finished mesh into `mesh`.
+
+         @result false if no mesh has finished since the last call
+         */
+        bool popFinished(MeshData& mesh);
+
+        /**
+         @result The number of files that are queued or being parsed
+         */
+        unsigned pending();
+
+    private:
+        ThreadPool& _pool;
+        int _n;
+        FileCache* _cache;
+        bool _quantize;
+        unsigned _pending;
+        unsigned _nextTicket;
+        std::deque<MeshData> _finished;
+        std::mutex _mutex;
+        std::condition_variable _allDone;
+
+        void _parse(const std::string& filePath, unsigned ticket);
+
+        //copying disabled
+        ModelLoader(const ModelLoader&);
+        const ModelLoader& operator=(const ModelLoader&);
+    };
+
+}
@@ -0,0 +1,384 @@
+/*
+ tdogl::OcclusionBuffer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "OcclusionBuffer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+//TDOGL_NO_SIMD leaves out the SSE2 code, to compare it with the plain code
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(TDOGL_NO_SIMD)
+#include <emmintrin.h>
+#define TDOGL_OCCLUSION_SSE2 1
+#endif
+
+using namespace tdogl;
+
+static const float EmptyDepth = FLT_MAX;
+
+//points closer to the eye plane than this are clipped away, or make a box visible
+static const float MinClipW = 1e-5f;
+
+//triangles are clipped to this many times the view, which keeps the pixel coordinates small
+static const float GuardBand = 4.0f;
+
+// the signed distance of a clip space point inside plane `plane` of the clipping volume
+static float ClipDistance(const glm::vec4& p, int plane) {
+    switch(plane){
+        case 0: return p.w - MinClipW;
+        case 1: return GuardBand * p.w - p.x;
+        case 2: return GuardBand * p.w + p.x;
+        case 3: return GuardBand * p.w - p.y;
+        default: return GuardBand * p.w + p.y;
+    }
+}
+
+// clips a convex polygon against one plane (Sutherland-Hodgman)
+static void ClipPolygon(const std::vector<glm::vec4>& input, int plane, std::vector<glm::vec4>& output) {
+    output.clear();
+    for(size_t i = 0; i < input.size(); ++i){
+        const glm::vec4& a = input[i];
+        const glm::vec4& b = input[(i + 1) % input.size()];
+        float da = ClipDistance(a, plane), db = ClipDistance(b, plane);
+        if(da >= 0.0f)
+            output.push_back(a);
+        if((da >= 0.0f) != (db >= 0.0f))
+            output.push_back(a + (b - a) * (da / (da - db)));
+    }
+}
+
+OcclusionBuffer::OcclusionBuffer(unsigned width, unsigned height) :
+    _tilesX((std::max(width, 1u) + TileSize - 1) / TileSize),
+    _tilesY((std::max(height, 1u) + TileSize - 1) / TileSize)
+{
+    _width = _tilesX * TileSize;
+    _height = _tilesY * TileSize;
+    _depth.assign(_width * _height, EmptyDepth);
+    _tileDepth.assign(_tilesX * _tilesY, EmptyDepth);
+}
+
+unsigned OcclusionBuffer::width() const {
+    return _width;
+}
+
+unsigned OcclusionBuffer::height() const {
+    return _height;
+}
+
+void OcclusionBuffer::clear() {
+    _polygons.clear();
+}
+
+// if the triangles `first` and `second` share an edge, lie in one plane and make a convex
+// quad, puts the quad's corners in order in `quad`
+static bool MakeQuad(const std::vector<glm::vec3>& vertices, const unsigned* first, const unsigned* second, unsigned quad[4]) {
+    for(int i = 0; i < 3; ++i){
+        for(int j = 0; j < 3; ++j){
+            //the edge i -> i + 1 of the first is j + 1 -> j of the second
+            if(vertices[first[i]] != vertices[second[(j + 1) % 3]] || vertices[first[(i + 1) % 3]] != vertices[second[j]])
+                continue;
+
+            quad[0] = first[(i + 1) % 3];
+            quad[1] = first[(i + 2) % 3];
+            quad[2] = first[i];
+            quad[3] = second[(j + 2) % 3];
+
+            const glm::vec3& a = vertices[quad[0]];
+            glm::vec3 normal = glm::cross(vertices[quad[1]] - a, vertices[quad[2]] - a);
+            glm::vec3 toLast = vertices[quad[3]] - a;
+            if(fabsf(glm::dot(normal, toLast)) > 1e-5f * glm::length(normal) * glm::length(toLast))
+                return false;
+            for(int k = 0; k < 4; ++k){
+                const glm::vec3& p = vertices[quad[k]];
+                const glm::vec3& q = vertices[quad[(k + 1) % 4]];
+                const glm::vec3& r = vertices[quad[(k + 2) % 4]];
+                if(glm::dot(glm::cross(q - p, r - q), normal) <= 0.0f)
+                    return false;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void OcclusionBuffer::addOccluder(const glm::mat4& clip,
+                                  const std::vector<glm::vec3>& vertices,
+                                  const std::vector<unsigned>& indices)
+{
+    std::vector<glm::vec4> projected(vertices.size());
+    for(size_t i = 0; i < vertices.size(); ++i)
+        projected[i] = clip * glm::vec4(vertices[i], 1.0f);
+
+    std::vector<glm::vec4> polygon, scratch;
+    for(size_t i = 0; i + 2 < indices.size();){
+        unsigned quad[4];
+        polygon.clear();
+        if(i + 5 < indices.size() && MakeQuad(vertices, &indices[i], &indices[i + 3], quad)){
+            for(int k = 0; k < 4; ++k)
+                polygon.push_back(projected[quad[k]]);
+            i += 6;
+        } else {
+            for(int k = 0; k < 3; ++k)
+                polygon.push_back(projected[indices[i + k]]);
+            i += 3;
+        }
+        _addPolygon(polygon, scratch);
+    }
+}
+
+void OcclusionBuffer::_addPolygon(std::vector<glm::vec4>& polygon, std::vector<glm::vec4>& scratch) {
+    bool inside = true;
+    for(int plane = 0; plane < 5 && inside; ++plane){
+        for(size_t i = 0; i < polygon.size() && inside; ++i)
+            inside = ClipDistance(polygon[i], plane) >= 0.0f;
+    }
+    for(int plane = 0; plane < 5 && !inside && polygon.size() >= 3; ++plane){
+        ClipPolygon(polygon, plane, scratch);
+        polygon.swap(scratch);
+    }
+    if(polygon.size() >= 3)
+        _setupPolygon(polygon);
+}
+
+void OcclusionBuffer::_setupPolygon(const std::vector<glm::vec4>& polygon) {
+    //pixel coordinates, with the pixel centres at .5
+    const unsigned count = (unsigned)std::min(polygon.size(), (size_t)MaxEdges);
+    glm::vec3 v[MaxEdges];
+    for(unsigned i = 0; i < count; ++i){
+        const glm::vec4& p = polygon[i];
+        v[i] = glm::vec3((p.x / p.w * 0.5f + 0.5f) * _width,
+                         (p.y / p.w * 0.5f + 0.5f) * _height,
+                         p.z / p.w);
+    }
+
+    //counter clockwise, so the inside is on the left of every edge
+    float area = 0.0f;
+    for(unsigned i = 0; i < count; ++i)
+        area += v[i].x * v[(i + 1) % count].y - v[(i + 1) % count].x * v[i].y;
+    if(fabsf(area) < 1e-8f)
+        return;
+    if(area < 0.0f)
+        std::reverse(v, v + count);
+
+    float minX = v[0].x, maxX = v[0].x, minY = v[0].y, maxY = v[0].y;
+    for(unsigned i = 1; i < count; ++i){
+        minX = std::min(minX, v[i].x);
+        maxX = std::max(maxX, v[i].x);
+        minY = std::min(minY, v[i].y);
+        maxY = std::max(maxY, v[i].y);
+    }
+    //too thin to cover a whole pixel anywhere
+    if(maxX - minX < 1.0f || maxY - minY < 1.0f)
+        return;
+
+    ScreenPolygon t;
+    t.minX = std::max(0, (int)floorf(minX));
+    t.minY = std::max(0, (int)floorf(minY));
+    t.maxX = std::min((int)_width - 1, (int)floorf(maxX));
+    t.maxY = std::min((int)_height - 1, (int)floorf(maxY));
+    if(t.minX > t.maxX || t.minY > t.maxY)
+        return;
+
+    //edge i goes from v[i] to v[i + 1], and is positive on the inside. Moved in by the most
+    //it changes from the centre of a pixel to a corner, so a pixel centre is inside only if
+    //the whole pixel is.
+    t.edges = count;
+    for(unsigned i = 0; i < count; ++i){
+        const glm::vec3& p = v[i];
+        const glm::vec3& q = v[(i + 1) % count];
+        t.edgeA[i] = p.y - q.y;
+        t.edgeB[i] = q.x - p.x;
+        t.edgeC[i] = (q.y - p.y) * p.x - (q.x - p.x) * p.y - 0.5f * (fabsf(t.edgeA[i]) + fabsf(t.edgeB[i]));
+    }
+
+    //depth as a plane over the screen through the biggest corner triangle
+    unsigned widest = 1;
+    float widestArea = 0.0f;
+    for(unsigned i = 1; i + 1 < count; ++i){
+        glm::vec3 e1 = v[i] - v[0], e2 = v[i + 1] - v[0];
+        float triangleArea = e1.x * e2.y - e2.x * e1.y;
+        if(triangleArea > widestArea){
+            widestArea = triangleArea;
+            widest = i;
+        }
+    }
+    if(widestArea < 1e-8f)
+        return;
+    glm::vec3 e1 = v[widest] - v[0], e2 = v[widest + 1] - v[0];
+    t.depthA = (e1.z * e2.y - e2.z * e1.y) / widestArea;
+    t.depthB = (e2.z * e1.x - e1.z * e2.x) / widestArea;
+    t.depthC = v[0].z - t.depthA * v[0].x - t.depthB * v[0].y;
+
+    //moved back behind every corner, for quads that aren't quite flat and for rounding, and
+    //then to the furthest it gets inside a pixel
+    float behind = 0.0f;
+    for(unsigned i = 0; i < count; ++i)
+        behind = std::max(behind, v[i].z - (t.depthA * v[i].x + t.depthB * v[i].y + t.depthC));
+    t.depthC += behind + 0.5f * (fabsf(t.depthA) + fabsf(t.depthB));
+
+    _polygons.push_back(t);
+}
+
+void OcclusionBuffer::rasterize(ThreadPool& pool) {
+    pool.parallelFor(_tilesY, 1, [this](unsigned begin, unsigned end) {
+        for(unsigned row = begin; row < end; ++row)
+            _rasterizeBand(row);
+    });
+}
+
+void OcclusionBuffer::_rasterizeBand(unsigned tileRow) {
+    const int bandMinY = tileRow * TileSize;
+    const int bandMaxY = bandMinY + TileSize - 1;
+    std::fill(_depth.begin() + bandMinY * _width, _depth.begin() + (bandMaxY + 1) * _width, EmptyDepth);
+
+    for(size_t i = 0; i < _polygons.size(); ++i){
+        const ScreenPolygon& t = _polygons[i];
+        const int minY = std::max(t.minY, bandMinY);
+        const int maxY = std::min(t.maxY, bandMaxY);
+        if(minY > maxY)
+            continue;
+
+        //4 pixels at a time, from a multiple of 4, so the loads never leave the row. Both
+        //paths work out every value as A * x + (B * y + C), so they write the same depths.
+        const int minX = t.minX & ~3;
+        for(int y = minY; y <= maxY; ++y){
+            float* row = &_depth[y * _width];
+            const float py = y + 0.5f;
+            float rowEdge[MaxEdges];
+            for(unsigned k = 0; k < t.edges; ++k)
+                rowEdge[k] = t.edgeB[k] * py + t.edgeC[k];
+            const float rowDepth = t.depthB * py + t.depthC;
+#ifdef TDOGL_OCCLUSION_SSE2
+            const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            const __m128 zero = _mm_setzero_ps();
+
+            for(int x = minX; x <= t.maxX; x += 4){
+                const __m128 cx = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[0]), cx), _mm_set1_ps(rowEdge[0])), zero);
+                for(unsigned k = 1; k < t.edges; ++k){
+                    __m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[k]), cx), _mm_set1_ps(rowEdge[k]));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(e, zero));
+                }
+                if(_mm_movemask_ps(inside)){
+                    __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.depthA), cx), _mm_set1_ps(rowDepth));
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(old, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                }
+            }
+#else
+            for(int x = minX; x <= (t.maxX | 3); ++x){
+                const float cx = x + 0.5f;
+                bool inside = true;
+                for(unsigned k = 0; k < t.edges && inside; ++k)
+                    inside = t.edgeA[k] * cx + rowEdge[k] >= 0.0f;
+                if(inside)
+                    row[x] = std::min(row[x], t.depthA * cx + rowDepth);
+            }
+#endif
+        }
+    }
+
+    //the furthest depth of each tile of the band
+    for(unsigned tx = 0; tx < _tilesX; ++tx){
+        const float* tile = &_depth[bandMinY * _width + tx * TileSize];
+#ifdef TDOGL_OCCLUSION_SSE2
+        __m128 furthest = _mm_set1_ps(-FLT_MAX);
+        for(unsigned y = 0; y < TileSize; ++y){
+            for(unsigned x = 0; x < TileSize; x += 4)
+                furthest = _mm_max_ps(furthest, _mm_loadu_ps(tile + y * _width + x));
+        }
+        furthest = _mm_max_ps(furthest, _mm_shuffle_ps(furthest, furthest, _MM_SHUFFLE(1, 0, 3, 2)));
+        furthest = _mm_max_ps(furthest, _mm_shuffle_ps(furthest, furthest, _MM_SHUFFLE(2, 3, 0, 1)));
+        _tileDepth[tileRow * _tilesX + tx] = _mm_cvtss_f32(furthest);
+#else
+        float furthest = -FLT_MAX;
+        for(unsigned y = 0; y < TileSize; ++y){
+            for(unsigned x = 0; x < TileSize; ++x)
+                furthest = std::max(furthest, tile[y * _width + x]);
+        }
+        _tileDepth[tileRow * _tilesX + tx] = furthest;
+#endif
+    }
+}
+
+bool OcclusionBuffer::isVisible(const glm::mat4& clip, const glm::vec3& low, const glm::vec3& high) const {
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float nearest = FLT_MAX;
+    for(int i = 0; i < 8; ++i){
+        glm::vec4 p = clip * glm::vec4(i & 1 ? high.x : low.x,
+                                       i & 2 ? high.y : low.y,
+                                       i & 4 ? high.z : low.z,
+                                       1.0f);
+        if(p.w < MinClipW)
+            return true;
+
+        float x = (p.x / p.w * 0.5f + 0.5f) * _width;
+        float y = (p.y / p.w * 0.5f + 0.5f) * _height;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::min(nearest, p.z / p.w);
+    }
+
+    //the pixels whose area the box touches
+    if(maxX < 0.0f || maxY < 0.0f || minX >= _width || minY >= _height)
+        return false;
+    const int x0 = std::max(0, (int)floorf(minX));
+    const int y0 = std::max(0, (int)floorf(minY));
+    const int x1 = std::min((int)_width - 1, (int)floorf(maxX));
+    const int y1 = std::min((int)_height - 1, (int)floorf(maxY));
+
+    for(int ty = y0 / (int)TileSize; ty <= y1 / (int)TileSize; ++ty){
+        for(int tx = x0 / (int)TileSize; tx <= x1 / (int)TileSize; ++tx){
+            //everything in the tile is nearer than the box
+            if(nearest >= _tileDepth[ty * _tilesX + tx])
+                continue;
+
+            const int tileX0 = std::max(x0, tx * (int)TileSize);
+            const int tileX1 = std::min(x1, tx * (int)TileSize + (int)TileSize - 1);
+            const int tileY0 = std::max(y0, ty * (int)TileSize);
+            const int tileY1 = std::min(y1, ty * (int)TileSize + (int)TileSize - 1);
+            for(int y = tileY0; y <= tileY1; ++y){
+                const float* row = &_depth[y * _width];
+#ifdef TDOGL_OCCLUSION_SSE2
+                const __m128 box = _mm_set1_ps(nearest);
+                const __m128i first = _mm_set1_epi32(tileX0), last = _mm_set1_epi32(tileX1);
+                for(int x = tileX0 & ~3; x <= tileX1; x += 4){
+                    __m128i lanes = _mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3));
+                    __m128i outside = _mm_or_si128(_mm_cmplt_epi32(lanes, first), _mm_cmpgt_epi32(lanes, last));
+                    __m128 inFront = _mm_cmplt_ps(box, _mm_loadu_ps(row + x));
+                    if(_mm_movemask_ps(_mm_andnot_ps(_mm_castsi128_ps(outside), inFront)))
+                        return true;
+                }
+#else
+                for(int x = tileX0; x <= tileX1; ++x){
+                    if(nearest < row[x])
+                        return true;
+                }
+#endif
+            }
+        }
+    }
+    return false;
+}
+
+float OcclusionBuffer::depth(unsigned x, unsigned y) const {
+    return _depth[y * _width + x];
+}
@@ -0,0 +1,115 @@
+/*
+ tdogl::OcclusionBuffer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace tdogl {
+
+    /**
+     A small depth buffer, drawn on the CPU, for testing whether boxes are hidden behind a
+     few large occluders before they are sent to OpenGL.
+
+     Each frame: `clear`, `addOccluder` for every occluder, `rasterize`, then `isVisible`
+     for each box. The depth is the clip space z / w, so any projection works, including the
+     off-axis one of tdogl::Camera. Besides the depth of each pixel, the buffer keeps the
+     furthest depth of each TileSize x TileSize tile, so most boxes are decided without
+     looking at single pixels.
+
+     Nothing here uses OpenGL.
+     */
+    class OcclusionBuffer {
+    public:
+        /** side of the tiles of the coarse level, in pixels */
+        static const unsigned TileSize = 8;
+
+        /**
+         @param width, height  The size in pixels, rounded up to multiples of TileSize. A few
+                               hundred pixels wide is plenty.
+         */
+        OcclusionBuffer(unsigned width, unsigned height);
+
+        unsigned width() const;
+        unsigned height() const;
+
+        /**
+         Forgets the occluders of the previous frame.
+         */
+        void clear();
+
+        /**
+         Queues triangles to be drawn by the next `rasterize`. Both sides of the triangles
+         occlude, and the parts outside the view are clipped away. Only the pixels an occluder
+         covers completely are drawn, so two consecutive triangles that make a flat convex
+         quad are drawn as one, to keep the pixels along the edge between them.
+
+         @param clip     The matrix from the vertices' space to clip space, e.g. camera * model
+         @param indices  3 per triangle, into `vertices`
+         */
+        void addOccluder(const glm::mat4& clip,
+                         const std::vector<glm::vec3>& vertices,
+                         const std::vector<unsigned>& indices);
+
+        /**
+         Draws the queued occluders, one band of tiles per job on `pool`, and waits for them.
+         */
+        void rasterize(ThreadPool& pool);
+
+        /**
+         @param clip       The matrix from the box's space to clip space
+         @param low, high  The corners of the box
+         @result false if the box is outside the view or completely behind the occluders of
+                 the last `rasterize`. Boxes that cross the eye plane are always visible.
+         */
+        bool isVisible(const glm::mat4& clip, const glm::vec3& low, const glm::vec3& high) const;
+
+        /**
+         The depth of the pixel, the furthest depth its occluders can have anywhere inside
+         it. Very big where no occluder covers the whole pixel. Row 0 is the bottom of the view.
+         */
+        float depth(unsigned x, unsigned y) const;
+
+    private:
+        //the most corners of a quad clipped by the near plane and the four sides of the guard band
+        static const unsigned MaxEdges = 9;
+
+        //edge functions and depth plane of a convex polygon in pixel coordinates. The edges
+        //are moved in by half a pixel, so they are positive at the centres of the pixels
+        //that are inside completely.
+        struct ScreenPolygon {
+            int minX, minY, maxX, maxY;
+            unsigned edges;
+            float edgeA[MaxEdges], edgeB[MaxEdges], edgeC[MaxEdges];
+            float depthA, depthB, depthC;
+        };
+
+        unsigned _width, _height;
+        unsigned _tilesX, _tilesY;
+        std::vector<float> _depth;
+        std::vector<float> _tileDepth;
+        std::vector<ScreenPolygon> _polygons;
+
+        void _addPolygon(std::vector<glm::vec4>& polygon, std::vector<glm::vec4>& scratch);
+        void _setupPolygon(const std::vector<glm::vec4>& polygon);
+        void _rasterizeBand(unsigned tileRow);
+    };
+
+}
@@ -17,6 +17,7 @@
  */
 
 #include "Program.h"
+#include <algorithm>
 #include <stdexcept>
 #include <glm/gtc/type_ptr.hpp>
 
@@ -36,6 +37,10 @@ Program::Program(const std::vector<Shader>& shaders) :
     //attach all the shaders
     for(unsigned i = 0; i < shaders.size(); ++i)
         glAttachShader(_object, shaders[i].object());
+
+    //some drivers only keep what glGetProgramBinary needs if they're told before linking
+    if(GLEW_ARB_get_program_binary)
+        glProgramParameteri(_object, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     
     //link the shaders together
     glLinkProgram(_object);
@@ -62,6 +67,60 @@ Program::Program(const std::vector<Shader>& shaders) :
     }
 }
 
+Program::Program() :
+    _object(0)
+{
+}
+
+Program::Program(GLuint object) :
+    _object(object)
+{
+}
+
+void Program::swap(Program& other) {
+    std::swap(_object, other._object);
+    _attribs.clear();
+    _uniforms.clear();
+    other._attribs.clear();
+    other._uniforms.clear();
+}
+
+Program* Program::programFromBinary(GLenum format, const std::vector<unsigned char>& binary) {
+    if(!GLEW_ARB_get_program_binary || binary.empty())
+        return NULL;
+
+    Program* program = new Program();
+    program->_object = glCreateProgram();
+    if(program->_object == 0){
+        delete program;
+        throw std::runtime_error("glCreateProgram failed");
+    }
+
+    glProgramBinary(program->_object, format, &binary[0], (GLsizei)binary.size());
+    GLint status;
+    glGetProgramiv(program->_object, GL_LINK_STATUS, &status);
+    if(status == GL_FALSE){
+        delete program;
+        return NULL;
+    }
+    return program;
+}
+
+bool Program::binary(GLenum& format, std::vector<unsigned char>& binary) const {
+    if(!GLEW_ARB_get_program_binary)
+        return false;
+
+    GLint length = 0;
+    glGetProgramiv(_object, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return false;
+
+    binary.resize(length);
+    glGetProgramBinary(_object, length, &length, &format, &binary[0]);
+    binary.resize(length);
+    return length > 0;
+}
+
 Program::~Program() {
     //might be 0 if ctor fails by throwing exception
     if(_object != 0) glDeleteProgram(_object);
@@ -90,7 +149,7 @@ GLint Program::attrib(const GLchar* attribName) const {
     if(!attribName)
         throw std::runtime_error("attribName was NULL");
     
-    GLint attrib = glGetAttribLocation(_object, attribName);
+    GLint attrib = _attrib(attribName);
     if(attrib == -1)
         throw std::runtime_error(std::string("Program attribute not found: ") + attribName);
     
@@ -101,13 +160,45 @@ GLint Program::uniform(const GLchar* uniformName) const {
     if(!uniformName)
         throw std::runtime_error("uniformName was NULL");
     
-    GLint uniform = glGetUniformLocation(_object, uniformName);
+    GLint uniform = _uniform(uniformName);
     if(uniform == -1)
         throw std::runtime_error(std::string("Program uniform not found: ") + uniformName);
     
     return uniform;
 }
 
+bool Program::hasUniform(const GLchar* uniformName) const {
+    if(!uniformName)
+        throw std::runtime_error("uniformName was NULL");
+
+    return _uniform(uniformName) != -1;
+}
+
+GLint Program::_attrib(const GLchar* attribName) const {
+    std::map<std::string, GLint>::const_iterator it = _attribs.find(attribName);
+    if(it != _attribs.end())
+        return it->second;
+    return _attribs[attribName] = glGetAttribLocation(_object, attribName);
+}
+
+GLint Program::_uniform(const GLchar* uniformName) const {
+    std::map<std::string, GLint>::const_iterator it = _uniforms.find(uniformName);
+    if(it != _uniforms.end())
+        return it->second;
+    return _uniforms[uniformName] = glGetUniformLocation(_object, uniformName);
+}
+
+void Program::bindUniformBlock(const GLchar* blockName, GLuint bindingPoint) const {
+    if(!blockName)
+        throw std::runtime_error("blockName was NULL");
+
+    GLuint block = glGetUniformBlockIndex(_object, blockName);
+    if(block == GL_INVALID_INDEX)
+        throw std::runtime_error(std::string("Program uniform block not found: ") + blockName);
+
+    glUniformBlockBinding(_object, block, bindingPoint);
+}
+
 #define ATTRIB_N_UNIFORM_SETTERS(OGL_TYPE, TYPE_PREFIX, TYPE_SUFFIX) \
 \
     void Program::setAttrib(const GLchar* name, OGL_TYPE v0) \
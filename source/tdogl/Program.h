@@ -19,6 +19,8 @@
 #pragma once
 
 #include "Shader.h"
+#include <map>
+#include <string>
 #include <vector>
 #include <glm/glm.hpp>
 
@@ -39,7 +41,35 @@ namespace tdogl {
          @see tdogl::Shader
          */
         Program(const std::vector<Shader>& shaders);
+
+        /**
+         Takes ownership of a program object that is already linked.
+         */
+        explicit Program(GLuint object);
+
         ~Program();
+
+        /**
+         Exchanges the program objects of two programs, e.g. to replace a program with one
+         linked from edited shaders while everything keeps pointing at the same Program.
+         The locations looked up so far are forgotten, and looked up again on the next use.
+         */
+        void swap(Program& other);
+
+        /**
+         Creates a program from a binary returned by `binary`, without compiling anything.
+
+         @result NULL if the driver rejects the binary, e.g. because it was made by another
+                 driver version. That is expected now and then: link from source instead.
+         */
+        static Program* programFromBinary(GLenum format, const std::vector<unsigned char>& binary);
+
+        /**
+         Gets the linked program from the driver, for `programFromBinary` in a later run.
+
+         @result false if the driver doesn't support program binaries (ARB_get_program_binary)
+         */
+        bool binary(GLenum& format, std::vector<unsigned char>& binary) const;
         
         
         /**
@@ -55,15 +85,31 @@ namespace tdogl {
         
         /**
          @result The attribute index for the given name, as returned from glGetAttribLocation.
+                 The driver is only asked once per name.
          */
         GLint attrib(const GLchar* attribName) const;
         
         
         /**
          @result The uniform index for the given name, as returned from glGetUniformLocation.
+                 The driver is only asked once per name.
          */
         GLint uniform(const GLchar* uniformName) const;
 
+        /**
+         @result false if the program has no active uniform with that name, e.g. because the
+                 compiler removed it as unused. `uniform` and `setUniform` throw in that case.
+         */
+        bool hasUniform(const GLchar* uniformName) const;
+
+        /**
+         Connects the named uniform block to a uniform buffer binding point, as set with
+         glBindBufferBase.
+
+         @throws std::exception if the program has no block with that name.
+         */
+        void bindUniformBlock(const GLchar* blockName, GLuint bindingPoint) const;
+
         /**
          Setters for attribute and uniform variables.
 
@@ -107,6 +153,12 @@ namespace tdogl {
         
     private:
         GLuint _object;
+        mutable std::map<std::string, GLint> _attribs; //looked up locations, -1 for missing names
+        mutable std::map<std::string, GLint> _uniforms;
+
+        Program();
+        GLint _attrib(const GLchar* attribName) const;
+        GLint _uniform(const GLchar* uniformName) const;
         
         //copying disabled
         Program(const Program&);
@@ -0,0 +1,152 @@
+/*
+ tdogl::ProgramCache
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+
+#include "ProgramCache.h"
+#include <cstring>
+#include <iostream>
+
+using namespace tdogl;
+
+static const uint32_t ProgramCacheVersion = 1;
+
+// hashes a string from glGetString, which is NULL if the context can't tell
+static uint64_t HashDriverString(GLenum name, uint64_t seed) {
+    const char* value = (const char*)glGetString(name);
+    if(!value)
+        value = "";
+    return FileCache::hash(value, strlen(value) + 1, seed);
+}
+
+ShaderSource::ShaderSource(GLenum type, const std::string& code) :
+    type(type),
+    code(code)
+{
+}
+
+ProgramCache::ProgramCache(FileCache* cache) :
+    _cache(NULL),
+    _driverHash(0),
+    _binaryCount(0),
+    _linkCount(0)
+{
+    GLint formatCount = 0;
+    if(GLEW_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if(!cache || formatCount <= 0)
+        return;
+
+    _cache = cache;
+    _driverHash = FileCache::hash(&ProgramCacheVersion, sizeof(ProgramCacheVersion));
+    _driverHash = HashDriverString(GL_VENDOR, _driverHash);
+    _driverHash = HashDriverString(GL_RENDERER, _driverHash);
+    _driverHash = HashDriverString(GL_VERSION, _driverHash);
+    _driverHash = HashDriverString(GL_SHADING_LANGUAGE_VERSION, _driverHash);
+}
+
+bool ProgramCache::enabled() const {
+    return _cache != NULL;
+}
+
+unsigned ProgramCache::binaryCount() const {
+    return _binaryCount;
+}
+
+unsigned ProgramCache::linkCount() const {
+    return _linkCount;
+}
+
+Program* ProgramCache::program(const std::vector<ShaderSource>& sources) {
+    const std::string key = _key(sources);
+    if(!key.empty()){
+        Program* program = _read(key);
+        if(program){
+            ++_binaryCount;
+            return program;
+        }
+    }
+
+    std::vector<Shader> shaders;
+    for(size_t i = 0; i < sources.size(); ++i)
+        shaders.push_back(Shader(sources[i].code, sources[i].type));
+    Program* program = new Program(shaders);
+    ++_linkCount;
+    if(!key.empty())
+        _write(key, *program);
+    return program;
+}
+
+Program* ProgramCache::programFromFiles(const std::string& vertexShaderPath,
+                                        const std::string& fragmentShaderPath,
+                                        const std::vector<std::string>& defines)
+{
+    std::vector<ShaderSource> sources;
+    sources.push_back(ShaderSource(GL_VERTEX_SHADER, Shader::sourceWithDefines(Shader::sourceFromFile(vertexShaderPath), defines)));
+    sources.push_back(ShaderSource(GL_FRAGMENT_SHADER, Shader::sourceWithDefines(Shader::sourceFromFile(fragmentShaderPath), defines)));
+    return program(sources);
+}
+
+void ProgramCache::store(const std::vector<ShaderSource>& sources, const Program& program) {
+    const std::string key = _key(sources);
+    if(!key.empty())
+        _write(key, program);
+}
+
+std::string ProgramCache::_key(const std::vector<ShaderSource>& sources) const {
+    if(!_cache)
+        return "";
+
+    //the type and length of each source go in too, so the same text split differently
+    //between the shaders gets another key
+    uint64_t hash = _driverHash;
+    for(size_t i = 0; i < sources.size(); ++i){
+        const uint64_t length = sources[i].code.size();
+        hash = FileCache::hash(&sources[i].type, sizeof(sources[i].type), hash);
+        hash = FileCache::hash(&length, sizeof(length), hash);
+        hash = FileCache::hash(sources[i].code.data(), sources[i].code.size(), hash);
+    }
+    return FileCache::key(hash, ".program");
+}
+
+// the binary format, then the binary
+Program* ProgramCache::_read(const std::string& key) const {
+    std::vector<unsigned char> blob;
+    if(!_cache->read(key, blob) || blob.size() <= sizeof(uint32_t))
+        return NULL;
+
+    uint32_t format;
+    memcpy(&format, &blob[0], sizeof(format));
+    std::vector<unsigned char> binary(blob.begin() + sizeof(format), blob.end());
+    Program* program = Program::programFromBinary((GLenum)format, binary);
+    if(!program)
+        std::cerr << "The driver rejected cached program " << key << ", linking it again" << std::endl;
+    return program;
+}
+
+void ProgramCache::_write(const std::string& key, const Program& program) const {
+    GLenum format;
+    std::vector<unsigned char> binary;
+    if(!program.binary(format, binary))
+        return;
+
+    const uint32_t header = (uint32_t)format;
+    std::vector<unsigned char> blob((const unsigned char*)&header, (const unsigned char*)&header + sizeof(header));
+    blob.insert(blob.end(), binary.begin(), binary.end());
+    if(!_cache->write(key, blob))
+        std::cerr << "Can't write " << key << " to the cache" << std::endl;
+}
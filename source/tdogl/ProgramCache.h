@@ -0,0 +1,104 @@
+/*
+ tdogl::ProgramCache
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+
+#pragma once
+
+#include "Program.h"
+#include "FileCache.h"
+#include <string>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     The source code of one shader of a program.
+     */
+    struct ShaderSource {
+        GLenum type; //same as the argument to glCreateShader, e.g. GL_VERTEX_SHADER
+        std::string code;
+
+        ShaderSource(GLenum type, const std::string& code);
+    };
+
+    /**
+     Makes programs from shader sources, and keeps each linked program in a FileCache as a
+     program binary from the driver. The next run loads a program with the same sources
+     straight from its binary, without compiling or linking anything.
+
+     Binaries only work on the driver that made them, so the key of a binary is a hash of
+     the sources and of the vendor, renderer and version strings of the driver. A driver may
+     still reject a binary, e.g. after an update that kept its version string. Then the
+     program is linked from source as if nothing was cached, and the binary is replaced.
+
+     Uses OpenGL, so only use it on the thread where the context is current.
+     */
+    class ProgramCache {
+    public:
+        /**
+         @param cache  Where to keep the binaries. May be NULL, then every program is linked
+                       from source.
+         */
+        explicit ProgramCache(FileCache* cache);
+
+        /**
+         Loads the program cached for `sources`, or compiles and links them and caches the
+         result.
+
+         @throws std::exception if compiling or linking fails, like tdogl::Shader and
+                 tdogl::Program.
+         */
+        Program* program(const std::vector<ShaderSource>& sources);
+
+        /**
+         `program` for a vertex shader file and a fragment shader file, with `defines` added
+         to both as in Shader::sourceWithDefines.
+         */
+        Program* programFromFiles(const std::string& vertexShaderPath,
+                                  const std::string& fragmentShaderPath,
+                                  const std::vector<std::string>& defines = std::vector<std::string>());
+
+        /**
+         Caches a program that was linked from `sources` some other way, e.g. by a
+         ShaderReloader, so that `program` loads it from its binary next time.
+         */
+        void store(const std::vector<ShaderSource>& sources, const Program& program);
+
+        /** false if nothing is cached, because there is no FileCache or the driver has no binary formats */
+        bool enabled() const;
+
+        /** number of programs loaded from binaries, and linked from source */
+        unsigned binaryCount() const;
+        unsigned linkCount() const;
+
+    private:
+        FileCache* _cache;
+        uint64_t _driverHash;
+        unsigned _binaryCount;
+        unsigned _linkCount;
+
+        std::string _key(const std::vector<ShaderSource>& sources) const;
+        Program* _read(const std::string& key) const;
+        void _write(const std::string& key, const Program& program) const;
+
+        //copying disabled
+        ProgramCache(const ProgramCache&);
+        const ProgramCache& operator=(const ProgramCache&);
+    };
+
+}
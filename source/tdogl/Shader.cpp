@@ -87,6 +87,12 @@ Shader& Shader::operator = (const Shader& other) {
 }
 
 Shader Shader::shaderFromFile(const std::string& filePath, GLenum shaderType) {
+    //return new shader
+    Shader shader(sourceFromFile(filePath), shaderType);
+    return shader;
+}
+
+std::string Shader::sourceFromFile(const std::string& filePath) {
     //open file
     std::ifstream f;
     f.open(filePath.c_str(), std::ios::in | std::ios::binary);
@@ -97,10 +103,29 @@ Shader Shader::shaderFromFile(const std::string& filePath, GLenum shaderType) {
     //read whole file into stringstream buffer
     std::stringstream buffer;
     buffer << f.rdbuf();
+    return buffer.str();
+}
 
-    //return new shader
-    Shader shader(buffer.str(), shaderType);
-    return shader;
+std::string Shader::sourceWithDefines(const std::string& shaderCode, const std::vector<std::string>& defines) {
+    if(defines.empty())
+        return shaderCode;
+
+    //#version must come before anything but comments, so the defines go on the line after it
+    size_t insertAt = 0;
+    size_t version = shaderCode.find("#version");
+    if(version != std::string::npos){
+        size_t lineEnd = shaderCode.find('\n', version);
+        insertAt = (lineEnd == std::string::npos) ? shaderCode.size() : lineEnd + 1;
+    }
+
+    std::string lines;
+    for(size_t i = 0; i < defines.size(); ++i)
+        lines += "#define " + defines[i] + " 1\n";
+
+    std::string result = shaderCode.substr(0, insertAt);
+    if(insertAt > 0 && result[insertAt - 1] != '\n')
+        result += '\n';
+    return result + lines + shaderCode.substr(insertAt);
 }
 
 void Shader::_retain() {
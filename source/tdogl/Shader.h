@@ -20,6 +20,7 @@
 
 #include <GL/glew.h>
 #include <string>
+#include <vector>
 
 namespace tdogl {
 
@@ -39,6 +40,20 @@ namespace tdogl {
          @throws std::exception if an error occurs.
          */
         static Shader shaderFromFile(const std::string& filePath, GLenum shaderType);
+
+        /**
+         Reads the source code of a shader from a text file, without compiling it.
+
+         @throws std::exception if the file can't be read.
+         */
+        static std::string sourceFromFile(const std::string& filePath);
+
+        /**
+         Adds a `#define NAME 1` line for each of `defines` to shader source code, right after
+         its #version line, so the source can #ifdef out what a variant doesn't use. The
+         driver's error messages count the added lines too.
+         */
+        static std::string sourceWithDefines(const std::string& shaderCode, const std::vector<std::string>& defines);
         
         
         /**
@@ -0,0 +1,240 @@
+/*
+ tdogl::ShaderReloader
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+
+#include "ShaderReloader.h"
+#include <iostream>
+
+using namespace tdogl;
+
+// the info log of a shader or program, from glGetShaderInfoLog or glGetProgramInfoLog
+static std::string InfoLog(GLuint object, bool isProgram) {
+    GLint length = 0;
+    if(isProgram)
+        glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+    else
+        glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+    if(length <= 0)
+        return "";
+
+    std::vector<char> log(length + 1, '\0');
+    if(isProgram)
+        glGetProgramInfoLog(object, length, NULL, &log[0]);
+    else
+        glGetShaderInfoLog(object, length, NULL, &log[0]);
+    return &log[0];
+}
+
+// binds every active attribute of `from` to the same location in `to`, which isn't linked yet
+static void BindAttribLocations(GLuint from, GLuint to) {
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(from, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(from, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    std::vector<GLchar> name(maxLength + 1, '\0');
+    for(GLint i = 0; i < count; ++i){
+        GLint size;
+        GLenum type;
+        glGetActiveAttrib(from, (GLuint)i, (GLsizei)name.size(), NULL, &size, &type, &name[0]);
+        GLint location = glGetAttribLocation(from, &name[0]);
+        if(location >= 0) //built in attributes like gl_VertexID have none
+            glBindAttribLocation(to, (GLuint)location, &name[0]);
+    }
+}
+
+// gives the uniform blocks of `to` the bindings of the blocks with the same names in `from`
+static void CopyUniformBlockBindings(GLuint from, GLuint to) {
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(from, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(from, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+    std::vector<GLchar> name(maxLength + 1, '\0');
+    for(GLint i = 0; i < count; ++i){
+        GLint binding = 0;
+        glGetActiveUniformBlockName(from, (GLuint)i, (GLsizei)name.size(), NULL, &name[0]);
+        glGetActiveUniformBlockiv(from, (GLuint)i, GL_UNIFORM_BLOCK_BINDING, &binding);
+        GLuint block = glGetUniformBlockIndex(to, &name[0]);
+        if(block != GL_INVALID_INDEX)
+            glUniformBlockBinding(to, block, (GLuint)binding);
+    }
+}
+
+ShaderReloader::ShaderReloader(ProgramCache* programs) :
+    _programs(programs),
+    _parallel(false)
+{
+    //let the driver use as many threads as it likes
+    if(GLEW_KHR_parallel_shader_compile){
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        _parallel = true;
+    } else if(GLEW_ARB_parallel_shader_compile){
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        _parallel = true;
+    }
+}
+
+ShaderReloader::~ShaderReloader() {
+    for(size_t i = 0; i < _watched.size(); ++i)
+        _cancel(_watched[i]);
+}
+
+void ShaderReloader::watch(Program* program,
+                           const std::string& vertexShaderPath,
+                           const std::string& fragmentShaderPath,
+                           const std::vector<std::string>& defines)
+{
+    Watched watched;
+    watched.program = program;
+    watched.defines = defines;
+    watched.filePaths.push_back(vertexShaderPath);
+    watched.types.push_back(GL_VERTEX_SHADER);
+    watched.filePaths.push_back(fragmentShaderPath);
+    watched.types.push_back(GL_FRAGMENT_SHADER);
+    watched.object = 0;
+    _watched.push_back(watched);
+}
+
+void ShaderReloader::fileChanged(const std::string& filePath) {
+    for(size_t i = 0; i < _watched.size(); ++i){
+        Watched& watched = _watched[i];
+        for(size_t f = 0; f < watched.filePaths.size(); ++f){
+            if(watched.filePaths[f] == filePath){
+                _cancel(watched);
+                _start(watched);
+                break;
+            }
+        }
+    }
+}
+
+unsigned ShaderReloader::update() {
+    unsigned replaced = 0;
+    for(size_t i = 0; i < _watched.size(); ++i){
+        Watched& watched = _watched[i];
+        if(watched.object == 0)
+            continue;
+
+        if(_parallel){
+            GLint done = GL_FALSE;
+            glGetProgramiv(watched.object, GL_COMPLETION_STATUS_KHR, &done);
+            if(done == GL_FALSE)
+                continue;
+        }
+
+        if(_finish(watched))
+            ++replaced;
+    }
+    return replaced;
+}
+
+unsigned ShaderReloader::pending() const {
+    unsigned count = 0;
+    for(size_t i = 0; i < _watched.size(); ++i){
+        if(_watched[i].object != 0)
+            ++count;
+    }
+    return count;
+}
+
+// reads the files and starts compiling and linking them, without asking for the results
+void ShaderReloader::_start(Watched& watched) {
+    watched.sources.clear();
+    try {
+        for(size_t f = 0; f < watched.filePaths.size(); ++f){
+            std::string code = Shader::sourceWithDefines(Shader::sourceFromFile(watched.filePaths[f]), watched.defines);
+            watched.sources.push_back(ShaderSource(watched.types[f], code));
+        }
+    } catch(const std::exception& e) {
+        //editors sometimes replace the file, so it may be missing for a moment
+        std::cerr << "Can't reload shaders: " << e.what() << std::endl;
+        return;
+    }
+
+    watched.start = std::chrono::steady_clock::now();
+    watched.object = glCreateProgram();
+    for(size_t s = 0; s < watched.sources.size(); ++s){
+        GLuint shader = glCreateShader(watched.sources[s].type);
+        const char* code = watched.sources[s].code.c_str();
+        glShaderSource(shader, 1, (const GLchar**)&code, NULL);
+        glCompileShader(shader);
+        glAttachShader(watched.object, shader);
+        watched.shaders.push_back(shader);
+    }
+
+    BindAttribLocations(watched.program->object(), watched.object);
+    if(GLEW_ARB_get_program_binary)
+        glProgramParameteri(watched.object, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(watched.object);
+}
+
+// checks the results of the link, and swaps the program in if there were no errors
+bool ShaderReloader::_finish(Watched& watched) {
+    bool ok = true;
+    for(size_t s = 0; s < watched.shaders.size(); ++s){
+        GLint status;
+        glGetShaderiv(watched.shaders[s], GL_COMPILE_STATUS, &status);
+        if(status == GL_FALSE){
+            std::cerr << "Compile failure in " << watched.filePaths[s] << ":\n"
+                      << InfoLog(watched.shaders[s], false) << std::endl;
+            ok = false;
+        }
+    }
+
+    GLint status;
+    glGetProgramiv(watched.object, GL_LINK_STATUS, &status);
+    if(ok && status == GL_FALSE){
+        std::cerr << "Program linking failure: " << InfoLog(watched.object, true) << std::endl;
+        ok = false;
+    }
+
+    if(!ok){
+        std::cerr << "Keeping the old program" << std::endl;
+        _cancel(watched);
+        return false;
+    }
+
+    for(size_t s = 0; s < watched.shaders.size(); ++s){
+        glDetachShader(watched.object, watched.shaders[s]);
+        glDeleteShader(watched.shaders[s]);
+    }
+    watched.shaders.clear();
+
+    //the old program object goes with `linked`
+    CopyUniformBlockBindings(watched.program->object(), watched.object);
+    Program linked(watched.object);
+    watched.program->swap(linked);
+    watched.object = 0;
+    if(_programs)
+        _programs->store(watched.sources, *watched.program);
+
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - watched.start).count();
+    std::cerr << "Reloaded " << watched.filePaths[0];
+    for(size_t f = 1; f < watched.filePaths.size(); ++f)
+        std::cerr << " and " << watched.filePaths[f];
+    std::cerr << " in " << ms << " ms" << std::endl;
+    return true;
+}
+
+// deletes the objects of the link going on, if there is one
+void ShaderReloader::_cancel(Watched& watched) {
+    for(size_t s = 0; s < watched.shaders.size(); ++s)
+        glDeleteShader(watched.shaders[s]);
+    watched.shaders.clear();
+    if(watched.object != 0){
+        glDeleteProgram(watched.object);
+        watched.object = 0;
+    }
+}
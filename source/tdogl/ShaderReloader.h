@@ -0,0 +1,114 @@
+/*
+ tdogl::ShaderReloader
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+
+#pragma once
+
+#include "Program.h"
+#include "ProgramCache.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     Links programs again when their shader files change, while the app keeps running.
+
+     `fileChanged` starts compiling and linking the programs that use the file. With
+     KHR_parallel_shader_compile (or the ARB version) the driver does that on its own threads
+     and `update` only swaps in the programs that are done, otherwise `update` waits for them.
+
+     A program is only replaced if everything compiled and linked. Program::swap gives the
+     existing Program the new program object, so everything that points at it draws with the
+     new shaders from then on. A broken edit prints the driver's log and leaves the old
+     program running.
+
+     The new program is linked with each attribute at its location in the old one, so vertex
+     arrays set up for the old program still work, and uniform blocks keep their bindings.
+     Other uniforms start at their defaults like in any newly linked program.
+
+     Uses OpenGL, so only use it on the thread where the context is current.
+     */
+    class ShaderReloader {
+    public:
+        /**
+         @param programs  Gets the binary of each reloaded program, so the next run doesn't
+                          compile the edited shaders again. May be NULL.
+         */
+        explicit ShaderReloader(ProgramCache* programs = NULL);
+
+        /**
+         Deletes the links that haven't finished.
+         */
+        ~ShaderReloader();
+
+        /**
+         Reloads `program` from these files whenever one of them changes, with `defines`
+         added to them as in Shader::sourceWithDefines.
+         */
+        void watch(Program* program,
+                   const std::string& vertexShaderPath,
+                   const std::string& fragmentShaderPath,
+                   const std::vector<std::string>& defines = std::vector<std::string>());
+
+        /**
+         Starts linking every program that uses the file again. A link of the same program
+         that is still going on is dropped.
+         */
+        void fileChanged(const std::string& filePath);
+
+        /**
+         Replaces the programs whose links finished since the last call. With a parallel
+         compile extension this doesn't wait for the links that are still going on.
+
+         @result The number of programs that were replaced
+         */
+        unsigned update();
+
+        /** number of links going on */
+        unsigned pending() const;
+
+    private:
+        struct Watched {
+            Program* program;
+            std::vector<std::string> filePaths;
+            std::vector<GLenum> types;
+            std::vector<std::string> defines;
+
+            //the link going on, if object isn't 0
+            GLuint object;
+            std::vector<GLuint> shaders;
+            std::vector<ShaderSource> sources;
+            std::chrono::steady_clock::time_point start;
+        };
+
+        ProgramCache* _programs;
+        bool _parallel;
+        std::vector<Watched> _watched;
+
+        void _start(Watched& watched);
+        bool _finish(Watched& watched);
+        void _cancel(Watched& watched);
+
+        //copying disabled
+        ShaderReloader(const ShaderReloader&);
+        const ShaderReloader& operator=(const ShaderReloader&);
+    };
+
+}
@@ -0,0 +1,60 @@
+/*
+ tdogl::ShaderVariants
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "ShaderVariants.h"
+#include <algorithm>
+
+using namespace tdogl;
+
+ShaderVariants::ShaderVariants(ProgramCache* programs,
+                               const std::string& vertexShaderPath,
+                               const std::string& fragmentShaderPath,
+                               ShaderReloader* reloader) :
+    _programs(programs),
+    _reloader(reloader),
+    _vertexShaderPath(vertexShaderPath),
+    _fragmentShaderPath(fragmentShaderPath)
+{
+}
+
+ShaderVariants::~ShaderVariants() {
+    std::map<std::vector<std::string>, Program*>::iterator it;
+    for(it = _variants.begin(); it != _variants.end(); ++it)
+        delete it->second;
+}
+
+Program* ShaderVariants::program(const std::vector<std::string>& defines) {
+    //sorted, so the same set always has the same sources and the same cached binary
+    std::vector<std::string> key(defines);
+    std::sort(key.begin(), key.end());
+    key.erase(std::unique(key.begin(), key.end()), key.end());
+
+    std::map<std::vector<std::string>, Program*>::const_iterator it = _variants.find(key);
+    if(it != _variants.end())
+        return it->second;
+
+    Program* program = _programs->programFromFiles(_vertexShaderPath, _fragmentShaderPath, key);
+    _variants[key] = program;
+    if(_reloader)
+        _reloader->watch(program, _vertexShaderPath, _fragmentShaderPath, key);
+    return program;
+}
+
+unsigned ShaderVariants::size() const {
+    return (unsigned)_variants.size();
+}
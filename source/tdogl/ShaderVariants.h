@@ -0,0 +1,81 @@
+/*
+ tdogl::ShaderVariants
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include "Program.h"
+#include "ProgramCache.h"
+#include "ShaderReloader.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     The programs made from one vertex shader file and one fragment shader file with
+     different sets of #defines, e.g. HAS_NORMALS for vertices with normals. The shaders
+     #ifdef out what a set doesn't need, so each variant only reads the attributes and
+     does the work that it needs.
+
+     A variant is compiled (or loaded from the ProgramCache) the first time it is asked
+     for, so only the sets that something uses are ever built. The variants keep their
+     Program objects, so pointers to them stay valid until this is deleted.
+
+     Uses OpenGL, so only use it on the thread where the context is current.
+     */
+    class ShaderVariants {
+    public:
+        /**
+         @param programs  Links the variants, or loads them from their binaries
+         @param reloader  Reloads each variant when the files change. May be NULL.
+         */
+        ShaderVariants(ProgramCache* programs,
+                       const std::string& vertexShaderPath,
+                       const std::string& fragmentShaderPath,
+                       ShaderReloader* reloader = NULL);
+
+        /**
+         Deletes the programs. Delete the ShaderReloader first, because it points at them.
+         */
+        ~ShaderVariants();
+
+        /**
+         The variant for a set of defines, which is built if it wasn't already. The order of
+         the defines doesn't matter.
+
+         @throws std::exception if compiling or linking fails, like ProgramCache::program.
+         */
+        Program* program(const std::vector<std::string>& defines);
+
+        /** number of variants built so far */
+        unsigned size() const;
+
+    private:
+        ProgramCache* _programs;
+        ShaderReloader* _reloader;
+        std::string _vertexShaderPath;
+        std::string _fragmentShaderPath;
+        std::map<std::vector<std::string>, Program*> _variants; //by sorted defines
+
+        //copying disabled
+        ShaderVariants(const ShaderVariants&);
+        const ShaderVariants& operator=(const ShaderVariants&);
+    };
+
+}
@@ -21,20 +21,51 @@
 
 using namespace tdogl;
 
-static GLenum TextureFormatForBitmapFormat(Bitmap::Format format)
+// sets the sampler parameters of a mipmapped texture
+static void SetMipmapSampling(GLint wrapMode, GLfloat anisotropy)
 {
-    switch (format) {
-        case Bitmap::Format_Grayscale: return GL_LUMINANCE;
-        case Bitmap::Format_GrayscaleAlpha: return GL_LUMINANCE_ALPHA;
-        case Bitmap::Format_RGB: return GL_RGB;
-        case Bitmap::Format_RGBA: return GL_RGBA;
-        default: throw std::runtime_error("Unrecognised Bitmap::Format");
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
+    if(GLEW_EXT_texture_filter_anisotropic && anisotropy > 1.0f){
+        GLfloat maxAnisotropy;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy < maxAnisotropy ? anisotropy : maxAnisotropy);
     }
 }
 
+// width or height of a mipmap level
+static unsigned LevelSize(unsigned size, unsigned level)
+{
+    size >>= level;
+    return size > 0 ? size : 1;
+}
+
+// uploads a bitmap to a level of the bound texture. Rows are tightly packed, which matters
+// for RGB bitmaps and small mipmap levels whose rows aren't a multiple of 4 bytes.
+static void UploadLevel(GLint level, const Bitmap& bitmap)
+{
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D,
+                 level, 
+                 Texture::pixelFormat(bitmap.format()),
+                 (GLsizei)bitmap.width(), 
+                 (GLsizei)bitmap.height(),
+                 0, 
+                 Texture::pixelFormat(bitmap.format()), 
+                 GL_UNSIGNED_BYTE, 
+                 bitmap.pixelBuffer());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
+
 Texture::Texture(const Bitmap& bitmap, GLint minMagFiler, GLint wrapMode) :
     _originalWidth((GLfloat)bitmap.width()),
-    _originalHeight((GLfloat)bitmap.height())
+    _originalHeight((GLfloat)bitmap.height()),
+    _uvRect(0.0f, 0.0f, 1.0f, 1.0f),
+    _ownsObject(true)
 {
     glGenTextures(1, &_object);
     glBindTexture(GL_TEXTURE_2D, _object);
@@ -42,21 +73,152 @@ Texture::Texture(const Bitmap& bitmap, GLint minMagFiler, GLint wrapMode) :
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, minMagFiler);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
-    glTexImage2D(GL_TEXTURE_2D,
-                 0, 
-                 TextureFormatForBitmapFormat(bitmap.format()),
-                 (GLsizei)bitmap.width(), 
-                 (GLsizei)bitmap.height(),
-                 0, 
-                 TextureFormatForBitmapFormat(bitmap.format()), 
-                 GL_UNSIGNED_BYTE, 
-                 bitmap.pixelBuffer());
+    UploadLevel(0, bitmap);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+Texture::Texture(const Bitmap& bitmap, const std::vector<Bitmap>& mipmaps, GLint wrapMode, GLfloat anisotropy) :
+    _originalWidth((GLfloat)bitmap.width()),
+    _originalHeight((GLfloat)bitmap.height()),
+    _uvRect(0.0f, 0.0f, 1.0f, 1.0f),
+    _ownsObject(true)
+{
+    glGenTextures(1, &_object);
+    glBindTexture(GL_TEXTURE_2D, _object);
+    SetMipmapSampling(wrapMode, anisotropy);
+    UploadLevel(0, bitmap);
+    if(mipmaps.empty()){
+        glGenerateMipmap(GL_TEXTURE_2D);
+    } else {
+        for(size_t i = 0; i < mipmaps.size(); ++i)
+            UploadLevel((GLint)i + 1, mipmaps[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)mipmaps.size());
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture::Texture(const CompressedImage& image, GLint wrapMode, GLfloat anisotropy) :
+    _originalWidth((GLfloat)image.levels.at(0).width),
+    _originalHeight((GLfloat)image.levels.at(0).height),
+    _uvRect(0.0f, 0.0f, 1.0f, 1.0f),
+    _ownsObject(true)
+{
+    glGenTextures(1, &_object);
+    glBindTexture(GL_TEXTURE_2D, _object);
+    SetMipmapSampling(wrapMode, anisotropy);
+    if(image.levels.size() == 1)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    for(size_t i = 0; i < image.levels.size(); ++i){
+        const CompressedImage::Level& level = image.levels[i];
+        glCompressedTexImage2D(GL_TEXTURE_2D,
+                               (GLint)i,
+                               pixelFormat(image.format),
+                               (GLsizei)level.width,
+                               (GLsizei)level.height,
+                               0,
+                               (GLsizei)level.blocks.size(),
+                               &level.blocks[0]);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture::Texture(Bitmap::Format format, unsigned width, unsigned height, unsigned levelCount, GLint wrapMode, GLfloat anisotropy) :
+    _originalWidth((GLfloat)width),
+    _originalHeight((GLfloat)height),
+    _uvRect(0.0f, 0.0f, 1.0f, 1.0f),
+    _ownsObject(true)
+{
+    glGenTextures(1, &_object);
+    glBindTexture(GL_TEXTURE_2D, _object);
+    SetMipmapSampling(wrapMode, anisotropy);
+    for(unsigned i = 0; i < levelCount; ++i){
+        glTexImage2D(GL_TEXTURE_2D,
+                     (GLint)i,
+                     pixelFormat(format),
+                     (GLsizei)LevelSize(width, i),
+                     (GLsizei)LevelSize(height, i),
+                     0,
+                     pixelFormat(format),
+                     GL_UNSIGNED_BYTE,
+                     NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelCount - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture::Texture(CompressedImage::Format format, unsigned width, unsigned height, unsigned levelCount, GLint wrapMode, GLfloat anisotropy) :
+    _originalWidth((GLfloat)width),
+    _originalHeight((GLfloat)height),
+    _uvRect(0.0f, 0.0f, 1.0f, 1.0f),
+    _ownsObject(true)
+{
+    glGenTextures(1, &_object);
+    glBindTexture(GL_TEXTURE_2D, _object);
+    SetMipmapSampling(wrapMode, anisotropy);
+    if(levelCount == 1)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    for(unsigned i = 0; i < levelCount; ++i){
+        const unsigned levelWidth = LevelSize(width, i), levelHeight = LevelSize(height, i);
+        glCompressedTexImage2D(GL_TEXTURE_2D,
+                               (GLint)i,
+                               pixelFormat(format),
+                               (GLsizei)levelWidth,
+                               (GLsizei)levelHeight,
+                               0,
+                               (GLsizei)(((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * CompressedImage::blockSize(format)),
+                               NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelCount - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture::Texture(GLuint object, GLfloat width, GLfloat height, const glm::vec4& uvRect) :
+    _object(object),
+    _originalWidth(width),
+    _originalHeight(height),
+    _uvRect(uvRect),
+    _ownsObject(false)
+{
+}
+
+bool Texture::supportsFormat(CompressedImage::Format format)
+{
+    switch (format) {
+        case CompressedImage::Format_BC1:
+        case CompressedImage::Format_BC3: return GLEW_EXT_texture_compression_s3tc != GL_FALSE;
+        case CompressedImage::Format_BC7: return GLEW_ARB_texture_compression_bptc != GL_FALSE;
+        default: return false;
+    }
+}
+
+GLenum Texture::pixelFormat(Bitmap::Format format)
+{
+    switch (format) {
+        case Bitmap::Format_Grayscale: return GL_LUMINANCE;
+        case Bitmap::Format_GrayscaleAlpha: return GL_LUMINANCE_ALPHA;
+        case Bitmap::Format_RGB: return GL_RGB;
+        case Bitmap::Format_RGBA: return GL_RGBA;
+        default: throw std::runtime_error("Unrecognised Bitmap::Format");
+    }
+}
+
+GLenum Texture::pixelFormat(CompressedImage::Format format)
+{
+    switch (format) {
+        case CompressedImage::Format_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case CompressedImage::Format_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case CompressedImage::Format_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+        default: throw std::runtime_error("Unrecognised CompressedImage::Format");
+    }
+}
+
 Texture::~Texture()
 {
-    glDeleteTextures(1, &_object);
+    if(_ownsObject)
+        glDeleteTextures(1, &_object);
 }
 
 GLuint Texture::object() const
@@ -73,3 +235,13 @@ GLfloat Texture::originalHeight() const
 {
     return _originalHeight;
 }
+
+glm::vec4 Texture::uvRect() const
+{
+    return _uvRect;
+}
+
+bool Texture::isRegion() const
+{
+    return !_ownsObject;
+}
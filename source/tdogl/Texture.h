@@ -19,7 +19,10 @@
 #pragma once
 
 #include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
 #include "Bitmap.h"
+#include "BlockCompressor.h"
 
 namespace tdogl {
     
@@ -44,7 +47,93 @@ namespace tdogl {
                 GLint wrapMode = GL_CLAMP_TO_EDGE);
         
         /**
-         Deletes the texture object with glDeleteTextures
+         Creates a mipmapped texture from a bitmap, sampled trilinearly.
+         
+         @param bitmap  Level 0 of the texture
+         @param mipmaps  The levels below level 0, largest first, e.g. from
+                         tdogl::MipmapBuilder. If empty, glGenerateMipmap makes them instead.
+         @param wrapMode  As above
+         @param anisotropy  The most samples of anisotropic filtering, clamped to what the
+                            driver supports. 1 turns it off. Ignored without
+                            EXT_texture_filter_anisotropic.
+         */
+        Texture(const Bitmap& bitmap,
+                const std::vector<Bitmap>& mipmaps,
+                GLint wrapMode = GL_CLAMP_TO_EDGE,
+                GLfloat anisotropy = 1.0f);
+        
+        /**
+         Creates a texture from block compressed levels with glCompressedTexImage2D. It is
+         sampled trilinearly when there is more than one level.
+         
+         Check `supportsFormat` first, and fall back to the constructors above if the
+         format isn't supported.
+         
+         @param wrapMode  As above
+         @param anisotropy  As above
+         */
+        Texture(const CompressedImage& image,
+                GLint wrapMode = GL_CLAMP_TO_EDGE,
+                GLfloat anisotropy = 1.0f);
+        
+        /**
+         Creates a mipmapped texture whose levels are allocated but not filled, for
+         tdogl::TextureUploader to stream the pixels into. Level i is `width` and `height`
+         halved i times, like the levels of tdogl::MipmapBuilder.
+         
+         Only the smallest level is sampled at first: fill the levels smallest first, moving
+         GL_TEXTURE_BASE_LEVEL down as each one is done.
+         
+         @param format  The format of the bitmaps that will fill the levels
+         @param levelCount  Number of levels, including level 0
+         @param wrapMode  As above
+         @param anisotropy  As above
+         */
+        Texture(Bitmap::Format format,
+                unsigned width,
+                unsigned height,
+                unsigned levelCount,
+                GLint wrapMode = GL_CLAMP_TO_EDGE,
+                GLfloat anisotropy = 1.0f);
+        
+        /**
+         Same as above, for levels in a block compressed format.
+         */
+        Texture(CompressedImage::Format format,
+                unsigned width,
+                unsigned height,
+                unsigned levelCount,
+                GLint wrapMode = GL_CLAMP_TO_EDGE,
+                GLfloat anisotropy = 1.0f);
+        
+        /**
+         Refers to a region of another texture's storage, e.g. of a tdogl::TextureAtlas.
+         The texture object is shared, not owned: it isn't deleted with this texture.
+         
+         @param object  The texture object that holds the region
+         @param width  Width in pixels of the image in the region
+         @param height  Height in pixels of the image in the region
+         @param uvRect  Where the region is, see `uvRect()`
+         */
+        Texture(GLuint object, GLfloat width, GLfloat height, const glm::vec4& uvRect);
+        
+        /**
+         @result Whether the driver can sample the given block compressed format
+         */
+        static bool supportsFormat(CompressedImage::Format format);
+        
+        /**
+         @result The GL format of pixels in the given bitmap format, e.g. GL_RGB
+         */
+        static GLenum pixelFormat(Bitmap::Format format);
+        
+        /**
+         @result The GL internal format of the given block compressed format
+         */
+        static GLenum pixelFormat(CompressedImage::Format format);
+        
+        /**
+         Deletes the texture object with glDeleteTextures, unless it belongs to another texture
          */
         ~Texture();
         
@@ -63,10 +152,25 @@ namespace tdogl {
          */
         GLfloat originalHeight() const;
         
+        /**
+         @result Where the image is in the texture object: texture coordinates in [0, 1] map
+                 to xy + zw * coordinate. (0, 0, 1, 1) unless the texture is a region of
+                 another one.
+         */
+        glm::vec4 uvRect() const;
+        
+        /**
+         @result Whether this texture is a region of another one. Texture coordinates outside
+                 [0, 1] would sample the neighbouring regions, so clamp them first.
+         */
+        bool isRegion() const;
+        
     private:
         GLuint _object;
         GLfloat _originalWidth;
         GLfloat _originalHeight;
+        glm::vec4 _uvRect;
+        bool _ownsObject;
         
         //copying disabled
         Texture(const Texture&);
@@ -0,0 +1,169 @@
+/*
+ tdogl::TextureAtlas
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "TextureAtlas.h"
+#include <algorithm>
+
+using namespace tdogl;
+
+// the image in RGBA, with `gutter` pixels around it that repeat its edges
+static Bitmap PadImage(const Bitmap& image, unsigned gutter) {
+    const unsigned width = image.width(), height = image.height();
+    Bitmap padded(width + 2 * gutter, height + 2 * gutter, Bitmap::Format_RGBA);
+    padded.copyRectFromBitmap(image, 0, 0, gutter, gutter, width, height);
+    for(unsigned i = 0; i < gutter; ++i){
+        padded.copyRectFromBitmap(padded, gutter, gutter, i, gutter, 1, height);
+        padded.copyRectFromBitmap(padded, gutter + width - 1, gutter, gutter + width + i, gutter, 1, height);
+    }
+    for(unsigned i = 0; i < gutter; ++i){
+        padded.copyRectFromBitmap(padded, 0, gutter, 0, i, padded.width(), 1);
+        padded.copyRectFromBitmap(padded, 0, gutter + height - 1, 0, gutter + height + i, padded.width(), 1);
+    }
+    return padded;
+}
+
+TextureAtlas::TextureAtlas(unsigned size, unsigned levelCount, unsigned maxImageSize) :
+    _texture(NULL),
+    _size(size),
+    _levelCount(std::max(levelCount, 1u)),
+    _maxImageSize(maxImageSize),
+    _gutter(1u << (_levelCount - 1)),
+    _regions(0)
+{
+    Segment floor = { 0, 0, _size };
+    _skyline.push_back(floor);
+
+    _texture = new Texture(Bitmap::Format_RGBA, _size, _size, _levelCount, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, _texture->object());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+TextureAtlas::~TextureAtlas() {
+    delete _texture;
+}
+
+bool TextureAtlas::accepts(unsigned width, unsigned height) const {
+    return width > 0 && height > 0 && width <= _maxImageSize && height <= _maxImageSize &&
+           width % _gutter == 0 && height % _gutter == 0;
+}
+
+Texture* TextureAtlas::add(const Bitmap& bitmap, const std::vector<Bitmap>& mipmaps) {
+    const unsigned width = bitmap.width(), height = bitmap.height();
+    if(!accepts(width, height) || mipmaps.size() + 1 < _levelCount)
+        return NULL;
+
+    //multiples of the gutter, so every level of the region starts and ends on whole texels
+    unsigned x, y;
+    if(!_place(width + 2 * _gutter, height + 2 * _gutter, x, y))
+        return NULL;
+
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, _texture->object());
+    for(unsigned level = 0; level < _levelCount; ++level){
+        Bitmap padded = PadImage(level == 0 ? bitmap : mipmaps[level - 1], _gutter >> level);
+        glTexSubImage2D(GL_TEXTURE_2D,
+                        (GLint)level,
+                        (GLint)(x >> level),
+                        (GLint)(y >> level),
+                        (GLsizei)padded.width(),
+                        (GLsizei)padded.height(),
+                        GL_RGBA,
+                        GL_UNSIGNED_BYTE,
+                        padded.pixelBuffer());
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    _regions++;
+    const GLfloat scale = 1.0f / _size;
+    glm::vec4 uvRect((x + _gutter) * scale, (y + _gutter) * scale, width * scale, height * scale);
+    return new Texture(_texture->object(), (GLfloat)width, (GLfloat)height, uvRect);
+}
+
+void TextureAtlas::remove(Texture* region) {
+    if(!region || _regions == 0)
+        return;
+
+    if(--_regions == 0){
+        _skyline.clear();
+        Segment floor = { 0, 0, _size };
+        _skyline.push_back(floor);
+    }
+}
+
+GLuint TextureAtlas::object() const {
+    return _texture->object();
+}
+
+// finds the lowest place for a rectangle on the skyline, leftmost among equals, and raises
+// the skyline over it
+bool TextureAtlas::_place(unsigned width, unsigned height, unsigned& x, unsigned& y) {
+    size_t best = _skyline.size();
+    unsigned bestY = 0;
+    for(size_t i = 0; i < _skyline.size(); ++i){
+        const unsigned left = _skyline[i].x;
+        if(left + width > _size)
+            break;
+
+        //the rectangle rests on the highest segment under it
+        unsigned top = 0;
+        for(size_t j = i; j < _skyline.size() && _skyline[j].x < left + width; ++j)
+            top = std::max(top, _skyline[j].y);
+        if(top + height <= _size && (best == _skyline.size() || top < bestY)){
+            best = i;
+            bestY = top;
+        }
+    }
+    if(best == _skyline.size())
+        return false;
+
+    x = _skyline[best].x;
+    y = bestY;
+
+    //the segments under the rectangle are cut away and the new one goes in their place
+    const unsigned right = x + width;
+    std::vector<Segment> skyline;
+    skyline.reserve(_skyline.size() + 2);
+    for(size_t i = 0; i < _skyline.size() && _skyline[i].x < x; ++i){
+        Segment left = _skyline[i];
+        left.width = std::min(left.width, x - left.x);
+        skyline.push_back(left);
+    }
+    Segment raised = { x, y + height, width };
+    skyline.push_back(raised);
+    for(size_t i = 0; i < _skyline.size(); ++i){
+        const unsigned segmentRight = _skyline[i].x + _skyline[i].width;
+        if(segmentRight > right){
+            Segment rest = { std::max(_skyline[i].x, right), _skyline[i].y, segmentRight - std::max(_skyline[i].x, right) };
+            skyline.push_back(rest);
+        }
+    }
+
+    //neighbours at the same height merge, so the skyline stays short
+    _skyline.clear();
+    for(size_t i = 0; i < skyline.size(); ++i){
+        if(!_skyline.empty() && _skyline.back().y == skyline[i].y)
+            _skyline.back().width += skyline[i].width;
+        else
+            _skyline.push_back(skyline[i]);
+    }
+    return true;
+}
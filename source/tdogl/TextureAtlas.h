@@ -0,0 +1,104 @@
+/*
+ tdogl::TextureAtlas
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include "Bitmap.h"
+#include "Texture.h"
+
+namespace tdogl {
+
+    /**
+     One big RGBA texture that holds many small images, so models with different small
+     textures can be drawn without binding another texture in between.
+
+     Images are placed with a skyline packer. Each one gets a gutter that repeats its edge
+     pixels, so sampling a region behaves like GL_CLAMP_TO_EDGE on its own texture as long
+     as the texture coordinates are clamped to [0, 1] before they go through
+     Texture::uvRect. The gutter is one texel wide at the smallest level, which is why
+     the atlas has few levels, and why image sizes must be multiples of the gutter. For the
+     same reason the atlas has no anisotropic filtering: its samples would reach past the
+     gutter into the neighbouring images.
+
+     Space isn't reused when a region is removed, only once the atlas is empty again.
+     */
+    class TextureAtlas {
+    public:
+        /**
+         @param size  Width and height of the atlas texture in pixels
+         @param levelCount  Number of mipmap levels, including level 0
+         @param maxImageSize  The largest width or height of an image that goes in
+         */
+        TextureAtlas(unsigned size, unsigned levelCount, unsigned maxImageSize);
+
+        /**
+         Deletes the atlas texture. Remove the regions first.
+         */
+        ~TextureAtlas();
+
+        /**
+         @result Whether images of the given size can go in the atlas, when there is room.
+                 Safe to call from any thread.
+         */
+        bool accepts(unsigned width, unsigned height) const;
+
+        /**
+         Copies an image and its mipmaps into a free region, converted to RGBA.
+
+         @param bitmap  Level 0 of the image, with a size that `accepts`
+         @param mipmaps  The levels below level 0, as from tdogl::MipmapBuilder. At least
+                         levelCount - 1 are needed.
+         @result A texture that refers to the region, or NULL if the atlas is full or the
+                 image doesn't qualify. Pass it to `remove` before deleting it.
+         */
+        Texture* add(const Bitmap& bitmap, const std::vector<Bitmap>& mipmaps);
+
+        /**
+         Tells the atlas a region from `add` isn't used anymore.
+         */
+        void remove(Texture* region);
+
+        /** the GL texture object that holds every region */
+        GLuint object() const;
+
+    private:
+        //the top edge of the filled space over a span of columns
+        struct Segment {
+            unsigned x;
+            unsigned y;
+            unsigned width;
+        };
+
+        Texture* _texture;
+        unsigned _size;
+        unsigned _levelCount;
+        unsigned _maxImageSize;
+        unsigned _gutter; //at level 0
+        std::vector<Segment> _skyline; //left to right, covering the whole width
+        unsigned _regions;
+
+        bool _place(unsigned width, unsigned height, unsigned& x, unsigned& y);
+
+        //copying disabled
+        TextureAtlas(const TextureAtlas&);
+        const TextureAtlas& operator=(const TextureAtlas&);
+    };
+
+}
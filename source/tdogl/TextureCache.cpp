@@ -0,0 +1,295 @@
+/*
+ tdogl::TextureCache
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "TextureCache.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+#if defined( __WIN32__ ) || defined( _WIN32 ) || defined( _WIN64 )
+    #include <stdlib.h>
+#else
+    #include <limits.h>
+#endif
+
+using namespace tdogl;
+
+// the absolute path without links or "..", or the path as given if the file doesn't exist
+static std::string CanonicalPath(const std::string& filePath) {
+#if defined( __WIN32__ ) || defined( _WIN32 ) || defined( _WIN64 )
+    char resolved[_MAX_PATH];
+    if(_fullpath(resolved, filePath.c_str(), _MAX_PATH))
+        return resolved;
+#else
+    char resolved[PATH_MAX];
+    if(realpath(filePath.c_str(), resolved))
+        return resolved;
+#endif
+    return filePath;
+}
+
+// the CPU side of loading one texture. It runs once, on a worker, or on the main thread
+// if the main thread needs it before any worker has started it.
+struct TextureCache::Decoded {
+    std::string filePath;
+    ThreadPool* pool;
+    FileCache* cache;
+    DecodeOptions options;
+
+    std::atomic<bool> claimed;
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done;
+
+    DecodedImage result;
+
+    Decoded() : claimed(false), done(false) {}
+
+    void run() {
+        if(claimed.exchange(true))
+            return;
+
+        ImageLoader::decode(filePath, options, *pool, cache, result);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        finished.notify_all();
+    }
+
+    // runs the job here unless a worker has started it, and waits for it to finish
+    void wait() {
+        run();
+        waitDone();
+    }
+
+    // makes sure the job never starts, or waits for it if it has
+    void cancel() {
+        if(claimed.exchange(true))
+            waitDone();
+    }
+
+    void waitDone() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(!done)
+            finished.wait(lock);
+    }
+};
+
+TextureCache::Sampling::Sampling(GLint wrapMode, GLfloat anisotropy, bool atlas) :
+    wrapMode(wrapMode),
+    anisotropy(anisotropy),
+    atlas(atlas)
+{
+}
+
+TextureCache::TextureCache(ThreadPool& pool, FileCache* cache, size_t vramBudget, bool mipmapsOnCpu, bool compress,
+                           TextureUploader* uploader, TextureAtlas* atlas) :
+    _pool(pool),
+    _cache(cache),
+    _uploader(uploader),
+    _atlas(mipmapsOnCpu ? atlas : NULL),
+    _vramBudget(vramBudget),
+    _mipmapsOnCpu(mipmapsOnCpu),
+    _compress(compress && mipmapsOnCpu &&
+              Texture::supportsFormat(CompressedImage::Format_BC1) &&
+              Texture::supportsFormat(CompressedImage::Format_BC3)),
+    _allowBC7(Texture::supportsFormat(CompressedImage::Format_BC7)),
+    _vramUsed(0),
+    _clock(0)
+{
+}
+
+TextureCache::~TextureCache() {
+    for(std::map<std::string, Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it){
+        if(it->second.decoded)
+            it->second.decoded->cancel();
+        _delete(it->second);
+    }
+}
+
+DecodeOptions TextureCache::decodeOptions(const Sampling& sampling) const {
+    DecodeOptions options;
+    options.mipmaps = _mipmapsOnCpu;
+    options.compress = _compress;
+    options.allowBC7 = _allowBC7;
+    options.atlas = sampling.atlas && sampling.wrapMode == GL_CLAMP_TO_EDGE ? _atlas : NULL;
+    return options;
+}
+
+// the entry of a file, made if there is none: from `decoded` if it is given, or else by a
+// new job on the pool
+std::map<std::string, TextureCache::Entry>::iterator TextureCache::_find(const std::string& filePath,
+                                                                         const Sampling& sampling,
+                                                                         DecodedImage* decoded)
+{
+    const std::string canonicalPath = CanonicalPath(filePath);
+    std::ostringstream key;
+    key << canonicalPath << '|' << sampling.wrapMode << '|' << sampling.anisotropy << '|' << sampling.atlas;
+
+    std::map<std::string, Entry>::iterator it = _entries.find(key.str());
+    if(it != _entries.end())
+        return it;
+
+    Entry entry;
+    entry.decoded.reset(new Decoded());
+    entry.decoded->filePath = canonicalPath;
+    entry.decoded->pool = &_pool;
+    entry.decoded->cache = _cache;
+    entry.decoded->options = decodeOptions(sampling);
+    entry.texture = NULL;
+    entry.bytes = 0;
+    entry.atlased = false;
+    entry.refs = 0;
+    entry.lastUse = 0;
+
+    if(decoded){
+        entry.decoded->claimed = true;
+        entry.decoded->done = true;
+        entry.decoded->result = std::move(*decoded);
+    } else {
+        std::shared_ptr<Decoded> job = entry.decoded;
+        _pool.submit([job]() { job->run(); });
+    }
+    return _entries.insert(std::make_pair(key.str(), entry)).first;
+}
+
+void TextureCache::prefetch(const std::string& filePath, const Sampling& sampling) {
+    _find(filePath, sampling, NULL);
+}
+
+Texture* TextureCache::acquire(const std::string& filePath, const Sampling& sampling) {
+    return _acquire(_find(filePath, sampling, NULL), sampling);
+}
+
+Texture* TextureCache::acquire(DecodedImage& image, const Sampling& sampling) {
+    return _acquire(_find(image.filePath, sampling, &image), sampling);
+}
+
+Texture* TextureCache::_acquire(std::map<std::string, Entry>::iterator it, const Sampling& sampling) {
+    Entry& entry = it->second;
+    entry.lastUse = ++_clock;
+
+    if(entry.decoded){
+        std::shared_ptr<Decoded> decoded = entry.decoded;
+        entry.decoded.reset();
+        decoded->wait();
+
+        DecodedImage& image = decoded->result;
+        if(!image.error.empty()){
+            //remembered as a failure, so the file isn't decoded again for every material
+            std::cerr << "Can't load texture " << decoded->filePath << ": " << image.error << std::endl;
+        } else if(!image.compressed && decoded->options.atlas &&
+                  (entry.texture = _atlas->add(image.level0[0], image.mipmaps))){
+            entry.atlased = true;
+        } else {
+            entry.bytes = image.bytes();
+            if(!image.compressed && image.mipmaps.empty())
+                entry.bytes += entry.bytes / 3; //made by glGenerateMipmap
+            entry.texture = _upload(image, sampling);
+        }
+
+        if(entry.texture){
+            _keys[entry.texture] = it->first;
+            _vramUsed += entry.bytes;
+        }
+    }
+
+    if(!entry.texture)
+        return NULL;
+    entry.refs++;
+    _evict();
+    return entry.texture;
+}
+
+// makes the texture of a decoded image. With an uploader, the levels move into its queue
+// smallest first, and the texture is returned before any of them are on the GPU.
+Texture* TextureCache::_upload(DecodedImage& decoded, const Sampling& sampling) {
+    if(decoded.compressed){
+        CompressedImage& image = decoded.image;
+        if(!_uploader)
+            return new Texture(image, sampling.wrapMode, sampling.anisotropy);
+
+        Texture* texture = new Texture(image.format, image.levels[0].width, image.levels[0].height,
+                                       (unsigned)image.levels.size(), sampling.wrapMode, sampling.anisotropy);
+        for(size_t i = image.levels.size(); i-- > 0; )
+            _uploader->upload(texture, (GLint)i, image.format, std::move(image.levels[i]));
+        return texture;
+    }
+
+    //glGenerateMipmap needs all of level 0 at once, so only mipmaps from the CPU can stream
+    const Bitmap& level0 = decoded.level0[0];
+    if(!_uploader || decoded.mipmaps.empty())
+        return new Texture(level0, decoded.mipmaps, sampling.wrapMode, sampling.anisotropy);
+
+    Texture* texture = new Texture(level0.format(), level0.width(), level0.height(),
+                                   (unsigned)decoded.mipmaps.size() + 1, sampling.wrapMode, sampling.anisotropy);
+    for(size_t i = decoded.mipmaps.size(); i-- > 0; )
+        _uploader->upload(texture, (GLint)i + 1, std::move(decoded.mipmaps[i]));
+    _uploader->upload(texture, 0, std::move(decoded.level0[0]));
+    return texture;
+}
+
+void TextureCache::release(Texture* texture) {
+    std::map<Texture*, std::string>::iterator key = _keys.find(texture);
+    if(key == _keys.end())
+        throw std::runtime_error("Releasing a texture that isn't from the texture cache");
+
+    Entry& entry = _entries[key->second];
+    if(entry.refs == 0)
+        throw std::runtime_error("Texture released more times than it was acquired");
+    entry.refs--;
+    _evict();
+}
+
+size_t TextureCache::vramUsed() const {
+    return _vramUsed;
+}
+
+// deletes the texture of an entry, dropping its queued uploads or its place in the atlas
+void TextureCache::_delete(Entry& entry) {
+    if(!entry.texture)
+        return;
+    if(entry.atlased)
+        _atlas->remove(entry.texture);
+    else if(_uploader)
+        _uploader->cancel(entry.texture);
+    delete entry.texture;
+    entry.texture = NULL;
+}
+
+// deletes the least recently used textures that nobody holds until the rest fit the budget
+void TextureCache::_evict() {
+    while(_vramUsed > _vramBudget){
+        std::map<std::string, Entry>::iterator oldest = _entries.end();
+        for(std::map<std::string, Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it){
+            if(it->second.texture && !it->second.atlased && it->second.refs == 0 && (oldest == _entries.end() || it->second.lastUse < oldest->second.lastUse))
+                oldest = it;
+        }
+        if(oldest == _entries.end())
+            return;
+
+        _vramUsed -= oldest->second.bytes;
+        _keys.erase(oldest->second.texture);
+        _delete(oldest->second);
+        _entries.erase(oldest);
+    }
+}
@@ -0,0 +1,162 @@
+/*
+ tdogl::TextureCache
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include "FileCache.h"
+#include "ImageLoader.h"
+#include "Texture.h"
+#include "TextureAtlas.h"
+#include "TextureUploader.h"
+#include "ThreadPool.h"
+
+namespace tdogl {
+
+    /**
+     Shares textures loaded from image files.
+
+     Textures are found by the canonical path of the file plus how they are sampled, so
+     every material that names the same image, by whatever relative path, gets the same
+     tdogl::Texture. Each `acquire` must be matched by a `release`.
+
+     Decoding, making mipmaps and block compression run on the thread pool. `prefetch`
+     starts them early, so the images of a model decode in parallel while the main thread
+     acquires them one by one. Uploads happen on the calling thread, so everything except
+     the jobs must be called on the thread with the GL context.
+
+     With a tdogl::TextureUploader, textures with mipmaps are returned as soon as their
+     storage is allocated, and their levels stream in over the next frames, smallest first.
+     Without one, `acquire` uploads the whole texture before returning.
+
+     With a tdogl::TextureAtlas, small images sampled with GL_CLAMP_TO_EDGE go into the
+     atlas instead of a texture of their own, unless their Sampling keeps them out. They
+     aren't block compressed, and have only the atlas's levels and no anisotropic
+     filtering. Their textures are regions of the atlas: check Texture::uvRect. They take
+     no VRAM of their own, so they are never evicted.
+
+     Textures that nobody holds stay loaded until the textures together take more than the
+     VRAM budget, then the least recently acquired go first.
+     */
+    class TextureCache {
+    public:
+        /** how a texture is sampled. Textures with different sampling aren't shared. */
+        struct Sampling {
+            GLint wrapMode;
+            GLfloat anisotropy;
+            bool atlas; //may go into the atlas, if it is small and clamped
+
+            Sampling(GLint wrapMode = GL_CLAMP_TO_EDGE, GLfloat anisotropy = 1.0f, bool atlas = true);
+        };
+
+        /**
+         @param pool  The pool the images are decoded on
+         @param cache  Where mipmaps and compressed images are kept. May be NULL.
+         @param vramBudget  Bytes of texture memory to keep unused textures around in
+         @param mipmapsOnCpu  Make the mipmaps with tdogl::MipmapBuilder, or else with glGenerateMipmap
+         @param compress  Block compress the textures if the driver can sample BC1 and BC3.
+                          Needs mipmapsOnCpu.
+         @param uploader  Streams the levels into the textures. May be NULL. It must outlive
+                          the cache.
+         @param atlas  Where small images go. May be NULL. Needs mipmapsOnCpu. It must
+                       outlive the cache.
+         */
+        TextureCache(ThreadPool& pool, FileCache* cache, size_t vramBudget, bool mipmapsOnCpu, bool compress,
+                     TextureUploader* uploader = NULL, TextureAtlas* atlas = NULL);
+
+        /**
+         Waits for the decoding jobs that have started, and deletes every texture, even
+         ones still held.
+         */
+        ~TextureCache();
+
+        /**
+         Starts loading a texture in the background, if it isn't loaded or loading already.
+         */
+        void prefetch(const std::string& filePath, const Sampling& sampling = Sampling());
+
+        /**
+         Returns the texture of an image file, waiting for it to load and uploading it if
+         needed.
+
+         @result NULL if the image can't be loaded
+         */
+        Texture* acquire(const std::string& filePath, const Sampling& sampling = Sampling());
+
+        /**
+         Same as above, for an image decoded elsewhere, e.g. by a tdogl::ImageLoader made with
+         `decodeOptions(sampling)`. The levels are moved out of `image`. If the file is loaded
+         or loading already, the texture that is there is returned, and `image` isn't used.
+         */
+        Texture* acquire(DecodedImage& image, const Sampling& sampling = Sampling());
+
+        /**
+         @result What the cache does to the images it decodes for textures with the given
+                 sampling, so images decoded elsewhere can be made the same way
+         */
+        DecodeOptions decodeOptions(const Sampling& sampling = Sampling()) const;
+
+        /**
+         Gives back a texture from `acquire`.
+         */
+        void release(Texture* texture);
+
+        /** estimated bytes of VRAM taken by the loaded textures */
+        size_t vramUsed() const;
+
+    private:
+        struct Decoded;
+
+        struct Entry {
+            std::shared_ptr<Decoded> decoded; //until the texture is uploaded
+            Texture* texture;
+            size_t bytes; //0 for regions of the atlas
+            bool atlased;
+            unsigned refs;
+            uint64_t lastUse;
+        };
+
+        ThreadPool& _pool;
+        FileCache* _cache;
+        TextureUploader* _uploader;
+        TextureAtlas* _atlas;
+        size_t _vramBudget;
+        bool _mipmapsOnCpu;
+        bool _compress;
+        bool _allowBC7;
+        std::map<std::string, Entry> _entries; //by canonical path and sampling
+        std::map<Texture*, std::string> _keys;
+        size_t _vramUsed;
+        uint64_t _clock;
+
+        std::map<std::string, Entry>::iterator _find(const std::string& filePath, const Sampling& sampling, DecodedImage* decoded);
+        Texture* _acquire(std::map<std::string, Entry>::iterator it, const Sampling& sampling);
+        Texture* _upload(DecodedImage& decoded, const Sampling& sampling);
+        void _delete(Entry& entry);
+        void _evict();
+
+        //copying disabled
+        TextureCache(const TextureCache&);
+        const TextureCache& operator=(const TextureCache&);
+    };
+
+}
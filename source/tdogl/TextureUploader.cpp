@@ -0,0 +1,199 @@
+/*
+ tdogl::TextureUploader
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "TextureUploader.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace tdogl;
+
+static const GLbitfield PersistentMapping = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+TextureUploader::TextureUploader(size_t slotBytes, unsigned slotCount) :
+    _slotBytes(slotBytes),
+    _slots(std::max(slotCount, 1u)),
+    _nextSlot(0),
+    _pendingBytes(0)
+{
+    for(size_t i = 0; i < _slots.size(); ++i){
+        Slot& slot = _slots[i];
+        slot.mapped = NULL;
+        slot.fence = 0;
+        glGenBuffers(1, &slot.buffer);
+        if(GLEW_ARB_buffer_storage){
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, _slotBytes, NULL, PersistentMapping);
+            slot.mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, _slotBytes, PersistentMapping);
+            if(!slot.mapped){
+                //the storage is immutable, so orphaning needs a new buffer
+                glDeleteBuffers(1, &slot.buffer);
+                glGenBuffers(1, &slot.buffer);
+            }
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+TextureUploader::~TextureUploader() {
+    for(size_t i = 0; i < _slots.size(); ++i){
+        if(_slots[i].fence)
+            glDeleteSync(_slots[i].fence);
+        glDeleteBuffers(1, &_slots[i].buffer);
+    }
+}
+
+void TextureUploader::upload(Texture* texture, GLint level, Bitmap bitmap) {
+    std::shared_ptr<Bitmap> owner = std::make_shared<Bitmap>(std::move(bitmap));
+
+    Upload upload;
+    upload.texture = texture;
+    upload.level = level;
+    upload.width = (GLsizei)owner->width();
+    upload.height = (GLsizei)owner->height();
+    upload.format = Texture::pixelFormat(owner->format());
+    upload.compressed = false;
+    upload.rowHeight = 1;
+    upload.rowBytes = (size_t)owner->width() * owner->format();
+    upload.rowCount = owner->height();
+    upload.rowsDone = 0;
+    upload.data = owner->pixelBuffer();
+    upload.owner = owner;
+    _uploads.push_back(upload);
+    _pendingBytes += upload.rowBytes * upload.rowCount;
+}
+
+void TextureUploader::upload(Texture* texture, GLint level, CompressedImage::Format format, CompressedImage::Level blocks) {
+    std::shared_ptr<CompressedImage::Level> owner = std::make_shared<CompressedImage::Level>(std::move(blocks));
+
+    Upload upload;
+    upload.texture = texture;
+    upload.level = level;
+    upload.width = (GLsizei)owner->width;
+    upload.height = (GLsizei)owner->height;
+    upload.format = Texture::pixelFormat(format);
+    upload.compressed = true;
+    upload.rowHeight = 4;
+    upload.rowBytes = (size_t)((owner->width + 3) / 4) * CompressedImage::blockSize(format);
+    upload.rowCount = (owner->height + 3) / 4;
+    upload.rowsDone = 0;
+    upload.data = owner->blocks.empty() ? NULL : &owner->blocks[0];
+    upload.owner = owner;
+    _uploads.push_back(upload);
+    _pendingBytes += upload.rowBytes * upload.rowCount;
+}
+
+void TextureUploader::cancel(Texture* texture) {
+    for(std::deque<Upload>::iterator it = _uploads.begin(); it != _uploads.end(); ){
+        if(it->texture == texture){
+            _pendingBytes -= it->rowBytes * (it->rowCount - it->rowsDone);
+            it = _uploads.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t TextureUploader::pendingBytes() const {
+    return _pendingBytes;
+}
+
+void TextureUploader::update(size_t maxBytes) {
+    if(_uploads.empty())
+        return;
+
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    size_t copied = 0;
+    while(!_uploads.empty() && copied < maxBytes){
+        Slot& slot = _slots[_nextSlot];
+        if(!_waitForSlot(slot))
+            break;
+
+        Upload& upload = _uploads.front();
+        copied += _uploadRows(upload, slot);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        _nextSlot = (_nextSlot + 1) % _slots.size();
+
+        //commands run in order, so the level can be sampled as soon as its last rows are queued
+        if(upload.rowsDone == upload.rowCount){
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, upload.level);
+            _uploads.pop_front();
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
+
+// true if the GPU has finished reading the slot, without waiting for it
+bool TextureUploader::_waitForSlot(Slot& slot) {
+    if(!slot.fence)
+        return true;
+    if(glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+    return true;
+}
+
+// copies as many of the remaining rows as fit into the slot, and has the texture read them
+// from there. Returns the number of bytes copied.
+size_t TextureUploader::_uploadRows(Upload& upload, Slot& slot) {
+    const unsigned rows = std::max(1u, std::min(upload.rowCount - upload.rowsDone, (unsigned)(_slotBytes / upload.rowBytes)));
+    const size_t bytes = rows * upload.rowBytes;
+    const unsigned char* source = upload.data + upload.rowsDone * upload.rowBytes;
+
+    //a row too wide for the slots, or a failed mapping, is read from client memory instead
+    const GLvoid* pixels = source;
+    if(bytes <= _slotBytes){
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        if(slot.mapped){
+            memcpy(slot.mapped, source, bytes);
+            pixels = NULL;
+        } else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, _slotBytes, NULL, GL_STREAM_DRAW);
+            GLvoid* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if(mapped){
+                memcpy(mapped, source, bytes);
+                if(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE)
+                    pixels = NULL;
+            }
+        }
+        if(pixels)
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    //the last band of blocks may be less than 4 pixels high
+    const GLint y = (GLint)(upload.rowsDone * upload.rowHeight);
+    const GLsizei height = std::min((GLsizei)(rows * upload.rowHeight), upload.height - y);
+    glBindTexture(GL_TEXTURE_2D, upload.texture->object());
+    if(upload.compressed)
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, upload.level, 0, y, upload.width, height, upload.format, (GLsizei)bytes, pixels);
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, upload.level, 0, y, upload.width, height, upload.format, GL_UNSIGNED_BYTE, pixels);
+
+    upload.rowsDone += rows;
+    _pendingBytes -= bytes;
+    return bytes;
+}
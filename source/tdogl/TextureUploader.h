@@ -0,0 +1,126 @@
+/*
+ tdogl::TextureUploader
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "Bitmap.h"
+#include "BlockCompressor.h"
+#include "Texture.h"
+
+namespace tdogl {
+
+    /**
+     Streams pixels into textures through a ring of pixel buffer objects, a few rows at a
+     time, so big textures load while frames keep being drawn.
+
+     `upload` only queues a level. Each `update` copies queued rows into the next slot of
+     the ring and has glTexSubImage2D read them from there, so the driver copies to VRAM
+     asynchronously instead of blocking on client memory. A fence after each copy keeps a
+     slot from being written again before the GPU has finished reading it; when the next
+     slot is still busy, `update` stops until the next frame instead of waiting.
+
+     The slots are persistently mapped with ARB_buffer_storage, or else orphaned and
+     mapped again for every copy.
+
+     Every function must be called on the thread with the GL context.
+     */
+    class TextureUploader {
+    public:
+        /**
+         @param slotBytes  Size of each pixel buffer. Levels bigger than this are split
+                           into bands of rows.
+         @param slotCount  Number of pixel buffers, i.e. how many copies can be in flight
+         */
+        TextureUploader(size_t slotBytes, unsigned slotCount);
+
+        /**
+         Deletes the pixel buffers. Uploads that are still queued are dropped.
+         */
+        ~TextureUploader();
+
+        /**
+         Queues a level of a texture made with the storage only constructor of
+         tdogl::Texture. Queue the levels of a texture smallest first: when a level is done,
+         it becomes the base level, so the texture sharpens as it streams in.
+
+         @param texture  The texture, which must outlive the upload or be passed to `cancel`
+         @param level  The mipmap level
+         @param bitmap  The pixels of the level, kept until they are all copied
+         */
+        void upload(Texture* texture, GLint level, Bitmap bitmap);
+
+        /**
+         Same as above, for a level of block compressed texture.
+         */
+        void upload(Texture* texture, GLint level, CompressedImage::Format format, CompressedImage::Level blocks);
+
+        /**
+         Drops the queued uploads of a texture, e.g. before deleting it.
+         */
+        void cancel(Texture* texture);
+
+        /**
+         Copies queued rows to the GPU, until about `maxBytes` are copied or every slot is
+         busy. Call once per frame.
+         */
+        void update(size_t maxBytes);
+
+        /** bytes still queued */
+        size_t pendingBytes() const;
+
+    private:
+        struct Slot {
+            GLuint buffer;
+            GLvoid* mapped; //persistently mapped, or NULL to orphan and map for every copy
+            GLsync fence; //after the last glTexSubImage2D that read the slot, or 0
+        };
+
+        struct Upload {
+            Texture* texture;
+            GLint level;
+            GLsizei width;
+            GLsizei height;
+            GLenum format;
+            bool compressed;
+            unsigned rowHeight; //in pixels: 1, or 4 for rows of blocks
+            size_t rowBytes;
+            unsigned rowCount;
+            unsigned rowsDone;
+            const unsigned char* data;
+            std::shared_ptr<void> owner; //keeps `data` alive
+        };
+
+        size_t _slotBytes;
+        std::vector<Slot> _slots;
+        unsigned _nextSlot;
+        std::deque<Upload> _uploads;
+        size_t _pendingBytes;
+
+        bool _waitForSlot(Slot& slot);
+        size_t _uploadRows(Upload& upload, Slot& slot);
+
+        //copying disabled
+        TextureUploader(const TextureUploader&);
+        const TextureUploader& operator=(const TextureUploader&);
+    };
+
+}
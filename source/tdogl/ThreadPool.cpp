@@ -0,0 +1,162 @@
+/*
+ tdogl::ThreadPool
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <memory>
+
+using namespace tdogl;
+
+namespace {
+    // state shared between the caller of parallelFor and the helper jobs it queues
+    struct ParallelForState {
+        ThreadPool::RangeJob job;
+        unsigned count;
+        unsigned grain;
+        unsigned chunkCount;
+        std::atomic<unsigned> nextChunk;
+        std::atomic<unsigned> chunksDone;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+}
+
+// claims and runs chunks until there are none left
+static void RunChunks(ParallelForState& state) {
+    for(;;){
+        unsigned chunk = state.nextChunk++;
+        if(chunk >= state.chunkCount)
+            return;
+
+        unsigned begin = chunk * state.grain;
+        unsigned end = begin + state.grain;
+        if(end > state.count) end = state.count;
+        state.job(begin, end);
+
+        if(++state.chunksDone == state.chunkCount){
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.finished.notify_all();
+        }
+    }
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) :
+    _running(0),
+    _stopping(false)
+{
+    if(threadCount == 0){
+        unsigned hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    for(unsigned i = 0; i < threadCount; ++i)
+        _threads.push_back(std::thread(&ThreadPool::_workerMain, this));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _jobAvailable.notify_all();
+
+    for(unsigned i = 0; i < _threads.size(); ++i)
+        _threads[i].join();
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+unsigned ThreadPool::threadCount() const {
+    return (unsigned)_threads.size();
+}
+
+void ThreadPool::submit(const Job& job) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(job);
+    }
+    _jobAvailable.notify_one();
+}
+
+void ThreadPool::waitIdle() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(!_jobs.empty() || _running > 0)
+        _idle.wait(lock);
+}
+
+void ThreadPool::parallelFor(unsigned count, unsigned grain, const RangeJob& job) {
+    if(count == 0)
+        return;
+    if(grain == 0)
+        grain = 1;
+
+    unsigned chunkCount = (count + grain - 1) / grain;
+    if(chunkCount == 1){
+        job(0, count);
+        return;
+    }
+
+    std::shared_ptr<ParallelForState> state(new ParallelForState());
+    state->job = job;
+    state->count = count;
+    state->grain = grain;
+    state->chunkCount = chunkCount;
+    state->nextChunk = 0;
+    state->chunksDone = 0;
+
+    unsigned helpers = chunkCount - 1;
+    if(helpers > threadCount()) helpers = threadCount();
+    for(unsigned i = 0; i < helpers; ++i)
+        submit([state]() { RunChunks(*state); });
+
+    RunChunks(*state);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while(state->chunksDone < chunkCount)
+        state->finished.wait(lock);
+}
+
+void ThreadPool::_workerMain() {
+    for(;;){
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while(_jobs.empty() && !_stopping)
+                _jobAvailable.wait(lock);
+
+            if(_jobs.empty())
+                return; //stopping, and nothing left to do
+
+            job = _jobs.front();
+            _jobs.pop_front();
+            ++_running;
+        }
+
+        job();
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            --_running;
+            if(_jobs.empty() && _running == 0)
+                _idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ tdogl::ThreadPool
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     A fixed set of worker threads that run jobs from a shared FIFO queue.
+
+     Jobs must not make OpenGL calls: the GL context only exists on the main thread.
+     */
+    class ThreadPool {
+    public:
+        typedef std::function<void()> Job;
+
+        /**
+         A job over the half-open range [begin, end) of a parallelFor.
+         */
+        typedef std::function<void(unsigned begin, unsigned end)> RangeJob;
+
+        /**
+         Starts the worker threads.
+
+         @param threadCount  Number of workers. 0 means one per hardware thread, minus the
+                             main thread.
+         */
+        explicit ThreadPool(unsigned threadCount = 0);
+
+        /**
+         Finishes all the queued jobs, then joins the worker threads.
+         */
+        ~ThreadPool();
+
+        /**
+         The pool shared by the whole app, created on first use.
+         */
+        static ThreadPool& shared();
+
+        /** number of worker threads */
+        unsigned threadCount() const;
+
+        /**
+         Queues a job to be run on one of the worker threads.
+         */
+        void submit(const Job& job);
+
+        /**
+         Blocks until the queue is empty and no job is running.
+         */
+        void waitIdle();
+
+        /**
+         Splits [0, count) into chunks of `grain` items and runs `job` on each chunk, using the
+         workers and the calling thread. Returns when every chunk has finished.
+
+         Safe to call from inside a job, because the caller never waits on a chunk that no
+         thread has picked up.
+         */
+        void parallelFor(unsigned count, unsigned grain, const RangeJob& job);
+
+    private:
+        std::vector<std::thread> _threads;
+        std::deque<Job> _jobs;
+        std::mutex _mutex;
+        std::condition_variable _jobAvailable;
+        std::condition_variable _idle;
+        unsigned _running;
+        bool _stopping;
+
+        void _workerMain();
+
+        //copying disabled
+        ThreadPool(const ThreadPool&);
+        const ThreadPool& operator=(const ThreadPool&);
+    };
+
+}
@@ -0,0 +1,100 @@
+/*
+ tdogl::TransformBatch
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "TransformBatch.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TDOGL_TRANSFORM_SSE2 1
+#endif
+
+using namespace tdogl;
+
+static const unsigned BlockSize = 4;
+static const unsigned BlockFloats = 16 * BlockSize;
+
+TransformBatch::TransformBatch() :
+    _size(0)
+{
+}
+
+void TransformBatch::clear() {
+    _blocks.clear();
+    _size = 0;
+}
+
+unsigned TransformBatch::add(const glm::mat4& model) {
+    const unsigned lane = _size % BlockSize;
+    if(lane == 0)
+        _blocks.resize(_blocks.size() + BlockFloats, 0.0f);
+
+    //element (column c, row r) goes to lane `lane` of vector c * 4 + r of the block
+    float* block = &_blocks[_blocks.size() - BlockFloats];
+    for(int c = 0; c < 4; ++c){
+        for(int r = 0; r < 4; ++r)
+            block[(c * 4 + r) * BlockSize + lane] = model[c][r];
+    }
+    return _size++;
+}
+
+unsigned TransformBatch::size() const {
+    return _size;
+}
+
+void TransformBatch::multiply(const glm::mat4& camera, float* output) const {
+    for(unsigned first = 0; first < _size; first += BlockSize){
+        const float* block = &_blocks[first / BlockSize * BlockFloats];
+        const unsigned count = _size - first < BlockSize ? _size - first : BlockSize;
+        float* out = output + first * 16;
+
+#ifdef TDOGL_TRANSFORM_SSE2
+        for(int c = 0; c < 4; ++c){
+            //column c of the 4 model matrices, one row per vector
+            __m128 m0 = _mm_loadu_ps(block + (c * 4 + 0) * BlockSize);
+            __m128 m1 = _mm_loadu_ps(block + (c * 4 + 1) * BlockSize);
+            __m128 m2 = _mm_loadu_ps(block + (c * 4 + 2) * BlockSize);
+            __m128 m3 = _mm_loadu_ps(block + (c * 4 + 3) * BlockSize);
+
+            //column c of the products: row r is the sum over k of camera[k][r] * model[c][k]
+            __m128 rows[4];
+            for(int r = 0; r < 4; ++r){
+                rows[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(camera[0][r]), m0),
+                                                _mm_mul_ps(_mm_set1_ps(camera[1][r]), m1)),
+                                     _mm_add_ps(_mm_mul_ps(_mm_set1_ps(camera[2][r]), m2),
+                                                _mm_mul_ps(_mm_set1_ps(camera[3][r]), m3)));
+            }
+
+            //back to one vector per matrix
+            _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+            for(unsigned i = 0; i < count; ++i)
+                _mm_storeu_ps(out + i * 16 + c * 4, rows[i]);
+        }
+#else
+        for(unsigned i = 0; i < count; ++i){
+            for(int c = 0; c < 4; ++c){
+                for(int r = 0; r < 4; ++r){
+                    float sum = 0.0f;
+                    for(int k = 0; k < 4; ++k)
+                        sum += camera[k][r] * block[(c * 4 + k) * BlockSize + i];
+                    out[i * 16 + c * 4 + r] = sum;
+                }
+            }
+        }
+#endif
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ tdogl::TransformBatch
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     The model matrices of the instances drawn in a frame, multiplied by the camera matrix
+     all at once.
+
+     The matrices are kept as structure of arrays in blocks of 4: each block holds the first
+     element of its 4 matrices, then the second, and so on. With SSE2 the 4 matrices of a
+     block are multiplied together, one matrix element per instruction.
+
+     Nothing here uses OpenGL, so `multiply` can write into a mapped buffer.
+     */
+    class TransformBatch {
+    public:
+        TransformBatch();
+
+        /**
+         Removes all the matrices.
+         */
+        void clear();
+
+        /**
+         Adds a model matrix.
+
+         @result The index of the matrix, i.e. of its product in the output of `multiply`
+         */
+        unsigned add(const glm::mat4& model);
+
+        /** number of matrices */
+        unsigned size() const;
+
+        /**
+         Writes camera * model for every model matrix to `output`, as `size()` column major
+         matrices of 16 floats each, like glm::mat4. `output` is only written, never read, so
+         it can be write combined memory.
+         */
+        void multiply(const glm::mat4& camera, float* output) const;
+
+    private:
+        std::vector<float> _blocks; //64 floats per block of 4 matrices
+        unsigned _size;
+    };
+
+}
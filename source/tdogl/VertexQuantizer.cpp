@@ -0,0 +1,158 @@
+/*
+ tdogl::VertexQuantizer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include "VertexQuantizer.h"
+#include <cmath>
+#include <cstring>
+
+using namespace tdogl;
+
+static const float SnormMax = 32767.0f;
+
+static short QuantizeSnorm(float value) {
+    if(value > 1.0f) value = 1.0f;
+    if(value < -1.0f) value = -1.0f;
+    return (short)floorf(value * SnormMax + 0.5f);
+}
+
+static inline float SignNotZero(float value) {
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+void VertexQuantizer::quantize(const std::vector<glm::vec3>& positions,
+                               const std::vector<glm::vec2>& uvs,
+                               const std::vector<glm::vec3>& normals,
+                               QuantizedVertices& result)
+{
+    const size_t count = positions.size();
+    result.positions.resize(count * 4);
+    result.normals.resize(normals.size() == count ? count * 2 : 0);
+    result.uvs.resize(uvs.size() == count ? count * 2 : 0);
+    result.positionOffset = glm::vec3(0.0f);
+    result.positionScale = glm::vec3(1.0f);
+    if(count == 0)
+        return;
+
+    glm::vec3 low = positions[0], high = positions[0];
+    for(size_t i = 1; i < count; ++i){
+        low = glm::min(low, positions[i]);
+        high = glm::max(high, positions[i]);
+    }
+
+    glm::vec3 center = (low + high) * 0.5f;
+    glm::vec3 halfSize = (high - low) * 0.5f;
+    glm::vec3 inverse;
+    for(int axis = 0; axis < 3; ++axis)
+        inverse[axis] = halfSize[axis] > 0.0f ? 1.0f / halfSize[axis] : 0.0f;
+
+    result.positionOffset = center;
+    result.positionScale = halfSize / SnormMax;
+
+    for(size_t i = 0; i < count; ++i){
+        glm::vec3 p = (positions[i] - center) * inverse;
+        result.positions[i * 4 + 0] = QuantizeSnorm(p.x);
+        result.positions[i * 4 + 1] = QuantizeSnorm(p.y);
+        result.positions[i * 4 + 2] = QuantizeSnorm(p.z);
+        result.positions[i * 4 + 3] = 0;
+    }
+
+    for(size_t i = 0; i < result.normals.size() / 2; ++i){
+        glm::vec2 e = octahedralEncode(normals[i]);
+        result.normals[i * 2 + 0] = QuantizeSnorm(e.x);
+        result.normals[i * 2 + 1] = QuantizeSnorm(e.y);
+    }
+
+    for(size_t i = 0; i < result.uvs.size() / 2; ++i){
+        result.uvs[i * 2 + 0] = floatToHalf(uvs[i].x);
+        result.uvs[i * 2 + 1] = floatToHalf(uvs[i].y);
+    }
+}
+
+glm::vec2 VertexQuantizer::octahedralEncode(const glm::vec3& normal) {
+    float sum = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+    if(sum <= 0.0f)
+        return glm::vec2(0.0f);
+
+    glm::vec2 e(normal.x / sum, normal.y / sum);
+    if(normal.z < 0.0f){
+        //fold the lower half over the diagonals
+        glm::vec2 folded((1.0f - fabsf(e.y)) * SignNotZero(e.x),
+                         (1.0f - fabsf(e.x)) * SignNotZero(e.y));
+        e = folded;
+    }
+    return e;
+}
+
+glm::vec3 VertexQuantizer::octahedralDecode(const glm::vec2& encoded) {
+    glm::vec3 n(encoded.x, encoded.y, 1.0f - fabsf(encoded.x) - fabsf(encoded.y));
+    if(n.z < 0.0f){
+        float x = n.x;
+        n.x = (1.0f - fabsf(n.y)) * SignNotZero(x);
+        n.y = (1.0f - fabsf(x)) * SignNotZero(n.y);
+    }
+    return glm::normalize(n);
+}
+
+unsigned short VertexQuantizer::floatToHalf(float value) {
+    unsigned bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned sign = (bits >> 16) & 0x8000;
+    bits &= 0x7fffffff;
+
+    unsigned short half;
+    if(bits >= 0x47800000){
+        //too big for a half, or inf or nan
+        half = bits > 0x7f800000 ? 0x7e00 : 0x7c00;
+    } else if(bits < 0x38800000){
+        //subnormal half: adding 0.5 makes the float hardware do the shifting and the rounding
+        float magic = 0.5f;
+        float shifted;
+        memcpy(&shifted, &bits, sizeof(shifted));
+        shifted += magic;
+        unsigned shiftedBits;
+        memcpy(&shiftedBits, &shifted, sizeof(shiftedBits));
+        half = (unsigned short)(shiftedBits - 0x3f000000);
+    } else {
+        //rebias the exponent, and round the dropped mantissa bits to nearest even
+        unsigned odd = (bits >> 13) & 1;
+        bits += 0xc8000fff + odd;
+        half = (unsigned short)(bits >> 13);
+    }
+    return half | (unsigned short)sign;
+}
+
+float VertexQuantizer::halfToFloat(unsigned short value) {
+    unsigned sign = (unsigned)(value & 0x8000) << 16;
+    unsigned exponent = (value >> 10) & 0x1f;
+    unsigned mantissa = value & 0x3ff;
+
+    if(exponent == 0){
+        float result = ldexpf((float)mantissa, -24);
+        return sign ? -result : result;
+    }
+
+    unsigned bits;
+    if(exponent == 31)
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    else
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
@@ -0,0 +1,82 @@
+/*
+ tdogl::VertexQuantizer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace tdogl {
+
+    /**
+     Vertex attributes packed into 16 bits per component, half the size of the float
+     arrays they are made from.
+
+     The arrays are uploaded as they are: positions and normals as GL_SHORT attributes that
+     are not normalized, uvs as GL_HALF_FLOAT. The vertex shader decodes the positions with
+     `positionOffset` and `positionScale`, and the normals with VertexQuantizer's octahedral
+     decoding.
+     */
+    struct QuantizedVertices {
+        /** 4 per vertex: x, y and z in [-32767, 32767], and 0 so each vertex is 8 bytes */
+        std::vector<short> positions;
+
+        /** 2 per vertex: the octahedral encoding of the normal, in [-32767, 32767]. May be empty. */
+        std::vector<short> normals;
+
+        /** 2 per vertex, as half floats. May be empty. */
+        std::vector<unsigned short> uvs;
+
+        /** position = positionOffset + positionScale * (x, y, z) */
+        glm::vec3 positionOffset;
+        glm::vec3 positionScale;
+
+        size_t vertexCount() const { return positions.size() / 4; }
+    };
+
+    /**
+     Makes and reads QuantizedVertices.
+
+     Doesn't use OpenGL, so it can run on worker threads.
+     */
+    class VertexQuantizer {
+    public:
+        /**
+         Packs the given attributes. `uvs` and `normals` may be empty.
+
+         The positions are quantised relative to their bounding box, so the error is at most
+         half a step of 1/65534 of the box size on each axis.
+         */
+        static void quantize(const std::vector<glm::vec3>& positions,
+                             const std::vector<glm::vec2>& uvs,
+                             const std::vector<glm::vec3>& normals,
+                             QuantizedVertices& result);
+
+        /**
+         Maps a unit vector onto the octahedron and unfolds it into a square, giving two
+         values in [-1, 1]. Matches `octDecode` in vertex-shader.txt.
+         */
+        static glm::vec2 octahedralEncode(const glm::vec3& normal);
+        static glm::vec3 octahedralDecode(const glm::vec2& encoded);
+
+        /** IEEE 754 half precision, rounded to nearest even */
+        static unsigned short floatToHalf(float value);
+        static float halfToFloat(unsigned short value);
+    };
+
+}
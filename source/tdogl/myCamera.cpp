@@ -258,6 +258,21 @@ void Camera::setZ(glm::vec3 & f, int &coordZ) const {
     _prevZ2 = f[2];
 }
 
+float Camera::pixelsPerUnit(const glm::vec3& center, float radius) const {
+    //depth of the nearest point in front of the eye, never closer than the near plane
+    glm::vec4 viewCenter = viewMatrix * glm::vec4(center, 1.0f);
+    float depth = -viewCenter.z - radius;
+    if(depth < n)
+        depth = n;
+
+    //the frustum is top_edge - bottom_edge high at the near plane
+    return yScreen * n / ((top_edge - bottom_edge) * depth);
+}
+
+glm::vec3 Camera::eyePosition() const {
+    return positionV;
+}
+
 glm::mat4 Camera::projection() const {
     
 
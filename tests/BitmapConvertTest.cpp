@@ -0,0 +1,208 @@
+/*
+ Checks of tdogl::Bitmap pixel format conversion
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Checks copyRectFromBitmap for all 16 pairs of formats against a pixel at a time
+// reference, on whole bitmaps and on rectangles inside them, for widths around the 4 pixel
+// steps of the SSE2 path. Nothing outside the rectangle may change, which is where the 16
+// byte loads and stores of RGB could go wrong. Then prints the GB/s of each pair, counting
+// the bytes read and written, next to the reference. See tests/run.sh.
+
+#include "Bitmap.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace tdogl;
+
+typedef std::chrono::steady_clock Clock;
+
+static unsigned gFailures = 0;
+
+// counts and prints a failed check, the first few times
+static void Check(bool ok, const std::string& what) {
+    if(ok)
+        return;
+    if(gFailures < 10)
+        std::cerr << "FAILED: " << what << std::endl;
+    ++gFailures;
+}
+
+static const char* FormatName(int format) {
+    const char* names[] = { "", "Grey", "GreyA", "RGB", "RGBA" };
+    return names[format];
+}
+
+// one pixel the slow and obvious way: widen to RGBA, then narrow. Grey from colour is
+// Rec. 601 luma with weights that add up to 256.
+static void ReferencePixel(const unsigned char* src, int srcFormat, unsigned char* dest, int destFormat) {
+    if(srcFormat == destFormat){
+        memcpy(dest, src, srcFormat);
+        return;
+    }
+
+    int r, g, b, a;
+    if(srcFormat <= 2){
+        r = g = b = src[0];
+        a = srcFormat == 2 ? src[1] : 255;
+    } else {
+        r = src[0];
+        g = src[1];
+        b = src[2];
+        a = srcFormat == 4 ? src[3] : 255;
+    }
+
+    if(destFormat <= 2){
+        dest[0] = (unsigned char)(srcFormat <= 2 ? r : (r * 77 + g * 150 + b * 29 + 128) >> 8);
+        if(destFormat == 2)
+            dest[1] = (unsigned char)a;
+    } else {
+        dest[0] = (unsigned char)r;
+        dest[1] = (unsigned char)g;
+        dest[2] = (unsigned char)b;
+        if(destFormat == 4)
+            dest[3] = (unsigned char)a;
+    }
+}
+
+// the reference for copyRectFromBitmap
+static void ReferenceCopy(const Bitmap& src, unsigned srcCol, unsigned srcRow, Bitmap& dest,
+                          unsigned destCol, unsigned destRow, unsigned width, unsigned height)
+{
+    for(unsigned row = 0; row < height; ++row){
+        for(unsigned col = 0; col < width; ++col)
+            ReferencePixel(src.getPixel(srcCol + col, srcRow + row), src.format(),
+                           dest.getPixel(destCol + col, destRow + row), dest.format());
+    }
+}
+
+static Bitmap RandomBitmap(unsigned width, unsigned height, Bitmap::Format format) {
+    Bitmap bitmap(width, height, format);
+    for(size_t i = 0; i < (size_t)width * height * format; ++i)
+        bitmap.pixelBuffer()[i] = (unsigned char)rand();
+    return bitmap;
+}
+
+static bool SamePixels(const Bitmap& a, const Bitmap& b) {
+    return 0 == memcmp(a.pixelBuffer(), b.pixelBuffer(), (size_t)a.width() * a.height() * a.format());
+}
+
+// copies a rectangle both ways into bitmaps of random bytes, and compares all of them, so a
+// byte written outside the rectangle shows up too
+static void CheckRect(Bitmap::Format srcFormat, Bitmap::Format destFormat,
+                      unsigned srcWidth, unsigned srcHeight, unsigned destWidth, unsigned destHeight,
+                      unsigned srcCol, unsigned srcRow, unsigned destCol, unsigned destRow,
+                      unsigned width, unsigned height)
+{
+    Bitmap src = RandomBitmap(srcWidth, srcHeight, srcFormat);
+    Bitmap dest = RandomBitmap(destWidth, destHeight, destFormat);
+    Bitmap expected(dest);
+    ReferenceCopy(src, srcCol, srcRow, expected, destCol, destRow, width, height);
+
+    bool whole = srcCol == 0 && srcRow == 0 && width == srcWidth && height == srcHeight;
+    if(whole)
+        dest.copyRectFromBitmap(src, 0, 0, 0, 0, 0, 0);
+    else
+        dest.copyRectFromBitmap(src, srcCol, srcRow, destCol, destRow, width, height);
+
+    Check(SamePixels(dest, expected),
+          std::string(FormatName(srcFormat)) + " to " + FormatName(destFormat) + ", " +
+          std::to_string(width) + "x" + std::to_string(height) + " at " +
+          std::to_string(destCol) + "," + std::to_string(destRow));
+}
+
+static void CheckPair(Bitmap::Format srcFormat, Bitmap::Format destFormat) {
+    //every width up to 3 steps of 4 pixels and the 6 pixel margin of RGB, and an odd big one
+    std::vector<unsigned> widths;
+    for(unsigned w = 1; w <= 13; ++w)
+        widths.push_back(w);
+    widths.push_back(37);
+
+    for(size_t w = 0; w < widths.size(); ++w){
+        const unsigned width = widths[w];
+        for(unsigned height = 1; height <= 3; ++height){
+            //whole bitmaps, where the last row ends at the end of the buffers
+            CheckRect(srcFormat, destFormat, width, height, width, height, 0, 0, 0, 0, width, height);
+
+            //inside bigger bitmaps, at every column offset of a 4 pixel step, so there are
+            //pixels left and right of the rectangle on the same rows
+            for(unsigned offset = 0; offset < 4; ++offset){
+                CheckRect(srcFormat, destFormat, width + 9, height + 2, width + 7, height + 2,
+                          offset + 1, 1, 3 - offset, 1, width, height);
+            }
+
+            //ending at the end of the source and the destination buffer, from the middle of a row
+            CheckRect(srcFormat, destFormat, width + 5, height + 1, width + 2, height + 1,
+                      5, 1, 2, 1, width, height);
+        }
+    }
+}
+
+// fastest of a few runs, in seconds
+template <typename F>
+static double Fastest(F run) {
+    double best = 1e30;
+    for(int i = 0; i < 3; ++i){
+        Clock::time_point start = Clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+static void Benchmark() {
+    //an odd width, so every row ends with a few pixels that aren't a whole step
+    const unsigned width = 4099, height = 2048;
+    std::cout << "pair            copyRect GB/s   per pixel reference GB/s   (" << width << "x" << height << ")" << std::endl;
+    for(int s = 1; s <= 4; ++s){
+        for(int d = 1; d <= 4; ++d){
+            Bitmap src = RandomBitmap(width, height, (Bitmap::Format)s);
+            Bitmap dest(width, height, (Bitmap::Format)d);
+            const double bytes = (double)width * height * (s + d);
+
+            double fast = Fastest([&]() { dest.copyRectFromBitmap(src, 0, 0, 0, 0, 0, 0); });
+            double slow = Fastest([&]() { ReferenceCopy(src, 0, 0, dest, 0, 0, width, height); });
+
+            std::string pair = std::string(FormatName(s)) + " to " + FormatName(d);
+            pair.resize(16, ' ');
+            std::cout << pair << bytes / fast / 1e9 << "\t\t" << bytes / slow / 1e9 << std::endl;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    srand(1);
+    for(int s = 1; s <= 4; ++s){
+        for(int d = 1; d <= 4; ++d)
+            CheckPair((Bitmap::Format)s, (Bitmap::Format)d);
+    }
+
+    if(gFailures > 0){
+        std::cerr << gFailures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "Bitmap conversion ok" << std::endl;
+
+    //no benchmark under a sanitizer or valgrind, where the times mean nothing
+    if(argc > 1 && 0 == strcmp(argv[1], "--no-benchmark"))
+        return 0;
+    Benchmark();
+    return 0;
+}
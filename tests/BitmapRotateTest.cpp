@@ -0,0 +1,186 @@
+/*
+ Checks of tdogl::Bitmap rotation and flipping
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Checks rotate90CounterClockwise and flipVertically against the pixel at a time code they
+// replaced, for every format, on odd sizes that don't fill the tiles and on bitmaps big
+// enough to go to the thread pool. Then times both on box.jpg and on 8K textures. See
+// tests/run.sh.
+
+#include "Bitmap.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace tdogl;
+
+typedef std::chrono::steady_clock Clock;
+
+static unsigned gFailures = 0;
+
+// counts and prints a failed check, the first few times
+static void Check(bool ok, const std::string& what) {
+    if(ok)
+        return;
+    if(gFailures < 10)
+        std::cerr << "FAILED: " << what << std::endl;
+    ++gFailures;
+}
+
+static Bitmap RandomBitmap(unsigned width, unsigned height, Bitmap::Format format) {
+    Bitmap bitmap(width, height, format);
+    for(size_t i = 0; i < (size_t)width * height * format; ++i)
+        bitmap.pixelBuffer()[i] = (unsigned char)rand();
+    return bitmap;
+}
+
+/*
+ * The code before the tiles and the thread pool, kept as the reference
+ */
+
+inline unsigned GetPixelOffset(unsigned col, unsigned row, unsigned width, unsigned height, unsigned format) {
+    return (row*width + col)*format;
+}
+
+static void OldFlipVertically(unsigned char* pixels, unsigned width, unsigned height, unsigned format) {
+    unsigned long rowSize = format*width;
+    unsigned char* rowBuffer = new unsigned char[rowSize];
+    unsigned halfRows = height / 2;
+
+    for(unsigned rowIdx = 0; rowIdx < halfRows; ++rowIdx){
+        unsigned char* row = pixels + GetPixelOffset(0, rowIdx, width, height, format);
+        unsigned char* oppositeRow = pixels + GetPixelOffset(0, height - rowIdx - 1, width, height, format);
+
+        memcpy(rowBuffer, row, rowSize);
+        memcpy(row, oppositeRow, rowSize);
+        memcpy(oppositeRow, rowBuffer, rowSize);
+    }
+
+    delete[] rowBuffer;
+}
+
+// the rotated pixels, in a buffer from malloc
+static unsigned char* OldRotate90CounterClockwise(const unsigned char* pixels, unsigned width, unsigned height, unsigned format) {
+    unsigned char* newPixels = (unsigned char*) malloc((size_t)format*width*height);
+
+    for(unsigned row = 0; row < height; ++row){
+        for(unsigned col = 0; col < width; ++col){
+            unsigned srcOffset = GetPixelOffset(col, row, width, height, format);
+            unsigned destOffset = GetPixelOffset(row, width - col - 1, height, width, format);
+            memcpy(newPixels + destOffset, pixels + srcOffset, format); //copy one pixel
+        }
+    }
+    return newPixels;
+}
+
+/*
+ * Checks
+ */
+
+static void CheckSize(unsigned width, unsigned height, Bitmap::Format format) {
+    const std::string name = std::to_string(width) + "x" + std::to_string(height) +
+                             " with " + std::to_string(format) + " bytes per pixel";
+    const size_t size = (size_t)width * height * format;
+    Bitmap original = RandomBitmap(width, height, format);
+
+    Bitmap rotated(original);
+    rotated.rotate90CounterClockwise();
+    unsigned char* expected = OldRotate90CounterClockwise(original.pixelBuffer(), width, height, format);
+    Check(rotated.width() == height && rotated.height() == width, "rotated size of " + name);
+    Check(0 == memcmp(rotated.pixelBuffer(), expected, size), "rotated pixels of " + name);
+    free(expected);
+
+    //four turns go all the way round
+    for(int i = 0; i < 3; ++i)
+        rotated.rotate90CounterClockwise();
+    Check(rotated.width() == width && 0 == memcmp(rotated.pixelBuffer(), original.pixelBuffer(), size),
+          "four rotations of " + name);
+
+    Bitmap flipped(original);
+    flipped.flipVertically();
+    std::vector<unsigned char> expectedFlip(original.pixelBuffer(), original.pixelBuffer() + size);
+    OldFlipVertically(&expectedFlip[0], width, height, format);
+    Check(0 == memcmp(flipped.pixelBuffer(), &expectedFlip[0], size), "flipped pixels of " + name);
+}
+
+/*
+ * Benchmark
+ */
+
+// fastest of a few runs, in milliseconds
+template <typename F>
+static double Fastest(F run) {
+    double best = 1e30;
+    for(int i = 0; i < 3; ++i){
+        Clock::time_point start = Clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+static void Benchmark(const std::string& name, Bitmap bitmap) {
+    const unsigned format = bitmap.format();
+    double oldRotate = Fastest([&]() {
+        free(OldRotate90CounterClockwise(bitmap.pixelBuffer(), bitmap.width(), bitmap.height(), format));
+    });
+    double newRotate = Fastest([&]() { bitmap.rotate90CounterClockwise(); });
+    double oldFlip = Fastest([&]() { OldFlipVertically(bitmap.pixelBuffer(), bitmap.width(), bitmap.height(), format); });
+    double newFlip = Fastest([&]() { bitmap.flipVertically(); });
+
+    std::cout << name << ": rotate " << oldRotate << " -> " << newRotate << " ms, flip "
+              << oldFlip << " -> " << newFlip << " ms" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    srand(1);
+
+    //odd sizes, smaller and bigger than a tile and than a 4x4 block, in one serial band
+    const unsigned small[][2] = { {1, 1}, {5, 3}, {3, 5}, {37, 23}, {33, 1}, {1, 65}, {64, 64}, {97, 70} };
+    //4MB or more, so both go to the thread pool; the odd heights leave a row in the middle
+    const unsigned big[][2] = { {2049, 2053}, {4099, 1031} };
+
+    for(int format = 1; format <= 4; ++format){
+        for(size_t i = 0; i < sizeof(small) / sizeof(small[0]); ++i)
+            CheckSize(small[i][0], small[i][1], (Bitmap::Format)format);
+        for(size_t i = 0; i < sizeof(big) / sizeof(big[0]); ++i)
+            CheckSize(big[i][0], big[i][1], (Bitmap::Format)format);
+    }
+
+    if(gFailures > 0){
+        std::cerr << gFailures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "Bitmap rotation and flipping ok" << std::endl;
+
+    //no benchmark under a sanitizer or valgrind, where the times mean nothing
+    if(argc > 1 && 0 == strcmp(argv[1], "--no-benchmark"))
+        return 0;
+
+    std::cout << "old per-pixel code -> new, fastest of 3" << std::endl;
+    try {
+        Benchmark("resources/box.jpg", Bitmap::bitmapFromFile("resources/box.jpg"));
+    } catch(const std::exception& e) {
+        std::cout << "skipping box.jpg: " << e.what() << std::endl;
+    }
+    Benchmark("8K RGB", RandomBitmap(7680, 4320, Bitmap::Format_RGB));
+    Benchmark("8K RGBA", RandomBitmap(7680, 4320, Bitmap::Format_RGBA));
+    return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ Checks of tdogl::BoundingVolumeHierarchy
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Builds trees over random boxes, moves boxes around with refit, and checks every frustum
+// and ray query against a linear scan over all the boxes, timing both. See tests/run.sh.
+
+#include "BoundingVolumeHierarchy.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+using namespace tdogl;
+
+typedef std::chrono::steady_clock Clock;
+
+static const int Frustums = 20; //queries of each kind after a build and after each round of refits
+static const int Rays = 200;
+static const int RefitRounds = 4;
+
+static unsigned gFailures = 0;
+
+// counts and prints a failed check, the first few times
+static void Check(bool ok, const std::string& what) {
+    if(ok)
+        return;
+    if(gFailures < 10)
+        std::cerr << "FAILED: " << what << std::endl;
+    ++gFailures;
+}
+
+static double Microseconds(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// uniform in [low, high]
+static float Random(float low, float high) {
+    return low + (high - low) * (rand() / (float)RAND_MAX);
+}
+
+static BoundingBox RandomBox(float extent) {
+    glm::vec3 center(Random(-extent, extent), Random(-extent, extent), Random(-extent, extent));
+    glm::vec3 half(Random(0.1f, 1.0f), Random(0.1f, 1.0f), Random(0.1f, 1.0f));
+    return BoundingBox(center - half, center + half);
+}
+
+// a symmetric perspective projection looking down -z, turned by `yaw` radians about y
+static glm::mat4 Camera(float fieldOfView, float yaw, float farPlane) {
+    const float nearPlane = 0.1f;
+    const float f = 1.0f / tanf(fieldOfView * 0.5f);
+    glm::mat4 projection(0.0f);
+    projection[0][0] = f;
+    projection[1][1] = f;
+    projection[2][2] = -(farPlane + nearPlane) / (farPlane - nearPlane);
+    projection[2][3] = -1.0f;
+    projection[3][2] = -2.0f * farPlane * nearPlane / (farPlane - nearPlane);
+
+    glm::mat4 view(1.0f);
+    view[0][0] = cosf(yaw);
+    view[0][2] = sinf(yaw);
+    view[2][0] = -sinf(yaw);
+    view[2][2] = cosf(yaw);
+    return projection * view;
+}
+
+// what queryFrustum should find: every box that Frustum::intersectsBox accepts
+static void ScanFrustum(const std::vector<BoundingBox>& boxes, const Frustum& frustum, std::vector<unsigned>& items) {
+    for(unsigned i = 0; i < boxes.size(); ++i){
+        if(frustum.intersectsBox(boxes[i].low, boxes[i].high))
+            items.push_back(i);
+    }
+}
+
+// what queryRay should find: the nearest distance at which the ray enters a box
+static bool ScanRay(const std::vector<BoundingBox>& boxes, const glm::vec3& origin, const glm::vec3& direction, float& distance) {
+    glm::vec3 inverse = 1.0f / direction;
+    distance = FLT_MAX;
+    bool hit = false;
+    for(unsigned i = 0; i < boxes.size(); ++i){
+        glm::vec3 t0 = (boxes[i].low - origin) * inverse, t1 = (boxes[i].high - origin) * inverse;
+        glm::vec3 entries = glm::min(t0, t1), exits = glm::max(t0, t1);
+        float enter = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+        float leave = std::min(std::min(exits.x, exits.y), exits.z);
+        if(enter <= leave && enter < distance){
+            distance = enter;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+// the distance at which the ray enters one box, FLT_MAX if it misses
+static float RayEnters(const BoundingBox& box, const glm::vec3& origin, const glm::vec3& direction) {
+    std::vector<BoundingBox> one(1, box);
+    float distance;
+    return ScanRay(one, origin, direction, distance) ? distance : FLT_MAX;
+}
+
+// time spent in the tree's queries and in the linear scans
+struct Timings {
+    double treeFrustum, scanFrustum, treeRay, scanRay;
+
+    Timings() : treeFrustum(0.0), scanFrustum(0.0), treeRay(0.0), scanRay(0.0) {}
+};
+
+// queries `tree` over `boxes` with frustums and rays, checking against the linear scan
+static void CheckQueries(const BoundingVolumeHierarchy& tree, const std::vector<BoundingBox>& boxes, Timings& timings) {
+    for(int q = 0; q < Frustums; ++q){
+        //mostly narrow views, and some that take in nearly everything
+        float fieldOfView = q % 5 == 0 ? 2.8f : Random(0.2f, 1.2f);
+        Frustum frustum(Camera(fieldOfView, Random(0.0f, 6.28f), q % 3 == 0 ? 1000.0f : 60.0f));
+
+        std::vector<unsigned> found, expected;
+        Clock::time_point start = Clock::now();
+        tree.queryFrustum(frustum, found);
+        timings.treeFrustum += Microseconds(start);
+        start = Clock::now();
+        ScanFrustum(boxes, frustum, expected);
+        timings.scanFrustum += Microseconds(start);
+
+        std::sort(found.begin(), found.end());
+        Check(found == expected, "queryFrustum finds what the scan finds");
+    }
+
+    for(int q = 0; q < Rays; ++q){
+        glm::vec3 origin(Random(-10.0f, 10.0f), Random(-10.0f, 10.0f), Random(-10.0f, 10.0f));
+        glm::vec3 direction(Random(-1.0f, 1.0f), Random(-1.0f, 1.0f), Random(-1.0f, 1.0f));
+        if(q % 7 == 0)
+            direction = glm::vec3(0.0f, 0.0f, -1.0f); //parallel to two axes
+
+        unsigned item = ~0u;
+        float distance = 0.0f, expectedDistance = 0.0f;
+        Clock::time_point start = Clock::now();
+        bool hit = tree.queryRay(origin, direction, item, distance);
+        timings.treeRay += Microseconds(start);
+        start = Clock::now();
+        bool expectedHit = ScanRay(boxes, origin, direction, expectedDistance);
+        timings.scanRay += Microseconds(start);
+
+        Check(hit == expectedHit, "queryRay hits when the scan does");
+        if(hit && expectedHit){
+            //boxes at the same distance are equally right
+            Check(distance == expectedDistance, "queryRay finds the nearest distance");
+            Check(item < boxes.size() && RayEnters(boxes[item], origin, direction) == distance,
+                  "queryRay's item is at its distance");
+        }
+    }
+}
+
+static void CheckTree(unsigned count) {
+    const float extent = 100.0f;
+    std::vector<BoundingBox> boxes(count);
+    for(unsigned i = 0; i < count; ++i)
+        boxes[i] = RandomBox(extent);
+
+    BoundingVolumeHierarchy tree;
+    Clock::time_point start = Clock::now();
+    tree.build(boxes);
+    double buildMicroseconds = Microseconds(start);
+    Check(tree.size() == count, "size");
+
+    Timings timings;
+    CheckQueries(tree, boxes, timings);
+
+    //small moves like a frame of animation, then big moves that loosen the tree
+    double refitMicroseconds = 0.0;
+    unsigned refits = 0;
+    for(int round = 0; round < RefitRounds; ++round){
+        const float distance = round < 2 ? 0.5f : extent;
+        for(unsigned m = 0; m < count / 10 + 1; ++m, ++refits){
+            unsigned i = rand() % count;
+            glm::vec3 move(Random(-distance, distance), Random(-distance, distance), Random(-distance, distance));
+            boxes[i] = round == RefitRounds - 1 ? RandomBox(extent) : BoundingBox(boxes[i].low + move, boxes[i].high + move);
+            start = Clock::now();
+            tree.refit(i, boxes[i]);
+            refitMicroseconds += Microseconds(start);
+        }
+        CheckQueries(tree, boxes, timings);
+    }
+
+    const int rounds = RefitRounds + 1;
+    std::cout << count << " boxes: build " << buildMicroseconds / 1000.0 << " ms, refit "
+              << refitMicroseconds / refits << " us each\n"
+              << "  frustum " << timings.treeFrustum / (rounds * Frustums) << " us, linear scan "
+              << timings.scanFrustum / (rounds * Frustums) << " us\n"
+              << "  ray " << timings.treeRay / (rounds * Rays) << " us, linear scan "
+              << timings.scanRay / (rounds * Rays) << " us" << std::endl;
+}
+
+int main() {
+    srand(1);
+
+    //no items: nothing is found
+    BoundingVolumeHierarchy empty;
+    empty.build(std::vector<BoundingBox>());
+    std::vector<unsigned> items;
+    unsigned item;
+    float distance;
+    empty.queryFrustum(Frustum(Camera(1.0f, 0.0f, 100.0f)), items);
+    Check(items.empty(), "empty tree finds nothing in a frustum");
+    Check(!empty.queryRay(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), item, distance), "empty tree finds no ray hit");
+
+    //boxes all at one place, which can't be split by position
+    std::vector<BoundingBox> same(50, BoundingBox(glm::vec3(-1.0f, -1.0f, -6.0f), glm::vec3(1.0f, 1.0f, -4.0f)));
+    BoundingVolumeHierarchy stacked;
+    stacked.build(same);
+    Timings unused;
+    CheckQueries(stacked, same, unused);
+
+    CheckTree(1);
+    CheckTree(7);
+    CheckTree(1000);
+    CheckTree(10000);
+    CheckTree(100000);
+
+    if(gFailures > 0){
+        std::cerr << gFailures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "BoundingVolumeHierarchy ok" << std::endl;
+    return 0;
+}
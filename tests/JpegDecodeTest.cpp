@@ -0,0 +1,210 @@
+/*
+ Checks of the SSE2 kernels of the stb_image JPEG decoder
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Decodes JPEGs with every req_comp from 0 to 4, flipped and not, and checks that the SSE2
+// idct, 2x2 upsampling and YCbCr conversion give exactly the bytes of the C versions. Both
+// can't be linked into one program, so run.sh builds this twice:
+//
+//   JpegDecodeTest --write DUMP [FILES...]     built with STBI_NO_SIMD, writes the pixels
+//   JpegDecodeTest --compare DUMP [FILES...]   built as the app is, compares with them
+//
+// Without FILES, it decodes every .jpg in resources and tests/data. The 4:2:0 files in
+// tests/data are there for the upsampler, since everything in resources is 4:4:4. See
+// tests/run.sh.
+
+#define STBI_FAILURE_USERMSG
+#include <stb_image.c>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static unsigned gFailures = 0;
+
+// counts and prints a failed check, the first few times
+static void Check(bool ok, const std::string& what) {
+    if(ok)
+        return;
+    if(gFailures < 10)
+        std::cerr << "FAILED: " << what << std::endl;
+    ++gFailures;
+}
+
+// one decode: its size and components, and the pixels, empty if it failed
+struct Decoded {
+    int width, height, components;
+    std::vector<unsigned char> pixels;
+
+    Decoded() : width(0), height(0), components(0) {}
+};
+
+static Decoded Decode(const char* path, int reqComp, int flip) {
+    Decoded decoded;
+    stbi_set_flip_vertically_on_load(flip);
+    unsigned char* pixels = stbi_load(path, &decoded.width, &decoded.height, &decoded.components, reqComp);
+    stbi_set_flip_vertically_on_load(0);
+    if(!pixels){
+        std::cerr << path << ": " << stbi_failure_reason() << std::endl;
+        return Decoded();
+    }
+
+    size_t size = (size_t)decoded.width * decoded.height * (reqComp ? reqComp : decoded.components);
+    decoded.pixels.assign(pixels, pixels + size);
+    stbi_image_free(pixels);
+    return decoded;
+}
+
+static void Write(FILE* f, const Decoded& decoded) {
+    int header[4] = { decoded.width, decoded.height, decoded.components, (int)decoded.pixels.size() };
+    fwrite(header, sizeof(header), 1, f);
+    if(!decoded.pixels.empty())
+        fwrite(&decoded.pixels[0], 1, decoded.pixels.size(), f);
+}
+
+static bool Read(FILE* f, Decoded& decoded) {
+    int header[4];
+    if(fread(header, sizeof(header), 1, f) != 1 || header[3] < 0)
+        return false;
+    decoded.width = header[0];
+    decoded.height = header[1];
+    decoded.components = header[2];
+    decoded.pixels.resize(header[3]);
+    return decoded.pixels.empty() || fread(&decoded.pixels[0], 1, decoded.pixels.size(), f) == decoded.pixels.size();
+}
+
+// the sampling factors of the first component from the frame header, 0 if there isn't one
+static int LumaSampling(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if(!f)
+        return 0;
+    std::vector<unsigned char> data;
+    unsigned char buffer[4096];
+    size_t count;
+    while((count = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        data.insert(data.end(), buffer, buffer + count);
+    fclose(f);
+
+    //marker segments up to the first SOFn, whose first component starts at byte 11
+    for(size_t i = 2; i + 12 < data.size() && data[i] == 0xFF; i += 2 + (data[i+2] << 8 | data[i+3])){
+        unsigned char marker = data[i+1];
+        if(marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+            return data[i+11];
+    }
+    return 0;
+}
+
+// the .jpg files in `directory`, sorted, appended to `files`
+static void ListJpegs(const std::string& directory, std::vector<std::string>& files) {
+    DIR* dir = opendir(directory.c_str());
+    if(!dir)
+        return;
+    std::vector<std::string> found;
+    while(dirent* entry = readdir(dir)){
+        std::string name = entry->d_name;
+        if(name.size() > 4 && name.compare(name.size() - 4, 4, ".jpg") == 0)
+            found.push_back(directory + "/" + name);
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+// the name of one decode in messages
+static std::string CaseName(const std::string& path, int reqComp, int flip) {
+    return path + " req_comp " + std::to_string(reqComp) + (flip ? " flipped" : "");
+}
+
+int main(int argc, char** argv) {
+    const bool write = argc > 2 && 0 == strcmp(argv[1], "--write");
+    if(argc < 3 || (!write && 0 != strcmp(argv[1], "--compare"))){
+        std::cerr << "usage: " << argv[0] << " --write|--compare DUMP [FILES...]" << std::endl;
+        return 2;
+    }
+
+#ifdef STBI_SSE2
+    const bool sse2 = stbi_sse2_available() != 0;
+#else
+    const bool sse2 = false;
+#endif
+    if(write && sse2){
+        std::cerr << "--write needs a build with STBI_NO_SIMD" << std::endl;
+        return 2;
+    }
+    if(!write && !sse2){
+        //only the C kernels in this build or on this processor, so nothing to compare them with
+        std::cout << "no SSE2 kernels, skipping" << std::endl;
+        return 0;
+    }
+
+    FILE* dump = fopen(argv[2], write ? "wb" : "rb");
+    if(!dump){
+        std::cerr << "can't open " << argv[2] << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> files(argv + 3, argv + argc);
+    if(files.empty()){
+        ListJpegs("resources", files);
+        ListJpegs("tests/data", files);
+    }
+
+    int decodes = 0, upsampled = 0;
+    for(size_t i = 0; i < files.size(); ++i){
+        const char* path = files[i].c_str();
+        const bool subsampled = LumaSampling(path) == 0x22;
+        for(int flip = 0; flip <= 1; ++flip){
+            for(int reqComp = 0; reqComp <= 4; ++reqComp){
+                const std::string name = CaseName(files[i], reqComp, flip);
+                Decoded decoded = Decode(path, reqComp, flip);
+                Check(!decoded.pixels.empty(), "decoding " + name);
+                if(write){
+                    Write(dump, decoded);
+                    continue;
+                }
+
+                Decoded expected;
+                if(!Read(dump, expected)){
+                    Check(false, "no pixels from the C kernels for " + name);
+                    continue;
+                }
+                Check(decoded.width == expected.width && decoded.height == expected.height &&
+                      decoded.components == expected.components, "size of " + name);
+                Check(decoded.pixels == expected.pixels, "pixels of " + name);
+                ++decodes;
+                if(subsampled)
+                    ++upsampled;
+            }
+        }
+    }
+    fclose(dump);
+
+    if(!write){
+        Check(upsampled > 0, "no 4:2:0 file, so the 2x2 upsampler wasn't compared");
+        std::cout << decodes << " decodes, " << upsampled << " of them 4:2:0" << std::endl;
+    }
+    if(gFailures > 0){
+        std::cerr << gFailures << " checks failed" << std::endl;
+        return 1;
+    }
+    if(!write)
+        std::cout << "JPEG SSE2 kernels ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ Checks of tdogl::LoadObj
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Loads the .obj files in resources with the fscanf parser the tokenizer replaced, which only
+// reads triangles in one face format per file, and checks that loadObj gives exactly the
+// same triangles. Then checks the faces only the tokenizer reads, and times both parsers on
+// sphere.obj. Last, loads a big generated sphere with the counting pass and without it, each
+// in a child process of its own, and prints the peak memory of both. See tests/run.sh.
+
+#include "LoadObj.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace tdogl;
+
+typedef std::chrono::steady_clock Clock;
+
+static const char* TempObj = "tests/bin/LoadObjTest.obj";
+static const char* BigObj = "tests/bin/LoadObjTest-big.obj";
+
+static unsigned gFailures = 0;
+
+// counts and prints a failed check, the first few times
+static void Check(bool ok, const std::string& what) {
+    if(ok)
+        return;
+    if(gFailures < 10)
+        std::cerr << "FAILED: " << what << std::endl;
+    ++gFailures;
+}
+
+/*
+ * The parser before the tokenizer, kept as the reference
+ */
+
+static int OldLoadObj(const char* path,
+                      std::vector<glm::vec3>& out_vertices,
+                      std::vector<glm::vec2>& out_uvs,
+                      std::vector<glm::vec3>& out_normals,
+                      int n)
+{
+    std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+    std::vector<glm::vec3> temp_vertices;
+    std::vector<glm::vec2> temp_uvs;
+    std::vector<glm::vec3> temp_normals;
+    FILE* file = fopen(path, "r");
+    if(file == NULL)
+        return -1;
+
+    bool vt = false;
+    bool vn = false;
+    int retval = -1;
+    for(;;){
+        char lineHeader[128];
+        if(fscanf(file, "%127s", lineHeader) == EOF)
+            break;
+
+        if(strcmp(lineHeader, "v") == 0){
+            glm::vec3 vertex;
+            if(fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z) != 3)
+                break;
+            vertex.z -= n-2;
+            temp_vertices.push_back(vertex);
+        } else if(strcmp(lineHeader, "vt") == 0){
+            vt = true;
+            glm::vec2 uv;
+            if(fscanf(file, "%f %f\n", &uv.x, &uv.y) != 2)
+                break;
+            temp_uvs.push_back(uv);
+        } else if(strcmp(lineHeader, "vn") == 0){
+            vn = true;
+            glm::vec3 normal;
+            if(fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z) != 3)
+                break;
+            temp_normals.push_back(normal);
+        } else if(strcmp(lineHeader, "f") == 0){
+            unsigned int v[3], t[3], m[3];
+            bool ok;
+            if(vt && vn){
+                retval = 1;
+                ok = 9 == fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &v[0], &t[0], &m[0], &v[1], &t[1], &m[1], &v[2], &t[2], &m[2]);
+            } else if(vn){
+                retval = 2;
+                ok = 6 == fscanf(file, "%d//%d %d//%d %d//%d\n", &v[0], &m[0], &v[1], &m[1], &v[2], &m[2]);
+            } else if(vt){
+                retval = 3;
+                ok = 6 == fscanf(file, "%d/%d %d/%d %d/%d\n", &v[0], &t[0], &v[1], &t[1], &v[2], &t[2]);
+            } else {
+                retval = 4;
+                ok = 3 == fscanf(file, "%d %d %d\n", &v[0], &v[1], &v[2]);
+            }
+            if(!ok){
+                fclose(file);
+                return -1;
+            }
+            for(int i = 0; i < 3; ++i){
+                vertexIndices.push_back(v[i]);
+                if(vt)
+                    uvIndices.push_back(t[i]);
+                if(vn)
+                    normalIndices.push_back(m[i]);
+            }
+        }
+    }
+    fclose(file);
+
+    for(unsigned int i = 0; i < vertexIndices.size(); i++)
+        out_vertices.push_back(temp_vertices[vertexIndices[i] - 1]);
+    for(unsigned int i = 0; i < normalIndices.size(); i++)
+        out_normals.push_back(temp_normals[normalIndices[i] - 1]);
+    for(unsigned int i = 0; i < uvIndices.size(); i++)
+        out_uvs.push_back(temp_uvs[uvIndices[i] - 1]);
+    return retval;
+}
+
+/*
+ * Checks
+ */
+
+// what one parse gives
+struct Mesh {
+    int result;
+    std::vector<glm::vec3> vertices, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<ObjGroup> groups;
+};
+
+static Mesh Load(const char* path, bool countingPass = true) {
+    Mesh mesh;
+    std::string mtllib;
+    LoadObj loader;
+    loader.setCountingPass(countingPass);
+    mesh.result = loader.loadObj(path, mesh.vertices, mesh.uvs, mesh.normals, mesh.groups, mtllib, 2);
+    return mesh;
+}
+
+static Mesh LoadText(const char* text) {
+    FILE* f = fopen(TempObj, "wb");
+    fputs(text, f);
+    fclose(f);
+    return Load(TempObj);
+}
+
+static void CheckSameAsOld(const char* path) {
+    Mesh expected;
+    expected.result = OldLoadObj(path, expected.vertices, expected.uvs, expected.normals, 2);
+    Mesh mesh = Load(path);
+    Check(expected.result > 0, std::string("the old parser reads ") + path);
+    Check(mesh.result == expected.result, std::string("result of ") + path);
+    Check(mesh.vertices == expected.vertices, std::string("positions of ") + path);
+    Check(mesh.uvs == expected.uvs, std::string("uvs of ") + path);
+    Check(mesh.normals == expected.normals, std::string("normals of ") + path);
+
+    Mesh uncounted = Load(path, false);
+    Check(uncounted.result == mesh.result && uncounted.vertices == mesh.vertices &&
+          uncounted.uvs == mesh.uvs && uncounted.normals == mesh.normals,
+          std::string("the same without the counting pass: ") + path);
+}
+
+// twice the area of a triangle that faces +z, negative if it faces away
+static float FacingArea(const glm::vec3* t) {
+    return (t[1].x - t[0].x) * (t[2].y - t[0].y) - (t[1].y - t[0].y) * (t[2].x - t[0].x);
+}
+
+static void CheckFaces() {
+    const char* corners = "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nvt 0 0\nvt 1 1\nvn 0 0 1\n";
+
+    //a quad is two triangles, with negative indices the same as positive ones
+    Mesh quad = LoadText((std::string(corners) + "f 1 2 3 4\n").c_str());
+    Mesh backwards = LoadText((std::string(corners) + "f -4 -3 -2 -1\n").c_str());
+    Check(quad.result == 4 && quad.vertices.size() == 6, "a quad is two triangles");
+    Check(backwards.result == 4 && backwards.vertices == quad.vertices, "negative indices");
+
+    //every corner form in one face: the missing uv is zero, the missing normal is flat
+    Mesh mixed = LoadText((std::string(corners) + "f 1/1/1 2//1 3/2 4\n").c_str());
+    Check(mixed.result == 1 && mixed.uvs.size() == 6 && mixed.normals.size() == 6, "mixed corner forms");
+    if(mixed.result == 1 && mixed.uvs.size() == 6){
+        Check(mixed.uvs[1] == glm::vec2(0.0f) && mixed.uvs[2] == glm::vec2(1.0f), "uvs of mixed corners");
+        Check(mixed.normals[2] == glm::vec3(0.0f, 0.0f, 1.0f), "flat normal of a corner without one");
+    }
+
+    //an L: six corners, one of them reflex, so a fan from the first would fold over
+    Mesh concave = LoadText("v 0 0 0\nv 2 0 0\nv 2 1 0\nv 1 1 0\nv 1 2 0\nv 0 2 0\nf 2 3 4 5 6 1\n");
+    float area = 0.0f;
+    bool facing = concave.vertices.size() == 12;
+    for(size_t i = 0; facing && i < concave.vertices.size(); i += 3){
+        facing = FacingArea(&concave.vertices[i]) > 0.0f;
+        area += FacingArea(&concave.vertices[i]) / 2;
+    }
+    Check(facing && fabsf(area - 3.0f) < 1e-5f, "a concave polygon is ear clipped");
+
+    //each o, g and usemtl starts a group; faces before any of them are in an unnamed one
+    Mesh grouped = LoadText((std::string(corners) +
+                             "f 1 2 3\no first\nf 1 2 3 4\nusemtl red\nf 1 3 4\ng second\ng third\nf 1 2 3\n").c_str());
+    const std::vector<ObjGroup>& g = grouped.groups;
+    Check(g.size() == 4, "empty groups are dropped");
+    if(g.size() == 4){
+        Check(g[0].name == "" && g[0].start == 0 && g[0].count == 3, "first group");
+        Check(g[1].name == "first" && g[1].material == "" && g[1].start == 3 && g[1].count == 6, "o group");
+        Check(g[2].name == "first" && g[2].material == "red" && g[2].count == 3, "usemtl group");
+        Check(g[3].name == "third" && g[3].material == "red" && g[3].start == 12, "g group");
+    }
+
+    Check(LoadText((std::string(corners) + "f 1 2 9\n").c_str()).result == -1, "an index out of range");
+    Check(LoadText((std::string(corners) + "f 1 2\n").c_str()).result == -1, "a face with two corners");
+    Check(LoadText(corners).result == -1, "a file without faces");
+}
+
+/*
+ * Benchmark
+ */
+
+// fastest of a few runs, in milliseconds
+template <typename F>
+static double Fastest(F run) {
+    double best = 1e30;
+    for(int i = 0; i < 10; ++i){
+        Clock::time_point start = Clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+static void Benchmark(const char* path) {
+    double oldParse = Fastest([&]() {
+        std::vector<glm::vec3> vertices, normals;
+        std::vector<glm::vec2> uvs;
+        OldLoadObj(path, vertices, uvs, normals, 2);
+    });
+    double newParse = Fastest([&]() { Load(path); });
+    std::cout << path << ": fscanf " << oldParse << " ms, tokenizer " << newParse
+              << " ms, fastest of 10" << std::endl;
+}
+
+// a sphere of quads with uvs and normals, about 25 MB of text
+static void WriteBigSphere(const char* path) {
+    const int rings = 400, segments = 400;
+    FILE* f = fopen(path, "w");
+    for(int r = 0; r <= rings; ++r){
+        for(int s = 0; s <= segments; ++s){
+            float theta = 3.14159265f * r / rings, phi = 6.2831853f * s / segments;
+            fprintf(f, "v %f %f %f\n", sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+        }
+    }
+    for(int r = 0; r <= rings; ++r){
+        for(int s = 0; s <= segments; ++s)
+            fprintf(f, "vt %f %f\n", (float)s / segments, (float)r / rings);
+    }
+    for(int r = 0; r <= rings; ++r){
+        for(int s = 0; s <= segments; ++s){
+            float theta = 3.14159265f * r / rings, phi = 6.2831853f * s / segments;
+            fprintf(f, "vn %f %f %f\n", sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+        }
+    }
+    for(int r = 0; r < rings; ++r){
+        for(int s = 0; s < segments; ++s){
+            int a = r * (segments + 1) + s + 1, b = a + segments + 1;
+            fprintf(f, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, b + 1, b + 1, b + 1, a + 1, a + 1, a + 1);
+        }
+    }
+    fclose(f);
+}
+
+// peak resident memory in MB of a child process that runs `run`. Peak memory only ever goes
+// up, so each load needs a process of its own.
+template <typename F>
+static double ChildPeakMegabytes(F run) {
+    pid_t child = fork();
+    if(child == 0){
+        run();
+        _exit(0);
+    }
+    int status = 0;
+    struct rusage usage;
+    if(child < 0 || wait4(child, &status, 0, &usage) != child)
+        return 0.0;
+    return usage.ru_maxrss / 1024.0;
+}
+
+static void MemoryBenchmark() {
+    WriteBigSphere(BigObj);
+    double outputMegabytes = 0.0, counted = 0.0, uncounted = 0.0;
+    {
+        Mesh mesh = Load(BigObj);
+        outputMegabytes = (mesh.vertices.size() * sizeof(glm::vec3) + mesh.uvs.size() * sizeof(glm::vec2) +
+                           mesh.normals.size() * sizeof(glm::vec3)) / (1024.0 * 1024.0);
+        counted = Fastest([&]() { Load(BigObj, true); });
+        uncounted = Fastest([&]() { Load(BigObj, false); });
+    }
+
+    //a child that loads nothing has the memory all the children start with
+    double baseline = ChildPeakMegabytes([]() {});
+    double withPass = ChildPeakMegabytes([]() { Load(BigObj, true); });
+    double withoutPass = ChildPeakMegabytes([]() { Load(BigObj, false); });
+    remove(BigObj);
+
+    std::cout << "400x400 quad sphere, " << outputMegabytes << " MB of output: peak memory "
+              << withoutPass - baseline << " MB and " << uncounted << " ms without the counting pass, "
+              << withPass - baseline << " MB and " << counted << " ms with it" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    const char* files[] = { "resources/cilynder.obj", "resources/cubo.obj", "resources/cuboT.obj",
+                            "resources/monkey.obj", "resources/sphere.obj", "resources/untitled.obj",
+                            "resources/Models/fig1.obj" };
+    for(size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i)
+        CheckSameAsOld(files[i]);
+    CheckFaces();
+    remove(TempObj);
+
+    if(gFailures > 0){
+        std::cerr << gFailures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "LoadObj ok" << std::endl;
+
+    //no benchmark under a sanitizer or valgrind, where the times mean nothing
+    if(argc > 1 && 0 == strcmp(argv[1], "--no-benchmark"))
+        return 0;
+    Benchmark("resources/sphere.obj");
+    Benchmark("resources/monkey.obj");
+    MemoryBenchmark();
+    return 0;
+}
@@ -0,0 +1,362 @@
+/*
+ Checks of tdogl::OcclusionBuffer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Checks what the software depth buffer hides on hand-made scenes: a wall over the whole
+// view, an occluder whose edge is part way across a pixel, and a floor that goes behind the
+// eye. Then draws random scenes and checks that every pixel it marks as covered is covered
+// everywhere inside, no nearer than its depth says. run.sh builds this twice, so the SSE2
+// code can be compared with the plain code:
+//
+//   OcclusionBufferTest --write DUMP     built with TDOGL_NO_SIMD, writes the random scenes
+//   OcclusionBufferTest --compare DUMP   built as the app is, compares with them
+//
+// See tests/run.sh.
+
+#include "OcclusionBuffer.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace tdogl;
+
+static const unsigned Width = 256, Height = 144; //as in the app
+static const float FieldOfView = 1.0472f;         //60 degrees up and down
+static const float Aspect = (float)Width / Height;
+static const int Scenes = 10;
+static const int BoxesPerScene = 200;
+
+static unsigned gFailures = 0;
+
+// counts and prints a failed check, the first few times
+static void Check(bool ok, const std::string& what) {
+    if(ok)
+        return;
+    if(gFailures < 10)
+        std::cerr << "FAILED: " << what << std::endl;
+    ++gFailures;
+}
+
+// uniform in [low, high]
+static float Random(float low, float high) {
+    return low + (high - low) * (rand() / (float)RAND_MAX);
+}
+
+// a perspective projection from the origin down -z
+static glm::mat4 Projection() {
+    const float nearPlane = 0.1f, farPlane = 200.0f;
+    const float f = 1.0f / tanf(FieldOfView * 0.5f);
+    glm::mat4 projection(0.0f);
+    projection[0][0] = f / Aspect;
+    projection[1][1] = f;
+    projection[2][2] = -(farPlane + nearPlane) / (farPlane - nearPlane);
+    projection[2][3] = -1.0f;
+    projection[3][2] = -2.0f * farPlane * nearPlane / (farPlane - nearPlane);
+    return projection;
+}
+
+// the x at `distance` in front of the eye that shows at pixel column `pixel`
+static float WorldX(float pixel, float distance) {
+    return (pixel / Width * 2.0f - 1.0f) * distance * Aspect * tanf(FieldOfView * 0.5f);
+}
+
+// the depth the buffer keeps for a point `distance` in front of the eye
+static float Depth(float distance) {
+    glm::vec4 p = Projection() * glm::vec4(0.0f, 0.0f, -distance, 1.0f);
+    return p.z / p.w;
+}
+
+static bool Covered(const OcclusionBuffer& buffer, unsigned x, unsigned y) {
+    return buffer.depth(x, y) < 1e30f;
+}
+
+// adds the quad a b c d as the two triangles a b c and d a c, the way the box walls are made
+static void AddQuad(std::vector<glm::vec3>& vertices, std::vector<unsigned>& indices,
+                    const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d)
+{
+    const glm::vec3 corners[6] = { a, b, c, d, a, c };
+    for(int i = 0; i < 6; ++i){
+        indices.push_back((unsigned)vertices.size());
+        vertices.push_back(corners[i]);
+    }
+}
+
+static void Draw(OcclusionBuffer& buffer, const std::vector<glm::vec3>& vertices, const std::vector<unsigned>& indices) {
+    buffer.clear();
+    buffer.addOccluder(Projection(), vertices, indices);
+    buffer.rasterize(ThreadPool::shared());
+}
+
+static bool Visible(const OcclusionBuffer& buffer, const glm::vec3& low, const glm::vec3& high) {
+    return buffer.isVisible(Projection(), low, high);
+}
+
+/*
+ * Hand-made scenes
+ */
+
+static void CheckWall() {
+    //two triangles much bigger than the view, so they are clipped to the guard band
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned> indices;
+    AddQuad(vertices, indices, glm::vec3(-100, -100, -10), glm::vec3(100, -100, -10),
+            glm::vec3(100, 100, -10), glm::vec3(-100, 100, -10));
+    OcclusionBuffer buffer(Width, Height);
+    Draw(buffer, vertices, indices);
+
+    //every pixel, also along the diagonal between the triangles, at about the wall's depth
+    bool all = true, close = true;
+    for(unsigned y = 0; y < buffer.height(); ++y){
+        for(unsigned x = 0; x < buffer.width(); ++x){
+            all = all && Covered(buffer, x, y);
+            close = close && buffer.depth(x, y) >= Depth(10.0f) && buffer.depth(x, y) < Depth(10.01f);
+        }
+    }
+    Check(all, "a wall over the view covers every pixel");
+    Check(close, "the wall's depth is just behind it");
+
+    Check(!Visible(buffer, glm::vec3(-1, -1, -21), glm::vec3(1, 1, -19)), "a box behind the wall is hidden");
+    Check(!Visible(buffer, glm::vec3(-30, -15, -31), glm::vec3(30, 15, -30)), "a box behind the whole wall is hidden");
+    Check(Visible(buffer, glm::vec3(-1, -1, -6), glm::vec3(1, 1, -5)), "a box in front of the wall is visible");
+    Check(Visible(buffer, glm::vec3(-1, -1, -11), glm::vec3(1, 1, -9)), "a box through the wall is visible");
+    Check(Visible(buffer, glm::vec3(-1, -1, -20), glm::vec3(1, 1, 1)), "a box around the eye is visible");
+    Check(!Visible(buffer, glm::vec3(40, -1, -11), glm::vec3(42, 1, -9)), "a box beside the view is not");
+}
+
+static void CheckSilhouette() {
+    //a wall over the left of the view, whose right edge is 0.7 of the way across column 100,
+    //so the centre of that column is covered but not all of it
+    const float edge = 100.7f;
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned> indices;
+    AddQuad(vertices, indices, glm::vec3(-100, -100, -10), glm::vec3(WorldX(edge, 10.0f), -100, -10),
+            glm::vec3(WorldX(edge, 10.0f), 100, -10), glm::vec3(-100, 100, -10));
+    OcclusionBuffer buffer(Width, Height);
+    Draw(buffer, vertices, indices);
+
+    Check(Covered(buffer, 99, Height / 2), "a column the wall covers");
+    Check(!Covered(buffer, 100, Height / 2), "a column the wall covers part of");
+    Check(!Covered(buffer, 101, Height / 2), "a column right of the wall");
+
+    //boxes at 20 whose right sides show in columns 99, 100 and 120
+    const float d = 20.0f;
+    Check(!Visible(buffer, glm::vec3(WorldX(90.0f, d), -1, -d - 0.01f), glm::vec3(WorldX(99.9f, d), 1, -d)),
+          "a box inside the wall's outline is hidden");
+    Check(Visible(buffer, glm::vec3(WorldX(90.0f, d), -1, -d - 0.01f), glm::vec3(WorldX(100.9f, d), 1, -d)),
+          "a box showing in the part of a pixel the wall leaves is visible");
+    Check(Visible(buffer, glm::vec3(WorldX(90.0f, d), -1, -d - 0.01f), glm::vec3(WorldX(120.0f, d), 1, -d)),
+          "a box partly outside the wall's outline is visible");
+}
+
+static void CheckNearPlane() {
+    //a floor under the eye, from behind it to far in front
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned> indices;
+    AddQuad(vertices, indices, glm::vec3(-50, -1, 5), glm::vec3(50, -1, 5),
+            glm::vec3(50, -1, -100), glm::vec3(-50, -1, -100));
+    OcclusionBuffer buffer(Width, Height);
+    Draw(buffer, vertices, indices);
+
+    Check(Covered(buffer, Width / 2, 0), "the floor covers the bottom of the view");
+    Check(!Covered(buffer, Width / 2, Height - 1), "the floor leaves the top of the view");
+    Check(buffer.depth(Width / 2, 0) >= Depth(1.0f / tanf(FieldOfView * 0.5f)),
+          "the floor at the bottom of the view is no nearer than it is");
+    Check(!Visible(buffer, glm::vec3(-1, -3, -21), glm::vec3(1, -2, -19)), "a box under the floor is hidden");
+    Check(Visible(buffer, glm::vec3(-1, 0, -21), glm::vec3(1, 1, -19)), "a box over the floor is visible");
+
+    //a triangle all behind the eye draws nothing
+    std::vector<glm::vec3> behind;
+    behind.push_back(glm::vec3(-1, -1, 1));
+    behind.push_back(glm::vec3(1, -1, 1));
+    behind.push_back(glm::vec3(0, 1, 2));
+    std::vector<unsigned> triangle;
+    for(unsigned i = 0; i < 3; ++i)
+        triangle.push_back(i);
+    Draw(buffer, behind, triangle);
+    bool empty = true;
+    for(unsigned y = 0; y < buffer.height(); ++y){
+        for(unsigned x = 0; x < buffer.width(); ++x)
+            empty = empty && !Covered(buffer, x, y);
+    }
+    Check(empty, "a triangle behind the eye draws nothing");
+}
+
+/*
+ * Random scenes
+ */
+
+// a point in front of the eye, at `distance`, that shows at (x, y) of the view from -1 to 1
+static glm::vec3 InView(float x, float y, float distance) {
+    const float t = tanf(FieldOfView * 0.5f);
+    return glm::vec3(x * distance * Aspect * t, y * distance * t, -distance);
+}
+
+// some loose triangles and some flat quads, all in front of the eye and partly outside the view
+static void RandomScene(std::vector<glm::vec3>& vertices, std::vector<unsigned>& indices) {
+    for(int i = 0; i < 12; ++i){
+        glm::vec3 center = InView(Random(-1.3f, 1.3f), Random(-1.3f, 1.3f), Random(3.0f, 60.0f));
+        for(int k = 0; k < 3; ++k){
+            glm::vec3 p = center + glm::vec3(Random(-4, 4), Random(-4, 4), Random(-2, 2));
+            p.z = std::min(p.z, -1.0f);
+            indices.push_back((unsigned)vertices.size());
+            vertices.push_back(p);
+        }
+    }
+    for(int i = 0; i < 8; ++i){
+        glm::vec3 center = InView(Random(-1.3f, 1.3f), Random(-1.3f, 1.3f), Random(10.0f, 60.0f));
+        glm::vec3 u = glm::normalize(glm::vec3(Random(-1, 1), Random(-1, 1), Random(-1, 1)));
+        glm::vec3 v = glm::normalize(glm::cross(u, glm::vec3(Random(-1, 1), Random(-1, 1), Random(-1, 1))));
+        u *= Random(1.0f, 6.0f);
+        v *= Random(1.0f, 6.0f);
+        AddQuad(vertices, indices, center - u - v, center + u - v, center + u + v, center - u + v);
+    }
+}
+
+// the nearest depth of the triangles at the point (x, y) in pixels, or false if none is there
+static bool ReferenceDepth(const std::vector<glm::vec3>& screen, float x, float y, float& depth) {
+    bool found = false;
+    for(size_t i = 0; i + 2 < screen.size(); i += 3){
+        const glm::vec3& a = screen[i];
+        const glm::vec3& b = screen[i + 1];
+        const glm::vec3& c = screen[i + 2];
+        float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+        if(area == 0.0f)
+            continue;
+        float wa = ((b.x - x) * (c.y - y) - (c.x - x) * (b.y - y)) / area;
+        float wb = ((c.x - x) * (a.y - y) - (a.x - x) * (c.y - y)) / area;
+        float wc = 1.0f - wa - wb;
+        if(wa < 0.0f || wb < 0.0f || wc < 0.0f)
+            continue;
+        float z = wa * a.z + wb * b.z + wc * c.z;
+        if(!found || z < depth)
+            depth = z;
+        found = true;
+    }
+    return found;
+}
+
+// every covered pixel is covered at 9 points inside it, no nearer than its depth. Returns how
+// many pixels are covered.
+static unsigned CheckConservative(const OcclusionBuffer& buffer, const std::vector<glm::vec3>& vertices,
+                                  const std::vector<unsigned>& indices, int scene)
+{
+    std::vector<glm::vec3> screen;
+    for(size_t i = 0; i < indices.size(); ++i){
+        glm::vec4 p = Projection() * glm::vec4(vertices[indices[i]], 1.0f);
+        screen.push_back(glm::vec3((p.x / p.w * 0.5f + 0.5f) * buffer.width(),
+                                   (p.y / p.w * 0.5f + 0.5f) * buffer.height(), p.z / p.w));
+    }
+
+    unsigned covered = 0;
+    for(unsigned y = 0; y < buffer.height(); ++y){
+        for(unsigned x = 0; x < buffer.width(); ++x){
+            if(!Covered(buffer, x, y))
+                continue;
+            ++covered;
+            bool ok = true;
+            for(int s = 0; s < 9 && ok; ++s){
+                float depth;
+                ok = ReferenceDepth(screen, x + 0.02f + 0.48f * (s % 3), y + 0.02f + 0.48f * (s / 3), depth) &&
+                     depth <= buffer.depth(x, y) + 1e-6f;
+            }
+            Check(ok, "pixel " + std::to_string(x) + "," + std::to_string(y) + " of random scene " +
+                      std::to_string(scene) + " is covered all over");
+        }
+    }
+    return covered;
+}
+
+// draws the random scenes, checks them, and writes the depths and which random boxes are
+// visible to `dump`, or compares them with it
+static void CheckRandomScenes(FILE* dump, bool write) {
+    unsigned covered = 0;
+    for(int scene = 0; scene < Scenes; ++scene){
+        std::vector<glm::vec3> vertices;
+        std::vector<unsigned> indices;
+        RandomScene(vertices, indices);
+        OcclusionBuffer buffer(Width, Height);
+        Draw(buffer, vertices, indices);
+        covered += CheckConservative(buffer, vertices, indices, scene);
+
+        std::vector<float> depths;
+        for(unsigned y = 0; y < buffer.height(); ++y){
+            for(unsigned x = 0; x < buffer.width(); ++x)
+                depths.push_back(buffer.depth(x, y));
+        }
+        std::vector<unsigned char> visible;
+        for(int b = 0; b < BoxesPerScene; ++b){
+            glm::vec3 center = InView(Random(-1.2f, 1.2f), Random(-1.2f, 1.2f), Random(5.0f, 80.0f));
+            glm::vec3 half(Random(0.1f, 3.0f), Random(0.1f, 3.0f), Random(0.1f, 3.0f));
+            visible.push_back(Visible(buffer, center - half, center + half));
+        }
+
+        if(!dump)
+            continue;
+        if(write){
+            fwrite(&depths[0], sizeof(float), depths.size(), dump);
+            fwrite(&visible[0], 1, visible.size(), dump);
+            continue;
+        }
+        std::vector<float> expectedDepths(depths.size());
+        std::vector<unsigned char> expectedVisible(visible.size());
+        bool read = fread(&expectedDepths[0], sizeof(float), depths.size(), dump) == depths.size() &&
+                    fread(&expectedVisible[0], 1, visible.size(), dump) == visible.size();
+        const std::string name = "random scene " + std::to_string(scene);
+        Check(read, "no depths from the plain code for " + name);
+        Check(read && 0 == memcmp(&depths[0], &expectedDepths[0], depths.size() * sizeof(float)),
+              "SSE2 depths of " + name);
+        Check(read && visible == expectedVisible, "SSE2 visible boxes of " + name);
+    }
+
+    //the scenes aren't empty, so the checks above check something
+    Check(covered > Scenes * Width * Height / 20, "random scenes cover some pixels");
+}
+
+int main(int argc, char** argv) {
+    const bool write = argc > 2 && 0 == strcmp(argv[1], "--write");
+    const bool compare = argc > 2 && 0 == strcmp(argv[1], "--compare");
+    if(argc > 1 && !write && !compare){
+        std::cerr << "usage: " << argv[0] << " [--write|--compare DUMP]" << std::endl;
+        return 2;
+    }
+    FILE* dump = NULL;
+    if(write || compare){
+        dump = fopen(argv[2], write ? "wb" : "rb");
+        if(!dump){
+            std::cerr << "can't open " << argv[2] << std::endl;
+            return 1;
+        }
+    }
+
+    srand(1);
+    CheckWall();
+    CheckSilhouette();
+    CheckNearPlane();
+    CheckRandomScenes(dump, write);
+    if(dump)
+        fclose(dump);
+
+    if(gFailures > 0){
+        std::cerr << gFailures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "OcclusionBuffer ok" << (compare ? ", SSE2 and plain code agree" : "") << std::endl;
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ Checks of tdogl::VertexQuantizer
+
+ Copyright 2012 Thomas Dalling - http://tomdalling.com/
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+// Quantises random vertices and decodes them again the way vertex-shader.txt does, and
+// checks the half floats against their definition. See tests/run.sh.
+
+#include "VertexQuantizer.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace tdogl;
+
+static unsigned gFailures = 0;
+
+// counts and prints a failed check, the first few times
+static void Check(bool ok, const std::string& what) {
+    if(ok)
+        return;
+    if(gFailures < 10)
+        std::cerr << "FAILED: " << what << std::endl;
+    ++gFailures;
+}
+
+// angle between two unit vectors, in double so it isn't lost in the rounding of the cosine
+static double Angle(const glm::vec3& a, const glm::vec3& b) {
+    double cx = (double)a.y * b.z - (double)a.z * b.y;
+    double cy = (double)a.z * b.x - (double)a.x * b.z;
+    double cz = (double)a.x * b.y - (double)a.y * b.x;
+    double dot = (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z;
+    return atan2(sqrt(cx * cx + cy * cy + cz * cz), dot);
+}
+
+// uniform in [low, high]
+static float Random(float low, float high) {
+    return low + (high - low) * (rand() / (float)RAND_MAX);
+}
+
+static bool IsNan(unsigned short half) {
+    return (half & 0x7c00) == 0x7c00 && (half & 0x3ff) != 0;
+}
+
+// every half survives the trip through float and back
+static void CheckHalfRoundTrip() {
+    for(unsigned h = 0; h < 0x10000; ++h){
+        unsigned short half = (unsigned short)h;
+        unsigned short back = VertexQuantizer::floatToHalf(VertexQuantizer::halfToFloat(half));
+        if(IsNan(half))
+            Check(IsNan(back), "NaN half stays NaN");
+        else
+            Check(back == half, "half " + std::to_string(h) + " round trips");
+    }
+}
+
+// floats in the range of halves go to the nearest half, ties to the even one
+static void CheckHalfRounding() {
+    for(unsigned long long b = 0; b < 0x100000000ULL; b += 97){
+        unsigned bits = (unsigned)b;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        if(!(fabsf(value) < 65504.0f))
+            continue;
+
+        unsigned short half = VertexQuantizer::floatToHalf(value);
+        double error = fabs((double)value - VertexQuantizer::halfToFloat(half));
+        //the neighbours further from and closer to zero, when they are finite
+        unsigned short magnitude = half & 0x7fff, sign = half & 0x8000;
+        for(int step = -1; step <= 1; step += 2){
+            if((magnitude == 0 && step < 0) || magnitude + step >= 0x7c00)
+                continue;
+            unsigned short neighbour = (unsigned short)(sign | (magnitude + step));
+            double other = fabs((double)value - VertexQuantizer::halfToFloat(neighbour));
+            Check(error < other || (error == other && (half & 1) == 0),
+                  "float " + std::to_string(value) + " rounds to the nearest half");
+        }
+    }
+}
+
+// quantize, then decode like the shader: positions within half a step, normals within a
+// small angle, uvs within half a half float ulp
+static void CheckRoundTrip(size_t count, float extent) {
+    std::vector<glm::vec3> positions(count), normals(count);
+    std::vector<glm::vec2> uvs(count);
+    for(size_t i = 0; i < count; ++i){
+        positions[i] = glm::vec3(Random(-extent, extent), Random(-extent, extent), Random(0.0f, extent * 0.01f));
+        uvs[i] = glm::vec2(Random(-2.0f, 2.0f), Random(0.0f, 1.0f));
+        glm::vec3 n(Random(-1.0f, 1.0f), Random(-1.0f, 1.0f), Random(-1.0f, 1.0f));
+        normals[i] = glm::length(n) > 0.01f ? glm::normalize(n) : glm::vec3(0.0f, 0.0f, -1.0f);
+    }
+    //the corners and the axes, where the octahedral folds are
+    const glm::vec3 axes[] = {
+        glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0),
+        glm::vec3(0, 0, 1), glm::vec3(0, 0, -1), glm::normalize(glm::vec3(1, 1, -1)),
+        glm::normalize(glm::vec3(-1, 1, -1)), glm::normalize(glm::vec3(1, -1, 0))
+    };
+    for(size_t i = 0; i < sizeof(axes) / sizeof(axes[0]) && i < count; ++i)
+        normals[i] = axes[i];
+
+    QuantizedVertices q;
+    VertexQuantizer::quantize(positions, uvs, normals, q);
+    Check(q.vertexCount() == count, "vertex count");
+    Check(q.normals.size() == count * 2 && q.uvs.size() == count * 2, "attribute sizes");
+
+    double worstAngle = 0.0;
+    for(size_t i = 0; i < count; ++i){
+        for(int axis = 0; axis < 3; ++axis){
+            float decoded = q.positionOffset[axis] + q.positionScale[axis] * q.positions[i * 4 + axis];
+            float tolerance = 0.5f * q.positionScale[axis] + 1e-6f * extent;
+            Check(fabsf(decoded - positions[i][axis]) <= tolerance, "position within half a step");
+        }
+        Check(q.positions[i * 4 + 3] == 0, "position padding is 0");
+
+        glm::vec2 encoded(q.normals[i * 2] / 32767.0f, q.normals[i * 2 + 1] / 32767.0f);
+        glm::vec3 normal = VertexQuantizer::octahedralDecode(encoded);
+        worstAngle = std::max(worstAngle, Angle(normal, normals[i]));
+
+        for(int c = 0; c < 2; ++c){
+            float uv = VertexQuantizer::halfToFloat(q.uvs[i * 2 + c]);
+            Check(fabsf(uv - uvs[i][c]) <= fabsf(uvs[i][c]) / 2048.0f + 1e-7f, "uv within half an ulp");
+        }
+    }
+    Check(worstAngle < 1e-4, "normals within 0.0001 radians");
+    std::cout << count << " vertices: worst normal error " << worstAngle << " radians" << std::endl;
+}
+
+int main() {
+    srand(1);
+    CheckHalfRoundTrip();
+    CheckHalfRounding();
+    CheckRoundTrip(1, 1.0f);
+    CheckRoundTrip(10000, 1.0f);
+    CheckRoundTrip(10000, 500.0f);
+
+    //a flat model: the missing axis quantises to 0 and decodes to the plane
+    std::vector<glm::vec3> flat(3, glm::vec3(2.0f, 0.0f, -1.0f));
+    flat[1].x = 4.0f;
+    flat[2].y = 3.0f;
+    QuantizedVertices q;
+    VertexQuantizer::quantize(flat, std::vector<glm::vec2>(), std::vector<glm::vec3>(), q);
+    Check(q.normals.empty() && q.uvs.empty(), "missing attributes stay empty");
+    for(size_t i = 0; i < flat.size(); ++i)
+        Check(q.positionOffset.z + q.positionScale.z * q.positions[i * 4 + 2] == flat[i].z, "flat axis decodes exactly");
+
+    if(gFailures > 0){
+        std::cerr << gFailures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "VertexQuantizer ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""
+Writes the 4:2:0 JPEG fixtures of tests/JpegDecodeTest.cpp into this directory.
+
+Every JPEG in resources/ is 4:4:4, so without these the test would never decode an image
+whose chroma needs the 2x2 upsampler. This is a small baseline encoder with no
+dependencies: YCbCr with chroma averaged over 2x2 pixels, a plain DCT, and Huffman codes
+of one length per table, which are valid if not small. Run it again only to change the
+fixtures; the test just reads the files.
+"""
+
+import math
+import os
+import struct
+
+# (row, column) of each coefficient in zigzag order
+ZIGZAG = sorted(((r, c) for r in range(8) for c in range(8)),
+                key=lambda rc: (rc[0] + rc[1], rc[0] if (rc[0] + rc[1]) % 2 else -rc[0]))
+
+COSINES = [[math.cos((2 * x + 1) * u * math.pi / 16) * (math.sqrt(0.5) if u == 0 else 1.0)
+            for x in range(8)] for u in range(8)]
+
+
+def quant_table(base, step):
+    return [[min(255, base + step * (r + c)) for c in range(8)] for r in range(8)]
+
+
+LUMA_QUANT = quant_table(4, 2)
+CHROMA_QUANT = quant_table(6, 3)
+
+
+def pixel(x, y, width, height):
+    """A test image with gradients, hard edges and saturated colour."""
+    u, v = x / max(1, width - 1), y / max(1, height - 1)
+    r = 255 * u
+    g = 255 * v
+    b = 128 + 127 * math.sin(x * 0.35) * math.cos(y * 0.21)
+    if ((x // 7) + (y // 5)) % 3 == 0:
+        r, g, b = 255 - g, b, r
+    if (x - width / 2) ** 2 + (y - height / 2) ** 2 < (min(width, height) / 3) ** 2:
+        r, g, b = 250, 20, 200
+    return [max(0, min(255, int(round(c)))) for c in (r, g, b)]
+
+
+def to_ycbcr(rgb):
+    r, g, b = rgb
+    return (0.299 * r + 0.587 * g + 0.114 * b,
+            -0.168736 * r - 0.331264 * g + 0.5 * b + 128,
+            0.5 * r - 0.418688 * g - 0.081312 * b + 128)
+
+
+def fdct(block):
+    """8x8 forward DCT of level shifted samples, block[y][x] -> coefficients[v][u]."""
+    rows = [[sum(COSINES[u][x] * (block[y][x] - 128) for x in range(8)) / 2 for u in range(8)]
+            for y in range(8)]
+    return [[sum(COSINES[v][y] * rows[y][u] for y in range(8)) / 2 for u in range(8)]
+            for v in range(8)]
+
+
+def size_of(value):
+    return abs(value).bit_length()
+
+
+def value_bits(value):
+    return value if value >= 0 else value + (1 << size_of(value)) - 1
+
+
+class BitWriter:
+    def __init__(self):
+        self.data = bytearray()
+        self.bits = 0
+        self.count = 0
+
+    def write(self, value, count):
+        for i in range(count - 1, -1, -1):
+            self.bits = (self.bits << 1) | ((value >> i) & 1)
+            self.count += 1
+            if self.count == 8:
+                self.data.append(self.bits)
+                if self.bits == 0xFF:
+                    self.data.append(0)
+                self.bits = 0
+                self.count = 0
+
+    def flush(self):
+        while self.count:
+            self.write(1, 1)
+
+
+def segment(marker, payload):
+    return struct.pack('>BBH', 0xFF, marker, len(payload) + 2) + payload
+
+
+def encode(width, height):
+    padded_w, padded_h = (width + 15) // 16 * 16, (height + 15) // 16 * 16
+    planes = [[[0.0] * padded_w for _ in range(padded_h)] for _ in range(3)]
+    for y in range(padded_h):
+        for x in range(padded_w):
+            ycc = to_ycbcr(pixel(min(x, width - 1), min(y, height - 1), width, height))
+            for p in range(3):
+                planes[p][y][x] = ycc[p]
+
+    def block(plane, bx, by, subsampled):
+        if not subsampled:
+            return [[planes[plane][by + y][bx + x] for x in range(8)] for y in range(8)]
+        return [[sum(planes[plane][by + 2 * y + j][bx + 2 * x + i] for i in (0, 1) for j in (0, 1)) / 4
+                 for x in range(8)] for y in range(8)]
+
+    # (table, zigzag coefficients) of each block in MCU order: 4 luma, then Cb and Cr
+    blocks = []
+    for my in range(0, padded_h, 16):
+        for mx in range(0, padded_w, 16):
+            for by, bx in ((0, 0), (0, 8), (8, 0), (8, 8)):
+                blocks.append((0, block(0, mx + bx, my + by, False)))
+            blocks.append((1, block(1, mx, my, True)))
+            blocks.append((2, block(2, mx, my, True)))
+
+    # quantized coefficients, then the Huffman symbols and extra bits of each block
+    predictions = [0, 0, 0]
+    coded = []
+    for component, samples in blocks:
+        table = LUMA_QUANT if component == 0 else CHROMA_QUANT
+        coefficients = fdct(samples)
+        zz = [int(round(coefficients[r][c] / table[r][c])) for r, c in ZIGZAG]
+        diff = zz[0] - predictions[component]
+        predictions[component] = zz[0]
+        ac, run = [], 0
+        for value in zz[1:]:
+            if value == 0:
+                run += 1
+                continue
+            while run > 15:
+                ac.append((0xF0, 0, 0))
+                run -= 16
+            ac.append(((run << 4) | size_of(value), value_bits(value), size_of(value)))
+            run = 0
+        if run:
+            ac.append((0x00, 0, 0))
+        coded.append((component, (size_of(diff), value_bits(diff), size_of(diff)), ac))
+
+    # one code length per table, long enough for its symbols without the all ones code
+    dc_symbols, ac_symbols = [set(), set()], [set(), set()]
+    for component, dc, ac in coded:
+        t = 0 if component == 0 else 1
+        dc_symbols[t].add(dc[0])
+        ac_symbols[t].update(symbol for symbol, _, _ in ac)
+
+    def make_table(symbols, length):
+        symbols = sorted(symbols)
+        assert len(symbols) < (1 << length)
+        return symbols, length, {s: i for i, s in enumerate(symbols)}
+
+    dc_tables = [make_table(dc_symbols[t], 4) for t in range(2)]
+    ac_tables = [make_table(ac_symbols[t], 8) for t in range(2)]
+
+    writer = BitWriter()
+    for component, dc, ac in coded:
+        t = 0 if component == 0 else 1
+        _, length, codes = dc_tables[t]
+        writer.write(codes[dc[0]], length)
+        writer.write(dc[1], dc[2])
+        _, length, codes = ac_tables[t]
+        for symbol, bits, count in ac:
+            writer.write(codes[symbol], length)
+            writer.write(bits, count)
+    writer.flush()
+
+    def dht(table_class, index, table):
+        symbols, length, _ = table
+        counts = [0] * 16
+        counts[length - 1] = len(symbols)
+        return bytes([(table_class << 4) | index]) + bytes(counts) + bytes(symbols)
+
+    out = bytearray(b'\xFF\xD8')
+    out += segment(0xE0, b'JFIF\x00\x01\x01\x00\x00\x01\x00\x01\x00\x00')
+    out += segment(0xDB, bytes([0]) + bytes(LUMA_QUANT[r][c] for r, c in ZIGZAG) +
+                   bytes([1]) + bytes(CHROMA_QUANT[r][c] for r, c in ZIGZAG))
+    out += segment(0xC0, struct.pack('>BHHB', 8, height, width, 3) +
+                   bytes([1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1]))
+    out += segment(0xC4, dht(0, 0, dc_tables[0]) + dht(1, 0, ac_tables[0]) +
+                   dht(0, 1, dc_tables[1]) + dht(1, 1, ac_tables[1]))
+    out += segment(0xDA, bytes([3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0]))
+    out += writer.data
+    out += b'\xFF\xD9'
+    return bytes(out)
+
+
+if __name__ == '__main__':
+    here = os.path.dirname(os.path.abspath(__file__))
+    # odd sizes, so the last MCUs and the last upsampled pixels are partial, and one with
+    # chroma rows of whole 8 sample steps of the SSE2 upsampler
+    for name, width, height in (('gradient-420.jpg', 251, 189), ('small-420.jpg', 13, 7),
+                                ('steps-420.jpg', 64, 30)):
+        with open(os.path.join(here, name), 'wb') as f:
+            f.write(encode(width, height))
@@ -0,0 +1,79 @@
+#!/bin/sh
+# Builds and runs the checks of the tdogl modules that don't need an OpenGL context, and the
+# benchmarks that go with them. Each check is one .cpp in this directory, linked with the
+# sources listed for it below, and fails with a non-zero exit code.
+#
+#   tests/run.sh                          runs everything
+#   tests/run.sh BoundingVolumeHierarchyTest   runs only the checks named
+#
+# Needs glm like the app, but not GLFW, GLEW or a GPU. CXX and CXXFLAGS work as usual, e.g.
+#   CXXFLAGS="-O1 -g -fsanitize=address" tests/run.sh
+# also catches reads and writes past the ends of the buffers.
+
+cd "$(dirname "$0")/.." || exit 1
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--O2}
+FLAGS="$CXXFLAGS -std=c++11 -pthread -Wno-unknown-pragmas -Ithirdparty/stb_image -Isource/tdogl"
+BIN=tests/bin
+mkdir -p $BIN
+
+failed=0
+
+# true if the check named $1 wasn't asked for
+skip() {
+    [ -n "$ONLY" ] && ! echo " $ONLY " | grep -q " $1 "
+}
+
+# builds tests/$1.cpp with the other arguments, and runs it
+check() {
+    name=$1
+    shift
+    if skip $name; then
+        return
+    fi
+    echo "==== $name ===="
+    if ! $CXX $FLAGS -o $BIN/$name tests/$name.cpp "$@"; then
+        echo "$name: build failed"
+        failed=1
+    elif ! $BIN/$name; then
+        echo "$name: FAILED"
+        failed=1
+    fi
+}
+
+# like check, but builds it twice: with the SSE2 code of stb_image and tdogl left out, which
+# writes what it works out with --write, and as the app is built, which works out the same
+# and compares with --compare
+check_simd() {
+    name=$1
+    shift
+    if skip $name; then
+        return
+    fi
+    echo "==== $name ===="
+    if ! $CXX $FLAGS -DSTBI_NO_SIMD -DTDOGL_NO_SIMD -o $BIN/$name-nosimd tests/$name.cpp "$@" ||
+       ! $CXX $FLAGS -o $BIN/$name tests/$name.cpp "$@"; then
+        echo "$name: build failed"
+        failed=1
+    elif ! $BIN/$name-nosimd --write $BIN/$name.dump || ! $BIN/$name --compare $BIN/$name.dump; then
+        echo "$name: FAILED"
+        failed=1
+    fi
+}
+
+ONLY="$*"
+
+check VertexQuantizerTest source/tdogl/VertexQuantizer.cpp
+check BoundingVolumeHierarchyTest source/tdogl/BoundingVolumeHierarchy.cpp source/tdogl/Frustum.cpp
+check BitmapConvertTest source/tdogl/Bitmap.cpp source/tdogl/ThreadPool.cpp
+check BitmapRotateTest source/tdogl/Bitmap.cpp source/tdogl/ThreadPool.cpp
+check LoadObjTest source/tdogl/LoadObj.cpp
+check_simd JpegDecodeTest
+check_simd OcclusionBufferTest source/tdogl/OcclusionBuffer.cpp source/tdogl/ThreadPool.cpp
+
+if [ $failed -ne 0 ]; then
+    echo "some checks failed"
+    exit 1
+fi
+echo "all checks passed"
@@ -20,6 +20,8 @@
       - decode from memory or through FILE (define STBI_NO_STDIO to remove code)
       - decode from arbitrary I/O callbacks
       - overridable dequantizing-IDCT, YCbCr-to-RGB conversion (define STBI_SIMD)
+      - SSE2 jpeg IDCT, upsampling and YCbCr-to-RGB, used when cpuid reports SSE2
+        (define STBI_NO_SIMD to leave them out)
 
    Latest revisions:
       1.33 (2011-07-14) minor fixes suggested by Dave Moore
@@ -291,6 +293,12 @@ extern void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultiply
 // or just pass them through "as-is"
 extern void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 
+// flip the rows of 8-bit images as they load, so the first row of the result
+// is the bottom row of the image, which is where OpenGL expects it. jpegs are
+// written bottom up as they decode; other formats are flipped in place after.
+// the flag only affects loads on the calling thread.
+extern void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
+
 
 // ZLIB client - used by PNG, available for other purposes
 
@@ -384,6 +392,28 @@ typedef unsigned char validate_uint32[sizeof(uint32)==4 ? 1 : -1];
    #define stbi_lrot(x,y)  (((x) << (y)) | ((x) >> (32 - (y))))
 #endif
 
+// the jpeg decoder has SSE2 versions of its idct, 2x2 upsampling and YCbCr
+// conversion, which give exactly the same pixels as the C versions. they are
+// compiled in wherever the compiler can emit SSE2 and used only if cpuid says
+// the processor has it. with STBI_SIMD the installed functions are used instead.
+#if !defined(STBI_NO_SIMD) && !defined(STBI_SIMD)
+   #if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+   #define STBI_SSE2
+   #include <emmintrin.h>
+   #ifdef _MSC_VER
+   #include <intrin.h>  // __cpuid
+   #else
+   #include <cpuid.h>   // __get_cpuid
+   #endif
+   #endif
+#endif
+
+#ifdef _MSC_VER
+   #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
+#else
+   #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
+#endif
+
 ///////////////////////////////////////////////
 //
 //  stbi struct and start_xxx functions
@@ -531,9 +561,26 @@ static float   *ldr_to_hdr(stbi_uc *data, int x, int y, int comp);
 static stbi_uc *hdr_to_ldr(float   *data, int x, int y, int comp);
 #endif
 
-static unsigned char *stbi_load_main(stbi *s, int *x, int *y, int *comp, int req_comp)
+// per thread, so images can load flipped on one thread and not on another
+#if defined(__cplusplus) && __cplusplus >= 201103L
+   #define STBI_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+   #define STBI_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+   #define STBI_THREAD_LOCAL __thread
+#else
+   #define STBI_THREAD_LOCAL
+#endif
+
+static STBI_THREAD_LOCAL int stbi_vertically_flip_on_load = 0;
+
+void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
+{
+   stbi_vertically_flip_on_load = flag_true_if_should_flip;
+}
+
+static unsigned char *stbi_load_unflipped(stbi *s, int *x, int *y, int *comp, int req_comp)
 {
-   if (stbi_jpeg_test(s)) return stbi_jpeg_load(s,x,y,comp,req_comp);
    if (stbi_png_test(s))  return stbi_png_load(s,x,y,comp,req_comp);
    if (stbi_bmp_test(s))  return stbi_bmp_load(s,x,y,comp,req_comp);
    if (stbi_gif_test(s))  return stbi_gif_load(s,x,y,comp,req_comp);
@@ -553,6 +600,35 @@ static unsigned char *stbi_load_main(stbi *s, int *x, int *y, int *comp, int req
    return epuc("unknown image type", "Image not of any known type, or corrupt");
 }
 
+static void stbi_flip_rows(stbi_uc *data, int w, int h, int n)
+{
+   size_t stride = (size_t) w * n;
+   stbi_uc *top = data, *bottom = data + (h - 1) * stride;
+   for (; top < bottom; top += stride, bottom -= stride) {
+      size_t i;
+      for (i=0; i < stride; ++i) {
+         stbi_uc t = top[i];
+         top[i] = bottom[i];
+         bottom[i] = t;
+      }
+   }
+}
+
+static unsigned char *stbi_load_main(stbi *s, int *x, int *y, int *comp, int req_comp)
+{
+   unsigned char *result;
+   int n = 0;
+   // jpeg flips as it decodes, see load_jpeg_image
+   if (stbi_jpeg_test(s)) return stbi_jpeg_load(s,x,y,comp,req_comp);
+
+   result = stbi_load_unflipped(s,x,y,&n,req_comp);
+   if (!result) return NULL; // leave *comp alone, like the loaders do when they fail
+   if (comp) *comp = n;
+   if (stbi_vertically_flip_on_load)
+      stbi_flip_rows(result, *x, *y, req_comp ? req_comp : n);
+   return result;
+}
+
 #ifndef STBI_NO_STDIO
 unsigned char *stbi_load(char const *filename, int *x, int *y, int *comp, int req_comp)
 {
@@ -961,6 +1037,15 @@ typedef struct
    int    delta[17];   // old 'firstsymbol' - old 'firstcode'
 } huffman;
 
+#ifdef STBI_SIMD
+typedef unsigned short stbi_dequantize_t;
+#else
+typedef uint8 stbi_dequantize_t;
+#endif
+
+typedef uint8 *(*resample_row_func)(uint8 *out, uint8 *in0, uint8 *in1,
+                                    int w, int hs);
+
 typedef struct
 {
    #ifdef STBI_SIMD
@@ -998,6 +1083,11 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+
+// kernels for the slow parts of decoding, chosen by setup_jpeg
+   void (*idct_block_kernel)(uint8 *out, int out_stride, short data[64], stbi_dequantize_t *dequantize);
+   void (*YCbCr_to_RGB_kernel)(uint8 *out, const uint8 *y, const uint8 *pcb, const uint8 *pcr, int count, int step);
+   resample_row_func resample_row_hv_2_kernel;
 } jpeg;
 
 static int build_huffman(huffman *h, int *count)
@@ -1242,12 +1332,6 @@ stbi_inline static uint8 clamp(int x)
    t1 += p2+p4;                                \
    t0 += p1+p3;
 
-#ifdef STBI_SIMD
-typedef unsigned short stbi_dequantize_t;
-#else
-typedef uint8 stbi_dequantize_t;
-#endif
-
 // .344 seconds on 3*anemones.jpg
 static void idct_block(uint8 *out, int out_stride, short data[64], stbi_dequantize_t *dequantize)
 {
@@ -1310,6 +1394,181 @@ static void idct_block(uint8 *out, int out_stride, short data[64], stbi_dequanti
    }
 }
 
+#ifdef STBI_SSE2
+// the same idct as idct_block, on all 8 columns (then rows) at once in 16-bit
+// lanes. products and sums that need more than 16 bits are made in 32-bit
+// halves with pmaddwd, so every intermediate value matches the C version. the
+// two passes only part ways when a coefficient or the first pass overflows 16
+// bits, which a valid baseline jpeg can't do.
+
+// 16-bit coefficient pairs for pmaddwd: lane 2i gets a, lane 2i+1 gets b
+#define dct_const(a,b)  _mm_setr_epi16((short) (a),(short) (b),(short) (a),(short) (b),(short) (a),(short) (b),(short) (a),(short) (b))
+
+// out0 = x*c0[0] + y*c0[1], out1 = x*c1[0] + y*c1[1], in 32-bit halves _l and _h
+#define dct_rot(out0,out1, x,y,c0,c1) \
+   __m128i out0##_xy_l = _mm_unpacklo_epi16((x),(y)); \
+   __m128i out0##_xy_h = _mm_unpackhi_epi16((x),(y)); \
+   __m128i out0##_l = _mm_madd_epi16(out0##_xy_l, c0); \
+   __m128i out0##_h = _mm_madd_epi16(out0##_xy_h, c0); \
+   __m128i out1##_l = _mm_madd_epi16(out0##_xy_l, c1); \
+   __m128i out1##_h = _mm_madd_epi16(out0##_xy_h, c1)
+
+// out = in << 12, widened to 32 bits
+#define dct_widen(out, in) \
+   __m128i out##_l = _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), (in)), 4); \
+   __m128i out##_h = _mm_srai_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), (in)), 4)
+
+#define dct_wadd(out, a, b) \
+   __m128i out##_l = _mm_add_epi32(a##_l, b##_l); \
+   __m128i out##_h = _mm_add_epi32(a##_h, b##_h)
+
+#define dct_wsub(out, a, b) \
+   __m128i out##_l = _mm_sub_epi32(a##_l, b##_l); \
+   __m128i out##_h = _mm_sub_epi32(a##_h, b##_h)
+
+// out0 = (a+bias+b) >> s, out1 = (a+bias-b) >> s, narrowed back to 16 bits
+#define dct_bfly32o(out0, out1, a,b,bias,s) \
+   { \
+      __m128i abiased_l = _mm_add_epi32(a##_l, bias); \
+      __m128i abiased_h = _mm_add_epi32(a##_h, bias); \
+      dct_wadd(sum, abiased, b); \
+      dct_wsub(dif, abiased, b); \
+      out0 = _mm_packs_epi32(_mm_srai_epi32(sum_l, s), _mm_srai_epi32(sum_h, s)); \
+      out1 = _mm_packs_epi32(_mm_srai_epi32(dif_l, s), _mm_srai_epi32(dif_h, s)); \
+   }
+
+// IDCT_1D down row0..row7, written back to row0..row7; the rotations are
+// IDCT_1D's multiplies folded into pairs, e.g. t2 = s2*f2f(0.54) + s6*(f2f(0.54)+f2f(-1.85))
+#define dct_pass(bias,shift) \
+   { \
+      /* even part */ \
+      dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+      __m128i sum04 = _mm_add_epi16(row0, row4); \
+      __m128i dif04 = _mm_sub_epi16(row0, row4); \
+      dct_widen(t0e, sum04); \
+      dct_widen(t1e, dif04); \
+      dct_wadd(x0, t0e, t3e); \
+      dct_wsub(x3, t0e, t3e); \
+      dct_wadd(x1, t1e, t2e); \
+      dct_wsub(x2, t1e, t2e); \
+      /* odd part */ \
+      dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+      dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+      __m128i sum17 = _mm_add_epi16(row1, row7); \
+      __m128i sum35 = _mm_add_epi16(row3, row5); \
+      dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+      dct_wadd(x4, y0o, y4o); \
+      dct_wadd(x5, y1o, y5o); \
+      dct_wadd(x6, y2o, y5o); \
+      dct_wadd(x7, y3o, y4o); \
+      dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+      dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+      dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+      dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+   }
+
+// one step of an 8x8 transpose
+#define dct_interleave8(a, b) \
+   tmp = a; \
+   a = _mm_unpacklo_epi8(a, b); \
+   b = _mm_unpackhi_epi8(tmp, b)
+
+#define dct_interleave16(a, b) \
+   tmp = a; \
+   a = _mm_unpacklo_epi16(a, b); \
+   b = _mm_unpackhi_epi16(tmp, b)
+
+static void idct_block_sse2(uint8 *out, int out_stride, short data[64], stbi_dequantize_t *dequantize)
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   __m128i rot0_0 = dct_const(f2f(0.5411961f), f2f(0.5411961f) + f2f(-1.847759065f));
+   __m128i rot0_1 = dct_const(f2f(0.5411961f) + f2f( 0.765366865f), f2f(0.5411961f));
+   __m128i rot1_0 = dct_const(f2f(1.175875602f) + f2f(-0.899976223f), f2f(1.175875602f));
+   __m128i rot1_1 = dct_const(f2f(1.175875602f), f2f(1.175875602f) + f2f(-2.562915447f));
+   __m128i rot2_0 = dct_const(f2f(-1.961570560f) + f2f( 0.298631336f), f2f(-1.961570560f));
+   __m128i rot2_1 = dct_const(f2f(-1.961570560f), f2f(-1.961570560f) + f2f( 3.072711026f));
+   __m128i rot3_0 = dct_const(f2f(-0.390180644f) + f2f( 2.053119869f), f2f(-0.390180644f));
+   __m128i rot3_1 = dct_const(f2f(-0.390180644f), f2f(-0.390180644f) + f2f( 1.501321110f));
+
+   // rounding for the two passes, see idct_block
+   __m128i bias_0 = _mm_set1_epi32(512);
+   __m128i bias_1 = _mm_set1_epi32(65536 + (128<<17));
+
+   // dequantize; the quantizer table is bytes, so widen it to 16 bits
+   {
+      __m128i zero = _mm_setzero_si128();
+      __m128i *d = (__m128i *) data;
+      #define dct_load(row, i) \
+         row = _mm_mullo_epi16(_mm_loadu_si128(d + i), \
+                               _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (dequantize + i*8)), zero))
+      dct_load(row0, 0); dct_load(row1, 1); dct_load(row2, 2); dct_load(row3, 3);
+      dct_load(row4, 4); dct_load(row5, 5); dct_load(row6, 6); dct_load(row7, 7);
+      #undef dct_load
+   }
+
+   // columns
+   dct_pass(bias_0, 10);
+
+   // transpose, so the rows are in lanes
+   dct_interleave16(row0, row4);
+   dct_interleave16(row1, row5);
+   dct_interleave16(row2, row6);
+   dct_interleave16(row3, row7);
+
+   dct_interleave16(row0, row2);
+   dct_interleave16(row1, row3);
+   dct_interleave16(row4, row6);
+   dct_interleave16(row5, row7);
+
+   dct_interleave16(row0, row1);
+   dct_interleave16(row2, row3);
+   dct_interleave16(row4, row5);
+   dct_interleave16(row6, row7);
+
+   // rows
+   dct_pass(bias_1, 17);
+
+   {
+      // clamp to 0..255: p0 = column 0 then column 1 of the block, and so on
+      __m128i p0 = _mm_packus_epi16(row0, row1);
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      // transpose back to rows
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+}
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_pass
+#undef dct_interleave8
+#undef dct_interleave16
+#endif // STBI_SSE2
+
 #ifdef STBI_SIMD
 static stbi_idct_8x8 stbi_idct_installed = idct_block;
 
@@ -1357,10 +1616,7 @@ static int parse_entropy_coded_data(jpeg *z)
    reset(z);
    if (z->scan_n == 1) {
       int i,j;
-      #ifdef STBI_SIMD
-      __declspec(align(16))
-      #endif
-      short data[64];
+      STBI_SIMD_ALIGN(short, data[64]);
       int n = z->order[0];
       // non-interleaved data, we just need to process one block at a time,
       // in trivial scanline order
@@ -1372,9 +1628,9 @@ static int parse_entropy_coded_data(jpeg *z)
          for (i=0; i < w; ++i) {
             if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, n)) return 0;
             #ifdef STBI_SIMD
-            stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
+            z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
             #else
-            idct_block(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
+            z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
             #endif
             // every data block is an MCU, so countdown the restart interval
             if (--z->todo <= 0) {
@@ -1388,7 +1644,7 @@ static int parse_entropy_coded_data(jpeg *z)
       }
    } else { // interleaved!
       int i,j,k,x,y;
-      short data[64];
+      STBI_SIMD_ALIGN(short, data[64]);
       for (j=0; j < z->img_mcu_y; ++j) {
          for (i=0; i < z->img_mcu_x; ++i) {
             // scan an interleaved mcu... process scan_n components in order
@@ -1402,9 +1658,9 @@ static int parse_entropy_coded_data(jpeg *z)
                      int y2 = (j*z->img_comp[n].v + y)*8;
                      if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, n)) return 0;
                      #ifdef STBI_SIMD
-                     stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
+                     z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
                      #else
-                     idct_block(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
+                     z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
                      #endif
                   }
                }
@@ -1651,9 +1907,6 @@ static int decode_jpeg_image(jpeg *j)
 
 // static jfif-centered resampling (across block boundaries)
 
-typedef uint8 *(*resample_row_func)(uint8 *out, uint8 *in0, uint8 *in1,
-                                    int w, int hs);
-
 #define div4(x) ((uint8) ((x) >> 2))
 
 static uint8 *resample_row_1(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
@@ -1729,6 +1982,62 @@ static uint8 *resample_row_hv_2(uint8 *out, uint8 *in_near, uint8 *in_far, int w
    return out;
 }
 
+#ifdef STBI_SSE2
+// resample_row_hv_2 on 8 input samples at a time
+static uint8 *resample_row_hv_2_sse2(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+   __m128i zero = _mm_setzero_si128();
+   __m128i bias = _mm_set1_epi16(8);
+
+   if (w == 1) {
+      out[0] = out[1] = div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   // the last sample has no right neighbour, so it is left to the C loop. the
+   // first one has no left neighbour; with t1 as its own neighbour the sum
+   // comes out as div4(t1+2), just like the C version
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~7); i += 8) {
+      // vertical pass: 3*near + far
+      __m128i nearw = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (in_near + i)), zero);
+      __m128i farw  = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (in_far + i)), zero);
+      __m128i curr  = _mm_add_epi16(_mm_add_epi16(nearw, _mm_slli_epi16(nearw, 1)), farw);
+
+      // the neighbours of each sample: shifted by one lane, with the sample
+      // before this group and the one after it put in the ends
+      __m128i prev  = _mm_insert_epi16(_mm_slli_si128(curr, 2), t1, 0);
+      __m128i next  = _mm_insert_epi16(_mm_srli_si128(curr, 2), 3*in_near[i+8] + in_far[i+8], 7);
+
+      // even outputs 3*curr + prev, odd ones 3*curr + next
+      __m128i curr3 = _mm_add_epi16(_mm_add_epi16(curr, _mm_slli_epi16(curr, 1)), bias);
+      __m128i even  = _mm_add_epi16(curr3, prev);
+      __m128i odd   = _mm_add_epi16(curr3, next);
+      __m128i lo    = _mm_srli_epi16(_mm_unpacklo_epi16(even, odd), 4);
+      __m128i hi    = _mm_srli_epi16(_mm_unpackhi_epi16(even, odd), 4);
+      _mm_storeu_si128((__m128i *) (out + i*2), _mm_packus_epi16(lo, hi));
+
+      t1 = 3*in_near[i+7] + in_far[i+7];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = div16(3*t1 + t0 + 8);
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = div16(3*t0 + t1 + 8);
+      out[i*2  ] = div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif // STBI_SSE2
+
 static uint8 *resample_row_generic(uint8 *out, uint8 *in_near, uint8 * /*in_far*/, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -1763,11 +2072,81 @@ static void YCbCr_to_RGB_row(uint8 *out, const uint8 *y, const uint8 *pcb, const
       out[0] = (uint8)r;
       out[1] = (uint8)g;
       out[2] = (uint8)b;
-      out[3] = 255;
+      // rgb must not touch the byte past the pixel: with flipped loads that is
+      // the first byte of the row decoded before this one
+      if (step == 4) out[3] = 255;
       out += step;
    }
 }
 
+#ifdef STBI_SSE2
+// YCbCr_to_RGB_row on 8 pixels at a time. the multipliers don't fit in 16
+// bits, so each is split into a multiple of 65536, which goes onto y after the
+// shift, and a 16-bit remainder for pmaddwd. e.g. r = y + cr + ((cr*(1.402-1)*65536 + 32768) >> 16)
+static void YCbCr_to_RGB_row_sse2(uint8 *out, const uint8 *y, const uint8 *pcb, const uint8 *pcr, int count, int step)
+{
+   int i=0;
+   __m128i zero  = _mm_setzero_si128();
+   __m128i signflip = _mm_set1_epi16(128);
+   __m128i alpha = _mm_set1_epi8((char) 255);
+   // pairs for pmaddwd: (cr, 2) for r, (cr, cb) for g, (cb, 2) for b;
+   // the 2 * 16384 is the rounding
+   __m128i cr_r  = _mm_setr_epi16(float2fixed(1.40200f) - 65536, 16384, float2fixed(1.40200f) - 65536, 16384,
+                                  float2fixed(1.40200f) - 65536, 16384, float2fixed(1.40200f) - 65536, 16384);
+   __m128i crcb_g = _mm_setr_epi16(65536 - float2fixed(0.71414f), -float2fixed(0.34414f), 65536 - float2fixed(0.71414f), -float2fixed(0.34414f),
+                                   65536 - float2fixed(0.71414f), -float2fixed(0.34414f), 65536 - float2fixed(0.71414f), -float2fixed(0.34414f));
+   __m128i cb_b  = _mm_setr_epi16(float2fixed(1.77200f) - 2*65536, 16384, float2fixed(1.77200f) - 2*65536, 16384,
+                                  float2fixed(1.77200f) - 2*65536, 16384, float2fixed(1.77200f) - 2*65536, 16384);
+   __m128i round = _mm_set1_epi32(32768);
+   __m128i two   = _mm_set1_epi16(2);
+   STBI_SIMD_ALIGN(uint32, rgba[8]);
+
+   // with 3 bytes per pixel, each pixel is written as 4 bytes and the next one
+   // covers the extra byte, so the last pixel of the row is left to the C loop
+   for (; i + 8 + (step == 3) <= count; i += 8) {
+      __m128i yw  = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (y + i)), zero);
+      __m128i cbw = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (pcb + i)), zero), signflip);
+      __m128i crw = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (pcr + i)), zero), signflip);
+
+      // the 16-bit parts: y + cr, y - cr and y + 2*cb
+      __m128i r16 = _mm_add_epi16(yw, crw);
+      __m128i g16 = _mm_sub_epi16(yw, crw);
+      __m128i b16 = _mm_add_epi16(yw, _mm_add_epi16(cbw, cbw));
+
+      // the fractions, shifted down
+      __m128i r_l = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(crw, two), cr_r), 16);
+      __m128i r_h = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(crw, two), cr_r), 16);
+      __m128i g_l = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(crw, cbw), crcb_g), round), 16);
+      __m128i g_h = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(crw, cbw), crcb_g), round), 16);
+      __m128i b_l = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(cbw, two), cb_b), 16);
+      __m128i b_h = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(cbw, two), cb_b), 16);
+
+      // add them up (they all fit in 16 bits) and clamp to 0..255
+      __m128i r = _mm_add_epi16(r16, _mm_packs_epi32(r_l, r_h));
+      __m128i g = _mm_add_epi16(g16, _mm_packs_epi32(g_l, g_h));
+      __m128i b = _mm_add_epi16(b16, _mm_packs_epi32(b_l, b_h));
+      __m128i rg8 = _mm_packus_epi16(r, g);  // r0..r7 g0..g7
+      __m128i rg = _mm_unpacklo_epi8(rg8, _mm_srli_si128(rg8, 8));  // r0 g0 r1 g1 ..
+      __m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), alpha);  // b0 255 b1 255 ..
+      __m128i rgba_l = _mm_unpacklo_epi16(rg, ba);
+      __m128i rgba_h = _mm_unpackhi_epi16(rg, ba);
+
+      if (step == 4) {
+         _mm_storeu_si128((__m128i *) (out + i*4), rgba_l);
+         _mm_storeu_si128((__m128i *) (out + i*4 + 16), rgba_h);
+      } else {
+         int k;
+         _mm_store_si128((__m128i *) rgba, rgba_l);
+         _mm_store_si128((__m128i *) (rgba + 4), rgba_h);
+         for (k=0; k < 8; ++k)
+            memcpy(out + (i+k)*3, rgba + k, 4);
+      }
+   }
+
+   YCbCr_to_RGB_row(out + i*step, y + i, pcb + i, pcr + i, count - i, step);
+}
+#endif // STBI_SSE2
+
 #ifdef STBI_SIMD
 static stbi_YCbCr_to_RGB_run stbi_YCbCr_installed = YCbCr_to_RGB_row;
 
@@ -1777,6 +2156,42 @@ void stbi_install_YCbCr_to_RGB(stbi_YCbCr_to_RGB_run func)
 }
 #endif
 
+#ifdef STBI_SSE2
+static int stbi_sse2_available(void)
+{
+   #ifdef _MSC_VER
+   int info[4];
+   __cpuid(info, 1);
+   return (info[3] >> 26) & 1;
+   #else
+   unsigned int eax, ebx, ecx, edx;
+   if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+   return (edx >> 26) & 1;
+   #endif
+}
+#endif
+
+// pick the fastest kernels this processor runs
+static void setup_jpeg(jpeg *j)
+{
+   #ifdef STBI_SIMD
+   j->idct_block_kernel = stbi_idct_installed;
+   j->YCbCr_to_RGB_kernel = stbi_YCbCr_installed;
+   #else
+   j->idct_block_kernel = idct_block;
+   j->YCbCr_to_RGB_kernel = YCbCr_to_RGB_row;
+   #endif
+   j->resample_row_hv_2_kernel = resample_row_hv_2;
+
+   #ifdef STBI_SSE2
+   if (stbi_sse2_available()) {
+      j->idct_block_kernel = idct_block_sse2;
+      j->YCbCr_to_RGB_kernel = YCbCr_to_RGB_row_sse2;
+      j->resample_row_hv_2_kernel = resample_row_hv_2_sse2;
+   }
+   #endif
+}
+
 
 // clean up the temporary component buffers
 static void cleanup_jpeg(jpeg *j)
@@ -1810,6 +2225,7 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
    // validate req_comp
    if (req_comp < 0 || req_comp > 4) return epuc("bad req_comp", "Internal error");
    z->s->img_n = 0;
+   setup_jpeg(z);
 
    // load a jpeg image from whichever source
    if (!decode_jpeg_image(z)) { cleanup_jpeg(z); return NULL; }
@@ -1849,7 +2265,7 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
          if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
          else if (r->hs == 1 && r->vs == 2) r->resample = resample_row_v_2;
          else if (r->hs == 2 && r->vs == 1) r->resample = resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = resample_row_hv_2;
+         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
          else                               r->resample = resample_row_generic;
       }
 
@@ -1859,7 +2275,9 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
 
       // now go ahead and resample
       for (j=0; j < z->s->img_y; ++j) {
-         uint8 *out = output + n * z->s->img_x * j;
+         // rows go straight to where they end up, so flipping costs nothing
+         uint32 row = stbi_vertically_flip_on_load ? z->s->img_y - 1 - j : j;
+         uint8 *out = output + n * z->s->img_x * row;
          for (k=0; k < decode_n; ++k) {
             stbi_resample *r = &res_comp[k];
             int y_bot = r->ystep >= (r->vs >> 1);
@@ -1877,15 +2295,11 @@ static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int re
          if (n >= 3) {
             uint8 *y = coutput[0];
             if (z->s->img_n == 3) {
-               #ifdef STBI_SIMD
-               stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->s.img_x, n);
-               #else
-               YCbCr_to_RGB_row(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               #endif
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
             } else
                for (i=0; i < z->s->img_x; ++i) {
                   out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
+                  if (n == 4) out[3] = 255;
                   out += n;
                }
          } else {